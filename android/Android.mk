@@ -69,6 +69,8 @@ LOCAL_SRC_FILES := \
 	bluez/src/shared/gatt-db.c \
 	bluez/src/shared/io-glib.c \
 	bluez/src/shared/timeout-glib.c \
+	bluez/src/shared/timer-wheel.c \
+	bluez/src/shared/aes.c \
 	bluez/src/shared/crypto.c \
 	bluez/src/shared/uhid.c \
 	bluez/src/shared/att.c \
@@ -229,6 +231,9 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
 	bluez/src/shared/log.c \
+	bluez/src/shared/util.c \
+	bluez/src/shared/timeout-glib.c \
+	bluez/src/shared/timer-wheel.c \
 	bluez/src/log.c \
 	bluez/btio/btio.c \
 	bluez/lib/bluetooth.c \
@@ -359,9 +364,11 @@ LOCAL_SRC_FILES := \
 	bluez/monitor/broadcom.c \
 	bluez/src/shared/util.c \
 	bluez/src/shared/queue.c \
+	bluez/src/shared/aes.c \
 	bluez/src/shared/crypto.c \
 	bluez/src/shared/btsnoop.c \
 	bluez/src/shared/mainloop.c \
+	bluez/src/shared/timer-wheel.c \
 	bluez/lib/hci.c \
 	bluez/lib/bluetooth.c \
 
@@ -390,6 +397,7 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES := \
 	bluez/tools/btproxy.c \
 	bluez/src/shared/mainloop.c \
+	bluez/src/shared/timer-wheel.c \
 	bluez/src/shared/util.c \
 	bluez/src/shared/ecc.c \
 
@@ -508,6 +516,8 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES := \
 	bluez/android/bluetoothd-snoop.c \
 	bluez/src/shared/mainloop.c \
+	bluez/src/shared/timer-wheel.c \
+	bluez/src/shared/util.c \
 	bluez/src/shared/btsnoop.c \
 	bluez/android/log.c \
 
@@ -550,6 +560,7 @@ LOCAL_SRC_FILES := \
 	bluez/lib/hci.c \
 	bluez/lib/sdp.c \
 	bluez/src/shared/mainloop.c \
+	bluez/src/shared/timer-wheel.c \
 	bluez/src/shared/io-mainloop.c \
 	bluez/src/shared/mgmt.c \
 	bluez/src/shared/queue.c \
@@ -28,10 +28,12 @@
 #include "src/log.h"
 
 #define DEFAULT_SNOOP_FILE "/sdcard/btsnoop_hci.log"
+#define FLUSH_INTERVAL 1000
 
 static struct btsnoop *snoop = NULL;
 static uint8_t monitor_buf[BTSNOOP_MAX_PACKET_SIZE];
 static int monitor_fd = -1;
+static int flush_id = -1;
 
 static void signal_callback(int signum, void *user_data)
 {
@@ -130,15 +132,28 @@ static void data_callback(int fd, uint32_t events, void *user_data)
 	}
 }
 
+static void flush_callback(int id, void *user_data)
+{
+	btsnoop_flush(snoop);
+
+	mainloop_modify_timeout(id, FLUSH_INTERVAL);
+}
+
 static int open_monitor(const char *path)
 {
 	struct sockaddr_hci addr;
 	int opt = 1;
 
-	snoop = btsnoop_create(path, 0, 0, BTSNOOP_FORMAT_HCI);
+	snoop = btsnoop_create(path, 0, 0, BTSNOOP_FORMAT_HCI,
+							BTSNOOP_FLAG_BUFFERED);
 	if (!snoop)
 		return -1;
 
+	flush_id = mainloop_add_timeout(FLUSH_INTERVAL, flush_callback, NULL,
+									NULL);
+	if (flush_id < 0)
+		goto failed;
+
 	monitor_fd = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC, BTPROTO_HCI);
 	if (monitor_fd < 0)
 		goto failed;
@@ -164,6 +179,11 @@ failed_close:
 	monitor_fd = -1;
 
 failed:
+	if (flush_id >= 0) {
+		mainloop_remove_timeout(flush_id);
+		flush_id = -1;
+	}
+
 	btsnoop_unref(snoop);
 	snoop = NULL;
 
@@ -172,6 +192,9 @@ failed:
 
 static void close_monitor(void)
 {
+	mainloop_remove_timeout(flush_id);
+	flush_id = -1;
+
 	btsnoop_unref(snoop);
 	snoop = NULL;
 
@@ -206,6 +206,8 @@ struct btdev {
 	uint8_t  le_scan_filter_policy;
 	uint8_t  le_filter_dup;
 	uint8_t  le_adv_enable;
+	unsigned int le_adv_interval;
+	unsigned int le_adv_timeout_id;
 	uint8_t  le_pa_enable;
 	uint16_t le_pa_properties;
 	uint16_t le_pa_min_interval;
@@ -240,6 +242,9 @@ struct btdev {
 
 	struct queue *le_ext_adv;
 
+	/* Next device in the same bucket of the address hash */
+	struct btdev *hash_next;
+
 	btdev_debug_func_t debug_callback;
 	btdev_destroy_func_t debug_destroy;
 	void *debug_data;
@@ -255,13 +260,26 @@ struct inquiry_data {
 
 #define DEFAULT_INQUIRY_INTERVAL 100 /* 100 miliseconds */
 
-#define MAX_BTDEV_ENTRIES 16
+/*
+ * Devices are kept in a table that grows as needed, the slot of a device
+ * becomes part of its address so the limit is what fits in bdaddr[2..3].
+ */
+#define MAX_BTDEV_ENTRIES 0xff00
+#define BTDEV_HASH_SIZE 256
 
 static const uint8_t LINK_KEY_NONE[16] = { 0 };
 static const uint8_t LINK_KEY_DUMMY[16] = {	0, 1, 2, 3, 4, 5, 6, 7,
 						8, 9, 0, 1, 2, 3, 4, 5 };
 
-static struct btdev *btdev_list[MAX_BTDEV_ENTRIES] = { };
+static struct btdev **btdev_list;
+static int btdev_list_size;
+static int btdev_count;
+
+/* Devices by public address, lookups are done for every remote operation */
+static struct btdev *btdev_hash[BTDEV_HASH_SIZE];
+
+/* Devices with LE scanning enabled, advertising is only reported to these */
+static struct queue *le_scanners;
 
 static int get_hook_index(struct btdev *btdev, enum btdev_hook_type type,
 								uint16_t opcode)
@@ -291,41 +309,104 @@ static bool run_hooks(struct btdev *btdev, enum btdev_hook_type type,
 					btdev->hook_list[index]->user_data);
 }
 
-static inline int add_btdev(struct btdev *btdev)
+static unsigned int bdaddr_hash(const uint8_t *bdaddr)
 {
-	int i, index = -1;
+	unsigned int hash = 0;
+	int i;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (btdev_list[i] == NULL) {
-			index = i;
-			btdev_list[index] = btdev;
+	for (i = 0; i < 6; i++)
+		hash = hash * 31 + bdaddr[i];
+
+	return hash % BTDEV_HASH_SIZE;
+}
+
+static void hash_add_btdev(struct btdev *btdev)
+{
+	unsigned int hash = bdaddr_hash(btdev->bdaddr);
+
+	btdev->hash_next = btdev_hash[hash];
+	btdev_hash[hash] = btdev;
+}
+
+static void hash_del_btdev(struct btdev *btdev)
+{
+	struct btdev **curr;
+
+	for (curr = &btdev_hash[bdaddr_hash(btdev->bdaddr)]; *curr;
+						curr = &(*curr)->hash_next) {
+		if (*curr == btdev) {
+			*curr = btdev->hash_next;
+			btdev->hash_next = NULL;
 			break;
 		}
 	}
+}
 
-	return index;
+static inline int add_btdev(struct btdev *btdev)
+{
+	struct btdev **list;
+	int i, size;
+
+	if (btdev_count < btdev_list_size) {
+		for (i = 0; i < btdev_list_size; i++) {
+			if (btdev_list[i] == NULL)
+				goto done;
+		}
+	}
+
+	if (btdev_list_size == MAX_BTDEV_ENTRIES)
+		return -1;
+
+	size = btdev_list_size ? btdev_list_size * 2 : 16;
+	if (size > MAX_BTDEV_ENTRIES)
+		size = MAX_BTDEV_ENTRIES;
+
+	list = realloc(btdev_list, size * sizeof(*list));
+	if (!list)
+		return -1;
+
+	memset(list + btdev_list_size, 0,
+				(size - btdev_list_size) * sizeof(*list));
+
+	i = btdev_list_size;
+	btdev_list = list;
+	btdev_list_size = size;
+
+done:
+	btdev_list[i] = btdev;
+	btdev_count++;
+
+	return i;
 }
 
 static inline int del_btdev(struct btdev *btdev)
 {
-	int i, index = -1;
+	int i;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
+	for (i = 0; i < btdev_list_size; i++) {
 		if (btdev_list[i] == btdev) {
-			index = i;
-			btdev_list[index] = NULL;
+			btdev_list[i] = NULL;
 			break;
 		}
 	}
 
-	return index;
+	if (i == btdev_list_size)
+		return -1;
+
+	if (!--btdev_count) {
+		free(btdev_list);
+		btdev_list = NULL;
+		btdev_list_size = 0;
+	}
+
+	return i;
 }
 
 static inline bool valid_btdev(struct btdev *btdev)
 {
 	int i;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
+	for (i = 0; i < btdev_list_size; i++) {
 		if (btdev_list[i] == btdev)
 			return true;
 	}
@@ -335,11 +416,12 @@ static inline bool valid_btdev(struct btdev *btdev)
 
 static inline struct btdev *find_btdev_by_bdaddr(const uint8_t *bdaddr)
 {
-	int i;
+	struct btdev *btdev;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (btdev_list[i] && !memcmp(btdev_list[i]->bdaddr, bdaddr, 6))
-			return btdev_list[i];
+	for (btdev = btdev_hash[bdaddr_hash(bdaddr)]; btdev;
+						btdev = btdev->hash_next) {
+		if (!memcmp(btdev->bdaddr, bdaddr, 6))
+			return btdev;
 	}
 
 	return NULL;
@@ -358,40 +440,54 @@ static inline struct btdev *find_btdev_by_bdaddr_type(const uint8_t *bdaddr,
 {
 	int i;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
+	if (bdaddr_type != 0x01)
+		return find_btdev_by_bdaddr(bdaddr);
+
+	/* Random addresses change too often to be worth hashing */
+	for (i = 0; i < btdev_list_size; i++) {
 		struct btdev *dev = btdev_list[i];
-		int cmp;
 		struct le_ext_adv *adv;
 
 		if (!dev)
 			continue;
 
-		if (bdaddr_type == 0x01)
-			cmp = memcmp(dev->random_addr, bdaddr, 6);
-		else
-			cmp = memcmp(dev->bdaddr, bdaddr, 6);
-
-		if (!cmp)
+		if (!memcmp(dev->random_addr, bdaddr, 6))
 			return dev;
 
 		/* Check for instance own Random addresses */
-		if (bdaddr_type == 0x01) {
-			adv = queue_find(dev->le_ext_adv, match_adv_addr,
-								bdaddr);
-			if (adv)
-				return dev;
-		}
+		adv = queue_find(dev->le_ext_adv, match_adv_addr, bdaddr);
+		if (adv)
+			return dev;
 	}
 
 	return NULL;
 }
 
-static void get_bdaddr(uint16_t id, uint8_t index, uint8_t *bdaddr)
+static void set_le_scan_enable(struct btdev *btdev, uint8_t enable)
+{
+	if (enable && !btdev->le_scan_enable) {
+		if (!le_scanners)
+			le_scanners = queue_new();
+
+		queue_push_tail(le_scanners, btdev);
+	} else if (!enable && btdev->le_scan_enable) {
+		queue_remove(le_scanners, btdev);
+
+		if (queue_isempty(le_scanners)) {
+			queue_destroy(le_scanners, NULL);
+			le_scanners = NULL;
+		}
+	}
+
+	btdev->le_scan_enable = enable;
+}
+
+static void get_bdaddr(uint16_t id, uint16_t index, uint8_t *bdaddr)
 {
 	bdaddr[0] = id & 0xff;
 	bdaddr[1] = id >> 8;
-	bdaddr[2] = index;
-	bdaddr[3] = 0x01;
+	bdaddr[2] = index & 0xff;
+	bdaddr[3] = 0x01 + (index >> 8);
 	bdaddr[4] = 0xaa;
 	bdaddr[5] = 0x00;
 }
@@ -575,7 +671,7 @@ static void btdev_reset(struct btdev *btdev)
 	 * cleared upon HCI_Reset
 	 */
 
-	btdev->le_scan_enable		= 0x00;
+	set_le_scan_enable(btdev, 0x00);
 	btdev->le_adv_enable		= 0x00;
 	btdev->le_pa_enable		= 0x00;
 	btdev->le_pa_sync_handle	= 0x0000;
@@ -908,10 +1004,10 @@ static bool inquiry_callback(void *user_data)
 	int i;
 
 	/*Report devices only once and wait for inquiry timeout*/
-	if (data->iter == MAX_BTDEV_ENTRIES)
+	if (data->iter >= btdev_list_size)
 		return true;
 
-	for (i = data->iter; i < MAX_BTDEV_ENTRIES; i++) {
+	for (i = data->iter; i < btdev_list_size; i++) {
 		/*Lets sent 10 inquiry results at once */
 		if (sent + 10 == data->sent_count)
 			break;
@@ -3523,32 +3619,43 @@ static bool adv_match(struct btdev *scan, struct btdev *adv)
 	return !memcmp(scan_addr(scan), adv->le_adv_direct_addr, 6);
 }
 
-static void le_set_adv_enable_complete(struct btdev *btdev)
+static void send_adv_report(void *data, void *user_data)
 {
+	struct btdev *scan = data;
+	struct btdev *btdev = user_data;
 	uint8_t report_type;
-	int i;
 
-	report_type = get_adv_report_type(btdev->le_adv_type);
+	if (scan == btdev || !adv_match(scan, btdev))
+		return;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (!btdev_list[i] || btdev_list[i] == btdev)
-			continue;
+	report_type = get_adv_report_type(btdev->le_adv_type);
+	le_send_adv_report(scan, btdev, report_type);
 
-		if (!btdev_list[i]->le_scan_enable)
-			continue;
+	if (scan->le_scan_type != 0x01)
+		return;
 
-		if (!adv_match(btdev_list[i], btdev))
-			continue;
+	/* ADV_IND & ADV_SCAN_IND generate a scan response */
+	if (btdev->le_adv_type == 0x00 || btdev->le_adv_type == 0x02)
+		le_send_adv_report(scan, btdev, 0x04);
+}
 
-		le_send_adv_report(btdev_list[i], btdev, report_type);
+static void le_set_adv_enable_complete(struct btdev *btdev)
+{
+	queue_foreach(le_scanners, send_adv_report, btdev);
+}
 
-		if (btdev_list[i]->le_scan_type != 0x01)
-			continue;
+static bool adv_interval_timeout(void *user_data)
+{
+	struct btdev *btdev = user_data;
 
-		/* ADV_IND & ADV_SCAN_IND generate a scan response */
-		if (btdev->le_adv_type == 0x00 || btdev->le_adv_type == 0x02)
-			le_send_adv_report(btdev_list[i], btdev, 0x04);
+	if (!btdev->le_adv_enable) {
+		btdev->le_adv_timeout_id = 0;
+		return false;
 	}
+
+	le_set_adv_enable_complete(btdev);
+
+	return true;
 }
 
 #define RL_ADDR_EQUAL(_rl, _type, _addr) \
@@ -3617,8 +3724,16 @@ done:
 	cmd_complete(dev, BT_HCI_CMD_LE_SET_ADV_ENABLE, &status,
 						sizeof(status));
 
-	if (!status && dev->le_adv_enable)
-		le_set_adv_enable_complete(dev);
+	if (status || !dev->le_adv_enable)
+		return 0;
+
+	le_set_adv_enable_complete(dev);
+
+	/* Keep reporting for as long as advertising stays enabled */
+	if (dev->le_adv_interval && !dev->le_adv_timeout_id)
+		dev->le_adv_timeout_id = timeout_add(dev->le_adv_interval,
+							adv_interval_timeout,
+							dev, NULL);
 
 	return 0;
 }
@@ -3667,7 +3782,7 @@ static int cmd_set_scan_enable(struct btdev *dev, const void *data, uint8_t len)
 		goto done;
 	}
 
-	dev->le_scan_enable = cmd->enable;
+	set_le_scan_enable(dev, cmd->enable);
 	dev->le_filter_dup = cmd->filter_dup;
 	status = BT_HCI_ERR_SUCCESS;
 
@@ -3687,7 +3802,7 @@ static int cmd_set_scan_enable_complete(struct btdev *dev, const void *data,
 	if (!dev->le_scan_enable || !cmd->enable)
 		return 0;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
+	for (i = 0; i < btdev_list_size; i++) {
 		uint8_t report_type;
 
 		if (!btdev_list[i] || btdev_list[i] == dev)
@@ -4957,44 +5072,52 @@ static void send_ext_adv(struct btdev *btdev, const struct btdev *remote,
 					1 + 24 + meta_event.lear.data_len);
 }
 
-static void le_set_ext_adv_enable_complete(struct btdev *btdev,
-						struct le_ext_adv *ext_adv)
+struct ext_adv_report_data {
+	struct btdev *btdev;
+	struct le_ext_adv *ext_adv;
+};
+
+static void send_ext_adv_report(void *data, void *user_data)
 {
+	struct btdev *scan = data;
+	struct ext_adv_report_data *report = user_data;
+	struct le_ext_adv *ext_adv = report->ext_adv;
 	uint16_t report_type;
-	int i;
+
+	if (scan == report->btdev || !ext_adv_match_addr(scan, ext_adv))
+		return;
 
 	report_type = get_ext_adv_type(ext_adv->type);
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (!btdev_list[i] || btdev_list[i] == btdev)
-			continue;
+	send_ext_adv(scan, report->btdev, ext_adv, report_type, false);
 
-		if (!btdev_list[i]->le_scan_enable)
-			continue;
+	if (scan->le_scan_type != 0x01)
+		return;
 
-		if (!ext_adv_match_addr(btdev_list[i], ext_adv))
-			continue;
+	/* if scannable bit is set the send scan response */
+	if (ext_adv->type & 0x02) {
+		if (ext_adv->type == 0x13)
+			report_type = 0x1b;
+		else if (ext_adv->type == 0x12)
+			report_type = 0x1a;
+		else if (!(ext_adv->type & 0x10))
+			report_type &= 0x08;
+		else
+			return;
 
-		send_ext_adv(btdev_list[i], btdev, ext_adv, report_type, false);
+		send_ext_adv(scan, report->btdev, ext_adv, report_type, true);
+	}
+}
 
-		if (btdev_list[i]->le_scan_type != 0x01)
-			continue;
+static void le_set_ext_adv_enable_complete(struct btdev *btdev,
+						struct le_ext_adv *ext_adv)
+{
+	struct ext_adv_report_data report;
 
-		/* if scannable bit is set the send scan response */
-		if (ext_adv->type & 0x02) {
-			if (ext_adv->type == 0x13)
-				report_type = 0x1b;
-			else if (ext_adv->type == 0x12)
-				report_type = 0x1a;
-			else if (!(ext_adv->type & 0x10))
-				report_type &= 0x08;
-			else
-				continue;
+	report.btdev = btdev;
+	report.ext_adv = ext_adv;
 
-			send_ext_adv(btdev_list[i], btdev, ext_adv,
-							report_type, true);
-		}
-	}
+	queue_foreach(le_scanners, send_ext_adv_report, &report);
 }
 static void adv_set_terminate(struct btdev *dev, uint8_t status, uint8_t handle,
 					uint16_t conn_handle, uint8_t num_evts)
@@ -5346,11 +5469,19 @@ static void le_pa_sync_estabilished(struct btdev *dev, struct btdev *remote,
 	send_pa(dev, remote, 0);
 }
 
+static void pa_sync_scanner(void *data, void *user_data)
+{
+	struct btdev *remote = data;
+	struct btdev *dev = user_data;
+
+	if (remote != dev && remote->le_pa_sync_handle == INV_HANDLE)
+		le_pa_sync_estabilished(remote, dev, BT_HCI_ERR_SUCCESS);
+}
+
 static int cmd_set_pa_enable(struct btdev *dev, const void *data, uint8_t len)
 {
 	const struct bt_hci_cmd_le_set_pa_enable *cmd = data;
 	uint8_t status;
-	int i;
 
 	if (dev->le_pa_enable == cmd->enable) {
 		status = BT_HCI_ERR_COMMAND_DISALLOWED;
@@ -5362,17 +5493,7 @@ static int cmd_set_pa_enable(struct btdev *dev, const void *data, uint8_t len)
 	cmd_complete(dev, BT_HCI_CMD_LE_SET_PA_ENABLE, &status,
 							sizeof(status));
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		struct btdev *remote = btdev_list[i];
-
-		if (!remote || remote == dev)
-			continue;
-
-		if (remote->le_scan_enable &&
-			remote->le_pa_sync_handle == INV_HANDLE)
-			le_pa_sync_estabilished(remote, dev,
-							BT_HCI_ERR_SUCCESS);
-	}
+	queue_foreach(le_scanners, pa_sync_scanner, dev);
 
 	return 0;
 }
@@ -5427,7 +5548,7 @@ static int cmd_set_ext_scan_enable(struct btdev *dev, const void *data,
 		goto done;
 	}
 
-	dev->le_scan_enable = cmd->enable;
+	set_le_scan_enable(dev, cmd->enable);
 	dev->le_filter_dup = cmd->filter_dup;
 	status = BT_HCI_ERR_SUCCESS;
 
@@ -5496,7 +5617,7 @@ static int cmd_set_ext_scan_enable_complete(struct btdev *dev, const void *data,
 	if (!dev->le_scan_enable || !cmd->enable)
 		return 0;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
+	for (i = 0; i < btdev_list_size; i++) {
 		if (!btdev_list[i] || btdev_list[i] == dev)
 			continue;
 
@@ -7122,7 +7243,7 @@ struct btdev *btdev_create(enum btdev_type type, uint16_t id)
 	if (type == BTDEV_TYPE_BREDRLE || type == BTDEV_TYPE_LE ||
 			type == BTDEV_TYPE_BREDRLE50 ||
 			type == BTDEV_TYPE_BREDRLE52) {
-		btdev->crypto = bt_crypto_new();
+		btdev->crypto = bt_crypto_new_backend(BT_CRYPTO_BACKEND_FAST);
 		if (!btdev->crypto) {
 			free(btdev);
 			return NULL;
@@ -7197,6 +7318,7 @@ struct btdev *btdev_create(enum btdev_type type, uint16_t id)
 	}
 
 	get_bdaddr(id, index, btdev->bdaddr);
+	hash_add_btdev(btdev);
 
 	btdev->conns = queue_new();
 	btdev->le_ext_adv = queue_new();
@@ -7214,7 +7336,12 @@ void btdev_destroy(struct btdev *btdev)
 	if (btdev->inquiry_id > 0)
 		timeout_remove(btdev->inquiry_id);
 
+	if (btdev->le_adv_timeout_id)
+		timeout_remove(btdev->le_adv_timeout_id);
+
 	bt_crypto_unref(btdev->crypto);
+	set_le_scan_enable(btdev, 0x00);
+	hash_del_btdev(btdev);
 	del_btdev(btdev);
 
 	queue_destroy(btdev->conns, conn_remove);
@@ -7249,7 +7376,24 @@ bool btdev_set_bdaddr(struct btdev *btdev, const uint8_t *bdaddr)
 	if (!btdev || !bdaddr)
 		return false;
 
+	hash_del_btdev(btdev);
 	memcpy(btdev->bdaddr, bdaddr, sizeof(btdev->bdaddr));
+	hash_add_btdev(btdev);
+
+	return true;
+}
+
+bool btdev_set_adv_interval(struct btdev *btdev, unsigned int interval)
+{
+	if (!btdev)
+		return false;
+
+	btdev->le_adv_interval = interval;
+
+	if (!interval && btdev->le_adv_timeout_id) {
+		timeout_remove(btdev->le_adv_timeout_id);
+		btdev->le_adv_timeout_id = 0;
+	}
 
 	return true;
 }
@@ -74,6 +74,9 @@ bool btdev_set_debug(struct btdev *btdev, btdev_debug_func_t callback,
 const uint8_t *btdev_get_bdaddr(struct btdev *btdev);
 bool btdev_set_bdaddr(struct btdev *btdev, const uint8_t *bdaddr);
 
+/* Interval in milliseconds to repeat advertising reports at, 0 to disable */
+bool btdev_set_adv_interval(struct btdev *btdev, unsigned int interval);
+
 uint8_t *btdev_get_features(struct btdev *btdev);
 
 uint8_t btdev_get_scan_enable(struct btdev *btdev);
@@ -238,6 +238,8 @@ struct bthost {
 	void *cmd_complete_data;
 	bthost_new_conn_cb new_conn_cb;
 	void *new_conn_data;
+	bthost_disconn_cb disconn_cb;
+	void *disconn_data;
 	bthost_accept_conn_cb accept_iso_cb;
 	bthost_new_conn_cb new_iso_cb;
 	void *new_iso_data;
@@ -1220,6 +1222,9 @@ static void evt_disconn_complete(struct bthost *bthost, const void *data,
 			curr = &conn->next;
 		}
 	}
+
+	if (bthost->disconn_cb)
+		bthost->disconn_cb(handle, bthost->disconn_data);
 }
 
 static void evt_num_completed_packets(struct bthost *bthost, const void *data,
@@ -3083,6 +3088,13 @@ void bthost_set_connect_cb(struct bthost *bthost, bthost_new_conn_cb cb,
 	bthost->new_conn_data = user_data;
 }
 
+void bthost_set_disconnect_cb(struct bthost *bthost, bthost_disconn_cb cb,
+							void *user_data)
+{
+	bthost->disconn_cb = cb;
+	bthost->disconn_data = user_data;
+}
+
 void bthost_set_iso_cb(struct bthost *bthost, bthost_accept_conn_cb accept,
 				bthost_new_conn_cb cb, void *user_data)
 {
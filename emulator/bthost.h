@@ -51,6 +51,11 @@ typedef void (*bthost_new_conn_cb) (uint16_t handle, void *user_data);
 void bthost_set_connect_cb(struct bthost *bthost, bthost_new_conn_cb cb,
 							void *user_data);
 
+typedef void (*bthost_disconn_cb) (uint16_t handle, void *user_data);
+
+void bthost_set_disconnect_cb(struct bthost *bthost, bthost_disconn_cb cb,
+							void *user_data);
+
 void bthost_set_iso_cb(struct bthost *bthost, bthost_accept_conn_cb accept,
 				bthost_new_conn_cb cb, void *user_data);
 
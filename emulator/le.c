@@ -2045,7 +2045,7 @@ struct bt_le *bt_le_new(void)
 	mainloop_add_fd(hci->vhci_fd, EPOLLIN, vhci_read_callback, hci, NULL);
 
 	hci->phy = bt_phy_new();
-	hci->crypto = bt_crypto_new();
+	hci->crypto = bt_crypto_new_backend(BT_CRYPTO_BACKEND_FAST);
 
 	bt_phy_register(hci->phy, phy_recv_callback, hci);
 
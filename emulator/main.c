@@ -18,6 +18,7 @@
 #include <stdbool.h>
 #include <getopt.h>
 #include <sys/uio.h>
+#include <sys/resource.h>
 
 #include "src/shared/mainloop.h"
 #include "src/shared/util.h"
@@ -28,6 +29,9 @@
 #include "vhci.h"
 #include "amp.h"
 #include "le.h"
+#include "peripheral.h"
+
+#define DEFAULT_ADV_INTERVAL 100 /* 100 milliseconds */
 
 static void signal_callback(int signum, void *user_data)
 {
@@ -54,6 +58,9 @@ static void usage(void)
 		"\t-B                    Create BR/EDR only controller\n"
 		"\t-A                    Create AMP controller\n"
 		"\t-T[num]               Number of test AMP controllers\n"
+		"\t-P[num]               Number of LE peripherals\n"
+		"\t-I <msec>             Advertising interval of peripherals\n"
+		"\t-G <num>              Extra GATT services per peripheral\n"
 		"\t-h, --help            Show help options\n");
 }
 
@@ -67,6 +74,9 @@ static const struct option main_options[] = {
 	{ "amp",     no_argument,       NULL, 'A' },
 	{ "letest",  optional_argument, NULL, 'U' },
 	{ "amptest", optional_argument, NULL, 'T' },
+	{ "peripheral", optional_argument, NULL, 'P' },
+	{ "adv-interval", required_argument, NULL, 'I' },
+	{ "gatt-services", required_argument, NULL, 'G' },
 	{ "version", no_argument,	NULL, 'v' },
 	{ "help",    no_argument,	NULL, 'h' },
 	{ }
@@ -79,6 +89,18 @@ static void vhci_debug(const char *str, void *user_data)
 	printf("vhci%u: %s\n", i, str);
 }
 
+/* Every peripheral takes a few descriptors, plus some per connection */
+static void raise_fd_limit(void)
+{
+	struct rlimit rlim;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim) < 0)
+		return;
+
+	rlim.rlim_cur = rlim.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rlim);
+}
+
 int main(int argc, char *argv[])
 {
 	struct server *server1;
@@ -92,6 +114,9 @@ int main(int argc, char *argv[])
 	int letest_count = 0;
 	int amptest_count = 0;
 	int vhci_count = 0;
+	int peripheral_count = 0;
+	unsigned int adv_interval = DEFAULT_ADV_INTERVAL;
+	unsigned int gatt_services = 0;
 	enum btdev_type type = BTDEV_TYPE_BREDRLE52;
 	int i;
 
@@ -100,7 +125,7 @@ int main(int argc, char *argv[])
 	for (;;) {
 		int opt;
 
-		opt = getopt_long(argc, argv, "dSsl::LBAU::T::vh",
+		opt = getopt_long(argc, argv, "dSsl::LBAU::T::P::I:G:vh",
 						main_options, NULL);
 		if (opt < 0)
 			break;
@@ -142,6 +167,18 @@ int main(int argc, char *argv[])
 			else
 				amptest_count = 1;
 			break;
+		case 'P':
+			if (optarg)
+				peripheral_count = atoi(optarg);
+			else
+				peripheral_count = 1;
+			break;
+		case 'I':
+			adv_interval = atoi(optarg);
+			break;
+		case 'G':
+			gatt_services = atoi(optarg);
+			break;
 		case 'v':
 			printf("%s\n", VERSION);
 			return EXIT_SUCCESS;
@@ -153,7 +190,7 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (letest_count < 1 && amptest_count < 1 &&
+	if (letest_count < 1 && amptest_count < 1 && peripheral_count < 1 &&
 			vhci_count < 1 && !server_enabled && !serial_enabled) {
 		fprintf(stderr, "No emulator specified\n");
 		return EXIT_FAILURE;
@@ -181,6 +218,19 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (peripheral_count > 0)
+		raise_fd_limit();
+
+	for (i = 0; i < peripheral_count; i++) {
+		struct peripheral *peripheral;
+
+		peripheral = peripheral_new(i, adv_interval, gatt_services);
+		if (!peripheral) {
+			fprintf(stderr, "Failed to create LE peripheral\n");
+			return EXIT_FAILURE;
+		}
+	}
+
 	for (i = 0; i < vhci_count; i++) {
 		struct vhci *vhci;
 
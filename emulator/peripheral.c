@@ -0,0 +1,357 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "lib/bluetooth.h"
+#include "lib/uuid.h"
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/io.h"
+#include "src/shared/att.h"
+#include "src/shared/gatt-db.h"
+#include "src/shared/gatt-server.h"
+
+#include "btdev.h"
+#include "bthost.h"
+#include "peripheral.h"
+
+#define UUID_GAP		0x1800
+#define UUID_GATT		0x1801
+#define UUID_BATTERY		0x180f
+
+#define ATT_CID			0x0004
+
+/*
+ * A scripted LE peripheral: a controller and a host talking to each other
+ * over a socket pair, the host advertises and serves a GATT database to
+ * whoever connects to it.
+ */
+struct peripheral {
+	struct btdev *btdev;
+	struct bthost *bthost;
+	struct io *dev_io;
+	struct io *host_io;
+	struct gatt_db *db;
+	struct queue *conns;
+	char name[20];
+};
+
+/* The ATT channel of a connection is bridged to a local socket */
+struct peripheral_conn {
+	struct peripheral *peripheral;
+	uint16_t handle;
+	struct io *io;
+	struct bt_att *att;
+	struct bt_gatt_server *server;
+};
+
+static void conn_free(void *data)
+{
+	struct peripheral_conn *conn = data;
+
+	bt_gatt_server_unref(conn->server);
+	bt_att_unref(conn->att);
+	io_destroy(conn->io);
+
+	free(conn);
+}
+
+static bool match_conn_handle(const void *data, const void *match_data)
+{
+	const struct peripheral_conn *conn = data;
+	uint16_t handle = PTR_TO_UINT(match_data);
+
+	return conn->handle == handle;
+}
+
+static void att_hook(const void *data, uint16_t len, void *user_data)
+{
+	struct peripheral_conn *conn = user_data;
+	struct iovec iov;
+
+	iov.iov_base = (void *) data;
+	iov.iov_len = len;
+
+	io_send(conn->io, &iov, 1);
+}
+
+static bool att_read_callback(struct io *io, void *user_data)
+{
+	struct peripheral_conn *conn = user_data;
+	uint8_t buf[BT_ATT_MAX_LE_MTU];
+	ssize_t len;
+
+	len = read(io_get_fd(io), buf, sizeof(buf));
+	if (len < 1)
+		return false;
+
+	bthost_send_cid(conn->peripheral->bthost, conn->handle, ATT_CID,
+								buf, len);
+
+	return true;
+}
+
+static void new_conn(uint16_t handle, void *user_data)
+{
+	struct peripheral *peripheral = user_data;
+	struct peripheral_conn *conn;
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
+								0, sv) < 0)
+		return;
+
+	conn = new0(struct peripheral_conn, 1);
+	conn->peripheral = peripheral;
+	conn->handle = handle;
+
+	conn->io = io_new(sv[1]);
+	io_set_close_on_destroy(conn->io, true);
+	io_set_read_handler(conn->io, att_read_callback, conn, NULL);
+
+	conn->att = bt_att_new(sv[0], false);
+	if (!conn->att) {
+		close(sv[0]);
+		goto fail;
+	}
+
+	bt_att_set_close_on_unref(conn->att, true);
+
+	conn->server = bt_gatt_server_new(peripheral->db, conn->att, 0, 0);
+	if (!conn->server)
+		goto fail;
+
+	bthost_add_cid_hook(peripheral->bthost, handle, ATT_CID, att_hook,
+									conn);
+
+	queue_push_tail(peripheral->conns, conn);
+
+	return;
+
+fail:
+	conn_free(conn);
+}
+
+static void disconn(uint16_t handle, void *user_data)
+{
+	struct peripheral *peripheral = user_data;
+
+	queue_remove_all(peripheral->conns, match_conn_handle,
+					UINT_TO_PTR(handle), conn_free);
+
+	/* Advertising stops once connected, start over for the next one */
+	bthost_set_adv_enable(peripheral->bthost, 0x01);
+}
+
+static void dev_write_callback(const struct iovec *iov, int iovlen,
+							void *user_data)
+{
+	struct peripheral *peripheral = user_data;
+
+	io_send(peripheral->dev_io, iov, iovlen);
+}
+
+static bool dev_read_callback(struct io *io, void *user_data)
+{
+	struct peripheral *peripheral = user_data;
+	unsigned char buf[4096];
+	ssize_t len;
+
+	len = read(io_get_fd(io), buf, sizeof(buf));
+	if (len < 1)
+		return false;
+
+	btdev_receive_h4(peripheral->btdev, buf, len);
+
+	return true;
+}
+
+static void host_write_callback(const struct iovec *iov, int iovlen,
+							void *user_data)
+{
+	struct peripheral *peripheral = user_data;
+
+	io_send(peripheral->host_io, iov, iovlen);
+}
+
+static bool host_read_callback(struct io *io, void *user_data)
+{
+	struct peripheral *peripheral = user_data;
+	unsigned char buf[4096];
+	ssize_t len;
+
+	len = read(io_get_fd(io), buf, sizeof(buf));
+	if (len < 1)
+		return false;
+
+	bthost_receive_h4(peripheral->bthost, buf, len);
+
+	return true;
+}
+
+static void populate_db(struct peripheral *peripheral,
+						unsigned int num_services)
+{
+	struct gatt_db_attribute *service, *attrib;
+	bt_uuid_t uuid;
+	uint16_t appearance;
+	uint8_t level;
+	unsigned int i;
+
+	bt_uuid16_create(&uuid, UUID_GAP);
+	service = gatt_db_add_service(peripheral->db, &uuid, true, 5);
+
+	bt_uuid16_create(&uuid, GATT_CHARAC_DEVICE_NAME);
+	attrib = gatt_db_service_add_characteristic(service, &uuid,
+						BT_ATT_PERM_READ,
+						BT_GATT_CHRC_PROP_READ,
+						NULL, NULL, NULL);
+	gatt_db_attribute_write(attrib, 0, (void *) peripheral->name,
+					strlen(peripheral->name), 0, NULL,
+					NULL, NULL);
+
+	/* Generic Sensor */
+	put_le16(0x0540, &appearance);
+
+	bt_uuid16_create(&uuid, GATT_CHARAC_APPEARANCE);
+	attrib = gatt_db_service_add_characteristic(service, &uuid,
+						BT_ATT_PERM_READ,
+						BT_GATT_CHRC_PROP_READ,
+						NULL, NULL, NULL);
+	gatt_db_attribute_write(attrib, 0, (void *) &appearance,
+					sizeof(appearance), 0, NULL,
+					NULL, NULL);
+
+	gatt_db_service_set_active(service, true);
+
+	bt_uuid16_create(&uuid, UUID_GATT);
+	service = gatt_db_add_service(peripheral->db, &uuid, true, 1);
+	gatt_db_service_set_active(service, true);
+
+	/* Any number of batteries to make the database as large as needed */
+	for (i = 0; i < num_services; i++) {
+		bt_uuid16_create(&uuid, UUID_BATTERY);
+		service = gatt_db_add_service(peripheral->db, &uuid, true, 3);
+
+		bt_uuid16_create(&uuid, GATT_CHARAC_BATTERY_LEVEL);
+		attrib = gatt_db_service_add_characteristic(service, &uuid,
+						BT_ATT_PERM_READ,
+						BT_GATT_CHRC_PROP_READ,
+						NULL, NULL, NULL);
+
+		level = 100 - i % 101;
+		gatt_db_attribute_write(attrib, 0, &level, sizeof(level), 0,
+							NULL, NULL, NULL);
+
+		gatt_db_service_set_active(service, true);
+	}
+}
+
+static void start_advertising(struct peripheral *peripheral)
+{
+	uint8_t adv_data[31];
+	size_t name_len = strlen(peripheral->name);
+
+	/* Flags: LE General Discoverable, BR/EDR Not Supported */
+	adv_data[0] = 0x02;
+	adv_data[1] = 0x01;
+	adv_data[2] = 0x06;
+
+	/* Complete Local Name */
+	adv_data[3] = name_len + 1;
+	adv_data[4] = 0x09;
+	memcpy(adv_data + 5, peripheral->name, name_len);
+
+	bthost_set_adv_data(peripheral->bthost, adv_data, 5 + name_len);
+	bthost_set_adv_enable(peripheral->bthost, 0x01);
+}
+
+struct peripheral *peripheral_new(uint16_t id, unsigned int adv_interval,
+						unsigned int num_services)
+{
+	struct peripheral *peripheral;
+	int sv[2];
+
+	peripheral = new0(struct peripheral, 1);
+	snprintf(peripheral->name, sizeof(peripheral->name), "btvirt %u", id);
+
+	peripheral->btdev = btdev_create(BTDEV_TYPE_LE, id);
+	if (!peripheral->btdev)
+		goto fail;
+
+	btdev_set_adv_interval(peripheral->btdev, adv_interval);
+
+	peripheral->bthost = bthost_create();
+	if (!peripheral->bthost)
+		goto fail;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
+								0, sv) < 0)
+		goto fail;
+
+	peripheral->dev_io = io_new(sv[0]);
+	io_set_close_on_destroy(peripheral->dev_io, true);
+	io_set_read_handler(peripheral->dev_io, dev_read_callback,
+							peripheral, NULL);
+	btdev_set_send_handler(peripheral->btdev, dev_write_callback,
+								peripheral);
+
+	peripheral->host_io = io_new(sv[1]);
+	io_set_close_on_destroy(peripheral->host_io, true);
+	io_set_read_handler(peripheral->host_io, host_read_callback,
+							peripheral, NULL);
+	bthost_set_send_handler(peripheral->bthost, host_write_callback,
+								peripheral);
+
+	peripheral->db = gatt_db_new();
+	populate_db(peripheral, num_services);
+
+	peripheral->conns = queue_new();
+
+	bthost_set_connect_cb(peripheral->bthost, new_conn, peripheral);
+	bthost_set_disconnect_cb(peripheral->bthost, disconn, peripheral);
+
+	/* Commands are queued by the host until the controller is ready */
+	bthost_start(peripheral->bthost);
+	start_advertising(peripheral);
+
+	return peripheral;
+
+fail:
+	peripheral_free(peripheral);
+
+	return NULL;
+}
+
+void peripheral_free(struct peripheral *peripheral)
+{
+	if (!peripheral)
+		return;
+
+	queue_destroy(peripheral->conns, conn_free);
+	gatt_db_unref(peripheral->db);
+
+	io_destroy(peripheral->host_io);
+	io_destroy(peripheral->dev_io);
+
+	bthost_destroy(peripheral->bthost);
+	btdev_destroy(peripheral->btdev);
+
+	free(peripheral);
+}
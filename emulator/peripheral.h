@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdint.h>
+
+struct peripheral;
+
+struct peripheral *peripheral_new(uint16_t id, unsigned int adv_interval,
+						unsigned int num_services);
+void peripheral_free(struct peripheral *peripheral);
@@ -33,6 +33,13 @@ typedef enum {
 typedef gssize (*GObexDataProducer) (void *buf, gsize len, gpointer user_data);
 typedef gboolean (*GObexDataConsumer) (const void *buf, gsize len,
 							gpointer user_data);
+/*
+ * Returns how many of the next len bytes of the body are to be sent straight
+ * from *fd, starting at its current offset, 0 at the end of the body or a
+ * negative errno. GObex sends them from its own copy of *fd, so the producer
+ * may close it at any time.
+ */
+typedef gssize (*GObexFdProducer) (int *fd, gsize len, gpointer user_data);
 
 #define G_OBEX_ERROR g_obex_error_quark()
 GQuark g_obex_error_quark(void);
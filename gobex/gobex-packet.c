@@ -38,6 +38,11 @@ struct _GObexPacket {
 
 	GObexDataProducer get_body;
 	gpointer get_body_data;
+
+	GObexFdProducer get_body_fd;
+	gpointer get_body_fd_data;
+	int body_fd;		/* Body left out of the encoded buffer */
+	gsize body_fd_len;
 };
 
 GObexHeader *g_obex_packet_get_header(GObexPacket *pkt, guint8 id)
@@ -104,7 +109,7 @@ gboolean g_obex_packet_add_body(GObexPacket *pkt, GObexDataProducer func,
 {
 	g_obex_debug(G_OBEX_DEBUG_PACKET, "opcode 0x%02x", pkt->opcode);
 
-	if (pkt->get_body != NULL)
+	if (pkt->get_body != NULL || pkt->get_body_fd != NULL)
 		return FALSE;
 
 	pkt->get_body = func;
@@ -113,6 +118,34 @@ gboolean g_obex_packet_add_body(GObexPacket *pkt, GObexDataProducer func,
 	return TRUE;
 }
 
+gboolean g_obex_packet_add_body_fd(GObexPacket *pkt, GObexFdProducer func,
+							gpointer user_data)
+{
+	g_obex_debug(G_OBEX_DEBUG_PACKET, "opcode 0x%02x", pkt->opcode);
+
+	if (pkt->get_body != NULL || pkt->get_body_fd != NULL)
+		return FALSE;
+
+	pkt->get_body_fd = func;
+	pkt->get_body_fd_data = user_data;
+
+	return TRUE;
+}
+
+/*
+ * After g_obex_packet_encode() returns the number of bytes at the end of the
+ * packet that were not written to the buffer and are to be sent from fd.
+ */
+gsize g_obex_packet_get_body_fd(GObexPacket *pkt, int *fd)
+{
+	g_obex_debug(G_OBEX_DEBUG_PACKET, "opcode 0x%02x", pkt->opcode);
+
+	if (fd)
+		*fd = pkt->body_fd;
+
+	return pkt->body_fd_len;
+}
+
 gboolean g_obex_packet_add_unicode(GObexPacket *pkt, guint8 id,
 							const char *str)
 {
@@ -229,6 +262,7 @@ GObexPacket *g_obex_packet_new_valist(guint8 opcode, gboolean final,
 	pkt->headers = g_obex_header_create_list(first_hdr_id, args,
 								&pkt->hlen);
 	pkt->data_policy = G_OBEX_DATA_COPY;
+	pkt->body_fd = -1;
 
 	return pkt;
 }
@@ -382,7 +416,16 @@ static gssize get_body(GObexPacket *pkt, guint8 *buf, gsize len)
 	if (len < 3)
 		return -ENOBUFS;
 
-	ret = pkt->get_body(buf + 3, len - 3, pkt->get_body_data);
+	if (pkt->get_body_fd) {
+		ret = pkt->get_body_fd(&pkt->body_fd, len - 3,
+						pkt->get_body_fd_data);
+		if (ret > (gssize) (len - 3))
+			return -EINVAL;
+		if (ret > 0)
+			pkt->body_fd_len = ret;
+	} else
+		ret = pkt->get_body(buf + 3, len - 3, pkt->get_body_data);
+
 	if (ret < 0)
 		return ret;
 
@@ -435,7 +478,7 @@ gssize g_obex_packet_encode(GObexPacket *pkt, guint8 *buf, gsize len)
 		count += ret;
 	}
 
-	if (pkt->get_body) {
+	if (pkt->get_body || pkt->get_body_fd) {
 		ret = get_body(pkt, buf + count, len - count);
 		if (ret < 0)
 			return ret;
@@ -37,6 +37,7 @@ struct transfer {
 	guint abort_id;
 
 	GObexDataProducer data_producer;
+	GObexFdProducer fd_producer;
 	GObexDataConsumer data_consumer;
 	GObexFunc complete_func;
 
@@ -118,14 +119,22 @@ static void transfer_abort_response(GObex *obex, GError *err, GObexPacket *rsp,
 }
 
 
-static gssize put_get_data(void *buf, gsize len, gpointer user_data)
+static gssize put_get_data(void *buf, gsize len, gpointer user_data);
+static gssize put_get_fd(int *fd, gsize len, gpointer user_data);
+
+static void transfer_add_put_body(struct transfer *transfer, GObexPacket *req)
+{
+	if (transfer->fd_producer)
+		g_obex_packet_add_body_fd(req, put_get_fd, transfer);
+	else
+		g_obex_packet_add_body(req, put_get_data, transfer);
+}
+
+static gssize put_get_done(struct transfer *transfer, gssize ret)
 {
-	struct transfer *transfer = user_data;
 	GObexPacket *req;
 	GError *err = NULL;
-	gssize ret;
 
-	ret = transfer->data_producer(buf, len, transfer->user_data);
 	if (ret == 0 || ret == -EAGAIN)
 		return ret;
 
@@ -137,7 +146,7 @@ static gssize put_get_data(void *buf, gsize len, gpointer user_data)
 		/* Generate next packet */
 		req = g_obex_packet_new(transfer->opcode, FALSE,
 							G_OBEX_HDR_INVALID);
-		g_obex_packet_add_body(req, put_get_data, transfer);
+		transfer_add_put_body(transfer, req);
 		transfer->req_id = g_obex_send_req(transfer->obex, req, -1,
 						transfer_response, transfer,
 						&err);
@@ -155,6 +164,26 @@ done:
 	return ret;
 }
 
+static gssize put_get_data(void *buf, gsize len, gpointer user_data)
+{
+	struct transfer *transfer = user_data;
+	gssize ret;
+
+	ret = transfer->data_producer(buf, len, transfer->user_data);
+
+	return put_get_done(transfer, ret);
+}
+
+static gssize put_get_fd(int *fd, gsize len, gpointer user_data)
+{
+	struct transfer *transfer = user_data;
+	gssize ret;
+
+	ret = transfer->fd_producer(fd, len, transfer->user_data);
+
+	return put_get_done(transfer, ret);
+}
+
 static gboolean handle_get_body(struct transfer *transfer, GObexPacket *rsp,
 								GError **err)
 {
@@ -217,7 +246,7 @@ static void transfer_response(GObex *obex, GError *err, GObexPacket *rsp,
 	if (transfer->opcode == G_OBEX_OP_PUT) {
 		req = g_obex_packet_new(transfer->opcode, FALSE,
 							G_OBEX_HDR_INVALID);
-		g_obex_packet_add_body(req, put_get_data, transfer);
+		transfer_add_put_body(transfer, req);
 	} else if (!g_obex_srm_active(transfer->obex)) {
 		req = g_obex_packet_new(transfer->opcode, TRUE,
 							G_OBEX_HDR_INVALID);
@@ -258,9 +287,10 @@ static struct transfer *transfer_new(GObex *obex, guint8 opcode,
 	return transfer;
 }
 
-guint g_obex_put_req_pkt(GObex *obex, GObexPacket *req,
-			GObexDataProducer data_func, GObexFunc complete_func,
-			gpointer user_data, GError **err)
+static guint put_req_pkt(GObex *obex, GObexPacket *req,
+			GObexDataProducer data_func, GObexFdProducer fd_func,
+			GObexFunc complete_func, gpointer user_data,
+			GError **err)
 {
 	struct transfer *transfer;
 
@@ -271,8 +301,9 @@ guint g_obex_put_req_pkt(GObex *obex, GObexPacket *req,
 
 	transfer = transfer_new(obex, G_OBEX_OP_PUT, complete_func, user_data);
 	transfer->data_producer = data_func;
+	transfer->fd_producer = fd_func;
 
-	g_obex_packet_add_body(req, put_get_data, transfer);
+	transfer_add_put_body(transfer, req);
 
 	transfer->req_id = g_obex_send_req(obex, req, FIRST_PACKET_TIMEOUT,
 					transfer_response, transfer, err);
@@ -286,6 +317,22 @@ guint g_obex_put_req_pkt(GObex *obex, GObexPacket *req,
 	return transfer->id;
 }
 
+guint g_obex_put_req_pkt(GObex *obex, GObexPacket *req,
+			GObexDataProducer data_func, GObexFunc complete_func,
+			gpointer user_data, GError **err)
+{
+	return put_req_pkt(obex, req, data_func, NULL, complete_func,
+							user_data, err);
+}
+
+guint g_obex_put_req_pkt_fd(GObex *obex, GObexPacket *req,
+			GObexFdProducer fd_func, GObexFunc complete_func,
+			gpointer user_data, GError **err)
+{
+	return put_req_pkt(obex, req, NULL, fd_func, complete_func,
+							user_data, err);
+}
+
 guint g_obex_put_req(GObex *obex, GObexDataProducer data_func,
 			GObexFunc complete_func, gpointer user_data,
 			GError **err, guint first_hdr_id, ...)
@@ -304,6 +351,24 @@ guint g_obex_put_req(GObex *obex, GObexDataProducer data_func,
 							user_data, err);
 }
 
+guint g_obex_put_req_fd(GObex *obex, GObexFdProducer fd_func,
+			GObexFunc complete_func, gpointer user_data,
+			GError **err, guint first_hdr_id, ...)
+{
+	GObexPacket *req;
+	va_list args;
+
+	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "obex %p", obex);
+
+	va_start(args, first_hdr_id);
+	req = g_obex_packet_new_valist(G_OBEX_OP_PUT, FALSE,
+							first_hdr_id, args);
+	va_end(args);
+
+	return g_obex_put_req_pkt_fd(obex, req, fd_func, complete_func,
+							user_data, err);
+}
+
 static void transfer_abort_req(GObex *obex, GObexPacket *req, gpointer user_data)
 {
 	struct transfer *transfer = user_data;
@@ -491,17 +556,23 @@ guint g_obex_get_req(GObex *obex, GObexDataConsumer data_func,
 	return transfer->id;
 }
 
-static gssize get_get_data(void *buf, gsize len, gpointer user_data)
+static gssize get_get_data(void *buf, gsize len, gpointer user_data);
+static gssize get_get_fd(int *fd, gsize len, gpointer user_data);
+
+static void transfer_add_get_body(struct transfer *transfer, GObexPacket *rsp)
+{
+	if (transfer->fd_producer)
+		g_obex_packet_add_body_fd(rsp, get_get_fd, transfer);
+	else
+		g_obex_packet_add_body(rsp, get_get_data, transfer);
+}
+
+static gssize get_get_done(struct transfer *transfer, gssize ret)
 {
-	struct transfer *transfer = user_data;
 	GObexPacket *req, *rsp;
 	GError *err = NULL;
-	gssize ret;
 	guint8 op;
 
-	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "transfer %u", transfer->id);
-
-	ret = transfer->data_producer(buf, len, transfer->user_data);
 	if (ret > 0) {
 		if (!g_obex_srm_active(transfer->obex))
 			return ret;
@@ -509,7 +580,7 @@ static gssize get_get_data(void *buf, gsize len, gpointer user_data)
 		/* Generate next response */
 		rsp = g_obex_packet_new(G_OBEX_RSP_CONTINUE, TRUE,
 							G_OBEX_HDR_INVALID);
-		g_obex_packet_add_body(rsp, get_get_data, transfer);
+		transfer_add_get_body(transfer, rsp);
 
 		if (!g_obex_send(transfer->obex, rsp, &err)) {
 			transfer_complete(transfer, err);
@@ -541,6 +612,30 @@ static gssize get_get_data(void *buf, gsize len, gpointer user_data)
 	return ret;
 }
 
+static gssize get_get_data(void *buf, gsize len, gpointer user_data)
+{
+	struct transfer *transfer = user_data;
+	gssize ret;
+
+	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "transfer %u", transfer->id);
+
+	ret = transfer->data_producer(buf, len, transfer->user_data);
+
+	return get_get_done(transfer, ret);
+}
+
+static gssize get_get_fd(int *fd, gsize len, gpointer user_data)
+{
+	struct transfer *transfer = user_data;
+	gssize ret;
+
+	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "transfer %u", transfer->id);
+
+	ret = transfer->fd_producer(fd, len, transfer->user_data);
+
+	return get_get_done(transfer, ret);
+}
+
 static gboolean transfer_get_req_first(struct transfer *transfer,
 							GObexPacket *rsp)
 {
@@ -548,7 +643,7 @@ static gboolean transfer_get_req_first(struct transfer *transfer,
 
 	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "transfer %u", transfer->id);
 
-	g_obex_packet_add_body(rsp, get_get_data, transfer);
+	transfer_add_get_body(transfer, rsp);
 
 	if (!g_obex_send(transfer->obex, rsp, &err)) {
 		transfer_complete(transfer, err);
@@ -568,7 +663,7 @@ static void transfer_get_req(GObex *obex, GObexPacket *req, gpointer user_data)
 	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "transfer %u", transfer->id);
 
 	rsp = g_obex_packet_new(G_OBEX_RSP_CONTINUE, TRUE, G_OBEX_HDR_INVALID);
-	g_obex_packet_add_body(rsp, get_get_data, transfer);
+	transfer_add_get_body(transfer, rsp);
 
 	if (!g_obex_send(obex, rsp, &err)) {
 		transfer_complete(transfer, err);
@@ -576,9 +671,10 @@ static void transfer_get_req(GObex *obex, GObexPacket *req, gpointer user_data)
 	}
 }
 
-guint g_obex_get_rsp_pkt(GObex *obex, GObexPacket *rsp,
-			GObexDataProducer data_func, GObexFunc complete_func,
-			gpointer user_data, GError **err)
+static guint get_rsp_pkt(GObex *obex, GObexPacket *rsp,
+			GObexDataProducer data_func, GObexFdProducer fd_func,
+			GObexFunc complete_func, gpointer user_data,
+			GError **err)
 {
 	struct transfer *transfer;
 	guint id;
@@ -587,6 +683,7 @@ guint g_obex_get_rsp_pkt(GObex *obex, GObexPacket *rsp,
 
 	transfer = transfer_new(obex, G_OBEX_OP_GET, complete_func, user_data);
 	transfer->data_producer = data_func;
+	transfer->fd_producer = fd_func;
 
 	if (!transfer_get_req_first(transfer, rsp))
 		return 0;
@@ -607,6 +704,22 @@ guint g_obex_get_rsp_pkt(GObex *obex, GObexPacket *rsp,
 	return transfer->id;
 }
 
+guint g_obex_get_rsp_pkt(GObex *obex, GObexPacket *rsp,
+			GObexDataProducer data_func, GObexFunc complete_func,
+			gpointer user_data, GError **err)
+{
+	return get_rsp_pkt(obex, rsp, data_func, NULL, complete_func,
+							user_data, err);
+}
+
+guint g_obex_get_rsp_pkt_fd(GObex *obex, GObexPacket *rsp,
+			GObexFdProducer fd_func, GObexFunc complete_func,
+			gpointer user_data, GError **err)
+{
+	return get_rsp_pkt(obex, rsp, NULL, fd_func, complete_func,
+							user_data, err);
+}
+
 guint g_obex_get_rsp(GObex *obex, GObexDataProducer data_func,
 			GObexFunc complete_func, gpointer user_data,
 			GError **err, guint first_hdr_id, ...)
@@ -625,6 +738,24 @@ guint g_obex_get_rsp(GObex *obex, GObexDataProducer data_func,
 							user_data, err);
 }
 
+guint g_obex_get_rsp_fd(GObex *obex, GObexFdProducer fd_func,
+			GObexFunc complete_func, gpointer user_data,
+			GError **err, guint first_hdr_id, ...)
+{
+	GObexPacket *rsp;
+	va_list args;
+
+	g_obex_debug(G_OBEX_DEBUG_TRANSFER, "obex %p", obex);
+
+	va_start(args, first_hdr_id);
+	rsp = g_obex_packet_new_valist(G_OBEX_RSP_CONTINUE, TRUE,
+							first_hdr_id, args);
+	va_end(args);
+
+	return g_obex_get_rsp_pkt_fd(obex, rsp, fd_func, complete_func,
+							user_data, err);
+}
+
 gboolean g_obex_cancel_transfer(guint id, GObexFunc complete_func,
 			gpointer user_data)
 {
@@ -14,6 +14,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/sendfile.h>
 
 #include "gobex.h"
 #include "gobex-debug.h"
@@ -64,6 +65,9 @@ struct _GObex {
 	guint8 *tx_buf;
 	size_t tx_data;
 	size_t tx_sent;
+	int tx_body_fd;
+	size_t tx_body;		/* Body left to send from tx_body_fd */
+	gboolean tx_body_copy;
 
 	gboolean suspended;
 	gboolean use_srm;
@@ -254,12 +258,102 @@ static gboolean req_timeout(gpointer user_data)
 	return FALSE;
 }
 
+static void set_tx_body(GObex *obex, int fd, gsize len)
+{
+	if (obex->tx_body_fd >= 0)
+		close(obex->tx_body_fd);
+
+	obex->tx_body_fd = fd;
+	obex->tx_body = len;
+	obex->tx_body_copy = FALSE;
+}
+
+static void body_sent(GObex *obex, gsize len)
+{
+	obex->tx_body -= len;
+
+	if (obex->tx_body == 0)
+		set_tx_body(obex, -1, 0);
+}
+
+static gssize read_body(GObex *obex, void *buf, gsize len, GError **err)
+{
+	gssize ret;
+
+	do {
+		ret = read(obex->tx_body_fd, buf, MIN(len, obex->tx_body));
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret <= 0) {
+		g_set_error(err, G_OBEX_ERROR, G_OBEX_ERROR_FAILED,
+				"Unable to read body: %s",
+				ret < 0 ? strerror(errno) : "unexpected EOF");
+		return -1;
+	}
+
+	body_sent(obex, ret);
+
+	return ret;
+}
+
+/*
+ * The body is sent with sendfile() straight from its file to the socket,
+ * falling back to reading it into tx_buf for files that do not support it.
+ */
+static gboolean write_body(GObex *obex, GError **err)
+{
+	gssize ret;
+	int fd;
+
+	if (obex->tx_body_copy)
+		goto copy;
+
+	fd = g_io_channel_unix_get_fd(obex->io);
+
+	ret = sendfile(fd, obex->tx_body_fd, NULL, obex->tx_body);
+	if (ret > 0) {
+		body_sent(obex, ret);
+		return TRUE;
+	}
+
+	if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+		return TRUE;
+
+	if (ret == 0 || (errno != EINVAL && errno != ENOSYS)) {
+		g_set_error(err, G_OBEX_ERROR, G_OBEX_ERROR_FAILED,
+				"Unable to send body: %s",
+				ret < 0 ? strerror(errno) : "unexpected EOF");
+		return FALSE;
+	}
+
+	obex->tx_body_copy = TRUE;
+
+copy:
+	ret = read_body(obex, obex->tx_buf, obex->tx_mtu, err);
+	if (ret < 0)
+		return FALSE;
+
+	obex->tx_data = ret;
+	obex->tx_sent = 0;
+
+	return TRUE;
+}
+
 static gboolean write_stream(GObex *obex, GError **err)
 {
 	GIOStatus status;
 	gsize bytes_written;
 	char *buf;
 
+	if (obex->tx_data == 0) {
+		if (!write_body(obex, err))
+			return FALSE;
+
+		/* Nothing else to do unless it was copied to tx_buf */
+		if (obex->tx_data == 0)
+			return TRUE;
+	}
+
 	buf = (char *) &obex->tx_buf[obex->tx_sent];
 	status = g_io_channel_write_chars(obex->io, buf, obex->tx_data,
 							&bytes_written, err);
@@ -428,8 +522,10 @@ static gboolean write_data(GIOChannel *io, GIOCondition cond,
 	if (cond & (G_IO_HUP | G_IO_ERR))
 		goto stop_tx;
 
-	if (obex->tx_data == 0) {
+	if (obex->tx_data == 0 && obex->tx_body == 0) {
 		ssize_t len;
+		gsize body;
+		int fd;
 
 		p = g_queue_pop_head(obex->tx_queue);
 		if (p == NULL)
@@ -459,6 +555,36 @@ encode:
 			goto done;
 		}
 
+		/*
+		 * The body may still be in flight when the producer closes
+		 * its fd, e.g. when the transfer is aborted, so use a copy.
+		 */
+		body = g_obex_packet_get_body_fd(p->pkt, &fd);
+		if (body > 0) {
+			fd = dup(fd);
+			if (fd < 0) {
+				g_set_error(&err, G_OBEX_ERROR,
+						G_OBEX_ERROR_FAILED,
+						"Unable to dup body: %s",
+						strerror(errno));
+				goto failed;
+			}
+
+			set_tx_body(obex, fd, body);
+		}
+
+		/* Packets must be written at once, so the body is copied */
+		if (body > 0 && obex->write == write_packet) {
+			while (obex->tx_body > 0) {
+				guint8 *buf = obex->tx_buf + len - obex->tx_body;
+
+				if (read_body(obex, buf, obex->tx_body,
+								&err) < 0)
+					goto failed;
+			}
+		} else
+			len -= body;
+
 		if (p->id > 0) {
 			if (obex->pending_req != NULL)
 				pending_pkt_free(obex->pending_req);
@@ -484,27 +610,31 @@ encode:
 		return FALSE;
 	}
 
-	if (!obex->write(obex, &err)) {
-		g_obex_debug(G_OBEX_DEBUG_ERROR, "%s", err->message);
+	if (obex->write(obex, &err))
+		goto done;
 
-		if (p) {
-			if (p->rsp_func)
-				p->rsp_func(obex, err, NULL, p->rsp_data);
+failed:
+	g_obex_debug(G_OBEX_DEBUG_ERROR, "%s", err->message);
 
-			pending_pkt_free(p);
-		}
+	if (p) {
+		if (p->rsp_func)
+			p->rsp_func(obex, err, NULL, p->rsp_data);
 
-		g_error_free(err);
-		goto stop_tx;
+		pending_pkt_free(p);
 	}
 
+	g_error_free(err);
+	goto stop_tx;
+
 done:
-	if (obex->tx_data > 0 || g_queue_get_length(obex->tx_queue) > 0)
+	if (obex->tx_data > 0 || obex->tx_body > 0 ||
+				g_queue_get_length(obex->tx_queue) > 0)
 		return TRUE;
 
 stop_tx:
 	obex->rx_last_op = G_OBEX_OP_NONE;
 	obex->tx_data = 0;
+	set_tx_body(obex, -1, 0);
 	obex->write_source = 0;
 	return FALSE;
 }
@@ -1007,7 +1137,8 @@ void g_obex_resume(GObex *obex)
 		g_obex_srm_resume(obex);
 
 done:
-	if (g_queue_get_length(obex->tx_queue) > 0 || obex->tx_data > 0)
+	if (g_queue_get_length(obex->tx_queue) > 0 || obex->tx_data > 0 ||
+							obex->tx_body > 0)
 		enable_tx(obex);
 }
 
@@ -1479,6 +1610,7 @@ GObex *g_obex_new(GIOChannel *io, GObexTransportType transport_type,
 		obex->rx_mtu = io_rx_mtu;
 
 	obex->tx_mtu = G_OBEX_MINIMUM_MTU;
+	obex->tx_body_fd = -1;
 
 	obex->tx_queue = g_queue_new();
 	obex->rx_buf = g_malloc(obex->rx_mtu);
@@ -1551,6 +1683,8 @@ void g_obex_unref(GObex *obex)
 	if (obex->write_source > 0)
 		g_source_remove(obex->write_source);
 
+	set_tx_body(obex, -1, 0);
+
 	g_free(obex->rx_buf);
 	g_free(obex->tx_buf);
 	g_free(obex->srm);
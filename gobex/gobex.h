@@ -96,6 +96,14 @@ guint g_obex_put_req_pkt(GObex *obex, GObexPacket *req,
 			GObexDataProducer data_func, GObexFunc complete_func,
 			gpointer user_data, GError **err);
 
+guint g_obex_put_req_fd(GObex *obex, GObexFdProducer fd_func,
+			GObexFunc complete_func, gpointer user_data,
+			GError **err, guint first_hdr_id, ...);
+
+guint g_obex_put_req_pkt_fd(GObex *obex, GObexPacket *req,
+			GObexFdProducer fd_func, GObexFunc complete_func,
+			gpointer user_data, GError **err);
+
 guint g_obex_get_req(GObex *obex, GObexDataConsumer data_func,
 			GObexFunc complete_func, gpointer user_data,
 			GError **err, guint first_hdr_id, ...);
@@ -117,6 +125,14 @@ guint g_obex_get_rsp_pkt(GObex *obex, GObexPacket *rsp,
 			GObexDataProducer data_func, GObexFunc complete_func,
 			gpointer user_data, GError **err);
 
+guint g_obex_get_rsp_fd(GObex *obex, GObexFdProducer fd_func,
+			GObexFunc complete_func, gpointer user_data,
+			GError **err, guint first_hdr_id, ...);
+
+guint g_obex_get_rsp_pkt_fd(GObex *obex, GObexPacket *rsp,
+			GObexFdProducer fd_func, GObexFunc complete_func,
+			gpointer user_data, GError **err);
+
 gboolean g_obex_cancel_transfer(guint id, GObexFunc complete_func,
 							gpointer user_data);
 
@@ -65,6 +65,7 @@ static void finalize_key(void *a, void *b)
 
 	key->new_key_aid = APP_AID_INVALID;
 
+	mesh_crypto_cache_invalidate(key->key);
 	memcpy(key->key, key->new_key, 16);
 }
 
@@ -77,6 +78,7 @@ void appkey_finalize(struct mesh_net *net, uint16_t net_idx)
 		return;
 
 	l_queue_foreach(app_keys, finalize_key, L_UINT_TO_PTR(net_idx));
+	mesh_net_index_app_keys(net);
 }
 
 static struct mesh_app_key *app_key_new(void)
@@ -113,6 +115,11 @@ void appkey_key_free(void *data)
 	if (!key)
 		return;
 
+	mesh_crypto_cache_invalidate(key->key);
+
+	if (key->new_key_aid != APP_AID_INVALID)
+		mesh_crypto_cache_invalidate(key->new_key);
+
 	l_free(key);
 }
 
@@ -150,6 +157,7 @@ bool appkey_key_init(struct mesh_net *net, uint16_t net_idx, uint16_t app_idx,
 	}
 
 	l_queue_push_tail(app_keys, key);
+	mesh_net_index_app_keys(net);
 
 	return true;
 }
@@ -271,9 +279,14 @@ int appkey_key_update(struct mesh_net *net, uint16_t net_idx, uint16_t app_idx,
 	if (memcmp(new_key, key->new_key, 16) == 0)
 		return MESH_STATUS_SUCCESS;
 
+	if (key->new_key_aid != APP_AID_INVALID)
+		mesh_crypto_cache_invalidate(key->new_key);
+
 	if (!set_key(key, app_idx, new_key, true))
 		return MESH_STATUS_INSUFF_RESOURCES;
 
+	mesh_net_index_app_keys(net);
+
 	node = mesh_net_node_get(net);
 
 	if (!mesh_config_app_key_update(node_config_get(node), app_idx,
@@ -328,6 +341,7 @@ int appkey_key_add(struct mesh_net *net, uint16_t net_idx, uint16_t app_idx,
 	key->net_idx = net_idx;
 	key->app_idx = app_idx;
 	l_queue_push_tail(app_keys, key);
+	mesh_net_index_app_keys(net);
 
 	return MESH_STATUS_SUCCESS;
 }
@@ -356,6 +370,7 @@ int appkey_key_delete(struct mesh_net *net, uint16_t net_idx,
 	node_app_key_delete(node, net_idx, app_idx);
 
 	l_queue_remove(app_keys, key);
+	mesh_net_index_app_keys(net);
 	appkey_key_free(key);
 
 	if (!mesh_config_app_key_del(node_config_get(node), net_idx, app_idx))
@@ -380,6 +395,7 @@ void appkey_delete_bound_keys(struct mesh_net *net, uint16_t net_idx)
 					L_UINT_TO_PTR(net_idx));
 
 	while (key) {
+		mesh_net_index_app_keys(net);
 		node_app_key_delete(node, net_idx, key->app_idx);
 		mesh_config_app_key_del(node_config_get(node), net_idx,
 								key->app_idx);
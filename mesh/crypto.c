@@ -24,6 +24,189 @@
 /* Multiply used Zero array */
 static const uint8_t zero[16] = { 0, };
 
+/* Number of keyed cipher objects kept open for reuse */
+#define CRYPTO_CACHE_MAX	32
+
+enum crypto_ctx_type {
+	CRYPTO_CTX_ECB,
+	CRYPTO_CTX_CMAC,
+	CRYPTO_CTX_CCM,
+};
+
+struct crypto_ctx {
+	uint8_t type;
+	uint8_t mic_size;
+	uint8_t key[16];
+	void *obj;
+};
+
+struct crypto_ctx_match {
+	uint8_t type;
+	uint8_t mic_size;
+	const uint8_t *key;
+};
+
+/*
+ * Every ELL cipher object is backed by its own AF_ALG socket, so the ones
+ * used on the PDU path are kept around, most recently used first.
+ */
+static struct l_queue *ctx_cache;
+
+static void ctx_free(void *data)
+{
+	struct crypto_ctx *ctx = data;
+
+	switch (ctx->type) {
+	case CRYPTO_CTX_ECB:
+		l_cipher_free(ctx->obj);
+		break;
+	case CRYPTO_CTX_CMAC:
+		l_checksum_free(ctx->obj);
+		break;
+	case CRYPTO_CTX_CCM:
+		l_aead_cipher_free(ctx->obj);
+		break;
+	}
+
+	l_free(ctx);
+}
+
+static bool match_ctx(const void *a, const void *b)
+{
+	const struct crypto_ctx *ctx = a;
+	const struct crypto_ctx_match *match = b;
+
+	return ctx->type == match->type && ctx->mic_size == match->mic_size &&
+				!memcmp(ctx->key, match->key, sizeof(ctx->key));
+}
+
+static bool match_ctx_obj(const void *a, const void *b)
+{
+	const struct crypto_ctx *ctx = a;
+
+	return ctx->obj == b;
+}
+
+static void *ctx_get(uint8_t type, const uint8_t key[16], uint8_t mic_size)
+{
+	struct crypto_ctx_match match = {
+		.type = type,
+		.mic_size = mic_size,
+		.key = key,
+	};
+	struct crypto_ctx *ctx;
+	void *obj = NULL;
+
+	if (!ctx_cache)
+		ctx_cache = l_queue_new();
+
+	ctx = l_queue_remove_if(ctx_cache, match_ctx, &match);
+	if (ctx) {
+		l_queue_push_head(ctx_cache, ctx);
+		return ctx->obj;
+	}
+
+	switch (type) {
+	case CRYPTO_CTX_ECB:
+		obj = l_cipher_new(L_CIPHER_AES, key, 16);
+		break;
+	case CRYPTO_CTX_CMAC:
+		obj = l_checksum_new_cmac_aes(key, 16);
+		break;
+	case CRYPTO_CTX_CCM:
+		obj = l_aead_cipher_new(L_AEAD_CIPHER_AES_CCM, key, 16,
+								mic_size);
+		break;
+	}
+
+	if (!obj)
+		return NULL;
+
+	if (l_queue_length(ctx_cache) >= CRYPTO_CACHE_MAX) {
+		ctx = l_queue_peek_tail(ctx_cache);
+		l_queue_remove(ctx_cache, ctx);
+		ctx_free(ctx);
+	}
+
+	ctx = l_new(struct crypto_ctx, 1);
+	ctx->type = type;
+	ctx->mic_size = mic_size;
+	memcpy(ctx->key, key, sizeof(ctx->key));
+	ctx->obj = obj;
+
+	l_queue_push_head(ctx_cache, ctx);
+
+	return obj;
+}
+
+/* Objects which failed an operation are not trusted to be reused */
+static void ctx_drop(void *obj)
+{
+	struct crypto_ctx *ctx;
+
+	ctx = l_queue_remove_if(ctx_cache, match_ctx_obj, obj);
+	if (ctx)
+		ctx_free(ctx);
+}
+
+static bool invalidate_ctx(void *data, void *user_data)
+{
+	struct crypto_ctx *ctx = data;
+
+	if (memcmp(ctx->key, user_data, sizeof(ctx->key)))
+		return false;
+
+	ctx_free(ctx);
+
+	return true;
+}
+
+void mesh_crypto_cache_invalidate(const uint8_t key[16])
+{
+	l_queue_foreach_remove(ctx_cache, invalidate_ctx, (void *) key);
+}
+
+void mesh_crypto_cache_cleanup(void)
+{
+	l_queue_destroy(ctx_cache, ctx_free);
+	ctx_cache = NULL;
+}
+
+static bool aes_ecb_cached(const uint8_t key[16], const uint8_t in[16],
+								uint8_t out[16])
+{
+	void *cipher;
+
+	cipher = ctx_get(CRYPTO_CTX_ECB, key, 0);
+	if (!cipher)
+		return false;
+
+	if (l_cipher_encrypt(cipher, in, out, 16))
+		return true;
+
+	ctx_drop(cipher);
+
+	return false;
+}
+
+static bool aes_cmac_cached(const uint8_t key[16], const void *msg,
+					size_t msg_len, uint8_t res[16])
+{
+	void *checksum;
+
+	checksum = ctx_get(CRYPTO_CTX_CMAC, key, 0);
+	if (!checksum)
+		return false;
+
+	if (l_checksum_update(checksum, msg, msg_len) &&
+			l_checksum_get_digest(checksum, res, 16) == 16)
+		return true;
+
+	ctx_drop(checksum);
+
+	return false;
+}
+
 static bool aes_ecb_one(const uint8_t key[16], const uint8_t in[16],
 								uint8_t out[16])
 {
@@ -89,12 +272,15 @@ bool mesh_crypto_aes_ccm_encrypt(const uint8_t nonce[13], const uint8_t key[16],
 	void *cipher;
 	bool result;
 
-	cipher = l_aead_cipher_new(L_AEAD_CIPHER_AES_CCM, key, 16, mic_size);
+	cipher = ctx_get(CRYPTO_CTX_CCM, key, mic_size);
+	if (!cipher)
+		return false;
 
 	result = l_aead_cipher_encrypt(cipher, msg, msg_len, aad, aad_len,
 					nonce, 13, out_msg, msg_len + mic_size);
 
-	l_aead_cipher_free(cipher);
+	if (!result)
+		ctx_drop(cipher);
 
 	return result;
 }
@@ -109,8 +295,14 @@ bool mesh_crypto_aes_ccm_decrypt(const uint8_t nonce[13], const uint8_t key[16],
 	bool result;
 	size_t out_msg_len = enc_msg_len - mic_size;
 
-	cipher = l_aead_cipher_new(L_AEAD_CIPHER_AES_CCM, key, 16, mic_size);
+	cipher = ctx_get(CRYPTO_CTX_CCM, key, mic_size);
+	if (!cipher)
+		return false;
 
+	/*
+	 * A failed decryption is the normal outcome of trying the wrong key
+	 * and leaves the cipher usable, so it stays cached.
+	 */
 	result = l_aead_cipher_decrypt(cipher, enc_msg, enc_msg_len,
 							aad, aad_len, nonce, 13,
 							out_msg, out_msg_len);
@@ -124,8 +316,6 @@ bool mesh_crypto_aes_ccm_decrypt(const uint8_t nonce[13], const uint8_t key[16],
 				l_get_be64(enc_msg + enc_msg_len - mic_size);
 	}
 
-	l_aead_cipher_free(cipher);
-
 	return result;
 }
 
@@ -303,7 +493,7 @@ bool mesh_crypto_beacon_cmac(const uint8_t encryption_key[16],
 	memcpy(msg + 1, network_id, 8);
 	l_put_be32(iv_index, msg + 9);
 
-	if (!aes_cmac_one(encryption_key, msg, 13, tmp))
+	if (!aes_cmac_cached(encryption_key, msg, 13, tmp))
 		return false;
 
 	*cmac = l_get_be64(tmp);
@@ -471,7 +661,7 @@ static bool mesh_crypto_pecb(const uint8_t privacy_key[16],
 						uint8_t pecb[16])
 {
 	mesh_crypto_privacy_counter(iv_index, payload, pecb);
-	return aes_ecb_one(privacy_key, pecb, pecb);
+	return aes_ecb_cached(privacy_key, pecb, pecb);
 }
 
 static bool mesh_crypto_network_obfuscate(uint8_t *packet,
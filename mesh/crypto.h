@@ -107,3 +107,5 @@ bool mesh_crypto_check_fcs(const uint8_t *packet, uint8_t packet_len,
 bool mesh_crypto_aes_cmac(const uint8_t key[16], const uint8_t *msg,
 					size_t msg_len, uint8_t res[16]);
 bool mesh_crypto_check_avail(void);
+void mesh_crypto_cache_invalidate(const uint8_t key[16]);
+void mesh_crypto_cache_cleanup(void);
@@ -19,6 +19,7 @@
 #include "mesh/node.h"
 #include "mesh/net.h"
 #include "mesh/net-keys.h"
+#include "mesh/crypto.h"
 #include "mesh/provision.h"
 #include "mesh/model.h"
 #include "mesh/dbus.h"
@@ -353,6 +354,7 @@ void mesh_cleanup(bool signaled)
 	mesh_model_cleanup();
 	mesh_net_cleanup();
 	net_key_cleanup();
+	mesh_crypto_cache_cleanup();
 
 	l_dbus_object_remove_interface(dbus_get_bus(), BLUEZ_MESH_PATH,
 							MESH_NETWORK_INTERFACE);
@@ -400,9 +400,11 @@ static int app_packet_decrypt(struct mesh_net *net, const uint8_t *data,
 				uint8_t key_aid, uint32_t seq,
 				uint32_t iv_idx, uint8_t *out)
 {
-	struct l_queue *app_keys = mesh_net_get_app_keys(net);
+	struct l_queue *app_keys;
 	const struct l_queue_entry *entry;
 
+	/* Only keys whose current or updated AID matches can decrypt */
+	app_keys = mesh_net_get_app_keys_by_aid(net, key_aid);
 	if (!app_keys)
 		return -1;
 
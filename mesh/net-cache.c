@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <ell/ell.h>
+
+#include "mesh/node.h"
+#include "mesh/rpl.h"
+#include "mesh/net-cache.h"
+
+#define RPL_CACHE_MIN	32
+
+struct mesh_msg {
+	uint16_t src;
+	uint32_t seq;
+	uint32_t mic;
+};
+
+/*
+ * Network message cache.
+ *
+ * Messages are kept in a ring in arrival order so that the oldest one is
+ * evicted first once the cache is full, and are additionally indexed by an
+ * open-addressed hash table using linear probing. Each slot holds the ring
+ * position of a message plus one, zero marking an empty slot.
+ */
+struct mesh_msg_cache {
+	struct mesh_msg *ring;
+	uint16_t *slots;
+	unsigned int size;
+	unsigned int count;
+	unsigned int next;
+	unsigned int mask;
+};
+
+/*
+ * Replay protection cache, an open-addressed hash table of entries keyed by
+ * source address. The unassigned address is never a valid source and marks
+ * an empty slot.
+ */
+struct mesh_replay_cache {
+	struct mesh_rpl *table;
+	unsigned int mask;
+	unsigned int count;
+};
+
+static uint32_t hash_mix(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	return h;
+}
+
+static unsigned int msg_hash(const struct mesh_msg_cache *cache, uint16_t src,
+						uint32_t seq, uint32_t mic)
+{
+	return hash_mix(mic ^ (seq * 0x9e3779b1) ^ src) & cache->mask;
+}
+
+static bool msg_match(const struct mesh_msg *msg, uint16_t src, uint32_t seq,
+								uint32_t mic)
+{
+	return msg->mic == mic && msg->seq == seq && msg->src == src;
+}
+
+struct mesh_msg_cache *msg_cache_new(unsigned int size)
+{
+	struct mesh_msg_cache *cache;
+	unsigned int slots = 1;
+
+	if (!size || size > UINT16_MAX)
+		return NULL;
+
+	/* Keep the load factor of the table at or below one half */
+	while (slots < size * 2)
+		slots <<= 1;
+
+	cache = l_new(struct mesh_msg_cache, 1);
+	cache->ring = l_new(struct mesh_msg, size);
+	cache->slots = l_new(uint16_t, slots);
+	cache->size = size;
+	cache->mask = slots - 1;
+
+	return cache;
+}
+
+void msg_cache_free(struct mesh_msg_cache *cache)
+{
+	if (!cache)
+		return;
+
+	l_free(cache->slots);
+	l_free(cache->ring);
+	l_free(cache);
+}
+
+void msg_cache_clear(struct mesh_msg_cache *cache)
+{
+	if (!cache)
+		return;
+
+	memset(cache->slots, 0, (cache->mask + 1) * sizeof(*cache->slots));
+	cache->count = 0;
+	cache->next = 0;
+}
+
+static void msg_slot_remove(struct mesh_msg_cache *cache, unsigned int i)
+{
+	unsigned int j = i;
+
+	/* Shift back any following entry whose probe sequence crosses i */
+	for (;;) {
+		const struct mesh_msg *msg;
+		unsigned int k;
+
+		j = (j + 1) & cache->mask;
+		if (!cache->slots[j])
+			break;
+
+		msg = &cache->ring[cache->slots[j] - 1];
+		k = msg_hash(cache, msg->src, msg->seq, msg->mic);
+
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+
+		cache->slots[i] = cache->slots[j];
+		i = j;
+	}
+
+	cache->slots[i] = 0;
+}
+
+static void msg_evict_oldest(struct mesh_msg_cache *cache)
+{
+	const struct mesh_msg *msg = &cache->ring[cache->next];
+	unsigned int i;
+
+	l_debug("Remove %4.4x + %6.6x + %8.8x", msg->src, msg->seq, msg->mic);
+
+	i = msg_hash(cache, msg->src, msg->seq, msg->mic);
+
+	while (cache->slots[i] != cache->next + 1)
+		i = (i + 1) & cache->mask;
+
+	msg_slot_remove(cache, i);
+	cache->count--;
+}
+
+/*
+ * Return true if the message was already seen, otherwise add it to the
+ * cache, evicting the oldest message when the cache is full.
+ */
+bool msg_cache_seen(struct mesh_msg_cache *cache, uint16_t src, uint32_t seq,
+								uint32_t mic)
+{
+	struct mesh_msg *msg;
+	unsigned int i;
+
+	i = msg_hash(cache, src, seq, mic);
+
+	while (cache->slots[i]) {
+		if (msg_match(&cache->ring[cache->slots[i] - 1], src, seq,
+									mic)) {
+			l_debug("Supressing duplicate %4.4x + %6.6x + %8.8x",
+								src, seq, mic);
+			return true;
+		}
+
+		i = (i + 1) & cache->mask;
+	}
+
+	l_debug("Add %4.4x + %6.6x + %8.8x", src, seq, mic);
+
+	if (cache->count == cache->size) {
+		msg_evict_oldest(cache);
+
+		/* Removal may have shifted entries, probe again */
+		i = msg_hash(cache, src, seq, mic);
+
+		while (cache->slots[i])
+			i = (i + 1) & cache->mask;
+	}
+
+	msg = &cache->ring[cache->next];
+	msg->src = src;
+	msg->seq = seq;
+	msg->mic = mic;
+
+	cache->slots[i] = cache->next + 1;
+	cache->next = (cache->next + 1) % cache->size;
+	cache->count++;
+
+	return false;
+}
+
+static unsigned int rpl_hash(const struct mesh_replay_cache *cache,
+								uint16_t src)
+{
+	return hash_mix(src * 0x9e3779b1) & cache->mask;
+}
+
+static struct mesh_rpl *rpl_slot(struct mesh_replay_cache *cache,
+								uint16_t src)
+{
+	unsigned int i = rpl_hash(cache, src);
+
+	while (cache->table[i].src && cache->table[i].src != src)
+		i = (i + 1) & cache->mask;
+
+	return &cache->table[i];
+}
+
+static void rpl_rebuild(struct mesh_replay_cache *cache, unsigned int size,
+							uint32_t min_iv_index)
+{
+	struct mesh_rpl *old = cache->table;
+	unsigned int old_size = cache->mask + 1;
+	unsigned int i;
+
+	cache->table = l_new(struct mesh_rpl, size);
+	cache->mask = size - 1;
+	cache->count = 0;
+
+	for (i = 0; i < old_size; i++) {
+		if (!old[i].src || old[i].iv_index < min_iv_index)
+			continue;
+
+		*rpl_slot(cache, old[i].src) = old[i];
+		cache->count++;
+	}
+
+	l_free(old);
+}
+
+struct mesh_replay_cache *replay_cache_new(void)
+{
+	struct mesh_replay_cache *cache;
+
+	cache = l_new(struct mesh_replay_cache, 1);
+	cache->table = l_new(struct mesh_rpl, RPL_CACHE_MIN);
+	cache->mask = RPL_CACHE_MIN - 1;
+
+	return cache;
+}
+
+void replay_cache_free(struct mesh_replay_cache *cache)
+{
+	if (!cache)
+		return;
+
+	l_free(cache->table);
+	l_free(cache);
+}
+
+struct mesh_rpl *replay_cache_find(struct mesh_replay_cache *cache,
+								uint16_t src)
+{
+	struct mesh_rpl *rpe;
+
+	if (!cache || !src)
+		return NULL;
+
+	rpe = rpl_slot(cache, src);
+
+	return rpe->src ? rpe : NULL;
+}
+
+/*
+ * Look up the entry for src, creating a zeroed one if needed. The returned
+ * entry is only valid until the next call modifying the cache.
+ */
+struct mesh_rpl *replay_cache_add(struct mesh_replay_cache *cache,
+								uint16_t src)
+{
+	struct mesh_rpl *rpe;
+
+	if (!cache || !src)
+		return NULL;
+
+	rpe = rpl_slot(cache, src);
+	if (rpe->src)
+		return rpe;
+
+	if ((cache->count + 1) * 2 > cache->mask + 1) {
+		rpl_rebuild(cache, (cache->mask + 1) * 2, 0);
+		rpe = rpl_slot(cache, src);
+	}
+
+	rpe->src = src;
+	rpe->iv_index = 0;
+	rpe->seq = 0;
+	cache->count++;
+
+	return rpe;
+}
+
+unsigned int replay_cache_length(struct mesh_replay_cache *cache)
+{
+	return cache ? cache->count : 0;
+}
+
+/*
+ * Drop the entries recorded more than one IV Index ago and return how many
+ * were removed.
+ */
+unsigned int replay_cache_clean(struct mesh_replay_cache *cache,
+							uint32_t iv_index)
+{
+	unsigned int i, count = 0;
+
+	if (!cache || iv_index < 2)
+		return 0;
+
+	for (i = 0; i <= cache->mask; i++) {
+		if (cache->table[i].src &&
+				cache->table[i].iv_index < iv_index - 1)
+			count++;
+	}
+
+	if (count)
+		rpl_rebuild(cache, cache->mask + 1, iv_index - 1);
+
+	return count;
+}
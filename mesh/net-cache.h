@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+struct mesh_rpl;
+struct mesh_msg_cache;
+struct mesh_replay_cache;
+
+struct mesh_msg_cache *msg_cache_new(unsigned int size);
+void msg_cache_free(struct mesh_msg_cache *cache);
+void msg_cache_clear(struct mesh_msg_cache *cache);
+bool msg_cache_seen(struct mesh_msg_cache *cache, uint16_t src, uint32_t seq,
+								uint32_t mic);
+
+struct mesh_replay_cache *replay_cache_new(void);
+void replay_cache_free(struct mesh_replay_cache *cache);
+struct mesh_rpl *replay_cache_find(struct mesh_replay_cache *cache,
+								uint16_t src);
+struct mesh_rpl *replay_cache_add(struct mesh_replay_cache *cache,
+								uint16_t src);
+unsigned int replay_cache_length(struct mesh_replay_cache *cache);
+unsigned int replay_cache_clean(struct mesh_replay_cache *cache,
+							uint32_t iv_index);
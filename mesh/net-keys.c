@@ -27,6 +27,11 @@
 /* This allows daemon to skip decryption on recently seen beacons */
 #define BEACON_CACHE_MAX	10
 
+/* Relayed copies of a packet often arrive interleaved with other traffic */
+#define DECODE_CACHE_MAX	8
+
+#define NID_MASK		0x7f
+
 struct beacon_rx {
 	uint8_t data[28];
 	uint32_t id;
@@ -67,17 +72,36 @@ struct net_key {
 	bool ivu;
 };
 
+struct decode_cache {
+	uint8_t pkt[29];
+	uint8_t plain[29];
+	size_t len;
+	size_t plainlen;
+	uint32_t id;
+	uint32_t iv_index;
+};
+
 static struct l_queue *beacons;
 static struct l_queue *keys;
 static uint32_t last_flooding_id;
 
+/* Keys in the same order as in keys, bucketed by NID */
+static struct l_queue *nid_keys[NID_MASK + 1];
+
 /* To avoid re-decrypting same packet for multiple nodes, cache and check */
-static uint8_t cache_pkt[29];
-static uint8_t cache_plain[29];
-static size_t cache_len;
-static size_t cache_plainlen;
-static uint32_t cache_id;
-static uint32_t cache_iv_index;
+static struct decode_cache decode_cache[DECODE_CACHE_MAX];
+static unsigned int decode_next;
+
+static void release_key(struct net_key *key)
+{
+	mesh_crypto_cache_invalidate(key->enc_key);
+	mesh_crypto_cache_invalidate(key->prv_key);
+
+	if (!key->friend_key) {
+		mesh_crypto_cache_invalidate(key->snb_key);
+		mesh_crypto_cache_invalidate(key->pvt_key);
+	}
+}
 
 static bool match_flooding(const void *a, const void *b)
 {
@@ -143,6 +167,12 @@ uint32_t net_key_add(const uint8_t flooding[16])
 
 	key->id = ++last_flooding_id;
 	l_queue_push_tail(keys, key);
+
+	if (!nid_keys[key->nid])
+		nid_keys[key->nid] = l_queue_new();
+
+	l_queue_push_tail(nid_keys[key->nid], key);
+
 	return key->id;
 
 fail:
@@ -182,9 +212,24 @@ uint32_t net_key_frnd_add(uint32_t flooding_id, uint16_t lpn, uint16_t frnd,
 	frnd_key->id = ++last_flooding_id;
 	l_queue_push_head(keys, frnd_key);
 
+	if (!nid_keys[frnd_key->nid])
+		nid_keys[frnd_key->nid] = l_queue_new();
+
+	l_queue_push_head(nid_keys[frnd_key->nid], frnd_key);
+
 	return frnd_key->id;
 }
 
+static void decode_cache_invalidate(uint32_t id)
+{
+	unsigned int i;
+
+	for (i = 0; i < DECODE_CACHE_MAX; i++) {
+		if (decode_cache[i].id == id)
+			decode_cache[i].id = 0;
+	}
+}
+
 void net_key_unref(uint32_t id)
 {
 	struct net_key *key = l_queue_find(keys, match_id, L_UINT_TO_PTR(id));
@@ -193,6 +238,9 @@ void net_key_unref(uint32_t id)
 		if (--key->ref_cnt == 0) {
 			l_timeout_remove(key->observe.timeout);
 			l_queue_remove(keys, key);
+			l_queue_remove(nid_keys[key->nid], key);
+			decode_cache_invalidate(key->id);
+			release_key(key);
 			l_free(key);
 		}
 	}
@@ -223,51 +271,71 @@ bool net_key_retrieve(uint32_t id, uint8_t *flooding)
 static void decrypt_net_pkt(void *a, void *b)
 {
 	const struct net_key *key = a;
+	struct decode_cache *cache = b;
 	bool result;
 
-	if (cache_id || !key->ref_cnt || (cache_pkt[0] & 0x7f) != key->nid)
+	if (cache->id || !key->ref_cnt)
 		return;
 
-	result = mesh_crypto_packet_decode(cache_pkt, cache_len, false,
-						cache_plain, cache_iv_index,
+	result = mesh_crypto_packet_decode(cache->pkt, cache->len, false,
+						cache->plain, cache->iv_index,
 						key->enc_key, key->prv_key);
 
 	if (result) {
-		cache_id = key->id;
-		if (cache_plain[1] & 0x80)
-			cache_plainlen = cache_len - 8;
+		cache->id = key->id;
+		if (cache->plain[1] & 0x80)
+			cache->plainlen = cache->len - 8;
 		else
-			cache_plainlen = cache_len - 4;
+			cache->plainlen = cache->len - 4;
 	}
 }
 
 uint32_t net_key_decrypt(uint32_t iv_index, const uint8_t *pkt, size_t len,
 					uint8_t **plain, size_t *plain_len)
 {
+	struct decode_cache *cache, attempt;
+	unsigned int i;
+
+	if (len > sizeof(cache->pkt))
+		return 0;
+
 	/* If we already successfully decrypted this packet, use cached data */
-	if (cache_id && cache_len == len && !memcmp(pkt, cache_pkt, len)) {
+	for (i = 0; i < DECODE_CACHE_MAX; i++) {
+		cache = &decode_cache[i];
+
+		if (!cache->id || cache->len != len ||
+						memcmp(pkt, cache->pkt, len))
+			continue;
+
 		/* IV Index must match what was used to decrypt */
-		if (cache_iv_index != iv_index)
+		if (cache->iv_index != iv_index)
 			return 0;
 
 		goto done;
 	}
 
-	cache_id = 0;
-	memcpy(cache_pkt, pkt, len);
-	cache_len = len;
-	cache_iv_index = iv_index;
+	attempt.id = 0;
+	memcpy(attempt.pkt, pkt, len);
+	attempt.len = len;
+	attempt.iv_index = iv_index;
 
-	/* Try all network keys known to us */
-	l_queue_foreach(keys, decrypt_net_pkt, NULL);
+	/* Try the network keys known to us with a matching NID */
+	l_queue_foreach(nid_keys[pkt[0] & NID_MASK], decrypt_net_pkt,
+								&attempt);
+
+	/* Only a decoded packet replaces the oldest entry */
+	if (!attempt.id)
+		return 0;
+
+	cache = &decode_cache[decode_next];
+	*cache = attempt;
+	decode_next = (decode_next + 1) % DECODE_CACHE_MAX;
 
 done:
-	if (cache_id) {
-		*plain = cache_plain;
-		*plain_len = cache_plainlen;
-	}
+	*plain = cache->plain;
+	*plain_len = cache->plainlen;
 
-	return cache_id;
+	return cache->id;
 }
 
 bool net_key_encrypt(uint32_t id, uint32_t iv_index, uint8_t *pkt, size_t len)
@@ -783,6 +851,7 @@ static void free_key(void *data)
 {
 	struct net_key *key = data;
 
+	release_key(key);
 	l_timeout_remove(key->mpb_to);
 	l_free(key->snb);
 	l_free(key->mpb);
@@ -791,6 +860,16 @@ static void free_key(void *data)
 
 void net_key_cleanup(void)
 {
+	unsigned int i;
+
+	for (i = 0; i <= NID_MASK; i++) {
+		l_queue_destroy(nid_keys[i], NULL);
+		nid_keys[i] = NULL;
+	}
+
+	memset(decode_cache, 0, sizeof(decode_cache));
+	decode_next = 0;
+
 	l_queue_destroy(keys, free_key);
 	keys = NULL;
 	l_queue_destroy(beacons, l_free);
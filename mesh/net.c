@@ -30,6 +30,7 @@
 #include "mesh/model.h"
 #include "mesh/appkey.h"
 #include "mesh/rpl.h"
+#include "mesh/net-cache.h"
 
 #define abs_diff(a, b) ((a) > (b) ? (a) - (b) : (b) - (a))
 
@@ -96,6 +97,7 @@ struct mesh_net {
 	struct mesh_node *node;
 	struct mesh_prov *prov;
 	struct l_queue *app_keys;
+	struct l_queue *app_aids[KEY_AID_MASK + 1];
 	unsigned int pkt_id;
 	unsigned int bea_id;
 	unsigned int beacon_id;
@@ -134,8 +136,8 @@ struct mesh_net {
 	uint16_t features;
 
 	struct l_queue *subnets;
-	struct l_queue *msg_cache;
-	struct l_queue *replay_cache;
+	struct mesh_msg_cache *msg_cache;
+	struct mesh_replay_cache *replay_cache;
 	struct l_queue *sar_in;
 	struct l_queue *sar_out;
 	struct l_queue *sar_queue;
@@ -145,12 +147,6 @@ struct mesh_net {
 	struct l_queue *destinations;
 };
 
-struct mesh_msg {
-	uint16_t src;
-	uint32_t seq;
-	uint32_t mic;
-};
-
 struct mesh_sar {
 	unsigned int id;
 	struct l_timeout *seg_timeout;
@@ -642,14 +638,14 @@ struct mesh_net *mesh_net_new(struct mesh_node *node)
 	net->tx_interval = DEFAULT_TRANSMIT_INTERVAL;
 
 	net->subnets = l_queue_new();
-	net->msg_cache = l_queue_new();
+	net->msg_cache = msg_cache_new(MSG_CACHE_SIZE);
 	net->sar_in = l_queue_new();
 	net->sar_out = l_queue_new();
 	net->sar_queue = l_queue_new();
 	net->frnd_msgs = l_queue_new();
 	net->destinations = l_queue_new();
 	net->app_keys = l_queue_new();
-	net->replay_cache = l_queue_new();
+	net->replay_cache = replay_cache_new();
 
 	if (!nets)
 		nets = l_queue_new();
@@ -663,13 +659,14 @@ struct mesh_net *mesh_net_new(struct mesh_node *node)
 void mesh_net_free(void *user_data)
 {
 	struct mesh_net *net = user_data;
+	int i;
 
 	if (!net)
 		return;
 
 	l_queue_destroy(net->subnets, subnet_free);
-	l_queue_destroy(net->msg_cache, l_free);
-	l_queue_destroy(net->replay_cache, l_free);
+	msg_cache_free(net->msg_cache);
+	replay_cache_free(net->replay_cache);
 	l_queue_destroy(net->sar_in, mesh_sar_free);
 	l_queue_destroy(net->sar_out, mesh_sar_free);
 	l_queue_destroy(net->sar_queue, mesh_sar_free);
@@ -679,6 +676,9 @@ void mesh_net_free(void *user_data)
 	l_queue_destroy(net->destinations, l_free);
 	l_queue_destroy(net->app_keys, appkey_key_free);
 
+	for (i = 0; i <= KEY_AID_MASK; i++)
+		l_queue_destroy(net->app_aids[i], NULL);
+
 	l_free(net);
 }
 
@@ -1033,51 +1033,10 @@ void mesh_net_set_frnd_seq(struct mesh_net *net, bool seq)
 	net->friend_seq = seq;
 }
 
-static bool match_cache(const void *a, const void *b)
-{
-	const struct mesh_msg *msg = a;
-	const struct mesh_msg *tst = b;
-
-	if (msg->seq != tst->seq || msg->mic != tst->mic ||
-					msg->src != tst->src)
-		return false;
-
-	return true;
-}
-
 static bool msg_in_cache(struct mesh_net *net, uint16_t src, uint32_t seq,
 								uint32_t mic)
 {
-	struct mesh_msg *msg;
-	struct mesh_msg tst = {
-		.src = src,
-		.seq = seq,
-		.mic = mic,
-	};
-
-	msg = l_queue_find(net->msg_cache, match_cache, &tst);
-
-	if (msg) {
-		l_debug("Supressing duplicate %4.4x + %6.6x + %8.8x",
-							src, seq, mic);
-		return true;
-	}
-
-	msg = l_new(struct mesh_msg, 1);
-	*msg = tst;
-	l_queue_push_head(net->msg_cache, msg);
-	l_debug("Add %4.4x + %6.6x + %8.8x", src, seq, mic);
-
-	if (l_queue_length(net->msg_cache) > MSG_CACHE_SIZE) {
-		msg = l_queue_peek_tail(net->msg_cache);
-		/* Remove Tail (oldest msg in cache) */
-		l_debug("Remove %4.4x + %6.6x + %8.8x",
-						msg->src, msg->seq, msg->mic);
-		if (l_queue_remove(net->msg_cache, msg))
-			l_free(msg);
-	}
-
-	return false;
+	return msg_cache_seen(net->msg_cache, src, seq, mic);
 }
 
 static bool match_sar_seq0(const void *a, const void *b)
@@ -1653,30 +1612,6 @@ static void outseg_to(struct l_timeout *seg_timeout, void *user_data)
 					sar->seqZero, sar->last_nak);
 }
 
-static bool match_replay_cache(const void *a, const void *b)
-{
-	const struct mesh_rpl *rpe = a;
-	uint16_t src = L_PTR_TO_UINT(b);
-
-	return src == rpe->src;
-}
-
-static bool clean_old_iv_index(void *a, void *b)
-{
-	struct mesh_rpl *rpe = a;
-	uint32_t iv_index = L_PTR_TO_UINT(b);
-
-	if (iv_index < 2)
-		return false;
-
-	if (rpe->iv_index < iv_index - 1) {
-		l_free(rpe);
-		return true;
-	}
-
-	return false;
-}
-
 static bool msg_check_replay_cache(struct mesh_net *net, uint16_t src,
 				uint16_t crpl, uint32_t seq, uint32_t iv_index)
 {
@@ -1686,8 +1621,7 @@ static bool msg_check_replay_cache(struct mesh_net *net, uint16_t src,
 	if (!net || !net->node)
 		return true;
 
-	rpe = l_queue_find(net->replay_cache, match_replay_cache,
-						L_UINT_TO_PTR(src));
+	rpe = replay_cache_find(net->replay_cache, src);
 
 	if (rpe) {
 		if (iv_index > rpe->iv_index)
@@ -1698,14 +1632,11 @@ static bool msg_check_replay_cache(struct mesh_net *net, uint16_t src,
 			l_debug("Ignoring replayed packet");
 			return true;
 		}
-	} else if (l_queue_length(net->replay_cache) >= crpl) {
+	} else if (replay_cache_length(net->replay_cache) >= crpl) {
 		/* SRC not in Replay Cache... see if there is space for it */
 
-		int ret = l_queue_foreach_remove(net->replay_cache,
-				clean_old_iv_index, L_UINT_TO_PTR(iv_index));
-
 		/* Return true if no space could be freed */
-		if (!ret) {
+		if (!replay_cache_clean(net->replay_cache, iv_index)) {
 			l_debug("Replay cache full");
 			return true;
 		}
@@ -1722,20 +1653,13 @@ static void msg_add_replay_cache(struct mesh_net *net, uint16_t src,
 	if (!net || !net->replay_cache)
 		return;
 
-	rpe = l_queue_remove_if(net->replay_cache, match_replay_cache,
-						L_UINT_TO_PTR(src));
-
-	if (!rpe) {
-		rpe = l_new(struct mesh_rpl, 1);
-		rpe->src = src;
-	}
+	rpe = replay_cache_add(net->replay_cache, src);
+	if (!rpe)
+		return;
 
 	rpe->seq = seq;
 	rpe->iv_index = iv_index;
 	rpl_put_entry(net->node, src, iv_index, seq);
-
-	/* Optimize so that most recent conversations stay earliest in cache */
-	l_queue_push_head(net->replay_cache, rpe);
 }
 
 static bool msg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
@@ -2584,7 +2508,7 @@ static void iv_upd_to(struct l_timeout *upd_timeout, void *user_data)
 							net->iv_index, false);
 		l_queue_foreach(net->subnets, refresh_beacon, net);
 		queue_friend_update(net);
-		l_queue_clear(net->msg_cache, l_free);
+		msg_cache_clear(net->msg_cache);
 		break;
 
 	case IV_UPD_INIT:
@@ -3074,7 +2998,7 @@ bool mesh_net_iv_index_update(struct mesh_net *net)
 		return false;
 
 	l_debug("iv_upd_state = IV_UPD_UPDATING");
-	l_queue_clear(net->msg_cache, l_free);
+	msg_cache_clear(net->msg_cache);
 
 	if (!mesh_config_write_iv_index(node_config_get(net->node),
 						net->iv_index + 1, true))
@@ -3641,6 +3565,60 @@ struct l_queue *mesh_net_get_app_keys(struct mesh_net *net)
 	return net->app_keys;
 }
 
+static void add_app_aid(struct mesh_net *net, uint8_t key_aid, void *app_key)
+{
+	struct l_queue **bucket = &net->app_aids[key_aid & KEY_AID_MASK];
+
+	if (!*bucket)
+		*bucket = l_queue_new();
+
+	l_queue_push_tail(*bucket, app_key);
+}
+
+static void index_app_key(void *a, void *b)
+{
+	struct mesh_app_key *app_key = a;
+	struct mesh_net *net = b;
+	const uint8_t *key, *new_key;
+	uint8_t key_aid, new_key_aid;
+
+	if (appkey_get_key_idx(app_key, &key, &key_aid, &new_key,
+							&new_key_aid) < 0)
+		return;
+
+	add_app_aid(net, key_aid, app_key);
+
+	if (new_key_aid != APP_AID_INVALID && new_key_aid != key_aid)
+		add_app_aid(net, new_key_aid, app_key);
+}
+
+/*
+ * Rebuild the AID index of the application keys. Keys keep their relative
+ * order from the app_keys list and are indexed under both the current and
+ * the updated AID during a Key Refresh.
+ */
+void mesh_net_index_app_keys(struct mesh_net *net)
+{
+	int i;
+
+	if (!net)
+		return;
+
+	for (i = 0; i <= KEY_AID_MASK; i++)
+		l_queue_clear(net->app_aids[i], NULL);
+
+	l_queue_foreach(net->app_keys, index_app_key, net);
+}
+
+struct l_queue *mesh_net_get_app_keys_by_aid(struct mesh_net *net,
+							uint8_t key_aid)
+{
+	if (!net)
+		return NULL;
+
+	return net->app_aids[key_aid & KEY_AID_MASK];
+}
+
 bool mesh_net_have_key(struct mesh_net *net, uint16_t idx)
 {
 	if (!net)
@@ -3871,7 +3849,28 @@ int mesh_net_set_heartbeat_pub(struct mesh_net *net, uint16_t dst,
 	return MESH_STATUS_SUCCESS;
 }
 
+static void load_rpl_entry(void *data, void *user_data)
+{
+	struct mesh_rpl *entry = data;
+	struct mesh_replay_cache *cache = user_data;
+	struct mesh_rpl *rpe;
+
+	rpe = replay_cache_add(cache, entry->src);
+	if (!rpe)
+		return;
+
+	rpe->iv_index = entry->iv_index;
+	rpe->seq = entry->seq;
+}
+
 bool mesh_net_load_rpl(struct mesh_net *net)
 {
-	return rpl_get_list(net->node, net->replay_cache);
+	struct l_queue *rpl_list = l_queue_new();
+	bool result;
+
+	result = rpl_get_list(net->node, rpl_list);
+	l_queue_foreach(rpl_list, load_rpl_entry, net->replay_cache);
+	l_queue_destroy(rpl_list, l_free);
+
+	return result;
 }
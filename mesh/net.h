@@ -259,6 +259,9 @@ bool mesh_net_get_key(struct mesh_net *net, bool new_key, uint16_t idx,
 bool mesh_net_attach(struct mesh_net *net, struct mesh_io *io);
 struct mesh_io *mesh_net_detach(struct mesh_net *net);
 struct l_queue *mesh_net_get_app_keys(struct mesh_net *net);
+void mesh_net_index_app_keys(struct mesh_net *net);
+struct l_queue *mesh_net_get_app_keys_by_aid(struct mesh_net *net,
+							uint8_t key_aid);
 
 void mesh_net_transport_send(struct mesh_net *net, uint32_t net_key_id,
 				uint16_t net_idx, uint32_t iv_index,
@@ -24,6 +24,7 @@
 #include "mesh/mesh.h"
 #include "mesh/net.h"
 #include "mesh/net-keys.h"
+#include "mesh/crypto.h"
 #include "mesh/appkey.h"
 #include "mesh/mesh-config.h"
 #include "mesh/provision.h"
@@ -301,7 +302,9 @@ static void free_node_resources(void *data)
 	l_queue_destroy(node->pages, l_free);
 	mesh_agent_remove(node->agent);
 	mesh_config_release(node->cfg);
+	rpl_release(node);
 	mesh_net_free(node->net);
+	mesh_crypto_cache_invalidate(node->dev_key);
 	l_free(node->storage_dir);
 	l_free(node);
 }
@@ -653,6 +656,8 @@ void node_finalize_candidate(struct mesh_node *node)
 	if (!node)
 		return;
 
+	mesh_crypto_cache_invalidate(node->dev_key);
+
 	if (mesh_config_read_candidate(node->cfg, node->dev_key))
 		mesh_config_finalize_candidate(node->cfg);
 }
@@ -98,6 +98,7 @@ static void acceptor_free(void)
 
 	pb_adv_unreg(prov);
 
+	mesh_crypto_cache_invalidate(prov->s_key);
 	l_free(prov);
 	prov = NULL;
 }
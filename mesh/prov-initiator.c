@@ -122,6 +122,8 @@ static void initiator_free(void)
 
 		if (!prov->server)
 			mesh_send_cancel(&pkt_filter, sizeof(pkt_filter));
+
+		mesh_crypto_cache_invalidate(prov->s_key);
 	}
 
 	pb_adv_unreg(prov);
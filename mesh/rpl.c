@@ -20,6 +20,7 @@
 #include <dirent.h>
 #include <errno.h>
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <ell/ell.h>
@@ -33,92 +34,418 @@
 
 static const char *rpl_dir = "/rpl";
 
-bool rpl_put_entry(struct mesh_node *node, uint16_t src, uint32_t iv_index,
-								uint32_t seq)
+/*
+ * The Replay Protection List is kept in one journal per IV Index, named
+ * rpl/<iv_index>.journal. A journal is a 16 byte header followed by fixed
+ * size records appended through a shared memory mapping, so that storing
+ * an entry does not require any system call. The file is preallocated
+ * with zeros, an all zero record marks unused space.
+ *
+ * Records carry a check byte: one torn by a crash is ignored when the
+ * journal is read back. For a given source, the last record of the most
+ * recent IV Index wins, as with the previous per-source file layout. When
+ * a journal fills up it is compacted to the latest record of each source,
+ * written to a temporary file and renamed over the original.
+ */
+#define RPL_JOURNAL_MAGIC	"MRPL"
+#define RPL_JOURNAL_VERSION	1
+#define RPL_JOURNAL_MIN		4096
+#define RPL_HDR_SIZE		16
+#define RPL_REC_SIZE		8
+#define RPL_REC_CHECK		0x5a
+#define RPL_FLAG_DELETED	0x01
+#define RPL_MAX_SRC		VIRTUAL_ADDRESS_LOW
+
+struct rpl_journal {
+	uint32_t iv_index;
+	uint8_t *map;
+	size_t size;
+	size_t used;
+};
+
+struct rpl_store {
+	char *node_path;
+	struct l_queue *journals;
+};
+
+static struct l_queue *stores;
+
+/* Offset of the latest record of each source, used by compaction */
+static uint32_t *compact_last;
+
+static uint8_t rec_check(const uint8_t *rec)
 {
-	const char *node_path;
-	char src_file[PATH_MAX];
-	char seq_txt[7];
+	uint8_t check = RPL_REC_CHECK;
+	int i;
+
+	for (i = 0; i < RPL_REC_SIZE - 1; i++)
+		check ^= rec[i];
+
+	return check;
+}
+
+static void rec_pack(uint8_t *rec, uint16_t src, uint32_t seq, uint8_t flags)
+{
+	l_put_le16(src, rec);
+	rec[2] = seq;
+	rec[3] = seq >> 8;
+	rec[4] = seq >> 16;
+	rec[5] = flags;
+	rec[6] = 0;
+
+	/* Check byte goes last so a partial record never validates */
+	rec[7] = rec_check(rec);
+}
+
+static bool rec_unpack(const uint8_t *rec, uint16_t *src, uint32_t *seq,
+								uint8_t *flags)
+{
+	if (rec[7] != rec_check(rec))
+		return false;
+
+	*src = l_get_le16(rec);
+	*seq = rec[2] | rec[3] << 8 | rec[4] << 16;
+	*flags = rec[5];
+
+	return IS_UNICAST(*src);
+}
+
+static bool rec_empty(const uint8_t *rec)
+{
+	int i;
+
+	for (i = 0; i < RPL_REC_SIZE; i++) {
+		if (rec[i])
+			return false;
+	}
+
+	return true;
+}
+
+static bool journal_name(const char *name, uint32_t *iv_index)
+{
+	if (strlen(name) != 16 || strcmp(name + 8, ".journal"))
+		return false;
+
+	return sscanf(name, "%08x", iv_index) == 1;
+}
+
+static bool journal_path(char *path, const char *node_path, uint32_t iv_index)
+{
+	if (strlen(node_path) + strlen(rpl_dir) + 30 >= PATH_MAX)
+		return false;
+
+	snprintf(path, PATH_MAX, "%s%s/%8.8x.journal", node_path, rpl_dir,
+								iv_index);
+	return true;
+}
+
+static bool journal_header_valid(const uint8_t *buf, size_t len,
+							uint32_t iv_index)
+{
+	if (len < RPL_HDR_SIZE || (len - RPL_HDR_SIZE) % RPL_REC_SIZE)
+		return false;
+
+	if (memcmp(buf, RPL_JOURNAL_MAGIC, 4) ||
+					buf[4] != RPL_JOURNAL_VERSION)
+		return false;
+
+	return l_get_le32(buf + 8) == iv_index;
+}
+
+/* Atomically replace a journal with the given records */
+static bool journal_write(const char *path, uint32_t iv_index,
+				const uint8_t *recs, size_t len, size_t size)
+{
+	char tmp_path[PATH_MAX];
+	uint8_t hdr[RPL_HDR_SIZE];
 	bool result = false;
-	DIR *dir;
 	int fd;
 
-	if (!IS_UNICAST(src))
+	if (strlen(path) + 5 >= PATH_MAX)
 		return false;
 
-	node_path = node_get_storage_dir(node);
+	snprintf(tmp_path, PATH_MAX, "%s.tmp", path);
 
-	if (strlen(node_path) + strlen(rpl_dir) + 15 >= PATH_MAX)
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		l_error("Failed to create(%d): %s", errno, tmp_path);
 		return false;
+	}
 
-	snprintf(src_file, PATH_MAX, "%s%s/%8.8x", node_path, rpl_dir,
-								iv_index);
-	dir = opendir(src_file);
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, RPL_JOURNAL_MAGIC, 4);
+	hdr[4] = RPL_JOURNAL_VERSION;
+	l_put_le32(iv_index, hdr + 8);
 
-	if (!dir) {
-		if (mkdir(src_file, 0755) != 0)
-			l_error("Failed to create dir: %s", src_file);
-	} else
-		closedir(dir);
+	if (write(fd, hdr, sizeof(hdr)) == sizeof(hdr) &&
+			(!len || write(fd, recs, len) == (ssize_t) len) &&
+			!ftruncate(fd, size) && !fsync(fd))
+		result = true;
+
+	close(fd);
+
+	if (result && !rename(tmp_path, path))
+		return true;
+
+	l_error("Failed to write(%d): %s", errno, path);
+	unlink(tmp_path);
 
-	snprintf(src_file, PATH_MAX, "%s%s/%8.8x/%4.4x", node_path, rpl_dir,
-								iv_index, src);
+	return false;
+}
+
+static struct rpl_journal *journal_map(const char *path, uint32_t iv_index)
+{
+	struct rpl_journal *journal;
+	struct stat st;
+	uint8_t *map;
+	size_t off;
+	int fd;
 
-	fd = open(src_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
-	if (fd >= 0) {
-		snprintf(seq_txt, 7, "%6.6x", seq);
-		if (write(fd, seq_txt, 6) == 6)
-			result = true;
+	fd = open(path, O_RDWR);
+	if (fd < 0)
+		return NULL;
 
+	if (fstat(fd, &st) < 0 || st.st_size < RPL_HDR_SIZE) {
 		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return NULL;
+
+	if (!journal_header_valid(map, st.st_size, iv_index)) {
+		munmap(map, st.st_size);
+		return NULL;
 	}
 
+	journal = l_new(struct rpl_journal, 1);
+	journal->iv_index = iv_index;
+	journal->map = map;
+	journal->size = st.st_size;
+	journal->used = RPL_HDR_SIZE;
+
+	/* Append after the last record, even if it was torn */
+	for (off = RPL_HDR_SIZE; off < journal->size; off += RPL_REC_SIZE) {
+		if (!rec_empty(map + off))
+			journal->used = off + RPL_REC_SIZE;
+	}
+
+	return journal;
+}
+
+static void journal_free(void *data)
+{
+	struct rpl_journal *journal = data;
+
+	munmap(journal->map, journal->size);
+	l_free(journal);
+}
+
+static bool match_journal(const void *a, const void *b)
+{
+	const struct rpl_journal *journal = a;
+	uint32_t iv_index = L_PTR_TO_UINT(b);
+
+	return journal->iv_index == iv_index;
+}
+
+static bool journal_stale(void *data, void *user_data)
+{
+	struct rpl_journal *journal = data;
+	uint32_t cur = L_PTR_TO_UINT(user_data);
+
+	if (journal->iv_index == cur || journal->iv_index == cur - 1)
+		return false;
+
+	journal_free(journal);
+
+	return true;
+}
+
+static bool match_store(const void *a, const void *b)
+{
+	const struct rpl_store *store = a;
+
+	return !strcmp(store->node_path, b);
+}
+
+static struct rpl_store *store_get(struct mesh_node *node)
+{
+	const char *node_path = node_get_storage_dir(node);
+	struct rpl_store *store;
+
+	if (!node_path)
+		return NULL;
+
+	store = l_queue_find(stores, match_store, node_path);
+	if (store)
+		return store;
+
+	store = l_new(struct rpl_store, 1);
+	store->node_path = l_strdup(node_path);
+	store->journals = l_queue_new();
+
+	if (!stores)
+		stores = l_queue_new();
+
+	l_queue_push_tail(stores, store);
+
+	return store;
+}
+
+static struct rpl_journal *journal_get(struct rpl_store *store,
+						uint32_t iv_index, bool create)
+{
+	struct rpl_journal *journal;
+	char path[PATH_MAX];
+
+	journal = l_queue_find(store->journals, match_journal,
+						L_UINT_TO_PTR(iv_index));
+	if (journal)
+		return journal;
+
+	if (!journal_path(path, store->node_path, iv_index))
+		return NULL;
+
+	journal = journal_map(path, iv_index);
+	if (!journal) {
+		if (!create)
+			return NULL;
+
+		/* Missing or unreadable, start a new journal */
+		if (!journal_write(path, iv_index, NULL, 0, RPL_JOURNAL_MIN))
+			return NULL;
+
+		journal = journal_map(path, iv_index);
+		if (!journal)
+			return NULL;
+	}
+
+	l_queue_push_tail(store->journals, journal);
+
+	return journal;
+}
+
+/* Rewrite a journal with only the latest record of each source */
+static bool journal_compact(struct rpl_store *store,
+						struct rpl_journal *journal)
+{
+	struct rpl_journal *compact;
+	char path[PATH_MAX];
+	uint8_t *recs;
+	size_t off, len = 0, size = RPL_JOURNAL_MIN;
+	uint16_t src;
+	uint32_t seq;
+	uint8_t flags;
+	bool result;
+
+	if (!journal_path(path, store->node_path, journal->iv_index))
+		return false;
+
+	if (!compact_last)
+		compact_last = l_new(uint32_t, RPL_MAX_SRC);
+
+	for (off = RPL_HDR_SIZE; off < journal->used; off += RPL_REC_SIZE) {
+		if (!rec_unpack(journal->map + off, &src, &seq, &flags))
+			continue;
+
+		compact_last[src] = (flags & RPL_FLAG_DELETED) ? 0 : off;
+	}
+
+	recs = l_malloc(journal->used - RPL_HDR_SIZE + 1);
+
+	/* Entries are reset as they are copied, leaving the table zeroed */
+	for (off = RPL_HDR_SIZE; off < journal->used; off += RPL_REC_SIZE) {
+		if (!rec_unpack(journal->map + off, &src, &seq, &flags) ||
+						compact_last[src] != off)
+			continue;
+
+		memcpy(recs + len, journal->map + off, RPL_REC_SIZE);
+		len += RPL_REC_SIZE;
+		compact_last[src] = 0;
+	}
+
+	/* Leave at least as much room as the live records take */
+	while (size < RPL_HDR_SIZE + 2 * len)
+		size *= 2;
+
+	result = journal_write(path, journal->iv_index, recs, len, size);
+	l_free(recs);
+
 	if (!result)
 		return false;
 
-	/* Delete RPL entry from old iv_index (if it exists) */
-	iv_index--;
-	snprintf(src_file, PATH_MAX, "%s%s/%8.8x/%4.4x", node_path, rpl_dir,
-								iv_index, src);
-	if (remove(src_file) < 0 && errno != ENOENT)
-		l_error("Failed to remove(%d): %s", errno, src_file);
+	compact = journal_map(path, journal->iv_index);
+	if (!compact)
+		return false;
+
+	munmap(journal->map, journal->size);
+	*journal = *compact;
+	l_free(compact);
 
-	return result;
+	return true;
 }
 
-void rpl_del_entry(struct mesh_node *node, uint16_t src)
+static bool journal_append(struct mesh_node *node, uint32_t iv_index,
+				uint16_t src, uint32_t seq, uint8_t flags)
 {
-	const char *node_path;
-	char rpl_path[PATH_MAX];
-	struct dirent *entry;
-	DIR *dir;
+	struct rpl_journal *journal;
+	struct rpl_store *store;
 
-	if (!IS_UNICAST(src))
-		return;
+	store = store_get(node);
+	if (!store)
+		return false;
 
-	node_path = node_get_storage_dir(node);
+	/* Deleting from a journal which does not exist is a no-op */
+	journal = journal_get(store, iv_index, !(flags & RPL_FLAG_DELETED));
+	if (!journal)
+		return !!(flags & RPL_FLAG_DELETED);
 
-	if (strlen(node_path) + strlen(rpl_dir) + 15 >= PATH_MAX)
-		return;
+	if (journal->used + RPL_REC_SIZE > journal->size &&
+					!journal_compact(store, journal))
+		return false;
 
-	snprintf(rpl_path, PATH_MAX, "%s%s", node_path, rpl_dir);
-	dir = opendir(rpl_path);
+	rec_pack(journal->map + journal->used, src, seq, flags);
+	journal->used += RPL_REC_SIZE;
 
-	if (!dir)
+	return true;
+}
+
+bool rpl_put_entry(struct mesh_node *node, uint16_t src, uint32_t iv_index,
+								uint32_t seq)
+{
+	if (!IS_UNICAST(src))
+		return false;
+
+	/*
+	 * Entries of the previous IV Index are left in place, they are
+	 * superseded by this one when the list is read back.
+	 */
+	return journal_append(node, iv_index, src, seq & SEQ_MASK, 0);
+}
+
+void rpl_del_entry(struct mesh_node *node, uint16_t src)
+{
+	uint32_t iv_index, i;
+
+	if (!IS_UNICAST(src))
 		return;
 
-	/* Remove all instances of src address */
-	while ((entry = readdir(dir)) != NULL) {
-		if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
-			snprintf(rpl_path, PATH_MAX, "%s%s/%s/%4.4x",
-					node_path, rpl_dir, entry->d_name, src);
-			if (remove(rpl_path) < 0)
-				l_error("Failed to remove(%d): %s", errno,
-								rpl_path);
-		}
-	}
+	/*
+	 * Only the journals of the current and previous IV Index are kept,
+	 * during an IV Update the current one is ahead of the reported value.
+	 */
+	iv_index = mesh_net_get_iv_index(node_get_net(node));
 
-	closedir(dir);
+	for (i = iv_index - 1; i != iv_index + 2; i++) {
+		if (!journal_append(node, i, src, 0, RPL_FLAG_DELETED))
+			l_error("Failed to remove %4.4x from RPL %8.8x", src,
+									i);
+	}
 }
 
 static bool match_src(const void *a, const void *b)
@@ -129,6 +456,14 @@ static bool match_src(const void *a, const void *b)
 	return rpl->src == src;
 }
 
+static bool match_iv_index(const void *a, const void *b)
+{
+	const struct mesh_rpl *rpl = a;
+	uint32_t iv_index = L_PTR_TO_UINT(b);
+
+	return rpl->iv_index == iv_index;
+}
+
 static void get_entries(const char *iv_path, struct l_queue *rpl_list)
 {
 	struct mesh_rpl *rpl;
@@ -194,11 +529,89 @@ static void get_entries(const char *iv_path, struct l_queue *rpl_list)
 	closedir(dir);
 }
 
+static void journal_load(const char *path, uint32_t iv_index,
+				struct l_queue *rpl_list, struct mesh_rpl **index)
+{
+	struct stat st;
+	uint8_t *buf;
+	size_t off;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return;
+
+	if (fstat(fd, &st) < 0 || st.st_size < RPL_HDR_SIZE) {
+		close(fd);
+		return;
+	}
+
+	/* The whole journal is read at once */
+	buf = l_malloc(st.st_size);
+
+	if (read(fd, buf, st.st_size) != st.st_size ||
+			!journal_header_valid(buf, st.st_size, iv_index)) {
+		l_error("Failed to read RPL journal: %s", path);
+		goto done;
+	}
+
+	for (off = RPL_HDR_SIZE; off < (size_t) st.st_size;
+							off += RPL_REC_SIZE) {
+		struct mesh_rpl *rpl;
+		uint16_t src;
+		uint32_t seq;
+		uint8_t flags;
+
+		if (!rec_unpack(buf + off, &src, &seq, &flags))
+			continue;
+
+		rpl = index[src];
+
+		if (flags & RPL_FLAG_DELETED) {
+			if (rpl && rpl->iv_index == iv_index) {
+				l_queue_remove(rpl_list, rpl);
+				l_free(rpl);
+				index[src] = NULL;
+			}
+
+			continue;
+		}
+
+		if (!rpl) {
+			rpl = l_new(struct mesh_rpl, 1);
+			rpl->src = src;
+			rpl->iv_index = iv_index;
+			l_queue_push_head(rpl_list, rpl);
+			index[src] = rpl;
+		} else if (rpl->iv_index > iv_index)
+			continue;
+
+		/* Later records and newer IV Indexes replace older entries */
+		rpl->iv_index = iv_index;
+		rpl->seq = seq;
+	}
+
+done:
+	l_free(buf);
+	close(fd);
+}
+
+static void index_entry(void *data, void *user_data)
+{
+	struct mesh_rpl *rpl = data;
+	struct mesh_rpl **index = user_data;
+
+	if (IS_UNICAST(rpl->src))
+		index[rpl->src] = rpl;
+}
+
 bool rpl_get_list(struct mesh_node *node, struct l_queue *rpl_list)
 {
 	const char *node_path;
 	struct dirent *entry;
+	struct mesh_rpl **index;
 	char *rpl_path;
+	uint32_t iv_index;
 	size_t len;
 	DIR *dir;
 
@@ -207,7 +620,7 @@ bool rpl_get_list(struct mesh_node *node, struct l_queue *rpl_list)
 
 	node_path = node_get_storage_dir(node);
 
-	len = strlen(node_path) + strlen(rpl_dir) + 15;
+	len = strlen(node_path) + strlen(rpl_dir) + 30;
 
 	if (len > PATH_MAX)
 		return false;
@@ -223,15 +636,20 @@ bool rpl_get_list(struct mesh_node *node, struct l_queue *rpl_list)
 		return false;
 	}
 
+	index = l_new(struct mesh_rpl *, RPL_MAX_SRC);
+	l_queue_foreach(rpl_list, index_entry, index);
+
 	while ((entry = readdir(dir)) != NULL) {
-		/* RPL sequences are stored in files under iv_indexs */
-		if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
+		/* RPL sequences are stored in journals named by iv_index */
+		if (entry->d_type == DT_REG &&
+				journal_name(entry->d_name, &iv_index)) {
 			snprintf(rpl_path, len, "%s%s/%s",
 					node_path, rpl_dir, entry->d_name);
-			get_entries(rpl_path, rpl_list);
+			journal_load(rpl_path, iv_index, rpl_list, index);
 		}
 	}
 
+	l_free(index);
 	l_free(rpl_path);
 	closedir(dir);
 
@@ -242,6 +660,7 @@ void rpl_update(struct mesh_node *node, uint32_t cur)
 {
 	uint32_t old = cur - 1;
 	const char *node_path;
+	struct rpl_store *store;
 	struct dirent *entry;
 	char path[PATH_MAX];
 	DIR *dir;
@@ -258,6 +677,11 @@ void rpl_update(struct mesh_node *node, uint32_t cur)
 	if (mkdir(path, 0755) != 0 && errno != EEXIST)
 		l_error("Failed to create dir(%d): %s", errno, path);
 
+	store = l_queue_find(stores, match_store, node_path);
+	if (store)
+		l_queue_foreach_remove(store->journals, journal_stale,
+							L_UINT_TO_PTR(cur));
+
 	dir = opendir(path);
 	if (!dir)
 		return;
@@ -279,21 +703,134 @@ void rpl_update(struct mesh_node *node, uint32_t cur)
 					node_path, rpl_dir, entry->d_name);
 				del_path(path);
 			}
+		} else if (entry->d_type == DT_REG) {
+			uint32_t val;
+
+			if (journal_name(entry->d_name, &val) &&
+						(val == cur || val == old))
+				continue;
+
+			/* Delete journals of older iv_index */
+			snprintf(path, PATH_MAX, "%s%s/%s",
+					node_path, rpl_dir, entry->d_name);
+			if (remove(path) < 0)
+				l_error("Failed to remove(%d): %s", errno, path);
 		}
 	}
 
 	closedir(dir);
 }
 
+/*
+ * Move entries from the per-source files used by previous versions,
+ * rpl/<iv_index>/<src>, into journals.
+ */
+static void rpl_migrate(const char *node_path)
+{
+	struct l_queue *rpl_list;
+	struct dirent *entry;
+	char path[PATH_MAX];
+	char *iv_path;
+	uint8_t *recs;
+	size_t len;
+	DIR *dir;
+
+	snprintf(path, PATH_MAX, "%s%s", node_path, rpl_dir);
+	dir = opendir(path);
+	if (!dir)
+		return;
+
+	rpl_list = l_queue_new();
+
+	len = strlen(node_path) + strlen(rpl_dir) + 15;
+	iv_path = l_malloc(len);
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
+			snprintf(iv_path, len, "%s%s/%s",
+					node_path, rpl_dir, entry->d_name);
+			get_entries(iv_path, rpl_list);
+		}
+	}
+
+	l_free(iv_path);
+
+	recs = l_malloc(l_queue_length(rpl_list) * RPL_REC_SIZE + 1);
+
+	while (!l_queue_isempty(rpl_list)) {
+		struct mesh_rpl *rpl = l_queue_peek_head(rpl_list);
+		uint32_t iv_index = rpl->iv_index;
+		size_t len = 0, size = RPL_JOURNAL_MIN;
+
+		while ((rpl = l_queue_remove_if(rpl_list, match_iv_index,
+						L_UINT_TO_PTR(iv_index)))) {
+			rec_pack(recs + len, rpl->src, rpl->seq, 0);
+			len += RPL_REC_SIZE;
+			l_free(rpl);
+		}
+
+		while (size < RPL_HDR_SIZE + 2 * len)
+			size *= 2;
+
+		/* Keep the old tree around if anything could not be saved */
+		if (!journal_path(path, node_path, iv_index) ||
+				!journal_write(path, iv_index, recs, len, size))
+			goto done;
+	}
+
+	rewinddir(dir);
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
+			snprintf(path, PATH_MAX, "%s%s/%s",
+					node_path, rpl_dir, entry->d_name);
+			del_path(path);
+		}
+	}
+
+done:
+	l_queue_destroy(rpl_list, l_free);
+	l_free(recs);
+	closedir(dir);
+}
+
 bool rpl_init(const char *node_path)
 {
 	char path[PATH_MAX];
 
-	if (strlen(node_path) + strlen(rpl_dir) + 15 >= PATH_MAX)
+	if (strlen(node_path) + strlen(rpl_dir) + 30 >= PATH_MAX)
 		return false;
 
 	snprintf(path, PATH_MAX, "%s%s", node_path, rpl_dir);
 	if (mkdir(path, 0755) != 0 && errno != EEXIST)
 		l_error("Failed to create dir(%d): %s", errno, path);
+
+	rpl_migrate(node_path);
+
 	return true;
 }
+
+void rpl_release(struct mesh_node *node)
+{
+	const char *node_path = node_get_storage_dir(node);
+	struct rpl_store *store;
+
+	if (!node_path)
+		return;
+
+	store = l_queue_remove_if(stores, match_store, node_path);
+	if (!store)
+		return;
+
+	l_queue_destroy(store->journals, journal_free);
+	l_free(store->node_path);
+	l_free(store);
+
+	if (l_queue_isempty(stores)) {
+		l_queue_destroy(stores, NULL);
+		stores = NULL;
+
+		l_free(compact_last);
+		compact_last = NULL;
+	}
+}
@@ -1044,7 +1044,8 @@ void analyze_trace(const char *path)
 	unsigned long num_packets = 0;
 	uint32_t format;
 
-	btsnoop_file = btsnoop_open(path, BTSNOOP_FLAG_PKLG_SUPPORT);
+	btsnoop_file = btsnoop_open(path, BTSNOOP_FLAG_PKLG_SUPPORT |
+							BTSNOOP_FLAG_BUFFERED);
 	if (!btsnoop_file)
 		return;
 
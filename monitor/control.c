@@ -21,11 +21,13 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sys/time.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <termios.h>
 #include <fcntl.h>
 #include <linux/filter.h>
@@ -46,11 +48,31 @@
 #include "control.h"
 #include "jlink.h"
 
+#define FLUSH_INTERVAL 1000
+
 static struct btsnoop *btsnoop_file = NULL;
 static bool hcidump_fallback = false;
 static bool decode_control = true;
 static uint16_t filter_index = HCI_DEV_NONE;
 
+struct time_limit {
+	bool set;
+	bool absolute;
+	struct timeval tv;
+};
+
+static struct time_limit range_start;
+static struct time_limit range_end;
+static uint16_t filter_handle = 0xffff;
+static unsigned int num_jobs = 1;
+
+#define CHUNK_RECORDS 20000
+
+struct decode_job {
+	pid_t pid;
+	FILE *out;
+};
+
 struct control_data {
 	uint16_t channel;
 	int fd;
@@ -1465,26 +1487,322 @@ int control_rtt(char *jlink, char *rtt)
 	return 0;
 }
 
+static void flush_callback(int id, void *user_data)
+{
+	/* Do not leave records behind in the buffer when traffic stops */
+	btsnoop_flush(btsnoop_file);
+
+	if (mainloop_modify_timeout(id, FLUSH_INTERVAL) < 0)
+		mainloop_exit_failure();
+}
+
 bool control_writer(const char *path)
 {
-	btsnoop_file = btsnoop_create(path, 0, 0, BTSNOOP_FORMAT_MONITOR);
+	btsnoop_file = btsnoop_create(path, 0, 0, BTSNOOP_FORMAT_MONITOR,
+							BTSNOOP_FLAG_BUFFERED);
+	if (!btsnoop_file)
+		return false;
+
+	if (mainloop_add_timeout(FLUSH_INTERVAL, flush_callback, NULL,
+								NULL) < 0) {
+		btsnoop_unref(btsnoop_file);
+		btsnoop_file = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+void control_cleanup(void)
+{
+	btsnoop_unref(btsnoop_file);
+	btsnoop_file = NULL;
+}
+
+static bool parse_time_limit(const char *str, size_t len,
+						struct time_limit *limit)
+{
+	char buf[32], *end;
+	double secs;
+
+	if (!len)
+		return true;
+
+	if (len >= sizeof(buf))
+		return false;
+
+	memcpy(buf, str, len);
+	buf[len] = '\0';
+
+	/* Absolute times are given as @seconds since the epoch */
+	limit->absolute = buf[0] == '@';
+
+	secs = strtod(buf + limit->absolute, &end);
+	if (end == buf + limit->absolute || *end != '\0' || secs < 0)
+		return false;
+
+	limit->set = true;
+	limit->tv.tv_sec = secs;
+	limit->tv.tv_usec = (secs - limit->tv.tv_sec) * 1000000;
+
+	return true;
+}
+
+bool control_set_time_range(const char *range)
+{
+	const char *sep;
+
+	sep = strchr(range, ',');
+	if (!sep)
+		return parse_time_limit(range, strlen(range), &range_start);
+
+	return parse_time_limit(range, sep - range, &range_start) &&
+		parse_time_limit(sep + 1, strlen(sep + 1), &range_end);
+}
+
+void control_set_handle(uint16_t handle)
+{
+	filter_handle = handle;
+}
+
+static bool resolve_time_limit(const struct time_limit *limit,
+						const struct timeval *first,
+						struct timeval *tv)
+{
+	if (!limit->set)
+		return false;
+
+	if (limit->absolute)
+		*tv = limit->tv;
+	else
+		timeradd(first, &limit->tv, tv);
 
-	return !!btsnoop_file;
+	return true;
+}
+
+static bool apply_filters(struct btsnoop *btsnoop)
+{
+	struct timeval first, start, end;
+	bool has_start, has_end;
+
+	if (filter_handle != 0xffff &&
+			!btsnoop_set_handle_filter(btsnoop, filter_handle))
+		return false;
+
+	if (!range_start.set && !range_end.set)
+		return true;
+
+	if (!btsnoop_get_first_time(btsnoop, &first))
+		timerclear(&first);
+
+	has_start = resolve_time_limit(&range_start, &first, &start);
+	has_end = resolve_time_limit(&range_end, &first, &end);
+
+	return btsnoop_set_time_range(btsnoop, has_start ? &start : NULL,
+						has_end ? &end : NULL);
+}
+
+void control_set_jobs(unsigned int jobs)
+{
+	num_jobs = jobs;
+}
+
+static bool read_hci_record(bool inject)
+{
+	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
+	uint16_t index, opcode, pktlen;
+	struct timeval tv;
+
+	if (!btsnoop_read_hci(btsnoop_file, &tv, &index, &opcode, buf,
+								&pktlen))
+		return false;
+
+	if (opcode == 0xffff)
+		return true;
+
+	packet_monitor(&tv, NULL, index, opcode, buf, pktlen);
+
+	if (inject)
+		ellisys_inject_hci(&tv, index, opcode, buf, pktlen);
+
+	return true;
+}
+
+static void write_fd(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t written;
+
+		written = write(fd, buf, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+
+		buf += written;
+		len -= written;
+	}
+}
+
+static void finish_job(struct decode_job *job, int fd)
+{
+	char buf[8192];
+	size_t len;
+
+	while (waitpid(job->pid, NULL, 0) < 0 && errno == EINTR);
+
+	rewind(job->out);
+
+	while ((len = fread(buf, 1, sizeof(buf), job->out)) > 0)
+		write_fd(fd, buf, len);
+
+	fclose(job->out);
+	job->out = NULL;
+}
+
+/*
+ * Decode the trace with worker processes. The parent walks through all
+ * records with the output suppressed, which is enough to keep the decoder
+ * state (connections, reassembly, frame numbers) up to date. At the start
+ * of each chunk it forks a worker, which inherits that state and decodes
+ * the chunk with output into its own file. Outputs are then written out in
+ * chunk order, which gives exactly the output of a sequential run.
+ */
+static void read_parallel(void)
+{
+	struct decode_job *jobs;
+	unsigned int head = 0, count = 0;
+	int out_fd, null_fd;
+	bool more = true;
+
+	/* Output settings are cached before stdout is redirected */
+	use_color();
+	num_columns();
+
+	fflush(stdout);
+
+	out_fd = dup(STDOUT_FILENO);
+	null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (out_fd < 0 || null_fd < 0) {
+		if (out_fd >= 0)
+			close(out_fd);
+		if (null_fd >= 0)
+			close(null_fd);
+		while (read_hci_record(true));
+		return;
+	}
+
+	dup2(null_fd, STDOUT_FILENO);
+	close(null_fd);
+
+	jobs = new0(struct decode_job, num_jobs);
+	display_quiet = true;
+
+	while (more) {
+		struct decode_job *job;
+		unsigned int i;
+
+		if (count == num_jobs) {
+			finish_job(&jobs[head], out_fd);
+			head = (head + 1) % num_jobs;
+			count--;
+		}
+
+		job = &jobs[(head + count) % num_jobs];
+
+		job->out = tmpfile();
+		if (!job->out)
+			break;
+
+		/* Nothing buffered may leak into the output of the worker */
+		fflush(stdout);
+
+		job->pid = fork();
+		if (job->pid < 0) {
+			fclose(job->out);
+			job->out = NULL;
+			break;
+		}
+
+		if (job->pid == 0) {
+			dup2(fileno(job->out), STDOUT_FILENO);
+			display_quiet = false;
+
+			for (i = 0; i < CHUNK_RECORDS; i++) {
+				if (!read_hci_record(false))
+					break;
+			}
+
+			fflush(stdout);
+			_exit(EXIT_SUCCESS);
+		}
+
+		count++;
+
+		for (i = 0; i < CHUNK_RECORDS && more; i++)
+			more = read_hci_record(true);
+	}
+
+	while (count > 0) {
+		finish_job(&jobs[head], out_fd);
+		head = (head + 1) % num_jobs;
+		count--;
+	}
+
+	free(jobs);
+
+	fflush(stdout);
+	dup2(out_fd, STDOUT_FILENO);
+	close(out_fd);
+
+	display_quiet = false;
+
+	/* Finish sequentially if no more workers could be started */
+	if (more)
+		while (read_hci_record(true));
 }
 
 void control_reader(const char *path, bool pager)
 {
 	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
+	unsigned long flags;
 	uint16_t pktlen;
 	uint32_t format;
 	struct timeval tv;
 
-	btsnoop_file = btsnoop_open(path, BTSNOOP_FLAG_PKLG_SUPPORT);
+	flags = BTSNOOP_FLAG_PKLG_SUPPORT | BTSNOOP_FLAG_BUFFERED;
+
+	/*
+	 * Seeking needs the record index of a memory mapped file, and worker
+	 * processes need a read position that is not shared with the parent.
+	 */
+	if (filter_handle != 0xffff || range_start.set || range_end.set ||
+								num_jobs > 1)
+		flags |= BTSNOOP_FLAG_MMAP;
+
+	btsnoop_file = btsnoop_open(path, flags);
 	if (!btsnoop_file)
 		return;
 
 	format = btsnoop_get_format(btsnoop_file);
 
+	if (format == BTSNOOP_FORMAT_SIMULATOR &&
+			(filter_handle != 0xffff || range_start.set ||
+							range_end.set)) {
+		fprintf(stderr, "Handle and time filters are not supported "
+					"for simulator traces\n");
+		btsnoop_unref(btsnoop_file);
+		return;
+	}
+
+	if ((flags & BTSNOOP_FLAG_MMAP) && format != BTSNOOP_FORMAT_SIMULATOR &&
+					!apply_filters(btsnoop_file)) {
+		fprintf(stderr, "Failed to index '%s'\n", path);
+		btsnoop_unref(btsnoop_file);
+		return;
+	}
+
 	switch (format) {
 	case BTSNOOP_FORMAT_HCI:
 	case BTSNOOP_FORMAT_UART:
@@ -1504,19 +1822,10 @@ void control_reader(const char *path, bool pager)
 	case BTSNOOP_FORMAT_HCI:
 	case BTSNOOP_FORMAT_UART:
 	case BTSNOOP_FORMAT_MONITOR:
-		while (1) {
-			uint16_t index, opcode;
-
-			if (!btsnoop_read_hci(btsnoop_file, &tv, &index,
-							&opcode, buf, &pktlen))
-				break;
-
-			if (opcode == 0xffff)
-				continue;
-
-			packet_monitor(&tv, NULL, index, opcode, buf, pktlen);
-			ellisys_inject_hci(&tv, index, opcode, buf, pktlen);
-		}
+		if (num_jobs > 1 && btsnoop_is_mapped(btsnoop_file))
+			read_parallel();
+		else
+			while (read_hci_record(true));
 		break;
 
 	case BTSNOOP_FORMAT_SIMULATOR:
@@ -1538,6 +1847,89 @@ void control_reader(const char *path, bool pager)
 	btsnoop_unref(btsnoop_file);
 }
 
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) +
+			(now.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+/*
+ * Decode a whole trace with the output going to /dev/null and report the
+ * decoder throughput.
+ */
+int control_bench(const char *path)
+{
+	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
+	unsigned long num_packets = 0;
+	struct timespec start;
+	struct btsnoop *btsnoop;
+	struct timeval tv;
+	uint16_t index, opcode, pktlen;
+	int null_fd, stdout_fd;
+	double secs;
+
+	btsnoop = btsnoop_open(path, BTSNOOP_FLAG_PKLG_SUPPORT |
+							BTSNOOP_FLAG_BUFFERED);
+	if (!btsnoop) {
+		fprintf(stderr, "Failed to open '%s'\n", path);
+		return -EIO;
+	}
+
+	switch (btsnoop_get_format(btsnoop)) {
+	case BTSNOOP_FORMAT_HCI:
+	case BTSNOOP_FORMAT_UART:
+		packet_del_filter(PACKET_FILTER_SHOW_INDEX);
+		break;
+	case BTSNOOP_FORMAT_MONITOR:
+		packet_add_filter(PACKET_FILTER_SHOW_INDEX);
+		break;
+	default:
+		fprintf(stderr, "Unsupported packet format\n");
+		btsnoop_unref(btsnoop);
+		return -EINVAL;
+	}
+
+	null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (null_fd < 0) {
+		btsnoop_unref(btsnoop);
+		return -errno;
+	}
+
+	fflush(stdout);
+	stdout_fd = dup(STDOUT_FILENO);
+	dup2(null_fd, STDOUT_FILENO);
+	close(null_fd);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (btsnoop_read_hci(btsnoop, &tv, &index, &opcode, buf, &pktlen)) {
+		if (opcode == 0xffff)
+			continue;
+
+		packet_monitor(&tv, NULL, index, opcode, buf, pktlen);
+		num_packets++;
+	}
+
+	fflush(stdout);
+	secs = elapsed(&start);
+
+	if (stdout_fd >= 0) {
+		dup2(stdout_fd, STDOUT_FILENO);
+		close(stdout_fd);
+	}
+
+	btsnoop_unref(btsnoop);
+
+	printf("Decoded %lu packets in %.3f seconds (%.0f packets/sec)\n",
+			num_packets, secs, secs > 0 ? num_packets / secs : 0);
+
+	return 0;
+}
+
 int control_tracing(void)
 {
 	packet_add_filter(PACKET_FILTER_SHOW_INDEX);
@@ -13,6 +13,11 @@
 
 bool control_writer(const char *path);
 void control_reader(const char *path, bool pager);
+bool control_set_time_range(const char *range);
+void control_set_handle(uint16_t handle);
+void control_set_jobs(unsigned int jobs);
+int control_bench(const char *path);
+void control_cleanup(void);
 void control_server(const char *path);
 int control_tty(const char *path, unsigned int speed);
 int control_rtt(char *jlink, char *rtt);
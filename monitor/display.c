@@ -28,6 +28,7 @@
 #include "display.h"
 
 static pid_t pager_pid = 0;
+bool display_quiet = false;
 int default_pager_num_columns = FALLBACK_TERMINAL_WIDTH;
 enum monitor_color setting_monitor_color = COLOR_AUTO;
 
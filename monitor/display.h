@@ -41,8 +41,23 @@ void set_monitor_color(enum monitor_color);
 
 #define FALLBACK_TERMINAL_WIDTH 80
 
+/*
+ * When quiet, decoding still runs but nothing is formatted. The arguments
+ * are evaluated anyway so that decoder state evolves exactly as when the
+ * output is shown.
+ */
+extern bool display_quiet;
+
+static inline void display_discard(int dummy, ...)
+{
+}
+
 #define print_indent(indent, color1, prefix, title, color2, fmt, args...) \
 do { \
+	if (display_quiet) { \
+		display_discard(0, prefix, title, ## args); \
+		break; \
+	} \
 	printf("%*c%s%s%s%s" fmt "%s\n", (indent), ' ', \
 		use_color() ? (color1) : "", prefix, title, \
 		use_color() ? (color2) : "", ## args, \
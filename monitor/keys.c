@@ -36,7 +36,7 @@ static struct queue *irk_list;
 
 void keys_setup(void)
 {
-	crypto = bt_crypto_new();
+	crypto = bt_crypto_new_backend(BT_CRYPTO_BACKEND_FAST);
 
 	irk_list = queue_new();
 }
@@ -49,11 +49,18 @@ static void usage(void)
 	printf("\tbtmon [options]\n");
 	printf("options:\n"
 		"\t-r, --read <file>      Read traces in btsnoop format\n"
+		"\t-F, --time-range <start>[,<end>]\n"
+		"\t                       Only read traces within the range,\n"
+		"\t                       in seconds from the first trace or\n"
+		"\t                       since the epoch when prefixed by @\n"
+		"\t-H, --handle <handle>  Only read traces for a connection\n"
+		"\t-j, --jobs <num>       Decode read traces in parallel\n"
 		"\t-w, --write <file>     Save traces in btsnoop format\n"
 		"\t-a, --analyze <file>   Analyze traces in btsnoop format\n"
 		"\t                       If gnuplot is installed on the\n"
                 "\t                       system it will also attempt to plot\n"
 		"\t                       packet latency graph.\n"
+		"\t    --bench <file>     Measure decoding speed of traces\n"
 		"\t-s, --server <socket>  Start monitor server socket\n"
 		"\t-p, --priority <level> Show only priority or lower\n"
 		"\t-i, --index <num>      Show only specified controller\n"
@@ -79,8 +86,12 @@ static void usage(void)
 
 static const struct option main_options[] = {
 	{ "read",      required_argument, NULL, 'r' },
+	{ "time-range", required_argument, NULL, 'F' },
+	{ "handle",    required_argument, NULL, 'H' },
+	{ "jobs",      required_argument, NULL, 'j' },
 	{ "write",     required_argument, NULL, 'w' },
 	{ "analyze",   required_argument, NULL, 'a' },
+	{ "bench",     required_argument, NULL, '%' },
 	{ "server",    required_argument, NULL, 's' },
 	{ "priority",  required_argument, NULL, 'p' },
 	{ "index",     required_argument, NULL, 'i' },
@@ -113,6 +124,7 @@ int main(int argc, char *argv[])
 	const char *reader_path = NULL;
 	const char *writer_path = NULL;
 	const char *analyze_path = NULL;
+	const char *bench_path = NULL;
 	const char *ellisys_server = NULL;
 	const char *tty = NULL;
 	unsigned int tty_speed = B115200;
@@ -120,6 +132,8 @@ int main(int argc, char *argv[])
 	const char *str;
 	char *jlink = NULL;
 	char *rtt = NULL;
+	char *endptr;
+	unsigned long handle, jobs;
 	int exit_status;
 
 	mainloop_init();
@@ -131,7 +145,7 @@ int main(int argc, char *argv[])
 		struct sockaddr_un addr;
 
 		opt = getopt_long(argc, argv,
-				"r:w:a:s:p:i:d:B:V:MNtTSAIE:PJ:R:C:c:vh",
+				"r:F:H:j:w:a:s:p:i:d:B:V:MNtTSAIE:PJ:R:C:c:vh",
 				main_options, NULL);
 		if (opt < 0)
 			break;
@@ -140,12 +154,37 @@ int main(int argc, char *argv[])
 		case 'r':
 			reader_path = optarg;
 			break;
+		case 'F':
+			if (!control_set_time_range(optarg)) {
+				fprintf(stderr, "Invalid time range\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'H':
+			handle = strtoul(optarg, &endptr, 0);
+			if (*endptr != '\0' || handle > 0x0eff) {
+				fprintf(stderr, "Invalid handle\n");
+				return EXIT_FAILURE;
+			}
+			control_set_handle(handle);
+			break;
+		case 'j':
+			jobs = strtoul(optarg, &endptr, 10);
+			if (*endptr != '\0' || !jobs || jobs > 256) {
+				fprintf(stderr, "Invalid number of jobs\n");
+				return EXIT_FAILURE;
+			}
+			control_set_jobs(jobs);
+			break;
 		case 'w':
 			writer_path = optarg;
 			break;
 		case 'a':
 			analyze_path = optarg;
 			break;
+		case '%':
+			bench_path = optarg;
+			break;
 		case 's':
 			if (strlen(optarg) > sizeof(addr.sun_path) - 1) {
 				fprintf(stderr, "Socket name too long\n");
@@ -270,6 +309,12 @@ int main(int argc, char *argv[])
 		return EXIT_SUCCESS;
 	}
 
+	if (bench_path) {
+		if (control_bench(bench_path) < 0)
+			return EXIT_FAILURE;
+		return EXIT_SUCCESS;
+	}
+
 	if (reader_path) {
 		if (ellisys_server)
 			ellisys_enable(ellisys_server, ellisys_port);
@@ -297,6 +342,7 @@ int main(int argc, char *argv[])
 
 	exit_status = mainloop_run_with_signal(signal_callback, NULL);
 
+	control_cleanup();
 	keys_cleanup();
 
 	return exit_status;
@@ -380,6 +380,12 @@ static void print_packet(struct timeval *tv, struct ucred *cred, char ident,
 	int n, ts_len = 0, ts_pos = 0, len = 0, pos = 0;
 	static size_t last_frame;
 
+	if (display_quiet) {
+		if (!channel && index != HCI_DEV_NONE && index < MAX_INDEX)
+			last_frame = index_list[index].frame;
+		return;
+	}
+
 	if (channel) {
 		if (use_color()) {
 			n = sprintf(ts_str + ts_pos, "%s", COLOR_CHANNEL_LABEL);
@@ -9941,6 +9947,50 @@ static const struct opcode_data opcode_table[] = {
 	{ }
 };
 
+/*
+ * Decoder tables are indexed once on first use so that every packet is
+ * dispatched with a direct lookup instead of a scan of the whole table.
+ * Commands are indexed by OCF within each OGF, earlier entries win just
+ * like they did with the scan.
+ */
+static const struct opcode_data **opcode_index[64];
+static bool opcode_index_built;
+
+static void build_opcode_index(void)
+{
+	int i;
+
+	for (i = 0; opcode_table[i].str; i++) {
+		uint16_t ogf = cmd_opcode_ogf(opcode_table[i].opcode);
+		uint16_t ocf = cmd_opcode_ocf(opcode_table[i].opcode);
+
+		if (!opcode_index[ogf]) {
+			opcode_index[ogf] = calloc(1024,
+						sizeof(*opcode_index[ogf]));
+			if (!opcode_index[ogf])
+				continue;
+		}
+
+		if (!opcode_index[ogf][ocf])
+			opcode_index[ogf][ocf] = &opcode_table[i];
+	}
+
+	opcode_index_built = true;
+}
+
+static const struct opcode_data *opcode_lookup(uint16_t opcode)
+{
+	uint16_t ogf = cmd_opcode_ogf(opcode);
+
+	if (!opcode_index_built)
+		build_opcode_index();
+
+	if (!opcode_index[ogf])
+		return NULL;
+
+	return opcode_index[ogf][cmd_opcode_ocf(opcode)];
+}
+
 static const char *get_supported_command(int bit)
 {
 	int i;
@@ -10220,14 +10270,8 @@ static void cmd_complete_evt(struct timeval *tv, uint16_t index,
 	const struct opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
 	char vendor_str[150];
-	int i;
 
-	for (i = 0; opcode_table[i].str; i++) {
-		if (opcode_table[i].opcode == opcode) {
-			opcode_data = &opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = opcode_lookup(opcode);
 
 	if (opcode_data) {
 		if (opcode_data->rsp_func)
@@ -10316,14 +10360,8 @@ static void cmd_status_evt(struct timeval *tv, uint16_t index,
 	const struct opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
 	char vendor_str[150];
-	int i;
 
-	for (i = 0; opcode_table[i].str; i++) {
-		if (opcode_table[i].opcode == opcode) {
-			opcode_data = &opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = opcode_lookup(opcode);
 
 	if (opcode_data) {
 		opcode_color = COLOR_HCI_COMMAND;
@@ -11884,13 +11922,33 @@ static const struct subevent_data le_meta_event_table[] = {
 	{ }
 };
 
+static const struct subevent_data *subevent_index[256];
+static bool subevent_index_built;
+
+static const struct subevent_data *subevent_lookup(uint8_t subevent)
+{
+	int i;
+
+	if (!subevent_index_built) {
+		for (i = 0; le_meta_event_table[i].str; i++) {
+			uint8_t sub = le_meta_event_table[i].subevent;
+
+			if (!subevent_index[sub])
+				subevent_index[sub] = &le_meta_event_table[i];
+		}
+
+		subevent_index_built = true;
+	}
+
+	return subevent_index[subevent];
+}
+
 static void le_meta_event_evt(struct timeval *tv, uint16_t index,
 				const void *data, uint8_t size)
 {
 	uint8_t subevent = *((const uint8_t *) data);
 	struct subevent_data unknown;
-	const struct subevent_data *subevent_data = &unknown;
-	int i;
+	const struct subevent_data *subevent_data;
 
 	unknown.subevent = subevent;
 	unknown.str = "Unknown";
@@ -11898,12 +11956,9 @@ static void le_meta_event_evt(struct timeval *tv, uint16_t index,
 	unknown.size = 0;
 	unknown.fixed = true;
 
-	for (i = 0; le_meta_event_table[i].str; i++) {
-		if (le_meta_event_table[i].subevent == subevent) {
-			subevent_data = &le_meta_event_table[i];
-			break;
-		}
-	}
+	subevent_data = subevent_lookup(subevent);
+	if (!subevent_data)
+		subevent_data = &unknown;
 
 	print_subevent(tv, index, subevent_data, data + 1, size - 1);
 }
@@ -12109,6 +12164,27 @@ static const struct event_data event_table[] = {
 	{ }
 };
 
+static const struct event_data *event_index[256];
+static bool event_index_built;
+
+static const struct event_data *event_lookup(uint8_t event)
+{
+	int i;
+
+	if (!event_index_built) {
+		for (i = 0; event_table[i].str; i++) {
+			uint8_t evt = event_table[i].event;
+
+			if (!event_index[evt])
+				event_index[evt] = &event_table[i];
+		}
+
+		event_index_built = true;
+	}
+
+	return event_index[event];
+}
+
 void packet_new_index(struct timeval *tv, uint16_t index, const char *label,
 				uint8_t type, uint8_t bus, const char *name)
 {
@@ -12264,7 +12340,6 @@ void packet_hci_command(struct timeval *tv, struct ucred *cred, uint16_t index,
 	const struct opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
 	char extra_str[25], vendor_str[150];
-	int i;
 
 	if (index >= MAX_INDEX) {
 		print_field("Invalid index (%d).", index);
@@ -12283,12 +12358,7 @@ void packet_hci_command(struct timeval *tv, struct ucred *cred, uint16_t index,
 	data += HCI_COMMAND_HDR_SIZE;
 	size -= HCI_COMMAND_HDR_SIZE;
 
-	for (i = 0; opcode_table[i].str; i++) {
-		if (opcode_table[i].opcode == opcode) {
-			opcode_data = &opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = opcode_lookup(opcode);
 
 	if (opcode_data) {
 		if (opcode_data->cmd_func)
@@ -12371,7 +12441,6 @@ void packet_hci_event(struct timeval *tv, struct ucred *cred, uint16_t index,
 	const struct event_data *event_data = NULL;
 	const char *event_color, *event_str;
 	char extra_str[25];
-	int i;
 
 	if (index >= MAX_INDEX) {
 		print_field("Invalid index (%d).", index);
@@ -12392,12 +12461,7 @@ void packet_hci_event(struct timeval *tv, struct ucred *cred, uint16_t index,
 	data += HCI_EVENT_HDR_SIZE;
 	size -= HCI_EVENT_HDR_SIZE;
 
-	for (i = 0; event_table[i].str; i++) {
-		if (event_table[i].event == hdr->evt) {
-			event_data = &event_table[i];
-			break;
-		}
-	}
+	event_data = event_lookup(hdr->evt);
 
 	if (event_data) {
 		if (event_data->func)
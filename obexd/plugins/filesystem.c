@@ -300,6 +300,20 @@ static ssize_t filesystem_read(void *object, void *buf, size_t count)
 	return ret;
 }
 
+static int filesystem_get_fd(void *object)
+{
+	int fd = GPOINTER_TO_INT(object);
+	struct stat st;
+
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	if (!S_ISREG(st.st_mode))
+		return -ENOTSUP;
+
+	return fd;
+}
+
 static ssize_t filesystem_write(void *object, const void *buf, size_t count)
 {
 	ssize_t ret;
@@ -773,6 +787,7 @@ static struct obex_mime_type_driver opp_file = {
 	.open = opp_filesystem_open,
 	.close = filesystem_close,
 	.read = filesystem_read,
+	.get_fd = filesystem_get_fd,
 	.write = filesystem_write,
 };
 
@@ -782,6 +797,7 @@ static struct obex_mime_type_driver file = {
 	.open = filesystem_open,
 	.close = filesystem_close,
 	.read = filesystem_read,
+	.get_fd = filesystem_get_fd,
 	.write = filesystem_write,
 	.remove = filesystem_remove,
 	.move = filesystem_rename,
@@ -28,6 +28,8 @@
 #include "gobex/gobex.h"
 #include "gobex/gobex-apparam.h"
 
+#include "src/shared/ringbuf.h"
+
 #include "obexd/src/obexd.h"
 #include "obexd/src/plugin.h"
 #include "obexd/src/log.h"
@@ -52,11 +54,21 @@
 #define PHONEBOOKSIZE_TAG	0X08
 #define NEWMISSEDCALLS_TAG	0X09
 
+/*
+ * Phonebook parts returned by the backend are queued in a ring, which is
+ * drained as the GET proceeds. The next part is only requested from the
+ * backend once the ring is empty, so its size only has to cover one part
+ * plus the vCard that went over PHONEBOOK_PART_SIZE. It is sized to the
+ * maximum OBEX packet and only grows for backends returning larger parts.
+ */
+#define PULL_RING_SIZE		(64 * 1024)
+
 struct cache {
 	gboolean valid;
 	uint32_t index;
 	gchar *path;
 	GSList *entries;
+	GHashTable *handles;
 };
 
 struct cache_entry {
@@ -77,6 +89,7 @@ struct pbap_session {
 
 struct pbap_object {
 	GString *buffer;
+	struct ringbuf *ring;
 	GObexApparam *apparam;
 	gboolean firstpacket;
 	gboolean lastpart;
@@ -141,16 +154,23 @@ static gboolean entry_tel_find(const struct cache_entry *entry,
 
 static const char *cache_find(struct cache *cache, uint32_t handle)
 {
-	GSList *l;
+	struct cache_entry *entry;
 
-	for (l = cache->entries; l; l = l->next) {
-		struct cache_entry *entry = l->data;
+	if (!cache->handles)
+		return NULL;
 
-		if (entry->handle == handle)
-			return entry->id;
-	}
+	entry = g_hash_table_lookup(cache->handles, GUINT_TO_POINTER(handle));
+	if (!entry)
+		return NULL;
 
-	return NULL;
+	return entry->id;
+}
+
+static void cache_ready(struct cache *cache)
+{
+	/* Entries are prepended as the backend notifies them */
+	cache->entries = g_slist_reverse(cache->entries);
+	cache->valid = TRUE;
 }
 
 static void invalidate_cache(struct cache *cache)
@@ -162,6 +182,65 @@ static void invalidate_cache(struct cache *cache)
 	cache->path = NULL;
 	g_slist_free_full(cache->entries, cache_entry_free);
 	cache->entries = NULL;
+
+	if (cache->handles) {
+		g_hash_table_destroy(cache->handles);
+		cache->handles = NULL;
+	}
+}
+
+static int object_append(struct pbap_object *obj, const char *buffer,
+							size_t bufsize)
+{
+	struct ringbuf *ring;
+	size_t len;
+	void *data;
+
+	if (!obj->ring) {
+		obj->ring = ringbuf_new(MAX(bufsize, PULL_RING_SIZE));
+		if (!obj->ring)
+			return -ENOMEM;
+	}
+
+	if (ringbuf_avail(obj->ring) < bufsize) {
+		ring = ringbuf_new(ringbuf_len(obj->ring) + bufsize);
+		if (!ring)
+			return -ENOMEM;
+
+		DBG("growing ring to %zu bytes", ringbuf_capacity(ring));
+
+		while ((data = ringbuf_peek(obj->ring, 0, &len)) && len) {
+			ringbuf_append(ring, data, len);
+			ringbuf_drain(obj->ring, len);
+		}
+
+		ringbuf_free(obj->ring);
+		obj->ring = ring;
+	}
+
+	if (ringbuf_append(obj->ring, buffer, bufsize) < 0)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static ssize_t object_read(struct pbap_object *obj, void *buf, size_t count)
+{
+	size_t len, total = 0;
+	void *data;
+
+	while (total < count) {
+		data = ringbuf_peek(obj->ring, 0, &len);
+		if (!data || !len)
+			break;
+
+		len = MIN(len, count - total);
+		memcpy(buf + total, data, len);
+		ringbuf_drain(obj->ring, len);
+		total += len;
+	}
+
+	return total;
 }
 
 static void phonebook_size_result(const char *buffer, size_t bufsize,
@@ -219,11 +298,10 @@ static void query_result(const char *buffer, size_t bufsize, int vcards,
 		return;
 	}
 
-	if (!pbap->obj->buffer)
-		pbap->obj->buffer = g_string_new_len(buffer, bufsize);
-	else
-		pbap->obj->buffer = g_string_append_len(pbap->obj->buffer,
-							buffer,	bufsize);
+	if (object_append(pbap->obj, buffer, bufsize) < 0) {
+		obex_object_set_io_flags(pbap->obj, G_IO_ERR, -ENOMEM);
+		return;
+	}
 
 	if (missed > 0)	{
 		DBG("missed %d", missed);
@@ -257,7 +335,16 @@ static void cache_entry_notify(const char *id, uint32_t handle,
 	entry->sound = g_strdup(sound);
 	entry->tel = g_strdup(tel);
 
-	cache->entries = g_slist_append(cache->entries, entry);
+	cache->entries = g_slist_prepend(cache->entries, entry);
+
+	if (!cache->handles)
+		cache->handles = g_hash_table_new(NULL, NULL);
+
+	/* Lookups by handle return the first entry notified */
+	if (!g_hash_table_lookup(cache->handles,
+					GUINT_TO_POINTER(entry->handle)))
+		g_hash_table_insert(cache->handles,
+					GUINT_TO_POINTER(entry->handle), entry);
 }
 
 static int alpha_sort(gconstpointer a, gconstpointer b)
@@ -341,12 +428,16 @@ static GSList *sort_entries(GSList *l, uint8_t order, uint8_t search_attrib,
 		if (searchval && !find(entry, (const char *) searchval))
 			continue;
 
-		sorted = g_slist_insert_sorted(sorted, entry, sort);
+		sorted = g_slist_prepend(sorted, entry);
 	}
 
 	g_free(searchval);
 
-	return sorted;
+	/*
+	 * The merge sort is stable, sorting the reversed list keeps equal
+	 * entries in the order g_slist_insert_sorted() used to put them.
+	 */
+	return g_slist_sort(sorted, sort);
 }
 
 static int generate_response(void *user_data)
@@ -409,7 +500,7 @@ static void cache_ready_notify(void *user_data)
 	phonebook_req_finalize(pbap->obj->request);
 	pbap->obj->request = NULL;
 
-	pbap->cache.valid = TRUE;
+	cache_ready(&pbap->cache);
 
 	generate_response(pbap);
 	obex_object_set_io_flags(pbap->obj, G_IO_IN, 0);
@@ -423,7 +514,7 @@ static void cache_entry_done(void *user_data)
 
 	DBG("");
 
-	pbap->cache.valid = TRUE;
+	cache_ready(&pbap->cache);
 
 	id = cache_find(&pbap->cache, pbap->find_handle);
 	if (id == NULL) {
@@ -757,6 +848,11 @@ static int vobject_close(void *object)
 		obj->buffer = NULL;
 	}
 
+	if (obj->ring) {
+		ringbuf_free(obj->ring);
+		obj->ring = NULL;
+	}
+
 	if (obj->apparam) {
 		g_obex_apparam_free(obj->apparam);
 		obj->apparam = NULL;
@@ -879,7 +975,7 @@ static ssize_t vobject_pull_get_next_header(void *object, void *buf, size_t mtu,
 {
 	struct pbap_object *obj = object;
 
-	if (!obj->buffer && !obj->apparam)
+	if (!obj->ring && !obj->apparam)
 		return -EAGAIN;
 
 	*hi = G_OBEX_HDR_APPARAM;
@@ -899,17 +995,17 @@ static ssize_t vobject_pull_read(void *object, void *buf, size_t count)
 	struct pbap_session *pbap = obj->session;
 	int len, ret;
 
-	DBG("buffer %p maxlistcount %d", obj->buffer,
+	DBG("ring %p maxlistcount %d", obj->ring,
 						pbap->params->maxlistcount);
 
-	if (!obj->buffer) {
+	if (!obj->ring) {
 		if (pbap->params->maxlistcount == 0)
 			return -ENOSTR;
 
 		return -EAGAIN;
 	}
 
-	len = string_read(obj->buffer, buf, count);
+	len = object_read(obj, buf, count);
 	if (len == 0 && !obj->lastpart) {
 		/* in case when buffer is empty and we know that more
 		 * data is still available in backend, requesting new
@@ -963,12 +1059,12 @@ static ssize_t vobject_vcard_read(void *object, void *buf, size_t count)
 {
 	struct pbap_object *obj = object;
 
-	DBG("buffer %p", obj->buffer);
+	DBG("ring %p", obj->ring);
 
-	if (!obj->buffer)
+	if (!obj->ring)
 		return -EAGAIN;
 
-	return string_read(obj->buffer, buf, count);
+	return object_read(obj, buf, count);
 }
 
 static const struct obex_mime_type_driver mime_pull = {
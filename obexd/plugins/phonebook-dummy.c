@@ -41,6 +41,13 @@ struct dummy_data {
 	char *folder;
 	int fd;
 	guint id;
+	gboolean pull;
+	gboolean started;
+	DIR *dp;
+	GSList *vcards;
+	GSList *next;
+	uint16_t count;
+	uint16_t max;
 };
 
 struct cache_query {
@@ -59,6 +66,10 @@ static void dummy_free(void *user_data)
 	if (dummy->fd >= 0)
 		close(dummy->fd);
 
+	if (dummy->dp)
+		closedir(dummy->dp);
+
+	g_slist_free_full(dummy->vcards, g_free);
 	g_free(dummy->folder);
 	g_free(dummy);
 }
@@ -105,22 +116,10 @@ static int handle_cmp(gconstpointer a, gconstpointer b)
 	return (i1 - i2);
 }
 
-static int foreach_vcard(DIR *dp, vcard_func_t func, uint16_t offset,
-			uint16_t maxlistcount, void *user_data, uint16_t *count)
+static GSList *sort_vcards(DIR *dp)
 {
 	struct dirent *ep;
-	GSList *sorted = NULL, *l;
-	VObject *v;
-	FILE *fp;
-	int err, fd, folderfd;
-	uint16_t n = 0;
-
-	folderfd = dirfd(dp);
-	if (folderfd < 0) {
-		err = errno;
-		error("dirfd(): %s(%d)", strerror(err), err);
-		return -err;
-	}
+	GSList *sorted = NULL;
 
 	/*
 	 * Sorting vcards by file name. versionsort is a GNU extension.
@@ -148,30 +147,66 @@ static int foreach_vcard(DIR *dp, vcard_func_t func, uint16_t offset,
 		sorted = g_slist_insert_sorted(sorted, filename, handle_cmp);
 	}
 
+	return sorted;
+}
+
+static int parse_vcard(int folderfd, const char *filename, vcard_func_t func,
+							void *user_data)
+{
+	VObject *v;
+	FILE *fp;
+	int err, fd;
+
+	fd = openat(folderfd, filename, O_RDONLY);
+	if (fd < 0) {
+		err = errno;
+		error("openat(%s): %s(%d)", filename, strerror(err), err);
+		return -err;
+	}
+
+	fp = fdopen(fd, "r");
+	if (fp == NULL) {
+		err = errno;
+		close(fd);
+		return -err;
+	}
+
+	v = Parse_MIME_FromFile(fp);
+	fclose(fp);
+
+	if (v == NULL)
+		return -EINVAL;
+
+	func(filename, v, user_data);
+	deleteVObject(v);
+
+	return 0;
+}
+
+static int foreach_vcard(DIR *dp, vcard_func_t func, uint16_t offset,
+			uint16_t maxlistcount, void *user_data, uint16_t *count)
+{
+	GSList *sorted, *l;
+	int err, folderfd;
+	uint16_t n = 0;
+
+	folderfd = dirfd(dp);
+	if (folderfd < 0) {
+		err = errno;
+		error("dirfd(): %s(%d)", strerror(err), err);
+		return -err;
+	}
+
+	sorted = sort_vcards(dp);
+
 	/*
 	 * Filtering only the requested vCards attributes. Offset
 	 * shall be based on the first entry of the phonebook.
 	 */
 	for (l = g_slist_nth(sorted, offset);
 			l && n < maxlistcount; l = l->next) {
-		const char *filename = l->data;
-
-		fd = openat(folderfd, filename, O_RDONLY);
-		if (fd < 0) {
-			err = errno;
-			error("openat(%s): %s(%d)", filename, strerror(err), err);
-			continue;
-		}
-
-		fp = fdopen(fd, "r");
-		v = Parse_MIME_FromFile(fp);
-		if (v != NULL) {
-			func(filename, v, user_data);
-			deleteVObject(v);
+		if (parse_vcard(folderfd, l->data, func, user_data) == 0)
 			n++;
-		}
-
-		close(fd);
 	}
 
 	g_slist_free_full(sorted, g_free);
@@ -201,20 +236,19 @@ static void entry_concat(const char *filename, VObject *v, void *user_data)
 	g_string_append_len(buffer, tmp, len);
 }
 
-static gboolean read_dir(void *user_data)
+static void entry_count(const char *filename, VObject *v, void *user_data)
 {
-	struct dummy_data *dummy = user_data;
-	GString *buffer;
-	DIR *dp;
-	uint16_t count = 0, max, offset;
+}
 
-	buffer = g_string_new("");
+static void read_dir_start(struct dummy_data *dummy)
+{
+	uint16_t offset;
 
-	dp = opendir(dummy->folder);
-	if (dp == NULL) {
+	dummy->dp = opendir(dummy->folder);
+	if (dummy->dp == NULL) {
 		int err = errno;
 		DBG("opendir(): %s(%d)", strerror(err), err);
-		goto done;
+		return;
 	}
 
 	/*
@@ -224,19 +258,70 @@ static gboolean read_dir(void *user_data)
 	 * other applicattion parameters that may be present in the request.
 	 */
 	if (dummy->apparams->maxlistcount == 0) {
-		max = 0xffff;
+		dummy->max = 0xffff;
 		offset = 0;
 	} else {
-		max = dummy->apparams->maxlistcount;
+		dummy->max = dummy->apparams->maxlistcount;
 		offset = dummy->apparams->liststartoffset;
 	}
 
-	foreach_vcard(dp, entry_concat, offset, max, buffer, &count);
+	dummy->vcards = sort_vcards(dummy->dp);
+	dummy->next = g_slist_nth(dummy->vcards, offset);
+}
+
+/*
+ * vCards are generated as the PBAP core asks for more data, one part of
+ * about PHONEBOOK_PART_SIZE bytes per phonebook_pull_read call. Only the
+ * size is needed when MaxListCount is ZERO, which is returned at once.
+ */
+static gboolean read_dir(void *user_data)
+{
+	struct dummy_data *dummy = user_data;
+	gboolean size_only = dummy->apparams->maxlistcount == 0;
+	gboolean lastpart;
+	GString *buffer;
+	int folderfd = -1;
+
+	if (!dummy->started) {
+		dummy->started = TRUE;
+		read_dir_start(dummy);
+	}
+
+	if (dummy->dp) {
+		folderfd = dirfd(dummy->dp);
+		if (folderfd < 0) {
+			int err = errno;
+			error("dirfd(): %s(%d)", strerror(err), err);
+		}
+	}
+
+	buffer = g_string_new("");
+
+	while (folderfd >= 0 && dummy->next && dummy->count < dummy->max) {
+		const char *filename = dummy->next->data;
+
+		dummy->next = dummy->next->next;
+
+		if (parse_vcard(folderfd, filename,
+					size_only ? entry_count : entry_concat,
+					buffer) == 0)
+			dummy->count++;
+
+		if (!size_only && buffer->len >= PHONEBOOK_PART_SIZE)
+			break;
+	}
+
+	lastpart = folderfd < 0 || !dummy->next || dummy->count >= dummy->max;
+
+	/*
+	 * The PBAP core may finalize the request from the callback, so the
+	 * request must not be touched after calling it.
+	 */
+	dummy->id = 0;
 
-	closedir(dp);
-done:
 	/* FIXME: Missing vCards fields filtering */
-	dummy->cb(buffer->str, buffer->len, count, 0, TRUE, dummy->user_data);
+	dummy->cb(buffer->str, buffer->len, dummy->count, 0, lastpart,
+							dummy->user_data);
 
 	g_string_free(buffer, TRUE);
 
@@ -439,10 +524,17 @@ void phonebook_req_finalize(void *request)
 {
 	struct dummy_data *dummy = request;
 
+	if (!dummy)
+		return;
+
 	/* dummy_data will be cleaned when request will be finished via
 	 * g_source_remove */
-	if (dummy && dummy->id)
+	if (dummy->id)
 		g_source_remove(dummy->id);
+
+	/* Pulls span several parts, so they are freed here instead */
+	if (dummy->pull)
+		dummy_free(dummy);
 }
 
 void *phonebook_pull(const char *name, const struct apparam_field *params,
@@ -481,6 +573,7 @@ void *phonebook_pull(const char *name, const struct apparam_field *params,
 	dummy->apparams = params;
 	dummy->folder = folder;
 	dummy->fd = -1;
+	dummy->pull = TRUE;
 
 	if (err)
 		*err = 0;
@@ -495,8 +588,12 @@ int phonebook_pull_read(void *request)
 	if (!dummy)
 		return -ENOENT;
 
+	/* Part already being generated */
+	if (dummy->id)
+		return 0;
+
 	dummy->id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, read_dir, dummy,
-								dummy_free);
+									NULL);
 
 	return 0;
 }
@@ -59,7 +59,13 @@ struct apparam_field {
  * Interface between the PBAP core and backends to retrieve
  * all contacts that match the application parameters rules.
  * Contacts will be returned in the vcard format.
+ *
+ * Large phonebooks should be returned in parts of about PHONEBOOK_PART_SIZE
+ * bytes with lastpart set to FALSE, the PBAP core requests the next part
+ * with phonebook_pull_read once the previous one has been sent.
  */
+#define PHONEBOOK_PART_SIZE (32 * 1024)
+
 typedef void (*phonebook_cb) (const char *buffer, size_t bufsize,
 		int vcards, int missed, gboolean lastpart, void *user_data);
 
@@ -341,6 +341,43 @@ static ssize_t driver_write(struct obex_session *os)
 	return len;
 }
 
+static ssize_t driver_write_direct(struct obex_session *os, const void *buf,
+								size_t size)
+{
+	size_t len = 0;
+
+	while (len < size) {
+		ssize_t w;
+
+		w = os->driver->write(os->object, (const uint8_t *) buf + len,
+								size - len);
+		if (w == -EINTR)
+			continue;
+
+		if (w < 0) {
+			if (w != -EAGAIN) {
+				error("write(): %s (%zd)", strerror(-w), -w);
+				return w;
+			}
+
+			if (len == 0)
+				return w;
+
+			break;
+		}
+
+		len += w;
+		os->offset += w;
+	}
+
+	DBG("%zu written", len);
+
+	if (os->service->progress != NULL)
+		os->service->progress(os, os->service_data);
+
+	return len;
+}
+
 static gssize driver_read(struct obex_session *os, void *buf, gsize size)
 {
 	gssize len;
@@ -381,6 +418,48 @@ static gssize send_data(void *buf, gsize size, gpointer user_data)
 	return driver_read(os, buf, size);
 }
 
+/* Regular files are sent straight from their descriptor, see send_data */
+static gssize send_fd(int *fd, gsize size, gpointer user_data)
+{
+	struct obex_session *os = user_data;
+	gssize len;
+
+	DBG("name=%s type=%s file=%p size=%zu", os->name, os->type, os->object,
+									size);
+
+	if (os->aborted)
+		return os->err < 0 ? os->err : -EPERM;
+
+	if (os->object == NULL)
+		return -EIO;
+
+	if (os->service->progress != NULL)
+		os->service->progress(os, os->service_data);
+
+	*fd = os->driver->get_fd(os->object);
+	if (*fd < 0)
+		return *fd;
+
+	len = MIN((int64_t) size, os->size - os->offset);
+	os->offset += len;
+
+	DBG("%zd to be sent", len);
+
+	return len;
+}
+
+static gboolean send_fd_supported(struct obex_session *os)
+{
+	if (os->driver->get_fd == NULL)
+		return FALSE;
+
+	/* The size has to be known to tell the end of the body */
+	if (os->size < 0)
+		return FALSE;
+
+	return os->driver->get_fd(os->object) >= 0;
+}
+
 static void transfer_complete(GObex *obex, GError *err, gpointer user_data)
 {
 	struct obex_session *os = user_data;
@@ -456,8 +535,12 @@ done:
 		g_obex_packet_add_header(rsp, hdr);
 	}
 
-	g_obex_get_rsp_pkt(os->obex, rsp, send_data, transfer_complete, os,
-									NULL);
+	if (send_fd_supported(os))
+		g_obex_get_rsp_pkt_fd(os->obex, rsp, send_fd, transfer_complete,
+								os, NULL);
+	else
+		g_obex_get_rsp_pkt(os->obex, rsp, send_data, transfer_complete,
+								os, NULL);
 
 	os->headers_sent = TRUE;
 
@@ -508,6 +591,21 @@ static gboolean recv_data(const void *buf, gsize size, gpointer user_data)
 	if (os->size == OBJECT_SIZE_DELETE)
 		os->size = OBJECT_SIZE_UNKNOWN;
 
+	/* Write straight from the packet unless there is data queued */
+	if (os->pending == 0 && os->object != NULL && os->driver != NULL) {
+		ret = driver_write_direct(os, buf, size);
+		if (ret < 0 && ret != -EAGAIN)
+			return FALSE;
+
+		if (ret == (ssize_t) size)
+			return TRUE;
+
+		if (ret > 0) {
+			buf = (const uint8_t *) buf + ret;
+			size -= ret;
+		}
+	}
+
 	os->buf = g_realloc(os->buf, os->pending + size);
 	memcpy(os->buf + os->pending, buf, size);
 	os->pending += size;
@@ -41,6 +41,7 @@
 #include "src/log.h"
 #include "src/sdpd.h"
 #include "src/textfile.h"
+#include "src/keyfile.h"
 #include "src/shared/queue.h"
 #include "src/shared/timeout.h"
 #include "src/shared/util.h"
@@ -837,9 +838,7 @@ static void store_remote_seps(struct a2dp_channel *chan)
 	char filename[PATH_MAX];
 	char dst_addr[18];
 	GKeyFile *key_file;
-	GError *gerr = NULL;
 	char *data;
-	gsize length = 0;
 
 	ba2str(device_get_address(device), dst_addr);
 
@@ -847,12 +846,7 @@ static void store_remote_seps(struct a2dp_channel *chan)
 			btd_adapter_get_storage_dir(device_get_adapter(device)),
 			dst_addr);
 
-	key_file = g_key_file_new();
-	if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
-		error("Unable to load key file from %s: (%s)", filename,
-								gerr->message);
-		g_clear_error(&gerr);
-	}
+	key_file = btd_keyfile_get(filename);
 
 	data = g_key_file_get_string(key_file, "Endpoints", "LastUsed",
 								NULL);
@@ -868,15 +862,7 @@ static void store_remote_seps(struct a2dp_channel *chan)
 		g_free(data);
 	}
 
-	data = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, data, length, &gerr)) {
-		error("Unable set contents for %s: (%s)", filename,
-								gerr->message);
-		g_error_free(gerr);
-	}
-
-	g_free(data);
-	g_key_file_free(key_file);
+	btd_keyfile_changed(filename);
 }
 
 static void invalidate_remote_cache(struct a2dp_setup *setup,
@@ -1007,12 +993,9 @@ static void store_last_used(struct a2dp_channel *chan, uint8_t lseid,
 							uint8_t rseid)
 {
 	GKeyFile *key_file;
-	GError *gerr = NULL;
 	char filename[PATH_MAX];
 	char dst_addr[18];
 	char value[6];
-	char *data;
-	size_t len = 0;
 
 	ba2str(device_get_address(chan->device), dst_addr);
 
@@ -1020,26 +1003,13 @@ static void store_last_used(struct a2dp_channel *chan, uint8_t lseid,
 		btd_adapter_get_storage_dir(device_get_adapter(chan->device)),
 		dst_addr);
 
-	key_file = g_key_file_new();
-	if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
-		error("Unable to load key file from %s: (%s)", filename,
-								gerr->message);
-		g_clear_error(&gerr);
-	}
+	key_file = btd_keyfile_get(filename);
 
 	sprintf(value, "%02hhx:%02hhx", lseid, rseid);
 
 	g_key_file_set_string(key_file, "Endpoints", "LastUsed", value);
 
-	data = g_key_file_to_data(key_file, &len, NULL);
-	if (!g_file_set_contents(filename, data, len, &gerr)) {
-		error("Unable set contents for %s: (%s)", filename,
-								gerr->message);
-		g_error_free(gerr);
-	}
-
-	g_free(data);
-	g_key_file_free(key_file);
+	btd_keyfile_changed(filename);
 }
 
 static void add_last_used(struct a2dp_channel *chan, struct a2dp_sep *lsep,
@@ -2284,7 +2254,6 @@ static void load_remote_seps(struct a2dp_channel *chan)
 	char dst_addr[18];
 	char **keys;
 	GKeyFile *key_file;
-	GError *gerr = NULL;
 
 	ba2str(device_get_address(device), dst_addr);
 
@@ -2292,18 +2261,12 @@ static void load_remote_seps(struct a2dp_channel *chan)
 			btd_adapter_get_storage_dir(device_get_adapter(device)),
 			dst_addr);
 
-	key_file = g_key_file_new();
-	if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
-		error("Unable to load key file from %s: (%s)", filename,
-								gerr->message);
-		g_error_free(gerr);
-	}
+	key_file = btd_keyfile_get(filename);
 	keys = g_key_file_get_keys(key_file, "Endpoints", NULL, NULL);
 
 	load_remote_sep(chan, key_file, keys);
 
 	g_strfreev(keys);
-	g_key_file_free(key_file);
 }
 
 static void avdtp_state_cb(struct btd_device *dev, struct avdtp *session,
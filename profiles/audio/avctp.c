@@ -338,7 +338,7 @@ static bool auto_release(gpointer user_data)
 static void handle_press(struct avctp *session, uint16_t op)
 {
 	if (session->key.timer > 0) {
-		g_source_remove(session->key.timer);
+		timeout_remove(session->key.timer);
 
 		/* Only auto release if keys are different */
 		if (session->key.op == op)
@@ -40,6 +40,7 @@
 
 #include "log.h"
 #include "textfile.h"
+#include "keyfile.h"
 
 #include "src/shared/mgmt.h"
 #include "src/shared/util.h"
@@ -53,6 +54,7 @@
 #include "sdpd.h"
 #include "adapter.h"
 #include "device.h"
+#include "device-index.h"
 #include "profile.h"
 #include "dbus-common.h"
 #include "error.h"
@@ -306,7 +308,7 @@ struct btd_adapter {
 	struct mgmt_cp_start_service_discovery *current_discovery_filter;
 	struct discovery_client *client;	/* active discovery client */
 
-	GSList *discovery_found;	/* list of found devices */
+	GHashTable *discovery_found;	/* set of found devices */
 	unsigned int discovery_idle_timeout; /* timeout between discovery
 					      * runs
 					      */
@@ -317,7 +319,7 @@ struct btd_adapter {
 	GQueue *auths;			/* Ongoing and pending auths */
 	bool pincode_requested;		/* PIN requested during last bonding */
 	GSList *connections;		/* Connected devices */
-	GSList *devices;		/* Devices structure pointers */
+	struct device_index *devices;	/* Devices structure pointers */
 	GSList *load_keys;		/* Devices keys to be loaded */
 	GSList *connect_list;		/* Devices to connect when found */
 	struct btd_device *connect_le;	/* LE device waiting to be connected */
@@ -747,12 +749,12 @@ static void set_mode_complete(uint8_t status, uint16_t length,
 
 static void remove_temporary_devices(struct btd_adapter *adapter)
 {
-	GSList *l, *next;
+	GList *l, *next;
 
-	for (l = adapter->devices; l; l = next) {
+	for (l = device_index_get_list(adapter->devices); l; l = next) {
 		struct btd_device *dev = l->data;
 
-		next = g_slist_next(l);
+		next = g_list_next(l);
 		if (device_is_temporary(dev))
 			btd_adapter_remove_device(adapter, dev);
 	}
@@ -1015,7 +1017,6 @@ struct btd_device *btd_adapter_find_device(struct btd_adapter *adapter,
 {
 	struct device_addr_type addr;
 	struct btd_device *device;
-	GSList *list;
 
 	if (!adapter)
 		return NULL;
@@ -1023,13 +1024,11 @@ struct btd_device *btd_adapter_find_device(struct btd_adapter *adapter,
 	bacpy(&addr.bdaddr, dst);
 	addr.bdaddr_type = bdaddr_type;
 
-	list = g_slist_find_custom(adapter->devices, &addr,
-							device_addr_type_cmp);
-	if (!list)
+	device = device_index_find(adapter->devices, dst,
+						device_addr_type_cmp, &addr);
+	if (!device)
 		return NULL;
 
-	device = list->data;
-
 	/*
 	 * If we're looking up based on public address and the address
 	 * was not previously used over this bearer we may need to
@@ -1043,28 +1042,13 @@ struct btd_device *btd_adapter_find_device(struct btd_adapter *adapter,
 	return device;
 }
 
-static int device_path_cmp(gconstpointer a, gconstpointer b)
-{
-	const struct btd_device *device = a;
-	const char *path = b;
-	const char *dev_path = device_get_path(device);
-
-	return strcasecmp(dev_path, path);
-}
-
 struct btd_device *btd_adapter_find_device_by_path(struct btd_adapter *adapter,
 						   const char *path)
 {
-	GSList *list;
-
 	if (!adapter)
 		return NULL;
 
-	list = g_slist_find_custom(adapter->devices, path, device_path_cmp);
-	if (!list)
-		return NULL;
-
-	return list->data;
+	return device_index_find_path(adapter->devices, path);
 }
 
 static void uuid_to_uuid128(uuid_t *uuid128, const uuid_t *uuid)
@@ -1430,8 +1414,7 @@ void btd_adapter_remove_device(struct btd_adapter *adapter,
 	adapter_remove_device(adapter, dev);
 	btd_adv_monitor_device_remove(adapter->adv_monitor_manager, dev);
 
-	adapter->discovery_found = g_slist_remove(adapter->discovery_found,
-									dev);
+	g_hash_table_remove(adapter->discovery_found, dev);
 
 	adapter->connections = g_slist_remove(adapter->connections, dev);
 
@@ -1706,9 +1689,10 @@ static void free_discovery_filter(struct discovery_filter *discovery_filter)
 	g_free(discovery_filter);
 }
 
-static void invalidate_rssi_and_tx_power(gpointer a)
+static void invalidate_rssi_and_tx_power(gpointer key, gpointer value,
+							gpointer user_data)
 {
-	struct btd_device *dev = a;
+	struct btd_device *dev = key;
 
 	device_set_rssi(dev, 0);
 	device_set_tx_power(dev, 127);
@@ -1716,7 +1700,7 @@ static void invalidate_rssi_and_tx_power(gpointer a)
 
 static void discovery_cleanup(struct btd_adapter *adapter, int timeout)
 {
-	GSList *l, *next;
+	GList *l, *next;
 
 	adapter->discovery_type = 0x00;
 
@@ -1725,17 +1709,15 @@ static void discovery_cleanup(struct btd_adapter *adapter, int timeout)
 		adapter->discovery_idle_timeout = 0;
 	}
 
-	g_slist_free_full(adapter->discovery_found,
-						invalidate_rssi_and_tx_power);
-	adapter->discovery_found = NULL;
-
-	if (!adapter->devices)
-		return;
+	g_hash_table_foreach(adapter->discovery_found,
+					invalidate_rssi_and_tx_power, NULL);
+	g_hash_table_remove_all(adapter->discovery_found);
 
-	for (l = adapter->devices; l != NULL; l = next) {
+	for (l = device_index_get_list(adapter->devices); l != NULL;
+								l = next) {
 		struct btd_device *dev = l->data;
 
-		next = g_slist_next(l);
+		next = g_list_next(l);
 
 		if (device_is_temporary(dev) && !device_is_connectable(dev))
 			btd_adapter_remove_device(adapter, dev);
@@ -3585,21 +3567,18 @@ static DBusMessage *remove_device(DBusConnection *conn,
 	struct btd_adapter *adapter = user_data;
 	struct btd_device *device;
 	const char *path;
-	GSList *list;
 
 	if (dbus_message_get_args(msg, NULL, DBUS_TYPE_OBJECT_PATH, &path,
 						DBUS_TYPE_INVALID) == FALSE)
 		return btd_error_invalid_args(msg);
 
-	list = g_slist_find_custom(adapter->devices, path, device_path_cmp);
-	if (!list)
+	device = device_index_find_path(adapter->devices, path);
+	if (!device)
 		return btd_error_does_not_exist(msg);
 
 	if (!btd_adapter_get_powered(adapter))
 		return btd_error_not_ready(msg);
 
-	device = list->data;
-
 	btd_device_set_temporary(device, true);
 
 	if (!btd_device_is_connected(device)) {
@@ -3874,7 +3853,8 @@ bool btd_adapter_set_allowed_uuids(struct btd_adapter *adapter,
 	}
 
 	queue_foreach(uuids, add_uuid_to_uuid_set, adapter->allowed_uuid_set);
-	g_slist_foreach(adapter->devices, update_device_allowed_services, NULL);
+	g_list_foreach(device_index_get_list(adapter->devices),
+					update_device_allowed_services, NULL);
 
 	return true;
 }
@@ -4079,8 +4059,6 @@ failed:
 static struct smp_ltk_info *get_ltk_info(GKeyFile *key_file, const char *peer,
 							uint8_t bdaddr_type)
 {
-	DBG("%s", peer);
-
 	return get_ltk(key_file, peer, bdaddr_type, "LongTermKey");
 }
 
@@ -4090,8 +4068,6 @@ static struct smp_ltk_info *get_peripheral_ltk_info(GKeyFile *key_file,
 {
 	struct smp_ltk_info *ltk;
 
-	DBG("%s", peer);
-
 	/* Peripheral* is the proper term, but for now read both entries
 	 * so it won't break when user up/downgrades. Remove the other
 	 * term after a few releases.
@@ -4928,16 +4904,130 @@ done:
 	mgmt_tlv_list_free(list);
 }
 
+/*
+ * Parsing the info file of every bonded device is what dominates startup
+ * with a large number of devices, so it is done by a pool of worker threads
+ * once there are enough of them. Workers only touch their own entry, the
+ * devices are created and the keys are handed to the kernel on the main
+ * thread in directory order.
+ */
+#define LOAD_DEVICES_POOL_MIN		64
+#define LOAD_DEVICES_THREADS_MAX	8
+
+struct device_load {
+	char address[18];
+	char *filename;
+	GKeyFile *key_file;
+	GError *gerr;
+	uint8_t bdaddr_type;
+	bool blocked;
+	struct link_key_info *key_info;
+	struct smp_ltk_info *ltk_info;
+	struct smp_ltk_info *peripheral_ltk_info;
+	struct irk_info *irk_info;
+	struct conn_param *param;
+};
+
+static void device_load_free(gpointer data)
+{
+	struct device_load *load = data;
+
+	g_free(load->key_info);
+	g_free(load->ltk_info);
+	g_free(load->peripheral_ltk_info);
+	g_free(load->irk_info);
+	g_free(load->param);
+	g_clear_error(&load->gerr);
+	g_key_file_free(load->key_file);
+	g_free(load->filename);
+	g_free(load);
+}
+
+static void device_load_parse(gpointer data, gpointer user_data)
+{
+	struct device_load *load = data;
+	const char *peer = load->address;
+
+	load->key_file = g_key_file_new();
+	g_key_file_load_from_file(load->key_file, load->filename, 0,
+								&load->gerr);
+
+	load->bdaddr_type = get_addr_type(load->key_file);
+
+	load->key_info = get_key_info(load->key_file, peer, load->bdaddr_type);
+	load->ltk_info = get_ltk_info(load->key_file, peer, load->bdaddr_type);
+	load->peripheral_ltk_info = get_peripheral_ltk_info(load->key_file,
+							peer,
+							load->bdaddr_type);
+	load->irk_info = get_irk_info(load->key_file, peer, load->bdaddr_type);
+
+	/* If any key for the device is blocked, we discard all */
+	if ((load->key_info && load->key_info->is_blocked) ||
+			(load->ltk_info && load->ltk_info->is_blocked) ||
+			(load->peripheral_ltk_info &&
+				load->peripheral_ltk_info->is_blocked) ||
+			(load->irk_info && load->irk_info->is_blocked)) {
+		g_free(load->key_info);
+		load->key_info = NULL;
+		g_free(load->ltk_info);
+		load->ltk_info = NULL;
+		g_free(load->peripheral_ltk_info);
+		load->peripheral_ltk_info = NULL;
+		g_free(load->irk_info);
+		load->irk_info = NULL;
+		load->blocked = true;
+		return;
+	}
+
+	load->param = get_conn_param(load->key_file, peer, load->bdaddr_type);
+}
+
+static void device_load_parse_all(GPtrArray *loads)
+{
+	GThreadPool *pool = NULL;
+	GError *gerr = NULL;
+	long threads;
+	unsigned int i;
+
+	threads = MIN(sysconf(_SC_NPROCESSORS_ONLN), LOAD_DEVICES_THREADS_MAX);
+
+	/* A single worker would only add overhead */
+	if (loads->len >= LOAD_DEVICES_POOL_MIN && threads > 1) {
+		pool = g_thread_pool_new(device_load_parse, NULL, threads,
+								TRUE, &gerr);
+		if (!pool) {
+			DBG("Unable to create thread pool: %s",
+					gerr ? gerr->message : "unsupported");
+			g_clear_error(&gerr);
+		}
+	}
+
+	if (!pool) {
+		for (i = 0; i < loads->len; i++)
+			device_load_parse(g_ptr_array_index(loads, i), NULL);
+		return;
+	}
+
+	for (i = 0; i < loads->len; i++)
+		g_thread_pool_push(pool, g_ptr_array_index(loads, i), NULL);
+
+	/* Waits for all entries to be parsed */
+	g_thread_pool_free(pool, FALSE, TRUE);
+}
+
 static void load_devices(struct btd_adapter *adapter)
 {
 	char dirname[PATH_MAX];
+	GSList *keys = NULL;
 	GSList *ltks = NULL;
 	GSList *irks = NULL;
 	GSList *params = NULL;
 	GSList *added_devices = NULL;
-	GError *gerr = NULL;
+	GPtrArray *loads;
+	gint64 start;
 	DIR *dir;
 	struct dirent *entry;
+	unsigned int i;
 
 	create_filename(dirname, PATH_MAX, "/%s",
 				btd_adapter_get_storage_dir(adapter));
@@ -4950,17 +5040,12 @@ static void load_devices(struct btd_adapter *adapter)
 		return;
 	}
 
+	start = g_get_monotonic_time();
+
+	loads = g_ptr_array_new_with_free_func(device_load_free);
+
 	while ((entry = readdir(dir)) != NULL) {
-		struct btd_device *device;
-		char filename[PATH_MAX];
-		GKeyFile *key_file;
-		struct link_key_info *key_info;
-		struct smp_ltk_info *ltk_info;
-		struct smp_ltk_info *peripheral_ltk_info;
-		GSList *list;
-		struct irk_info *irk_info;
-		struct conn_param *param;
-		uint8_t bdaddr_type;
+		struct device_load *load;
 
 		if (entry->d_type == DT_UNKNOWN)
 			entry->d_type = util_get_dt(dirname, entry->d_name);
@@ -4968,88 +5053,61 @@ static void load_devices(struct btd_adapter *adapter)
 		if (entry->d_type != DT_DIR || bachk(entry->d_name) < 0)
 			continue;
 
-		create_filename(filename, PATH_MAX, "/%s/%s/info",
-					btd_adapter_get_storage_dir(adapter),
-					entry->d_name);
-
-		key_file = g_key_file_new();
-		if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
-			error("Unable to load key file from %s: (%s)", filename,
-								gerr->message);
-			g_clear_error(&gerr);
-		}
-
-		bdaddr_type = get_addr_type(key_file);
+		load = g_new0(struct device_load, 1);
+		g_strlcpy(load->address, entry->d_name, sizeof(load->address));
+		load->filename = g_strdup_printf("%s/%s/info", dirname,
+								entry->d_name);
 
-		key_info = get_key_info(key_file, entry->d_name, bdaddr_type);
-
-		ltk_info = get_ltk_info(key_file, entry->d_name, bdaddr_type);
-
-		peripheral_ltk_info = get_peripheral_ltk_info(key_file,
-						entry->d_name, bdaddr_type);
+		g_ptr_array_add(loads, load);
+	}
 
-		irk_info = get_irk_info(key_file, entry->d_name, bdaddr_type);
+	closedir(dir);
 
-		// If any key for the device is blocked, we discard all.
-		if ((key_info && key_info->is_blocked) ||
-				(ltk_info && ltk_info->is_blocked) ||
-				(peripheral_ltk_info &&
-					peripheral_ltk_info->is_blocked) ||
-				(irk_info && irk_info->is_blocked)) {
+	device_load_parse_all(loads);
 
-			if (key_info) {
-				g_free(key_info);
-				key_info = NULL;
-			}
+	for (i = 0; i < loads->len; i++) {
+		struct device_load *load = g_ptr_array_index(loads, i);
+		struct btd_device *device;
+		bdaddr_t addr;
 
-			if (ltk_info) {
-				g_free(ltk_info);
-				ltk_info = NULL;
-			}
+		DBG("%s", load->address);
 
-			if (peripheral_ltk_info) {
-				g_free(peripheral_ltk_info);
-				peripheral_ltk_info = NULL;
-			}
+		if (load->gerr)
+			error("Unable to load key file from %s: (%s)",
+					load->filename, load->gerr->message);
 
-			if (irk_info) {
-				g_free(irk_info);
-				irk_info = NULL;
-			}
+		if (load->blocked)
+			continue;
 
-			goto free;
-		}
+		str2ba(load->address, &addr);
 
-		if (key_info)
-			adapter->load_keys = g_slist_append(adapter->load_keys,
-								key_info);
+		/* Lists are built in reverse and put in order below */
+		if (load->key_info)
+			keys = g_slist_prepend(keys, load->key_info);
 
-		if (ltk_info)
-			ltks = g_slist_append(ltks, ltk_info);
+		if (load->ltk_info)
+			ltks = g_slist_prepend(ltks, load->ltk_info);
 
-		if (peripheral_ltk_info)
-			ltks = g_slist_append(ltks, peripheral_ltk_info);
+		if (load->peripheral_ltk_info)
+			ltks = g_slist_prepend(ltks, load->peripheral_ltk_info);
 
-		if (irk_info)
-			irks = g_slist_append(irks, irk_info);
+		if (load->irk_info)
+			irks = g_slist_prepend(irks, load->irk_info);
 
-		param = get_conn_param(key_file, entry->d_name, bdaddr_type);
-		if (param)
-			params = g_slist_append(params, param);
+		if (load->param)
+			params = g_slist_prepend(params, load->param);
 
-		list = g_slist_find_custom(adapter->devices, entry->d_name,
-							device_address_cmp);
-		if (list) {
-			device = list->data;
+		device = device_index_find(adapter->devices, &addr,
+						device_bdaddr_cmp, &addr);
+		if (device)
 			goto device_exist;
-		}
 
-		device = device_create_from_storage(adapter, entry->d_name,
-							key_file);
+		device = device_create_from_storage(adapter, load->address,
+							load->key_file);
 		if (!device)
-			goto free;
+			goto done;
 
-		if (irk_info)
+		if (load->irk_info)
 			device_set_rpa(device, true);
 
 		btd_device_set_temporary(device, false);
@@ -5057,29 +5115,45 @@ static void load_devices(struct btd_adapter *adapter)
 
 		/* TODO: register services from pre-loaded list of primaries */
 
-		added_devices = g_slist_append(added_devices, device);
+		added_devices = g_slist_prepend(added_devices, device);
 
 device_exist:
-		if (key_info) {
+		if (load->key_info) {
 			device_set_paired(device, BDADDR_BREDR);
 			device_set_bonded(device, BDADDR_BREDR);
 		}
 
-free:
-		g_key_file_free(key_file);
+done:
+		/* Keys are now owned by the lists */
+		load->key_info = NULL;
+		load->ltk_info = NULL;
+		load->peripheral_ltk_info = NULL;
+		load->irk_info = NULL;
+		load->param = NULL;
 	}
 
-	closedir(dir);
+	DBG("hci%u loaded %u devices in %" G_GINT64_FORMAT " ms",
+				adapter->dev_id, loads->len,
+				(g_get_monotonic_time() - start) / 1000);
+
+	g_ptr_array_free(loads, TRUE);
+
+	adapter->load_keys = g_slist_concat(adapter->load_keys,
+						g_slist_reverse(keys));
 
 	load_link_keys(adapter, btd_opts.debug_keys, false);
 
+	ltks = g_slist_reverse(ltks);
 	load_ltks(adapter, ltks);
 	g_slist_free_full(ltks, g_free);
+	irks = g_slist_reverse(irks);
 	load_irks(adapter, irks);
 	g_slist_free_full(irks, g_free);
+	params = g_slist_reverse(params);
 	load_conn_params(adapter, params);
 	g_slist_free_full(params, g_free);
 
+	added_devices = g_slist_reverse(added_devices);
 	g_slist_free_full(added_devices, probe_devices);
 }
 
@@ -5183,7 +5257,8 @@ void adapter_add_profile(struct btd_adapter *adapter, gpointer p)
 
 	probe_profile(profile, adapter);
 
-	g_slist_foreach(adapter->devices, device_probe_profile, profile);
+	g_list_foreach(device_index_get_list(adapter->devices),
+					device_probe_profile, profile);
 }
 
 void adapter_remove_profile(struct btd_adapter *adapter, gpointer p)
@@ -5194,7 +5269,8 @@ void adapter_remove_profile(struct btd_adapter *adapter, gpointer p)
 		return;
 
 	if (profile->device_remove)
-		g_slist_foreach(adapter->devices, device_remove_profile, p);
+		g_list_foreach(device_index_get_list(adapter->devices),
+						device_remove_profile, p);
 
 	adapter->profiles = g_slist_remove(adapter->profiles, profile);
 
@@ -5247,14 +5323,15 @@ void device_resolved_drivers(struct btd_adapter *adapter,
 static void adapter_add_device(struct btd_adapter *adapter,
 						struct btd_device *device)
 {
-	adapter->devices = g_slist_append(adapter->devices, device);
+	device_index_add(adapter->devices, device, device_get_path(device),
+						device_get_address(device));
 	device_added_drivers(adapter, device);
 }
 
 static void adapter_remove_device(struct btd_adapter *adapter,
 						struct btd_device *device)
 {
-	adapter->devices = g_slist_remove(adapter->devices, device);
+	device_index_remove(adapter->devices, device);
 	device_removed_drivers(adapter, device);
 }
 
@@ -5265,6 +5342,11 @@ static void adapter_add_connection(struct btd_adapter *adapter,
 {
 	device_add_connection(device, bdaddr_type, flags);
 
+	/* The connection address stays valid for lookups */
+	device_index_set_address(adapter->devices, device,
+					device_get_address(device),
+					device_get_conn_address(device));
+
 	if (g_slist_find(adapter->connections, device)) {
 		btd_error(adapter->dev_id,
 				"Device is already marked as connected");
@@ -5798,13 +5880,13 @@ static void adapter_start(struct btd_adapter *adapter)
 
 static void reply_pending_requests(struct btd_adapter *adapter)
 {
-	GSList *l;
+	GList *l;
 
 	if (!adapter)
 		return;
 
 	/* pending bonding */
-	for (l = adapter->devices; l; l = l->next) {
+	for (l = device_index_get_list(adapter->devices); l; l = l->next) {
 		struct btd_device *device = l->data;
 
 		if (device_is_bonding(device, NULL))
@@ -5894,6 +5976,8 @@ static void adapter_free(gpointer user_data)
 
 	g_queue_foreach(adapter->auths, free_service_auth, NULL);
 	g_queue_free(adapter->auths);
+	device_index_free(adapter->devices);
+	g_hash_table_destroy(adapter->discovery_found);
 	queue_destroy(adapter->exps, NULL);
 
 	queue_destroy(adapter->exp_pending, cancel_exp_pending);
@@ -5964,9 +6048,6 @@ static void convert_names_entry(char *key, char *value, void *user_data)
 	char *str = key;
 	char filename[PATH_MAX];
 	GKeyFile *key_file;
-	GError *gerr = NULL;
-	char *data;
-	gsize length = 0;
 
 	if (strchr(key, '#'))
 		str[17] = '\0';
@@ -5975,25 +6056,11 @@ static void convert_names_entry(char *key, char *value, void *user_data)
 		return;
 
 	create_filename(filename, PATH_MAX, "/%s/cache/%s", address, str);
-	create_file(filename, 0600);
 
-	key_file = g_key_file_new();
-	if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
-		error("Unable to load key file from %s: (%s)", filename,
-								gerr->message);
-		g_clear_error(&gerr);
-	}
+	key_file = btd_keyfile_get(filename);
 	g_key_file_set_string(key_file, "General", "Name", value);
 
-	data = g_key_file_to_data(key_file, &length, NULL);
-	if (!g_file_set_contents(filename, data, length, &gerr)) {
-		error("Unable set contents for %s: (%s)", filename,
-								gerr->message);
-		g_error_free(gerr);
-	}
-	g_free(data);
-
-	g_key_file_free(key_file);
+	btd_keyfile_changed(filename);
 }
 
 struct device_converter {
@@ -6309,36 +6376,16 @@ static void store_sdp_record(char *local, char *peer, int handle, char *value)
 {
 	char filename[PATH_MAX];
 	GKeyFile *key_file;
-	GError *gerr = NULL;
 	char handle_str[11];
-	char *data;
-	gsize length = 0;
 
 	create_filename(filename, PATH_MAX, "/%s/cache/%s", local, peer);
 
-	key_file = g_key_file_new();
-	if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
-		error("Unable to load key file from %s: (%s)", filename,
-								gerr->message);
-		g_clear_error(&gerr);
-	}
+	key_file = btd_keyfile_get(filename);
 
 	sprintf(handle_str, "0x%8.8X", handle);
 	g_key_file_set_string(key_file, "ServiceRecords", handle_str, value);
 
-	data = g_key_file_to_data(key_file, &length, NULL);
-	if (length > 0) {
-		create_file(filename, 0600);
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
-			error("Unable set contents for %s: (%s)", filename,
-								gerr->message);
-			g_error_free(gerr);
-		}
-	}
-
-	g_free(data);
-
-	g_key_file_free(key_file);
+	btd_keyfile_changed(filename);
 }
 
 static void convert_sdp_entry(char *key, char *value, void *user_data)
@@ -6963,6 +7010,8 @@ static struct btd_adapter *btd_adapter_new(uint16_t index)
 			adapter_power_state_str(adapter->power_state));
 
 	adapter->auths = g_queue_new();
+	adapter->devices = device_index_new();
+	adapter->discovery_found = g_hash_table_new(NULL, NULL);
 	adapter->exps = queue_new();
 	adapter->exp_pending = queue_new();
 
@@ -6971,7 +7020,7 @@ static struct btd_adapter *btd_adapter_new(uint16_t index)
 
 static void adapter_remove(struct btd_adapter *adapter)
 {
-	GSList *l;
+	GList *l;
 	struct gatt_db *db;
 
 	DBG("Removing adapter %s", adapter->path);
@@ -6979,13 +7028,13 @@ static void adapter_remove(struct btd_adapter *adapter)
 	g_slist_free(adapter->connect_list);
 	adapter->connect_list = NULL;
 
-	for (l = adapter->devices; l; l = l->next) {
+	for (l = device_index_get_list(adapter->devices); l; l = l->next) {
 		device_removed_drivers(adapter, l->data);
 		device_remove(l->data, FALSE);
 	}
 
-	g_slist_free(adapter->devices);
-	adapter->devices = NULL;
+	device_index_free(adapter->devices);
+	adapter->devices = device_index_new();
 
 	g_slist_free(adapter->load_keys);
 	adapter->load_keys = NULL;
@@ -7408,7 +7457,7 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	if (!adapter->discovery_list)
 		goto connect_le;
 
-	if (g_slist_find(adapter->discovery_found, dev))
+	if (g_hash_table_contains(adapter->discovery_found, dev))
 		return;
 
 	/* If name is unknown but it's not allowed to resolve, don't send
@@ -7417,8 +7466,7 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	if (confirm && (name_known || device_is_name_resolve_allowed(dev)))
 		confirm_name(adapter, bdaddr, bdaddr_type, name_known);
 
-	adapter->discovery_found = g_slist_prepend(adapter->discovery_found,
-									dev);
+	g_hash_table_add(adapter->discovery_found, dev);
 
 	return;
 
@@ -8945,6 +8993,9 @@ static void new_irk_callback(uint16_t index, uint16_t length,
 	}
 
 	device_update_addr(device, &addr->bdaddr, addr->type);
+	device_index_set_address(adapter->devices, device,
+					device_get_address(device),
+					device_get_conn_address(device));
 
 	if (duplicate)
 		device_merge_duplicate(device, duplicate);
@@ -9186,7 +9237,8 @@ void btd_adapter_for_each_device(struct btd_adapter *adapter,
 			void (*cb)(struct btd_device *device, void *data),
 			void *data)
 {
-	g_slist_foreach(adapter->devices, (GFunc) cb, data);
+	g_list_foreach(device_index_get_list(adapter->devices), (GFunc) cb,
+									data);
 }
 
 static int adapter_cmp(gconstpointer a, gconstpointer b)
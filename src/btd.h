@@ -129,6 +129,7 @@ struct btd_opts {
 	bool		refresh_discovery;
 	bool		experimental;
 	bool		testing;
+	bool		buffered_log;
 	struct queue	*kernel;
 
 	uint16_t	did_source;
@@ -142,6 +143,7 @@ struct btd_opts {
 	uint16_t	gatt_mtu;
 	uint8_t		gatt_channels;
 	bool		gatt_client;
+	uint8_t		gatt_write_batch;
 	enum mps_mode_t	mps;
 
 	struct btd_avdtp_opts avdtp;
@@ -0,0 +1,284 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <string.h>
+#include <glib.h>
+
+#include "lib/bluetooth.h"
+
+#include "device-index.h"
+
+/*
+ * Registry of the devices of an adapter.
+ *
+ * Devices are kept in insertion order for iteration and are additionally
+ * hashed by Bluetooth address and by object path. A device is indexed under
+ * its current address and under the address it last connected with, since
+ * both are accepted by device_addr_type_cmp(). Lookups only compare the
+ * few devices sharing an address instead of walking the whole list.
+ */
+struct device_index {
+	GQueue list;
+	GHashTable *entries;
+	GHashTable *addrs;
+	GHashTable *paths;
+	guint64 seq;
+};
+
+struct index_entry {
+	void *data;
+	GList *link;
+	guint64 seq;
+	char *path;
+	bdaddr_t addr[2];
+	unsigned int num_addr;
+};
+
+static guint bdaddr_hash(gconstpointer key)
+{
+	const bdaddr_t *addr = key;
+	guint hash = 2166136261u;
+	int i;
+
+	for (i = 0; i < 6; i++)
+		hash = (hash ^ addr->b[i]) * 16777619u;
+
+	return hash;
+}
+
+static gboolean bdaddr_equal(gconstpointer a, gconstpointer b)
+{
+	return bacmp(a, b) == 0;
+}
+
+static void free_entry(gpointer data)
+{
+	struct index_entry *entry = data;
+
+	g_free(entry->path);
+	g_free(entry);
+}
+
+struct device_index *device_index_new(void)
+{
+	struct device_index *index;
+
+	index = g_new0(struct device_index, 1);
+	g_queue_init(&index->list);
+	index->entries = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+							NULL, free_entry);
+	index->addrs = g_hash_table_new_full(bdaddr_hash, bdaddr_equal,
+				g_free, (GDestroyNotify) g_ptr_array_unref);
+	index->paths = g_hash_table_new(g_str_hash, g_str_equal);
+
+	return index;
+}
+
+void device_index_free(struct device_index *index)
+{
+	if (!index)
+		return;
+
+	g_queue_clear(&index->list);
+	g_hash_table_destroy(index->paths);
+	g_hash_table_destroy(index->addrs);
+	g_hash_table_destroy(index->entries);
+	g_free(index);
+}
+
+static void addr_link(struct device_index *index, struct index_entry *entry,
+							const bdaddr_t *addr)
+{
+	GPtrArray *bucket;
+	bdaddr_t *key;
+
+	if (!bacmp(addr, BDADDR_ANY))
+		return;
+
+	if (entry->num_addr == 1 && !bacmp(addr, &entry->addr[0]))
+		return;
+
+	bacpy(&entry->addr[entry->num_addr++], addr);
+
+	bucket = g_hash_table_lookup(index->addrs, addr);
+	if (!bucket) {
+		key = g_new(bdaddr_t, 1);
+		bacpy(key, addr);
+
+		bucket = g_ptr_array_new();
+		g_hash_table_insert(index->addrs, key, bucket);
+	}
+
+	g_ptr_array_add(bucket, entry);
+}
+
+static void addr_unlink(struct device_index *index, struct index_entry *entry)
+{
+	unsigned int i;
+
+	for (i = 0; i < entry->num_addr; i++) {
+		GPtrArray *bucket;
+
+		bucket = g_hash_table_lookup(index->addrs, &entry->addr[i]);
+		if (!bucket)
+			continue;
+
+		g_ptr_array_remove_fast(bucket, entry);
+
+		if (!bucket->len)
+			g_hash_table_remove(index->addrs, &entry->addr[i]);
+	}
+
+	entry->num_addr = 0;
+}
+
+bool device_index_add(struct device_index *index, void *data,
+				const char *path, const bdaddr_t *addr)
+{
+	struct index_entry *entry;
+
+	if (!index || !data)
+		return false;
+
+	if (g_hash_table_contains(index->entries, data))
+		return false;
+
+	entry = g_new0(struct index_entry, 1);
+	entry->data = data;
+	entry->seq = index->seq++;
+	entry->path = g_ascii_strdown(path, -1);
+
+	g_queue_push_tail(&index->list, data);
+	entry->link = index->list.tail;
+
+	g_hash_table_insert(index->entries, data, entry);
+
+	/* Object paths are unique, the first registered device keeps it */
+	if (!g_hash_table_contains(index->paths, entry->path))
+		g_hash_table_insert(index->paths, entry->path, entry);
+
+	addr_link(index, entry, addr);
+
+	return true;
+}
+
+bool device_index_remove(struct device_index *index, void *data)
+{
+	struct index_entry *entry;
+
+	if (!index)
+		return false;
+
+	entry = g_hash_table_lookup(index->entries, data);
+	if (!entry)
+		return false;
+
+	addr_unlink(index, entry);
+
+	if (g_hash_table_lookup(index->paths, entry->path) == entry)
+		g_hash_table_remove(index->paths, entry->path);
+
+	g_queue_delete_link(&index->list, entry->link);
+
+	g_hash_table_remove(index->entries, data);
+
+	return true;
+}
+
+/*
+ * Re-index a device after its identity address was resolved or after it
+ * connected, conn_addr being the address the connection was made with.
+ */
+void device_index_set_address(struct device_index *index, void *data,
+				const bdaddr_t *addr, const bdaddr_t *conn_addr)
+{
+	struct index_entry *entry;
+
+	if (!index)
+		return;
+
+	entry = g_hash_table_lookup(index->entries, data);
+	if (!entry)
+		return;
+
+	addr_unlink(index, entry);
+	addr_link(index, entry, addr);
+
+	if (conn_addr)
+		addr_link(index, entry, conn_addr);
+}
+
+/*
+ * Return the first device, in insertion order, indexed under addr for
+ * which cmp returns 0. This matches what g_slist_find_custom() over the
+ * device list would return.
+ */
+void *device_index_find(struct device_index *index, const bdaddr_t *addr,
+				GCompareFunc cmp, gconstpointer user_data)
+{
+	struct index_entry *match = NULL;
+	GPtrArray *bucket;
+	unsigned int i;
+
+	if (!index)
+		return NULL;
+
+	bucket = g_hash_table_lookup(index->addrs, addr);
+	if (!bucket)
+		return NULL;
+
+	/* Bucket order is not preserved on removal, compare sequences */
+	for (i = 0; i < bucket->len; i++) {
+		struct index_entry *entry = g_ptr_array_index(bucket, i);
+
+		if (match && match->seq < entry->seq)
+			continue;
+
+		if (cmp(entry->data, user_data) == 0)
+			match = entry;
+	}
+
+	return match ? match->data : NULL;
+}
+
+void *device_index_find_path(struct device_index *index, const char *path)
+{
+	struct index_entry *entry;
+	char *key;
+
+	if (!index || !path)
+		return NULL;
+
+	/* Paths are compared case-insensitively */
+	key = g_ascii_strdown(path, -1);
+	entry = g_hash_table_lookup(index->paths, key);
+	g_free(key);
+
+	return entry ? entry->data : NULL;
+}
+
+GList *device_index_get_list(struct device_index *index)
+{
+	if (!index)
+		return NULL;
+
+	return index->list.head;
+}
+
+unsigned int device_index_size(struct device_index *index)
+{
+	if (!index)
+		return 0;
+
+	return index->list.length;
+}
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <glib.h>
+
+struct device_index;
+
+struct device_index *device_index_new(void);
+void device_index_free(struct device_index *index);
+
+bool device_index_add(struct device_index *index, void *data,
+				const char *path, const bdaddr_t *addr);
+bool device_index_remove(struct device_index *index, void *data);
+void device_index_set_address(struct device_index *index, void *data,
+				const bdaddr_t *addr, const bdaddr_t *conn_addr);
+
+void *device_index_find(struct device_index *index, const bdaddr_t *addr,
+				GCompareFunc cmp, gconstpointer user_data);
+void *device_index_find_path(struct device_index *index, const char *path);
+
+GList *device_index_get_list(struct device_index *index);
+unsigned int device_index_size(struct device_index *index);
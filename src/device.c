@@ -61,6 +61,7 @@
 #include "attrib/gatt.h"
 #include "agent.h"
 #include "textfile.h"
+#include "keyfile.h"
 #include "storage.h"
 #include "eir.h"
 #include "settings.h"
@@ -588,11 +589,7 @@ void device_store_cached_name(struct btd_device *dev, const char *name)
 	char filename[PATH_MAX];
 	char d_addr[18];
 	GKeyFile *key_file;
-	GError *gerr = NULL;
-	char *data;
-	char *data_old;
-	gsize length = 0;
-	gsize length_old = 0;
+	char *name_old;
 
 	if (device_address_is_private(dev)) {
 		DBG("Can't store name for private addressed device %s",
@@ -603,32 +600,21 @@ void device_store_cached_name(struct btd_device *dev, const char *name)
 	ba2str(&dev->bdaddr, d_addr);
 	create_filename(filename, PATH_MAX, "/%s/cache/%s",
 			btd_adapter_get_storage_dir(dev->adapter), d_addr);
-	create_file(filename, 0600);
 
-	key_file = g_key_file_new();
-	if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
-		error("Unable to load key file from %s: (%s)", filename,
-								gerr->message);
-		g_clear_error(&gerr);
+	key_file = btd_keyfile_get(filename);
+
+	/* Nothing to store if the name did not change */
+	name_old = g_key_file_get_string(key_file, "General", "Name", NULL);
+	if (!g_strcmp0(name, name_old)) {
+		g_free(name_old);
+		return;
 	}
 
-	data_old = g_key_file_to_data(key_file, &length_old, NULL);
+	g_free(name_old);
 
 	g_key_file_set_string(key_file, "General", "Name", name);
 
-	data = g_key_file_to_data(key_file, &length, NULL);
-
-	if ((length != length_old) || (memcmp(data, data_old, length))) {
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
-			error("Unable set contents for %s: (%s)", filename,
-								gerr->message);
-			g_clear_error(&gerr);
-		}
-	}
-	g_free(data);
-	g_free(data_old);
-
-	g_key_file_free(key_file);
+	btd_keyfile_changed(filename);
 }
 
 static void device_store_cached_name_resolve(struct btd_device *dev)
@@ -636,11 +622,6 @@ static void device_store_cached_name_resolve(struct btd_device *dev)
 	char filename[PATH_MAX];
 	char d_addr[18];
 	GKeyFile *key_file;
-	GError *gerr = NULL;
-	char *data;
-	char *data_old;
-	gsize length = 0;
-	gsize length_old = 0;
 	uint64_t failed_time;
 
 	if (device_address_is_private(dev)) {
@@ -652,36 +633,15 @@ static void device_store_cached_name_resolve(struct btd_device *dev)
 	ba2str(&dev->bdaddr, d_addr);
 	create_filename(filename, PATH_MAX, "/%s/cache/%s",
 			btd_adapter_get_storage_dir(dev->adapter), d_addr);
-	create_file(filename, 0600);
 
-	key_file = g_key_file_new();
-	if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
-		error("Unable to load key file from %s: (%s)", filename,
-								gerr->message);
-		g_clear_error(&gerr);
-	}
+	key_file = btd_keyfile_get(filename);
 
 	failed_time = (uint64_t) dev->name_resolve_failed_time;
 
-	data_old = g_key_file_to_data(key_file, &length_old, NULL);
-
 	g_key_file_set_uint64(key_file, "NameResolving", "FailedTime",
 								failed_time);
 
-	data = g_key_file_to_data(key_file, &length, NULL);
-
-	if ((length != length_old) || (memcmp(data, data_old, length))) {
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
-			error("Unable set contents for %s: (%s)", filename,
-								gerr->message);
-			g_error_free(gerr);
-		}
-	}
-
-	g_free(data);
-	g_free(data_old);
-
-	g_key_file_free(key_file);
+	btd_keyfile_changed(filename);
 }
 
 static void browse_request_free(struct browse_req *req)
@@ -2790,6 +2750,7 @@ static void store_gatt_db(struct btd_device *device)
 {
 	char filename[PATH_MAX];
 	char dst_addr[18];
+	GKeyFile *key_file;
 
 	if (device_address_is_private(device)) {
 		DBG("Can't store GATT db for private addressed device %s",
@@ -2807,7 +2768,13 @@ static void store_gatt_db(struct btd_device *device)
 				dst_addr);
 	create_file(filename, 0600);
 
-	btd_settings_gatt_db_store(device->db, filename);
+	if (btd_settings_gatt_cache_store(device->db, filename) < 0)
+		return;
+
+	/* Drop the text format copy once the binary cache is written */
+	key_file = btd_keyfile_get(filename);
+	if (g_key_file_remove_group(key_file, "Attributes", NULL))
+		btd_keyfile_changed(filename);
 }
 
 static void browse_request_complete(struct browse_req *req, uint8_t type,
@@ -3517,10 +3484,7 @@ static char *load_cached_name(struct btd_device *device, const char *local,
 
 	create_filename(filename, PATH_MAX, "/%s/cache/%s", local, peer);
 
-	key_file = g_key_file_new();
-
-	if (!g_key_file_load_from_file(key_file, filename, 0, NULL))
-		goto failed;
+	key_file = btd_keyfile_get(filename);
 
 	str = g_key_file_get_string(key_file, "General", "Name", NULL);
 	if (str) {
@@ -3529,9 +3493,6 @@ static char *load_cached_name(struct btd_device *device, const char *local,
 			str[HCI_MAX_NAME_LENGTH] = '\0';
 	}
 
-failed:
-	g_key_file_free(key_file);
-
 	return str;
 }
 
@@ -3547,18 +3508,12 @@ static void load_cached_name_resolve(struct btd_device *device,
 
 	create_filename(filename, PATH_MAX, "/%s/cache/%s", local, peer);
 
-	key_file = g_key_file_new();
-
-	if (!g_key_file_load_from_file(key_file, filename, 0, NULL))
-		goto failed;
+	key_file = btd_keyfile_get(filename);
 
 	failed_time = g_key_file_get_uint64(key_file, "NameResolving",
 							"FailedTime", NULL);
 
 	device->name_resolve_failed_time = failed_time;
-
-failed:
-	g_key_file_free(key_file);
 }
 
 static struct csrk_info *load_csrk(GKeyFile *key_file, const char *group)
@@ -3985,14 +3940,21 @@ static void load_gatt_db(struct btd_device *device, const char *local,
 
 	create_filename(filename, PATH_MAX, "/%s/cache/%s", local, peer);
 
-	err = btd_settings_gatt_db_load(device->db, filename);
+	err = btd_settings_gatt_cache_load(device->db, filename);
 	if (err < 0) {
+		err = btd_settings_gatt_db_load_key_file(device->db,
+						btd_keyfile_get(filename));
 		if (err == -ENOENT)
 			return;
 
+		/* Move caches in the text format over to the binary one */
+		if (!err)
+			store_gatt_db(device);
+	}
+
+	if (err < 0)
 		warn("Error loading db from cache for %s: %s (%d)", peer,
 						strerror(-err), err);
-	}
 
 	g_slist_free_full(device->primaries, g_free);
 	device->primaries = NULL;
@@ -4695,9 +4657,7 @@ static void device_remove_stored(struct btd_device *device)
 	char device_addr[18];
 	char filename[PATH_MAX];
 	GKeyFile *key_file;
-	GError *gerr = NULL;
-	char *data;
-	gsize length = 0;
+	bool changed;
 
 	if (device->bredr_state.bonded)
 		device_remove_bonding(device, BDADDR_BREDR);
@@ -4722,27 +4682,15 @@ static void device_remove_stored(struct btd_device *device)
 				btd_adapter_get_storage_dir(device->adapter),
 				device_addr);
 
-	key_file = g_key_file_new();
-	if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
-		g_error_free(gerr);
-		g_key_file_free(key_file);
-		return;
-	}
-	g_key_file_remove_group(key_file, "ServiceRecords", NULL);
-	g_key_file_remove_group(key_file, "Attributes", NULL);
+	key_file = btd_keyfile_get(filename);
 
-	data = g_key_file_to_data(key_file, &length, NULL);
-	if (length > 0) {
-		create_file(filename, 0600);
-		if (!g_file_set_contents(filename, data, length, &gerr)) {
-			error("Unable set contents for %s: (%s)", filename,
-								gerr->message);
-			g_error_free(gerr);
-		}
-	}
+	changed = g_key_file_remove_group(key_file, "ServiceRecords", NULL);
+	changed |= g_key_file_remove_group(key_file, "Attributes", NULL);
 
-	g_free(data);
-	g_key_file_free(key_file);
+	if (changed)
+		btd_keyfile_changed(filename);
+
+	btd_settings_gatt_cache_remove(filename);
 }
 
 void device_remove(struct btd_device *device, gboolean remove_stored)
@@ -5221,16 +5169,8 @@ static void update_bredr_services(struct browse_req *req, sdp_list_t *recs)
 	ba2str(&device->bdaddr, dstaddr);
 
 	create_filename(sdp_file, PATH_MAX, "/%s/cache/%s", srcaddr, dstaddr);
-	create_file(sdp_file, 0600);
 
-	sdp_key_file = g_key_file_new();
-	if (!g_key_file_load_from_file(sdp_key_file, sdp_file, 0, &gerr)) {
-		error("Unable to load key file from %s: (%s)", sdp_file,
-								gerr->message);
-		g_clear_error(&gerr);
-		g_key_file_free(sdp_key_file);
-		sdp_key_file = NULL;
-	}
+	sdp_key_file = btd_keyfile_get(sdp_file);
 
 	create_filename(att_file, PATH_MAX, "/%s/%s/attributes", srcaddr,
 							dstaddr);
@@ -5284,8 +5224,7 @@ static void update_bredr_services(struct browse_req *req, sdp_list_t *recs)
 		if (update_record(req, profile_uuid, rec) < 0)
 			goto next;
 
-		if (sdp_key_file)
-			store_sdp_record(sdp_key_file, rec);
+		store_sdp_record(sdp_key_file, rec);
 
 		if (att_key_file)
 			store_primaries_from_sdp_record(att_key_file, rec);
@@ -5294,20 +5233,7 @@ next:
 		free(profile_uuid);
 	}
 
-	if (sdp_key_file) {
-		data = g_key_file_to_data(sdp_key_file, &length, NULL);
-		if (length > 0) {
-			if (!g_file_set_contents(sdp_file, data, length,
-								&gerr)) {
-				error("Unable set contents for %s: (%s)",
-						sdp_file, gerr->message);
-				g_clear_error(&gerr);
-			}
-		}
-
-		g_free(data);
-		g_key_file_free(sdp_key_file);
-	}
+	btd_keyfile_changed(sdp_file);
 
 	if (att_key_file) {
 		data = g_key_file_to_data(att_key_file, &length, NULL);
@@ -5780,6 +5706,7 @@ bool device_attach_att(struct btd_device *dev, GIOChannel *io)
 	bt_att_ref(dev->att);
 
 	bt_att_set_debug(dev->att, BT_ATT_DEBUG, gatt_debug, NULL, NULL);
+	bt_att_set_write_batch(dev->att, btd_opts.gatt_write_batch);
 
 	dev->att_disconn_id = bt_att_register_disconnect(dev->att,
 						att_disconnected_cb, dev, NULL);
@@ -6108,6 +6035,11 @@ const bdaddr_t *device_get_address(struct btd_device *device)
 {
 	return &device->bdaddr;
 }
+
+const bdaddr_t *device_get_conn_address(struct btd_device *device)
+{
+	return &device->conn_bdaddr;
+}
 uint8_t device_get_le_address_type(struct btd_device *device)
 {
 	return device->bdaddr_type;
@@ -7142,7 +7074,6 @@ static sdp_list_t *read_device_records(struct btd_device *device)
 	char local[18], peer[18];
 	char filename[PATH_MAX];
 	GKeyFile *key_file;
-	GError *gerr = NULL;
 	char **keys, **handle;
 	char *str;
 	sdp_list_t *recs = NULL;
@@ -7153,12 +7084,7 @@ static sdp_list_t *read_device_records(struct btd_device *device)
 
 	create_filename(filename, PATH_MAX, "/%s/cache/%s", local, peer);
 
-	key_file = g_key_file_new();
-	if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
-		error("Unable to load key file from %s: (%s)", filename,
-								gerr->message);
-		g_error_free(gerr);
-	}
+	key_file = btd_keyfile_get(filename);
 	keys = g_key_file_get_keys(key_file, "ServiceRecords", NULL, NULL);
 
 	for (handle = keys; handle && *handle; handle++) {
@@ -7173,7 +7099,6 @@ static sdp_list_t *read_device_records(struct btd_device *device)
 	}
 
 	g_strfreev(keys);
-	g_key_file_free(key_file);
 
 	return recs;
 }
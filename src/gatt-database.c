@@ -71,6 +71,7 @@ struct btd_gatt_database {
 	GIOChannel *bredr_io;
 	struct queue *records;
 	struct queue *device_states;
+	struct queue *ccc_subscribers;
 	struct queue *ccc_callbacks;
 	struct gatt_db_attribute *svc_chngd;
 	struct gatt_db_attribute *svc_chngd_ccc;
@@ -191,10 +192,21 @@ typedef uint8_t (*btd_gatt_database_ccc_write_t) (struct pending_op *op,
 typedef void (*btd_gatt_database_destroy_t) (void *data);
 
 struct ccc_state {
+	struct device_state *state;
 	uint16_t handle;
 	uint16_t value;
 };
 
+/*
+ * CCC states, per CCC handle, of the connected devices that have enabled
+ * notifications or indications, so that notifying a characteristic does
+ * not have to go over every known device.
+ */
+struct ccc_subscribers {
+	uint16_t handle;
+	struct queue *ccc_states;
+};
+
 struct ccc_cb_data {
 	uint16_t handle;
 	btd_gatt_database_ccc_write_t callback;
@@ -275,6 +287,70 @@ static struct ccc_state *find_ccc_state(struct device_state *dev_state,
 							UINT_TO_PTR(handle));
 }
 
+static bool subscribers_match(const void *a, const void *b)
+{
+	const struct ccc_subscribers *subs = a;
+	uint16_t handle = PTR_TO_UINT(b);
+
+	return subs->handle == handle;
+}
+
+static struct ccc_subscribers *find_subscribers(struct btd_gatt_database *db,
+								uint16_t handle)
+{
+	return queue_find(db->ccc_subscribers, subscribers_match,
+							UINT_TO_PTR(handle));
+}
+
+static void subscribers_free(void *data)
+{
+	struct ccc_subscribers *subs = data;
+
+	queue_destroy(subs->ccc_states, NULL);
+	free(subs);
+}
+
+static void ccc_unsubscribe(void *data, void *user_data)
+{
+	struct ccc_state *ccc = data;
+	struct ccc_subscribers *subs;
+
+	subs = find_subscribers(ccc->state->db, ccc->handle);
+	if (subs)
+		queue_remove(subs->ccc_states, ccc);
+}
+
+static void ccc_subscribe(void *data, void *user_data)
+{
+	struct ccc_state *ccc = data;
+	struct btd_gatt_database *db = ccc->state->db;
+	struct ccc_subscribers *subs;
+
+	if (!(ccc->value & 0x0003)) {
+		ccc_unsubscribe(ccc, NULL);
+		return;
+	}
+
+	subs = find_subscribers(db, ccc->handle);
+	if (!subs) {
+		subs = new0(struct ccc_subscribers, 1);
+		subs->handle = ccc->handle;
+		subs->ccc_states = queue_new();
+		queue_push_tail(db->ccc_subscribers, subs);
+	} else if (queue_find(subs->ccc_states, NULL, ccc))
+		return;
+
+	queue_push_tail(subs->ccc_states, ccc);
+}
+
+static void ccc_state_free(void *data)
+{
+	struct ccc_state *ccc = data;
+
+	ccc_unsubscribe(ccc, NULL);
+	free(ccc);
+}
+
 static struct device_state *device_state_create(struct btd_gatt_database *db,
 							const bdaddr_t *bdaddr,
 							uint8_t bdaddr_type)
@@ -294,7 +370,7 @@ static void device_state_free(void *data)
 {
 	struct device_state *state = data;
 
-	queue_destroy(state->ccc_states, free);
+	queue_destroy(state->ccc_states, ccc_state_free);
 
 	if (state->pending) {
 		free(state->pending->value);
@@ -332,6 +408,8 @@ static void att_disconnected(int err, void *user_data)
 	state->disc_id = 0;
 	state->out_of_sync = false;
 
+	queue_foreach(state->ccc_states, ccc_unsubscribe, NULL);
+
 	device = btd_adapter_find_device(state->db->adapter, &state->bdaddr,
 							state->bdaddr_type);
 	if (!device)
@@ -445,6 +523,7 @@ static struct ccc_state *get_ccc_state(struct btd_gatt_database *database,
 		return ccc;
 
 	ccc = new0(struct ccc_state, 1);
+	ccc->state = dev_state;
 	ccc->handle = handle;
 	queue_push_tail(dev_state->ccc_states, ccc);
 
@@ -631,10 +710,12 @@ static void gatt_database_free(void *data)
 
 	queue_destroy(database->records, gatt_record_free);
 	queue_destroy(database->device_states, device_state_free);
+	queue_destroy(database->ccc_subscribers, subscribers_free);
 	queue_destroy(database->apps, app_free);
 	queue_destroy(database->profiles, profile_free);
 	queue_destroy(database->ccc_callbacks, ccc_cb_free);
 	database->device_states = NULL;
+	database->ccc_subscribers = NULL;
 	database->ccc_callbacks = NULL;
 
 	gatt_db_unref(database->db);
@@ -1075,8 +1156,10 @@ static void gatt_ccc_write_cb(struct gatt_db_attribute *attrib,
 			pending_op_free(op);
 	}
 
-	if (!ecode)
+	if (!ecode) {
 		ccc->value = val;
+		ccc_subscribe(ccc, NULL);
+	}
 
 done:
 	gatt_db_attribute_write_result(attrib, id, ecode);
@@ -1385,6 +1468,25 @@ static void state_set_pending(struct device_state *state, struct notify *notify)
 	memcpy(state->pending->value, notify->value, notify->len);
 }
 
+static void send_to_server(struct bt_gatt_server *server,
+				struct device_state *device_state,
+				struct ccc_state *ccc, struct notify *notify)
+{
+	if (!(ccc->value & 0x0002)) {
+		DBG("GATT server sending notification");
+		bt_gatt_server_send_notification(server,
+					notify->handle, notify->value,
+					notify->len, device_state->cli_feat[0] &
+					BT_GATT_CHRC_CLI_FEAT_NFY_MULTI);
+		return;
+	}
+
+	DBG("GATT server sending indication");
+	bt_gatt_server_send_indication(server, notify->handle, notify->value,
+						notify->len, notify->conf,
+						notify->user_data, NULL);
+}
+
 static void send_notification_to_device(void *data, void *user_data)
 {
 	struct device_state *device_state = data;
@@ -1429,19 +1531,7 @@ static void send_notification_to_device(void *data, void *user_data)
 	 * TODO: If the device is not connected but bonded, send the
 	 * notification/indication when it becomes connected.
 	 */
-	if (!(ccc->value & 0x0002)) {
-		DBG("GATT server sending notification");
-		bt_gatt_server_send_notification(server,
-					notify->handle, notify->value,
-					notify->len, device_state->cli_feat[0] &
-					BT_GATT_CHRC_CLI_FEAT_NFY_MULTI);
-		return;
-	}
-
-	DBG("GATT server sending indication");
-	bt_gatt_server_send_indication(server, notify->handle, notify->value,
-						notify->len, notify->conf,
-						notify->user_data, NULL);
+	send_to_server(server, device_state, ccc, notify);
 
 	return;
 
@@ -1454,6 +1544,50 @@ remove:
 	}
 }
 
+static void send_notification_to_subscriber(void *data, void *user_data)
+{
+	struct ccc_state *ccc = data;
+	struct notify *notify = user_data;
+	struct device_state *device_state = ccc->state;
+	struct btd_device *device;
+	struct bt_gatt_server *server = NULL;
+
+	device = btd_adapter_find_device(notify->database->adapter,
+						&device_state->bdaddr,
+						device_state->bdaddr_type);
+	if (device)
+		server = btd_device_get_gatt_server(device);
+
+	/* Let the generic path deal with devices that went away */
+	if (!server) {
+		send_notification_to_device(device_state, notify);
+		return;
+	}
+
+	send_to_server(server, device_state, ccc, notify);
+}
+
+/*
+ * Service Changed is also recorded for disconnected devices, any other
+ * notification only goes to the connected subscribers of its CCC.
+ */
+static void send_notification(struct btd_gatt_database *database,
+							struct notify *notify)
+{
+	struct ccc_subscribers *subs;
+
+	if (notify->conf == service_changed_conf) {
+		queue_foreach(database->device_states,
+				send_notification_to_device, notify);
+		return;
+	}
+
+	subs = find_subscribers(database, notify->ccc_handle);
+	if (subs)
+		queue_foreach(subs->ccc_states,
+				send_notification_to_subscriber, notify);
+}
+
 static void gatt_notify_cb(struct gatt_db_attribute *attrib,
 					struct gatt_db_attribute *ccc,
 					const uint8_t *value, size_t len,
@@ -1483,8 +1617,7 @@ static void gatt_notify_cb(struct gatt_db_attribute *attrib,
 
 		send_notification_to_device(state, &notify);
 	} else
-		queue_foreach(database->device_states,
-				send_notification_to_device, &notify);
+		send_notification(database, &notify);
 }
 
 static void register_core_services(struct btd_gatt_database *database)
@@ -1515,8 +1648,7 @@ static void send_notification_to_devices(struct btd_gatt_database *database,
 	notify.conf = conf;
 	notify.user_data = user_data;
 
-	queue_foreach(database->device_states, send_notification_to_device,
-								&notify);
+	send_notification(database, &notify);
 }
 
 static void send_service_changed(struct btd_gatt_database *database,
@@ -1589,7 +1721,8 @@ static void remove_device_ccc(void *data, void *user_data)
 {
 	struct device_state *state = data;
 
-	queue_remove_all(state->ccc_states, ccc_match_service, user_data, free);
+	queue_remove_all(state->ccc_states, ccc_match_service, user_data,
+							ccc_state_free);
 }
 
 static bool match_gatt_record(const void *data, const void *user_data)
@@ -3989,6 +4122,7 @@ struct btd_gatt_database *btd_gatt_database_new(struct btd_adapter *adapter)
 	database->db = gatt_db_new();
 	database->records = queue_new();
 	database->device_states = queue_new();
+	database->ccc_subscribers = queue_new();
 	database->apps = queue_new();
 	database->profiles = queue_new();
 	database->ccc_callbacks = queue_new();
@@ -4098,7 +4232,13 @@ void btd_gatt_database_server_connected(struct btd_gatt_database *database,
 	bt_gatt_server_set_authorize(server, server_authorize, database);
 
 	state = find_device_state(database, &bdaddr, bdaddr_type);
-	if (!state || !state->pending)
+	if (!state)
+		return;
+
+	/* Restore the subscriptions of a bonded device */
+	queue_foreach(state->ccc_states, ccc_subscribe, NULL);
+
+	if (!state->pending)
 		return;
 
 	send_notification_to_device(state, state->pending);
@@ -4146,6 +4286,7 @@ static void restore_ccc(struct btd_gatt_database *database,
 	queue_push_tail(database->device_states, dev_state);
 
 	ccc = new0(struct ccc_state, 1);
+	ccc->state = dev_state;
 	ccc->handle = gatt_db_attribute_get_handle(database->svc_chngd_ccc);
 	ccc->value = value;
 	queue_push_tail(dev_state->ccc_states, ccc);
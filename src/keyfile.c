@@ -0,0 +1,318 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "log.h"
+#include "textfile.h"
+#include "shared/timeout.h"
+#include "keyfile.h"
+
+#define KEYFILE_FLUSH_DELAY	1
+#define KEYFILE_CACHE_MAX	256
+
+/*
+ * Write-behind cache of storage key files.
+ *
+ * A key file is read from disk the first time it is needed and kept in
+ * memory, changes are written back after KEYFILE_FLUSH_DELAY seconds so
+ * that frequent updates, such as the name of a device seen advertising,
+ * end up as a single write. Files are replaced atomically by writing a
+ * temporary file and renaming it, all files written by a flush are synced
+ * together before any of them is renamed.
+ *
+ * The returned GKeyFile is owned by the cache and must not be kept past
+ * the current main loop iteration, clean entries are evicted by the flush
+ * once there are more than KEYFILE_CACHE_MAX of them.
+ */
+struct keyfile {
+	char *filename;
+	GKeyFile *key_file;
+	char *data;
+	gsize length;
+	bool exists;
+	bool dirty;
+};
+
+struct keyfile_write {
+	struct keyfile *keyfile;
+	char *data;
+	gsize length;
+	int fd;
+};
+
+static GHashTable *keyfiles;
+static unsigned int flush_id;
+
+static void keyfile_free(gpointer data)
+{
+	struct keyfile *keyfile = data;
+
+	g_key_file_free(keyfile->key_file);
+	g_free(keyfile->data);
+	g_free(keyfile->filename);
+	g_free(keyfile);
+}
+
+static bool flush_timeout(void *user_data)
+{
+	flush_id = 0;
+
+	btd_keyfile_flush();
+
+	return false;
+}
+
+static void schedule_flush(void)
+{
+	if (flush_id)
+		return;
+
+	flush_id = timeout_add_seconds(KEYFILE_FLUSH_DELAY, flush_timeout,
+								NULL, NULL);
+}
+
+GKeyFile *btd_keyfile_get(const char *filename)
+{
+	struct keyfile *keyfile;
+	GError *gerr = NULL;
+
+	if (!keyfiles)
+		keyfiles = g_hash_table_new_full(g_str_hash, g_str_equal,
+							NULL, keyfile_free);
+
+	keyfile = g_hash_table_lookup(keyfiles, filename);
+	if (keyfile)
+		return keyfile->key_file;
+
+	keyfile = g_new0(struct keyfile, 1);
+	keyfile->filename = g_strdup(filename);
+	keyfile->key_file = g_key_file_new();
+
+	if (g_key_file_load_from_file(keyfile->key_file, filename, 0, &gerr)) {
+		keyfile->exists = true;
+		keyfile->data = g_key_file_to_data(keyfile->key_file,
+						&keyfile->length, NULL);
+	} else {
+		DBG("Unable to load key file from %s: (%s)", filename,
+								gerr->message);
+		g_clear_error(&gerr);
+	}
+
+	g_hash_table_insert(keyfiles, keyfile->filename, keyfile);
+
+	if (g_hash_table_size(keyfiles) > KEYFILE_CACHE_MAX)
+		schedule_flush();
+
+	return keyfile->key_file;
+}
+
+void btd_keyfile_changed(const char *filename)
+{
+	struct keyfile *keyfile;
+
+	if (!keyfiles)
+		return;
+
+	keyfile = g_hash_table_lookup(keyfiles, filename);
+	if (!keyfile)
+		return;
+
+	keyfile->dirty = true;
+
+	schedule_flush();
+}
+
+static int write_temp(const char *filename, const char *data, gsize length)
+{
+	char tmp[PATH_MAX];
+	ssize_t written;
+	int fd;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+
+	/* Also creates the directories leading to the file */
+	if (create_file(tmp, 0600) < 0)
+		return -errno;
+
+	fd = open(tmp, O_WRONLY | O_TRUNC | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	while (length) {
+		written = write(fd, data, length);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+
+			written = -errno;
+			close(fd);
+			unlink(tmp);
+			return written;
+		}
+
+		data += written;
+		length -= written;
+	}
+
+	return fd;
+}
+
+static bool keyfile_prepare(struct keyfile *keyfile, GArray *writes)
+{
+	struct keyfile_write write;
+	int err;
+
+	keyfile->dirty = false;
+
+	write.keyfile = keyfile;
+	write.data = g_key_file_to_data(keyfile->key_file, &write.length,
+									NULL);
+
+	/* Nothing to do if the contents did not actually change */
+	if ((keyfile->exists || !write.length) &&
+				write.length == keyfile->length &&
+				!memcmp(write.data, keyfile->data ? : "",
+							write.length)) {
+		g_free(write.data);
+		return false;
+	}
+
+	err = write_temp(keyfile->filename, write.data, write.length);
+	if (err < 0) {
+		error("Unable to write %s: %s (%d)", keyfile->filename,
+							strerror(-err), -err);
+		g_free(write.data);
+		return false;
+	}
+
+	write.fd = err;
+	g_array_append_val(writes, write);
+
+	return true;
+}
+
+static void keyfile_commit(struct keyfile_write *write)
+{
+	struct keyfile *keyfile = write->keyfile;
+	char tmp[PATH_MAX];
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", keyfile->filename);
+
+	if (rename(tmp, keyfile->filename) < 0) {
+		error("Unable to replace %s: %s (%d)", keyfile->filename,
+							strerror(errno), errno);
+		unlink(tmp);
+		g_free(write->data);
+		return;
+	}
+
+	g_free(keyfile->data);
+	keyfile->data = write->data;
+	keyfile->length = write->length;
+	keyfile->exists = true;
+}
+
+static void sync_dir(const char *filename, char **last)
+{
+	char *dir = g_path_get_dirname(filename);
+	int fd;
+
+	/* Files of a flush mostly live in the same directory */
+	if (*last && !strcmp(*last, dir)) {
+		g_free(dir);
+		return;
+	}
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+
+	g_free(*last);
+	*last = dir;
+}
+
+void btd_keyfile_flush(void)
+{
+	struct keyfile_write *write;
+	GHashTableIter iter;
+	gpointer value;
+	GArray *writes;
+	char *dir = NULL;
+	unsigned int i;
+
+	if (!keyfiles)
+		return;
+
+	writes = g_array_new(FALSE, FALSE, sizeof(struct keyfile_write));
+
+	g_hash_table_iter_init(&iter, keyfiles);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct keyfile *keyfile = value;
+
+		if (keyfile->dirty)
+			keyfile_prepare(keyfile, writes);
+	}
+
+	/* Sync all temporary files before renaming any of them */
+	for (i = 0; i < writes->len; i++) {
+		write = &g_array_index(writes, struct keyfile_write, i);
+		fsync(write->fd);
+		close(write->fd);
+	}
+
+	for (i = 0; i < writes->len; i++) {
+		write = &g_array_index(writes, struct keyfile_write, i);
+		keyfile_commit(write);
+		sync_dir(write->keyfile->filename, &dir);
+	}
+
+	g_free(dir);
+	g_array_free(writes, TRUE);
+
+	if (g_hash_table_size(keyfiles) <= KEYFILE_CACHE_MAX)
+		return;
+
+	/* Evict clean entries down to half of the maximum */
+	g_hash_table_iter_init(&iter, keyfiles);
+	while (g_hash_table_iter_next(&iter, NULL, &value) &&
+			g_hash_table_size(keyfiles) > KEYFILE_CACHE_MAX / 2) {
+		struct keyfile *keyfile = value;
+
+		if (!keyfile->dirty)
+			g_hash_table_iter_remove(&iter);
+	}
+}
+
+void btd_keyfile_cleanup(void)
+{
+	if (flush_id) {
+		timeout_remove(flush_id);
+		flush_id = 0;
+	}
+
+	btd_keyfile_flush();
+
+	if (keyfiles) {
+		g_hash_table_destroy(keyfiles);
+		keyfiles = NULL;
+	}
+}
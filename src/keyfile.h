@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <glib.h>
+
+GKeyFile *btd_keyfile_get(const char *filename);
+void btd_keyfile_changed(const char *filename);
+void btd_keyfile_flush(void);
+void btd_keyfile_cleanup(void);
@@ -46,6 +46,7 @@
 #include "shared/crypto.h"
 #include "lib/uuid.h"
 #include "shared/util.h"
+#include "shared/log.h"
 #include "btd.h"
 #include "sdpd.h"
 #include "adapter.h"
@@ -53,6 +54,7 @@
 #include "dbus-common.h"
 #include "agent.h"
 #include "profile.h"
+#include "keyfile.h"
 
 #define BLUEZ_NAME "org.bluez"
 
@@ -90,6 +92,7 @@ static const char *supported_options[] = {
 	"Testing",
 	"KernelExperimental",
 	"RemoteNameRequestRetryDelay",
+	"BufferedLogging",
 	NULL
 };
 
@@ -147,6 +150,7 @@ static const char *gatt_options[] = {
 	"ExchangeMTU",
 	"Channels",
 	"Client",
+	"WriteBatch",
 	NULL
 };
 
@@ -1045,6 +1049,8 @@ static void parse_general(GKeyFile *config)
 	parse_config_u32(config, "General", "RemoteNameRequestRetryDelay",
 					&btd_opts.name_request_retry_delay,
 					0, UINT32_MAX);
+	parse_config_bool(config, "General", "BufferedLogging",
+						&btd_opts.buffered_log);
 }
 
 static void parse_gatt_cache(GKeyFile *config)
@@ -1068,6 +1074,8 @@ static void parse_gatt(GKeyFile *config)
 	parse_config_u8(config, "GATT", "Channels", &btd_opts.gatt_channels,
 				1, 5);
 	parse_config_bool(config, "GATT", "Client", &btd_opts.gatt_client);
+	parse_config_u8(config, "GATT", "WriteBatch",
+				&btd_opts.gatt_write_batch, 1, 32);
 }
 
 static void parse_csis_sirk(GKeyFile *config)
@@ -1201,6 +1209,7 @@ static void init_defaults(void)
 	btd_opts.gatt_mtu = BT_ATT_MAX_LE_MTU;
 	btd_opts.gatt_channels = 1;
 	btd_opts.gatt_client = true;
+	btd_opts.gatt_write_batch = 1;
 
 	btd_opts.avdtp.session_mode = BT_IO_MODE_BASIC;
 	btd_opts.avdtp.stream_mode = BT_IO_MODE_BASIC;
@@ -1411,6 +1420,9 @@ int main(int argc, char *argv[])
 
 	parse_config(main_conf);
 
+	if (btd_opts.buffered_log)
+		bt_log_set_buffered(true);
+
 	if (connect_dbus() < 0) {
 		error("Unable to get on D-Bus");
 		exit(1);
@@ -1477,6 +1489,8 @@ int main(int argc, char *argv[])
 
 	adapter_cleanup();
 
+	btd_keyfile_cleanup();
+
 	rfkill_exit();
 
 	if (btd_opts.mode != BT_MODE_LE)
@@ -266,7 +266,7 @@ static void foreach_rsi(void *data, void *user_data)
 	if (ad->type != BT_AD_CSIP_RSI || ad->len < 6)
 		return;
 
-	crypto = bt_crypto_new();
+	crypto = bt_crypto_new_backend(BT_CRYPTO_BACKEND_FAST);
 	if (!crypto)
 		return;
 
@@ -13,6 +13,11 @@
 
 #include <stdbool.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 
@@ -20,6 +25,7 @@
 #include "lib/uuid.h"
 
 #include "log.h"
+#include "src/shared/util.h"
 #include "src/shared/queue.h"
 #include "src/shared/att.h"
 #include "src/shared/gatt-db.h"
@@ -292,13 +298,31 @@ static int gatt_db_load(struct gatt_db *db, GKeyFile *key_file, char **keys)
 	return 0;
 }
 
-int btd_settings_gatt_db_load(struct gatt_db *db, const char *filename)
+int btd_settings_gatt_db_load_key_file(struct gatt_db *db, GKeyFile *key_file)
 {
 	char **keys;
+	int err;
+
+	keys = g_key_file_get_keys(key_file, "Attributes", NULL, NULL);
+	if (!keys)
+		return -ENOENT;
+
+	err = gatt_db_load(db, key_file, keys);
+
+	g_strfreev(keys);
+
+	return err;
+}
+
+int btd_settings_gatt_db_load(struct gatt_db *db, const char *filename)
+{
 	GKeyFile *key_file;
 	GError *gerr = NULL;
 	int err;
 
+	if (!btd_settings_gatt_cache_load(db, filename))
+		return 0;
+
 	key_file = g_key_file_new();
 	if (!g_key_file_load_from_file(key_file, filename, 0, &gerr)) {
 		DBG("Unable to load key file from %s: (%s)", filename,
@@ -306,16 +330,8 @@ int btd_settings_gatt_db_load(struct gatt_db *db, const char *filename)
 		g_clear_error(&gerr);
 	}
 
-	keys = g_key_file_get_keys(key_file, "Attributes", NULL, NULL);
-
-	if (!keys) {
-		g_key_file_free(key_file);
-		return -ENOENT;
-	}
-
-	err = gatt_db_load(db, key_file, keys);
+	err = btd_settings_gatt_db_load_key_file(db, key_file);
 
-	g_strfreev(keys);
 	g_key_file_free(key_file);
 
 	return err;
@@ -510,3 +526,497 @@ void btd_settings_gatt_db_store(struct gatt_db *db, const char *filename)
 	g_free(data);
 	g_key_file_free(key_file);
 }
+
+/*
+ * Binary cache of a remote GATT database, stored next to the device cache
+ * file with GATT_CACHE_SUFFIX appended. It is a header followed by fixed
+ * size records in handle order so it can be mapped and loaded without any
+ * parsing. The Database Hash of the peer is kept in the header, which lets
+ * an unchanged database be detected without reading the records.
+ */
+#define GATT_CACHE_SUFFIX	".gatt"
+#define GATT_CACHE_VERSION	1
+
+#define GATT_CACHE_HASH		0x01
+
+#define GATT_CACHE_PRIMARY	0x01
+#define GATT_CACHE_SECONDARY	0x02
+#define GATT_CACHE_INCLUDE	0x03
+#define GATT_CACHE_CHRC		0x04
+#define GATT_CACHE_DESC		0x05
+
+struct gatt_cache_hdr {
+	uint8_t magic[4];
+	uint8_t version;
+	uint8_t flags;
+	uint16_t count;
+	uint32_t crc;
+	uint16_t hash_handle;
+	uint8_t hash[16];
+} __packed;
+
+struct gatt_cache_attr {
+	uint8_t type;
+	uint8_t uuid_type;
+	uint16_t handle;
+	uint16_t value;		/* End, value or included service handle */
+	uint8_t properties;
+	uint8_t uuid[16];
+} __packed;
+
+static const uint8_t gatt_cache_magic[4] = { 'B', 'Z', 'G', 'C' };
+
+struct gatt_cache_saver {
+	struct gatt_db *db;
+	uint16_t ext_props;
+	GArray *attrs;
+	struct gatt_cache_hdr hdr;
+};
+
+static uint32_t gatt_cache_crc(const void *data, size_t len)
+{
+	const uint8_t *ptr = data;
+	uint32_t crc = 0xffffffff;
+	int i;
+
+	while (len--) {
+		crc ^= *ptr++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+
+	return ~crc;
+}
+
+static char *gatt_cache_path(const char *filename)
+{
+	return g_strconcat(filename, GATT_CACHE_SUFFIX, NULL);
+}
+
+static void gatt_cache_set_uuid(struct gatt_cache_attr *attr,
+						const bt_uuid_t *uuid)
+{
+	attr->uuid_type = uuid->type;
+
+	switch (uuid->type) {
+	case BT_UUID16:
+		put_le16(uuid->value.u16, attr->uuid);
+		break;
+	case BT_UUID32:
+		put_le32(uuid->value.u32, attr->uuid);
+		break;
+	case BT_UUID128:
+		memcpy(attr->uuid, &uuid->value.u128, 16);
+		break;
+	case BT_UUID_UNSPEC:
+	default:
+		break;
+	}
+}
+
+static int gatt_cache_get_uuid(const struct gatt_cache_attr *attr,
+							bt_uuid_t *uuid)
+{
+	uint128_t u128;
+
+	switch (attr->uuid_type) {
+	case BT_UUID16:
+		return bt_uuid16_create(uuid, get_le16(attr->uuid));
+	case BT_UUID32:
+		return bt_uuid32_create(uuid, get_le32(attr->uuid));
+	case BT_UUID128:
+		memcpy(&u128, attr->uuid, 16);
+		return bt_uuid128_create(uuid, u128);
+	}
+
+	return -EINVAL;
+}
+
+static struct gatt_cache_attr *gatt_cache_append(
+					struct gatt_cache_saver *saver,
+					uint8_t type, uint16_t handle,
+					uint16_t value, const bt_uuid_t *uuid)
+{
+	struct gatt_cache_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = type;
+	attr.handle = cpu_to_le16(handle);
+	attr.value = cpu_to_le16(value);
+	gatt_cache_set_uuid(&attr, uuid);
+
+	g_array_append_val(saver->attrs, attr);
+
+	return &g_array_index(saver->attrs, struct gatt_cache_attr,
+						saver->attrs->len - 1);
+}
+
+static void gatt_cache_store_desc(struct gatt_db_attribute *attr,
+							void *user_data)
+{
+	struct gatt_cache_saver *saver = user_data;
+	const bt_uuid_t *uuid;
+	uint16_t value = 0;
+
+	uuid = gatt_db_attribute_get_type(attr);
+	if (bt_uuid16_cmp(uuid, GATT_CHARAC_EXT_PROPER_UUID))
+		value = saver->ext_props;
+
+	gatt_cache_append(saver, GATT_CACHE_DESC,
+				gatt_db_attribute_get_handle(attr), value, uuid);
+}
+
+static void gatt_cache_store_chrc(struct gatt_db_attribute *attr,
+							void *user_data)
+{
+	struct gatt_cache_saver *saver = user_data;
+	struct gatt_cache_attr *entry;
+	uint16_t handle, value_handle;
+	uint8_t properties;
+	bt_uuid_t uuid;
+
+	if (!gatt_db_attribute_get_char_data(attr, &handle, &value_handle,
+						&properties, &saver->ext_props,
+						&uuid)) {
+		DBG("Unable to locate Characteristic data");
+		return;
+	}
+
+	entry = gatt_cache_append(saver, GATT_CACHE_CHRC, handle,
+							value_handle, &uuid);
+	entry->properties = properties;
+
+	if (bt_uuid16_cmp(&uuid, GATT_CHARAC_DB_HASH)) {
+		const uint8_t *hash = NULL;
+
+		gatt_db_attribute_read(gatt_db_get_attribute(saver->db,
+								value_handle),
+					0, BT_ATT_OP_READ_REQ, NULL,
+					db_hash_read_value_cb, &hash);
+		if (hash && !(saver->hdr.flags & GATT_CACHE_HASH)) {
+			memcpy(saver->hdr.hash, hash, 16);
+			saver->hdr.hash_handle = cpu_to_le16(value_handle);
+			saver->hdr.flags |= GATT_CACHE_HASH;
+		}
+	}
+
+	gatt_db_service_foreach_desc(attr, gatt_cache_store_desc, saver);
+}
+
+static void gatt_cache_store_incl(struct gatt_db_attribute *attr,
+							void *user_data)
+{
+	struct gatt_cache_saver *saver = user_data;
+	struct gatt_db_attribute *service;
+	uint16_t handle, start, end;
+	bt_uuid_t uuid;
+
+	if (!gatt_db_attribute_get_incl_data(attr, &handle, &start, &end)) {
+		DBG("Unable to locate Included data");
+		return;
+	}
+
+	service = gatt_db_get_attribute(saver->db, start);
+	if (!service) {
+		DBG("Unable to locate Included Service");
+		return;
+	}
+
+	gatt_db_attribute_get_service_uuid(service, &uuid);
+
+	gatt_cache_append(saver, GATT_CACHE_INCLUDE, handle, start, &uuid);
+}
+
+static void gatt_cache_store_service(struct gatt_db_attribute *attr,
+							void *user_data)
+{
+	struct gatt_cache_saver *saver = user_data;
+	uint16_t start, end;
+	bt_uuid_t uuid;
+	bool primary;
+
+	if (!gatt_db_attribute_get_service_data(attr, &start, &end, &primary,
+								&uuid)) {
+		DBG("Unable to locate Service data");
+		return;
+	}
+
+	gatt_cache_append(saver, primary ? GATT_CACHE_PRIMARY :
+					GATT_CACHE_SECONDARY, start, end, &uuid);
+
+	gatt_db_service_foreach_incl(attr, gatt_cache_store_incl, saver);
+	gatt_db_service_foreach_char(attr, gatt_cache_store_chrc, saver);
+}
+
+/* Returns the mapped cache if its header and records are consistent */
+static const struct gatt_cache_hdr *gatt_cache_map(const char *path,
+								size_t *size)
+{
+	const struct gatt_cache_hdr *hdr;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(*hdr)) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return NULL;
+
+	hdr = map;
+
+	if (memcmp(hdr->magic, gatt_cache_magic, sizeof(hdr->magic)) ||
+			hdr->version != GATT_CACHE_VERSION ||
+			(size_t) st.st_size != sizeof(*hdr) +
+				le16_to_cpu(hdr->count) *
+				sizeof(struct gatt_cache_attr))
+		goto invalid;
+
+	if (le32_to_cpu(hdr->crc) !=
+			gatt_cache_crc(hdr + 1, st.st_size - sizeof(*hdr)))
+		goto invalid;
+
+	*size = st.st_size;
+
+	return hdr;
+
+invalid:
+	DBG("Ignoring invalid GATT cache %s", path);
+	munmap(map, st.st_size);
+	return NULL;
+}
+
+static int gatt_cache_load_attr(struct gatt_db *db,
+				const struct gatt_cache_hdr *hdr,
+				const struct gatt_cache_attr *attr,
+				struct gatt_db_attribute *service)
+{
+	struct gatt_db_attribute *att;
+	uint16_t handle = le16_to_cpu(attr->handle);
+	uint16_t value = le16_to_cpu(attr->value);
+	uint8_t val[2];
+	bt_uuid_t uuid;
+
+	if (!service || gatt_cache_get_uuid(attr, &uuid) < 0)
+		return -EIO;
+
+	switch (attr->type) {
+	case GATT_CACHE_INCLUDE:
+		att = gatt_db_get_attribute(db, value);
+		if (!att || !gatt_db_service_add_included(service, att))
+			return -EIO;
+
+		break;
+	case GATT_CACHE_CHRC:
+		att = gatt_db_service_insert_characteristic(service, handle,
+							value, &uuid, 0,
+							attr->properties,
+							NULL, NULL, NULL);
+		if (!att || gatt_db_attribute_get_handle(att) != value)
+			return -EIO;
+
+		if (!(hdr->flags & GATT_CACHE_HASH) ||
+				le16_to_cpu(hdr->hash_handle) != value)
+			break;
+
+		if (!gatt_db_attribute_write(att, 0, hdr->hash,
+						sizeof(hdr->hash), 0, NULL,
+						load_desc_value, NULL))
+			return -EIO;
+
+		break;
+	case GATT_CACHE_DESC:
+		/* If it is CEP then it must contain the value */
+		if (bt_uuid16_cmp(&uuid, GATT_CHARAC_EXT_PROPER_UUID) &&
+									!value)
+			return -EIO;
+
+		att = gatt_db_service_insert_descriptor(service, handle, &uuid,
+							0, NULL, NULL, NULL);
+		if (!att || gatt_db_attribute_get_handle(att) != handle)
+			return -EIO;
+
+		if (!value)
+			break;
+
+		put_le16(value, val);
+
+		if (!gatt_db_attribute_write(att, 0, val, sizeof(val), 0, NULL,
+						load_desc_value, NULL))
+			return -EIO;
+
+		break;
+	default:
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int gatt_cache_load(struct gatt_db *db,
+					const struct gatt_cache_hdr *hdr)
+{
+	const struct gatt_cache_attr *attrs = (const void *) (hdr + 1);
+	struct gatt_db_attribute *service = NULL;
+	uint16_t count = le16_to_cpu(hdr->count);
+	bt_uuid_t uuid;
+	uint16_t i;
+	int err;
+
+	/* Services first so that included services can be resolved */
+	for (i = 0; i < count; i++) {
+		uint16_t start = le16_to_cpu(attrs[i].handle);
+		uint16_t end = le16_to_cpu(attrs[i].value);
+
+		if (attrs[i].type != GATT_CACHE_PRIMARY &&
+				attrs[i].type != GATT_CACHE_SECONDARY)
+			continue;
+
+		if (end < start || gatt_cache_get_uuid(&attrs[i], &uuid) < 0 ||
+				!gatt_db_insert_service(db, start, &uuid,
+					attrs[i].type == GATT_CACHE_PRIMARY,
+					end - start + 1)) {
+			DBG("Unable load service into db!");
+			gatt_db_clear(db);
+			return -EIO;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		if (attrs[i].type == GATT_CACHE_PRIMARY ||
+				attrs[i].type == GATT_CACHE_SECONDARY) {
+			if (service)
+				gatt_db_service_set_active(service, true);
+
+			service = gatt_db_get_attribute(db,
+					le16_to_cpu(attrs[i].handle));
+			continue;
+		}
+
+		err = gatt_cache_load_attr(db, hdr, &attrs[i], service);
+		if (err) {
+			gatt_db_clear(db);
+			return err;
+		}
+	}
+
+	if (service)
+		gatt_db_service_set_active(service, true);
+
+	return 0;
+}
+
+int btd_settings_gatt_cache_load(struct gatt_db *db, const char *filename)
+{
+	const struct gatt_cache_hdr *hdr;
+	char *path;
+	size_t size;
+	int err;
+
+	path = gatt_cache_path(filename);
+	hdr = gatt_cache_map(path, &size);
+	g_free(path);
+
+	if (!hdr)
+		return -ENOENT;
+
+	err = gatt_cache_load(db, hdr);
+
+	munmap((void *) hdr, size);
+
+	return err;
+}
+
+static bool gatt_cache_unchanged(const char *path,
+					const struct gatt_cache_saver *saver)
+{
+	const struct gatt_cache_hdr *old;
+	size_t size;
+	bool same;
+
+	if (!(saver->hdr.flags & GATT_CACHE_HASH))
+		return false;
+
+	/* A cache that would not load has to be rewritten */
+	old = gatt_cache_map(path, &size);
+	if (!old)
+		return false;
+
+	same = (old->flags & GATT_CACHE_HASH) &&
+			le16_to_cpu(old->count) == saver->attrs->len &&
+			!memcmp(old->hash, saver->hdr.hash, sizeof(old->hash));
+
+	munmap((void *) old, size);
+
+	return same;
+}
+
+int btd_settings_gatt_cache_store(struct gatt_db *db, const char *filename)
+{
+	struct gatt_cache_saver saver;
+	GError *gerr = NULL;
+	size_t len;
+	char *path, *data;
+	int err = 0;
+
+	memset(&saver, 0, sizeof(saver));
+	saver.db = db;
+	saver.attrs = g_array_new(FALSE, FALSE,
+					sizeof(struct gatt_cache_attr));
+
+	gatt_db_foreach_service(db, NULL, gatt_cache_store_service, &saver);
+
+	path = gatt_cache_path(filename);
+
+	if (!saver.attrs->len) {
+		unlink(path);
+		goto done;
+	}
+
+	/* Nothing to write if the peer reports the same Database Hash */
+	if (gatt_cache_unchanged(path, &saver))
+		goto done;
+
+	len = saver.attrs->len * sizeof(struct gatt_cache_attr);
+
+	memcpy(saver.hdr.magic, gatt_cache_magic, sizeof(saver.hdr.magic));
+	saver.hdr.version = GATT_CACHE_VERSION;
+	saver.hdr.count = cpu_to_le16(saver.attrs->len);
+	saver.hdr.crc = cpu_to_le32(gatt_cache_crc(saver.attrs->data, len));
+
+	data = g_malloc(sizeof(saver.hdr) + len);
+	memcpy(data, &saver.hdr, sizeof(saver.hdr));
+	memcpy(data + sizeof(saver.hdr), saver.attrs->data, len);
+
+	if (!g_file_set_contents(path, data, sizeof(saver.hdr) + len,
+								&gerr)) {
+		error("Unable set contents for %s: (%s)", path, gerr->message);
+		g_error_free(gerr);
+		err = -EIO;
+	}
+
+	g_free(data);
+
+done:
+	g_free(path);
+	g_array_free(saver.attrs, TRUE);
+
+	return err;
+}
+
+void btd_settings_gatt_cache_remove(const char *filename)
+{
+	char *path = gatt_cache_path(filename);
+
+	unlink(path);
+	g_free(path);
+}
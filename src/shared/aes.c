@@ -0,0 +1,536 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "src/shared/util.h"
+#include "src/shared/aes.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AESNI
+#include <wmmintrin.h>
+#endif
+
+/*
+ * Portable AES-128 encryption.
+ *
+ * There are no lookup tables indexed by secret data: SubBytes runs on a
+ * bitsliced copy of the state using the Boyar-Peralta S-box circuit and
+ * MixColumns uses masked arithmetic, so execution time does not depend
+ * on the key or the data.
+ */
+static void sbox_bitslice(uint32_t q[8])
+{
+	uint32_t x0, x1, x2, x3, x4, x5, x6, x7;
+	uint32_t y1, y2, y3, y4, y5, y6, y7, y8, y9;
+	uint32_t y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+	uint32_t y20, y21;
+	uint32_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+	uint32_t z10, z11, z12, z13, z14, z15, z16, z17;
+	uint32_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+	uint32_t t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+	uint32_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+	uint32_t t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+	uint32_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+	uint32_t t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+	uint32_t t60, t61, t62, t63, t64, t65, t66, t67;
+	uint32_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+	x0 = q[7];
+	x1 = q[6];
+	x2 = q[5];
+	x3 = q[4];
+	x4 = q[3];
+	x5 = q[2];
+	x6 = q[1];
+	x7 = q[0];
+
+	/* Top linear transformation */
+	y14 = x3 ^ x5;
+	y13 = x0 ^ x6;
+	y9 = x0 ^ x3;
+	y8 = x0 ^ x5;
+	t0 = x1 ^ x2;
+	y1 = t0 ^ x7;
+	y4 = y1 ^ x3;
+	y12 = y13 ^ y14;
+	y2 = y1 ^ x0;
+	y5 = y1 ^ x6;
+	y3 = y5 ^ y8;
+	t1 = x4 ^ y12;
+	y15 = t1 ^ x5;
+	y20 = t1 ^ x1;
+	y6 = y15 ^ x7;
+	y10 = y15 ^ t0;
+	y11 = y20 ^ y9;
+	y7 = x7 ^ y11;
+	y17 = y10 ^ y11;
+	y19 = y10 ^ y8;
+	y16 = t0 ^ y11;
+	y21 = y13 ^ y16;
+	y18 = x0 ^ y16;
+
+	/* Non-linear section */
+	t2 = y12 & y15;
+	t3 = y3 & y6;
+	t4 = t3 ^ t2;
+	t5 = y4 & x7;
+	t6 = t5 ^ t2;
+	t7 = y13 & y16;
+	t8 = y5 & y1;
+	t9 = t8 ^ t7;
+	t10 = y2 & y7;
+	t11 = t10 ^ t7;
+	t12 = y9 & y11;
+	t13 = y14 & y17;
+	t14 = t13 ^ t12;
+	t15 = y8 & y10;
+	t16 = t15 ^ t12;
+	t17 = t4 ^ t14;
+	t18 = t6 ^ t16;
+	t19 = t9 ^ t14;
+	t20 = t11 ^ t16;
+	t21 = t17 ^ y20;
+	t22 = t18 ^ y19;
+	t23 = t19 ^ y21;
+	t24 = t20 ^ y18;
+
+	t25 = t21 ^ t22;
+	t26 = t21 & t23;
+	t27 = t24 ^ t26;
+	t28 = t25 & t27;
+	t29 = t28 ^ t22;
+	t30 = t23 ^ t24;
+	t31 = t22 ^ t26;
+	t32 = t31 & t30;
+	t33 = t32 ^ t24;
+	t34 = t23 ^ t33;
+	t35 = t27 ^ t33;
+	t36 = t24 & t35;
+	t37 = t36 ^ t34;
+	t38 = t27 ^ t36;
+	t39 = t29 & t38;
+	t40 = t25 ^ t39;
+
+	t41 = t40 ^ t37;
+	t42 = t29 ^ t33;
+	t43 = t29 ^ t40;
+	t44 = t33 ^ t37;
+	t45 = t42 ^ t41;
+	z0 = t44 & y15;
+	z1 = t37 & y6;
+	z2 = t33 & x7;
+	z3 = t43 & y16;
+	z4 = t40 & y1;
+	z5 = t29 & y7;
+	z6 = t42 & y11;
+	z7 = t45 & y17;
+	z8 = t41 & y10;
+	z9 = t44 & y12;
+	z10 = t37 & y3;
+	z11 = t33 & y4;
+	z12 = t43 & y13;
+	z13 = t40 & y5;
+	z14 = t29 & y2;
+	z15 = t42 & y9;
+	z16 = t45 & y14;
+	z17 = t41 & y8;
+
+	/* Bottom linear transformation */
+	t46 = z15 ^ z16;
+	t47 = z10 ^ z11;
+	t48 = z5 ^ z13;
+	t49 = z9 ^ z10;
+	t50 = z2 ^ z12;
+	t51 = z2 ^ z5;
+	t52 = z7 ^ z8;
+	t53 = z0 ^ z3;
+	t54 = z6 ^ z7;
+	t55 = z16 ^ z17;
+	t56 = z12 ^ t48;
+	t57 = t50 ^ t53;
+	t58 = z4 ^ t46;
+	t59 = z3 ^ t54;
+	t60 = t46 ^ t57;
+	t61 = z14 ^ t57;
+	t62 = t52 ^ t58;
+	t63 = t49 ^ t58;
+	t64 = z4 ^ t59;
+	t65 = t61 ^ t62;
+	t66 = z1 ^ t63;
+	s0 = t59 ^ t63;
+	s6 = t56 ^ ~t62;
+	s7 = t48 ^ ~t60;
+	t67 = t64 ^ t65;
+	s3 = t53 ^ t66;
+	s4 = t51 ^ t66;
+	s5 = t47 ^ t65;
+	s1 = t64 ^ ~s3;
+	s2 = t55 ^ ~t67;
+
+	q[7] = s0;
+	q[6] = s1;
+	q[5] = s2;
+	q[4] = s3;
+	q[3] = s4;
+	q[2] = s5;
+	q[1] = s6;
+	q[0] = s7;
+}
+
+/* Transpose an 8x8 bit matrix stored one row per octet */
+static uint64_t transpose8(uint64_t x)
+{
+	uint64_t t;
+
+	t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+	x ^= t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+	x ^= t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+	x ^= t ^ (t << 28);
+
+	return x;
+}
+
+static void sub_bytes(uint8_t s[16])
+{
+	uint64_t lo, hi;
+	uint32_t q[8];
+	int i;
+
+	/* Plane i holds bit i of every octet of the state */
+	lo = transpose8(get_le64(s));
+	hi = transpose8(get_le64(s + 8));
+
+	for (i = 0; i < 8; i++)
+		q[i] = ((lo >> (i * 8)) & 0xff) |
+					(((hi >> (i * 8)) & 0xff) << 8);
+
+	sbox_bitslice(q);
+
+	lo = 0;
+	hi = 0;
+
+	for (i = 0; i < 8; i++) {
+		lo |= (uint64_t) (q[i] & 0xff) << (i * 8);
+		hi |= (uint64_t) ((q[i] >> 8) & 0xff) << (i * 8);
+	}
+
+	put_le64(transpose8(lo), s);
+	put_le64(transpose8(hi), s + 8);
+}
+
+static void shift_rows(uint8_t s[16])
+{
+	uint8_t t;
+
+	t = s[1];
+	s[1] = s[5];
+	s[5] = s[9];
+	s[9] = s[13];
+	s[13] = t;
+
+	t = s[2];
+	s[2] = s[10];
+	s[10] = t;
+	t = s[6];
+	s[6] = s[14];
+	s[14] = t;
+
+	t = s[15];
+	s[15] = s[11];
+	s[11] = s[7];
+	s[7] = s[3];
+	s[3] = t;
+}
+
+static inline uint32_t xtime32(uint32_t w)
+{
+	return ((w & 0x7f7f7f7f) << 1) ^ (((w >> 7) & 0x01010101) * 0x1b);
+}
+
+static inline uint32_t ror32(uint32_t w, unsigned int n)
+{
+	return (w >> n) | (w << (32 - n));
+}
+
+static void mix_columns(uint8_t s[16])
+{
+	int c;
+
+	for (c = 0; c < 16; c += 4) {
+		uint32_t w = get_le32(s + c);
+		uint32_t r = ror32(w, 8);
+		uint32_t t = w ^ r ^ ror32(w, 16) ^ ror32(w, 24);
+
+		put_le32(w ^ t ^ xtime32(w ^ r), s + c);
+	}
+}
+
+static inline void add_round_key(uint8_t s[16], const uint8_t *rk)
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+		s[i] ^= rk[i];
+}
+
+static void soft_set_key(uint8_t rk[176], const uint8_t key[16])
+{
+	uint8_t t[16];
+	uint8_t rcon = 0x01;
+	int i, j;
+
+	memcpy(rk, key, 16);
+	memset(t, 0, sizeof(t));
+
+	for (i = 16; i < 176; i += 16) {
+		/* RotWord followed by SubWord on the last column */
+		t[0] = rk[i - 3];
+		t[1] = rk[i - 2];
+		t[2] = rk[i - 1];
+		t[3] = rk[i - 4];
+
+		sub_bytes(t);
+
+		t[0] ^= rcon;
+		rcon = (rcon << 1) ^ ((rcon >> 7) * 0x1b);
+
+		for (j = 0; j < 16; j++) {
+			rk[i + j] = rk[i + j - 16] ^ t[j & 3];
+			t[j & 3] = rk[i + j];
+		}
+	}
+
+	memset(t, 0, sizeof(t));
+}
+
+static void soft_encrypt(const uint8_t rk[176], const uint8_t in[16],
+							uint8_t out[16])
+{
+	uint8_t s[16];
+	int round;
+
+	memcpy(s, in, 16);
+	add_round_key(s, rk);
+
+	for (round = 1; round < 10; round++) {
+		sub_bytes(s);
+		shift_rows(s);
+		mix_columns(s);
+		add_round_key(s, rk + round * 16);
+	}
+
+	sub_bytes(s);
+	shift_rows(s);
+	add_round_key(s, rk + 160);
+
+	memcpy(out, s, 16);
+}
+
+#ifdef HAVE_AESNI
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+
+static AESNI_TARGET __m128i aesni_expand(__m128i key, __m128i gen)
+{
+	gen = _mm_shuffle_epi32(gen, 0xff);
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+
+	return _mm_xor_si128(key, gen);
+}
+
+#define AESNI_ROUND_KEY(rk, k, n, rcon) do { \
+	k = aesni_expand(k, _mm_aeskeygenassist_si128(k, rcon)); \
+	_mm_storeu_si128((__m128i *) ((rk) + (n) * 16), k); \
+} while (0)
+
+static AESNI_TARGET void aesni_set_key(uint8_t rk[176], const uint8_t key[16])
+{
+	__m128i k;
+
+	k = _mm_loadu_si128((const __m128i *) key);
+	_mm_storeu_si128((__m128i *) rk, k);
+
+	/* The immediate operand of AESKEYGENASSIST must be a constant */
+	AESNI_ROUND_KEY(rk, k, 1, 0x01);
+	AESNI_ROUND_KEY(rk, k, 2, 0x02);
+	AESNI_ROUND_KEY(rk, k, 3, 0x04);
+	AESNI_ROUND_KEY(rk, k, 4, 0x08);
+	AESNI_ROUND_KEY(rk, k, 5, 0x10);
+	AESNI_ROUND_KEY(rk, k, 6, 0x20);
+	AESNI_ROUND_KEY(rk, k, 7, 0x40);
+	AESNI_ROUND_KEY(rk, k, 8, 0x80);
+	AESNI_ROUND_KEY(rk, k, 9, 0x1b);
+	AESNI_ROUND_KEY(rk, k, 10, 0x36);
+}
+
+static AESNI_TARGET void aesni_encrypt(const uint8_t rk[176],
+					const uint8_t in[16], uint8_t out[16])
+{
+	__m128i s;
+	int round;
+
+	s = _mm_loadu_si128((const __m128i *) in);
+	s = _mm_xor_si128(s, _mm_loadu_si128((const __m128i *) rk));
+
+	for (round = 1; round < 10; round++)
+		s = _mm_aesenc_si128(s, _mm_loadu_si128((const __m128i *)
+							(rk + round * 16)));
+
+	s = _mm_aesenclast_si128(s, _mm_loadu_si128((const __m128i *)
+								(rk + 160)));
+
+	_mm_storeu_si128((__m128i *) out, s);
+}
+#endif
+
+bool bt_aes_hw_available(void)
+{
+#ifdef HAVE_AESNI
+	static int supported = -1;
+
+	if (supported < 0) {
+		__builtin_cpu_init();
+		supported = __builtin_cpu_supports("aes") &&
+					__builtin_cpu_supports("sse2");
+	}
+
+	return supported;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Expand an AES-128 key. The key octets are used in the order given, the
+ * same as with the kernel ecb(aes) and cmac(aes) algorithms. The round
+ * keys have the same layout for both implementations, only the selected
+ * encryption routine differs.
+ */
+void bt_aes_set_key(struct bt_aes_key *key, const uint8_t k[16], bool hw)
+{
+	key->hw = hw && bt_aes_hw_available();
+
+#ifdef HAVE_AESNI
+	if (key->hw) {
+		aesni_set_key(key->rk, k);
+		return;
+	}
+#endif
+
+	soft_set_key(key->rk, k);
+}
+
+void bt_aes_encrypt(const struct bt_aes_key *key, const uint8_t in[16],
+							uint8_t out[16])
+{
+#ifdef HAVE_AESNI
+	if (key->hw) {
+		aesni_encrypt(key->rk, in, out);
+		return;
+	}
+#endif
+
+	soft_encrypt(key->rk, in, out);
+}
+
+void bt_aes_clear_key(struct bt_aes_key *key)
+{
+	volatile uint8_t *p = key->rk;
+	size_t i;
+
+	for (i = 0; i < sizeof(key->rk); i++)
+		p[i] = 0;
+}
+
+static void cmac_subkey(const uint8_t in[16], uint8_t out[16])
+{
+	uint8_t msb = in[0] >> 7;
+	int i;
+
+	for (i = 0; i < 15; i++)
+		out[i] = (in[i] << 1) | (in[i + 1] >> 7);
+
+	out[15] = (in[15] << 1) ^ (0x87 & -msb);
+}
+
+/* AES-CMAC as specified in RFC 4493 */
+void bt_aes_cmac_init(struct bt_aes_cmac *cmac, const uint8_t k[16], bool hw)
+{
+	bt_aes_set_key(&cmac->key, k, hw);
+	memset(cmac->x, 0, sizeof(cmac->x));
+	cmac->len = 0;
+}
+
+void bt_aes_cmac_update(struct bt_aes_cmac *cmac, const void *data,
+								size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len) {
+		size_t n;
+
+		/*
+		 * The last block gets special treatment in final, so a
+		 * full block is only processed once more data follows.
+		 */
+		if (cmac->len == BT_AES_BLOCK_SIZE) {
+			add_round_key(cmac->x, cmac->buf);
+			bt_aes_encrypt(&cmac->key, cmac->x, cmac->x);
+			cmac->len = 0;
+		}
+
+		n = BT_AES_BLOCK_SIZE - cmac->len;
+		if (n > len)
+			n = len;
+
+		memcpy(cmac->buf + cmac->len, p, n);
+		cmac->len += n;
+		p += n;
+		len -= n;
+	}
+}
+
+void bt_aes_cmac_final(struct bt_aes_cmac *cmac, uint8_t res[16])
+{
+	uint8_t l[16], k1[16], k2[16];
+	const uint8_t zero[16] = {};
+
+	bt_aes_encrypt(&cmac->key, zero, l);
+	cmac_subkey(l, k1);
+
+	if (cmac->len == BT_AES_BLOCK_SIZE) {
+		add_round_key(cmac->x, cmac->buf);
+		add_round_key(cmac->x, k1);
+	} else {
+		cmac_subkey(k1, k2);
+
+		memset(cmac->buf + cmac->len, 0,
+					BT_AES_BLOCK_SIZE - cmac->len);
+		cmac->buf[cmac->len] = 0x80;
+
+		add_round_key(cmac->x, cmac->buf);
+		add_round_key(cmac->x, k2);
+	}
+
+	bt_aes_encrypt(&cmac->key, cmac->x, res);
+
+	bt_aes_clear_key(&cmac->key);
+	memset(l, 0, sizeof(l));
+	memset(k1, 0, sizeof(k1));
+	memset(k2, 0, sizeof(k2));
+	memset(cmac->x, 0, sizeof(cmac->x));
+	cmac->len = 0;
+}
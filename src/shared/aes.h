@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BT_AES_BLOCK_SIZE	16
+
+struct bt_aes_key {
+	uint8_t rk[176];
+	bool hw;
+};
+
+struct bt_aes_cmac {
+	struct bt_aes_key key;
+	uint8_t x[BT_AES_BLOCK_SIZE];
+	uint8_t buf[BT_AES_BLOCK_SIZE];
+	uint8_t len;
+};
+
+bool bt_aes_hw_available(void);
+
+void bt_aes_set_key(struct bt_aes_key *key, const uint8_t k[16], bool hw);
+void bt_aes_encrypt(const struct bt_aes_key *key, const uint8_t in[16],
+							uint8_t out[16]);
+void bt_aes_clear_key(struct bt_aes_key *key);
+
+void bt_aes_cmac_init(struct bt_aes_cmac *cmac, const uint8_t k[16], bool hw);
+void bt_aes_cmac_update(struct bt_aes_cmac *cmac, const void *data,
+								size_t len);
+void bt_aes_cmac_final(struct bt_aes_cmac *cmac, uint8_t res[16]);
@@ -12,9 +12,11 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/socket.h>
 
 #include "src/shared/io.h"
 #include "src/shared/queue.h"
@@ -34,7 +36,15 @@
 /* Length of signature in write signed packet */
 #define BT_ATT_SIGNATURE_LEN		12
 
+/* Notifications queued in place, see bt_att_send_nfy() */
+#define ATT_NFY_RING_LEN		32
+#define ATT_NFY_PDU_LEN			BT_ATT_MAX_LE_MTU
+
+/* Maximum number of PDUs written on a single writable wakeup */
+#define ATT_WRITE_BATCH_MAX		32
+
 struct att_send_op;
+struct att_nfy_ring;
 
 struct bt_att_chan {
 	struct bt_att *att;
@@ -72,6 +82,8 @@ struct bt_att {
 	struct queue *req_queue;	/* Queued ATT protocol requests */
 	struct queue *ind_queue;	/* Queued ATT protocol indications */
 	struct queue *write_queue;	/* Queue of PDUs ready to send */
+	struct att_nfy_ring *nfy_ring;	/* Notifications ready to send */
+	uint8_t write_batch;		/* PDUs written per wakeup */
 	bool in_disc;			/* Cleanup queues on disconnect_cb */
 
 	bt_att_timeout_func_t timeout_callback;
@@ -194,11 +206,24 @@ struct att_send_op {
 	void *pdu;
 	uint16_t len;
 	bool retry;
+	bool pooled;
 	bt_att_response_func_t callback;
 	bt_att_destroy_func_t destroy;
 	void *user_data;
 };
 
+/*
+ * Preallocated notification operations, each with its own PDU buffer,
+ * used in FIFO order. A slot is free again once its operation has been
+ * destroyed, which is marked by a zero length.
+ */
+struct att_nfy_ring {
+	struct att_send_op ops[ATT_NFY_RING_LEN];
+	uint8_t pdus[ATT_NFY_RING_LEN][ATT_NFY_PDU_LEN];
+	unsigned int head;
+	unsigned int len;
+};
+
 static void destroy_att_send_op(void *data)
 {
 	struct att_send_op *op = data;
@@ -209,6 +234,12 @@ static void destroy_att_send_op(void *data)
 	if (op->destroy)
 		op->destroy(op->user_data);
 
+	/* Give the slot back to the notification ring */
+	if (op->pooled) {
+		op->len = 0;
+		return;
+	}
+
 	free(op->pdu);
 	free(op);
 }
@@ -413,19 +444,82 @@ static struct att_send_op *create_att_send_op(struct bt_att *att,
 	return op;
 }
 
+static struct att_nfy_ring *nfy_ring_get(struct bt_att *att)
+{
+	struct att_nfy_ring *ring = att->nfy_ring;
+	unsigned int i;
+
+	if (ring)
+		return ring;
+
+	ring = new0(struct att_nfy_ring, 1);
+
+	for (i = 0; i < ATT_NFY_RING_LEN; i++) {
+		ring->ops[i].type = ATT_OP_TYPE_NFY;
+		ring->ops[i].pdu = ring->pdus[i];
+		ring->ops[i].pooled = true;
+	}
+
+	att->nfy_ring = ring;
+
+	return ring;
+}
+
+static bool nfy_ring_isempty(struct bt_att *att)
+{
+	return !att->nfy_ring || !att->nfy_ring->len;
+}
+
+static struct att_send_op *nfy_ring_peek(struct bt_att *att)
+{
+	if (nfy_ring_isempty(att))
+		return NULL;
+
+	return &att->nfy_ring->ops[att->nfy_ring->head];
+}
+
+static struct att_send_op *nfy_ring_pop(struct bt_att *att)
+{
+	struct att_nfy_ring *ring = att->nfy_ring;
+	struct att_send_op *op;
+
+	op = &ring->ops[ring->head];
+	ring->head = (ring->head + 1) % ATT_NFY_RING_LEN;
+	ring->len--;
+
+	return op;
+}
+
+static void nfy_ring_clear(struct bt_att *att)
+{
+	struct att_nfy_ring *ring = att->nfy_ring;
+
+	if (!ring)
+		return;
+
+	while (ring->len)
+		destroy_att_send_op(nfy_ring_pop(att));
+}
+
 static struct att_send_op *pick_next_send_op(struct bt_att_chan *chan)
 {
 	struct bt_att *att = chan->att;
-	struct att_send_op *op;
+	struct att_send_op *op, *nfy;
 
 	/* Check if there is anything queued on the channel */
 	op = queue_pop_head(chan->queue);
 	if (op)
 		return op;
 
-	/* See if any operations are already in the write queue */
+	/* See if any operations are already in the write queue, queued
+	 * notifications are kept in order with it by their ids.
+	 */
 	op = queue_peek_head(att->write_queue);
-	if (op && op->len <= chan->mtu)
+	nfy = nfy_ring_peek(att);
+	if (nfy && (!op || (int) (nfy->id - op->id) < 0)) {
+		if (nfy->len <= chan->mtu)
+			return nfy_ring_pop(att);
+	} else if (op && op->len <= chan->mtu)
 		return queue_pop_head(att->write_queue);
 
 	/* If there is no pending request, pick an operation from the
@@ -541,24 +635,50 @@ static ssize_t bt_att_chan_write(struct bt_att_chan *chan, uint8_t opcode,
 	return ret;
 }
 
-static bool can_write_data(struct io *io, void *user_data)
+static int bt_att_chan_write_batch(struct bt_att_chan *chan,
+						struct att_send_op **ops,
+						unsigned int count)
 {
-	struct bt_att_chan *chan = user_data;
-	struct att_send_op *op;
-	struct timeout_data *timeout;
+	struct bt_att *att = chan->att;
+	struct mmsghdr msgs[ATT_WRITE_BATCH_MAX];
+	struct iovec iov[ATT_WRITE_BATCH_MAX];
+	unsigned int i;
+	int ret;
 
-	op = pick_next_send_op(chan);
-	if (!op)
-		return false;
+	memset(msgs, 0, count * sizeof(*msgs));
 
-	if (!bt_att_chan_write(chan, op->opcode, op->pdu, op->len)) {
-		if (op->callback)
-			op->callback(BT_ATT_OP_ERROR_RSP, NULL, 0,
-							op->user_data);
-		destroy_att_send_op(op);
-		return true;
+	for (i = 0; i < count; i++) {
+		iov[i].iov_base = ops[i]->pdu;
+		iov[i].iov_len = ops[i]->len;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
 	}
 
+	do {
+		ret = sendmmsg(chan->fd, msgs, count, MSG_DONTWAIT);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0) {
+		ret = -errno;
+		DBG(att, "(chan %p) write failed: %s", chan, strerror(-ret));
+		return ret;
+	}
+
+	for (i = 0; i < (unsigned int) ret; i++) {
+		VERBOSE(att, "(chan %p) ATT op 0x%02x", chan, ops[i]->opcode);
+
+		if (att->debug_level)
+			util_hexdump('<', ops[i]->pdu, msgs[i].msg_len,
+					att->debug_callback, att->debug_data);
+	}
+
+	return ret;
+}
+
+static void write_complete(struct bt_att_chan *chan, struct att_send_op *op)
+{
+	struct timeout_data *timeout;
+
 	/* Based on the operation type, set either the pending request or the
 	 * pending indication. If it came from the write queue, then there is
 	 * no need to keep it around.
@@ -580,7 +700,7 @@ static bool can_write_data(struct io *io, void *user_data)
 	case ATT_OP_TYPE_UNKNOWN:
 	default:
 		destroy_att_send_op(op);
-		return true;
+		return;
 	}
 
 	timeout = new0(struct timeout_data, 1);
@@ -588,6 +708,64 @@ static bool can_write_data(struct io *io, void *user_data)
 	timeout->id = op->id;
 	op->timeout_id = timeout_add(ATT_TIMEOUT_INTERVAL, timeout_cb,
 								timeout, free);
+}
+
+static bool can_write_data(struct io *io, void *user_data)
+{
+	struct bt_att_chan *chan = user_data;
+	struct att_send_op *ops[ATT_WRITE_BATCH_MAX];
+	struct att_send_op *op;
+	unsigned int count = 0, first = 0, i;
+	int ret;
+
+	/* Gather PDUs in the order they would be picked one wakeup at a time,
+	 * stopping after a request or an indication since only one of each
+	 * can be pending.
+	 */
+	while (count < chan->att->write_batch) {
+		op = pick_next_send_op(chan);
+		if (!op)
+			break;
+
+		ops[count++] = op;
+
+		if (op->type == ATT_OP_TYPE_REQ || op->type == ATT_OP_TYPE_IND)
+			break;
+	}
+
+	if (!count)
+		return false;
+
+	if (count > 1)
+		ret = bt_att_chan_write_batch(chan, ops, count);
+	else {
+		ret = bt_att_chan_write(chan, ops[0]->opcode, ops[0]->pdu,
+								ops[0]->len);
+		if (ret >= 0)
+			ret = 1;
+	}
+
+	if (ret < 0) {
+		/* Drop the PDU unless the socket is just full */
+		if (ret != -EAGAIN) {
+			op = ops[0];
+
+			if (op->callback)
+				op->callback(BT_ATT_OP_ERROR_RSP, NULL, 0,
+							op->user_data);
+			destroy_att_send_op(op);
+			first = 1;
+		}
+
+		ret = first;
+	}
+
+	for (i = first; i < (unsigned int) ret; i++)
+		write_complete(chan, ops[i]);
+
+	/* Put back what could not be written, it goes out first next time */
+	while (count > (unsigned int) ret)
+		queue_push_head(chan->queue, ops[--count]);
 
 	/* Return true as there may be more operations ready to write. */
 	return true;
@@ -604,7 +782,8 @@ static void wakeup_chan_writer(void *data, void *user_data)
 	/* Set the write handler only if there is anything that can be sent
 	 * at all.
 	 */
-	if (queue_isempty(chan->queue) && queue_isempty(att->write_queue)) {
+	if (queue_isempty(chan->queue) && queue_isempty(att->write_queue) &&
+						nfy_ring_isempty(att)) {
 		if ((chan->pending_req || queue_isempty(att->req_queue)) &&
 			(chan->pending_ind || queue_isempty(att->ind_queue)))
 			return;
@@ -696,6 +875,7 @@ static bool disconnect_cb(struct io *io, void *user_data)
 	queue_remove_all(att->req_queue, NULL, NULL, disc_att_send_op);
 	queue_remove_all(att->ind_queue, NULL, NULL, disc_att_send_op);
 	queue_remove_all(att->write_queue, NULL, NULL, disc_att_send_op);
+	nfy_ring_clear(att);
 
 	att->in_disc = false;
 
@@ -1148,6 +1328,9 @@ static void bt_att_free(struct bt_att *att)
 	queue_destroy(att->exchange_list, NULL);
 	queue_destroy(att->chans, bt_att_chan_free);
 
+	/* Channels may still hold notifications from the ring */
+	free(att->nfy_ring);
+
 	free(att);
 }
 
@@ -1262,10 +1445,11 @@ struct bt_att *bt_att_new(int fd, bool ext_signed)
 	att = new0(struct bt_att, 1);
 	att->chans = queue_new();
 	att->mtu = chan->mtu;
+	att->write_batch = 1;
 
 	/* crypto is optional, if not available leave it NULL */
 	if (!ext_signed)
-		att->crypto = bt_crypto_new();
+		att->crypto = bt_crypto_new_backend(BT_CRYPTO_BACKEND_FAST);
 
 	att->req_queue = queue_new();
 	att->ind_queue = queue_new();
@@ -1434,6 +1618,20 @@ bool bt_att_set_mtu(struct bt_att *att, uint16_t mtu)
 	return true;
 }
 
+/*
+ * Set how many PDUs not waiting for an answer may be written each time a
+ * channel becomes writable, 1 writes a single PDU per wakeup.
+ */
+bool bt_att_set_write_batch(struct bt_att *att, uint8_t max)
+{
+	if (!att || !max || max > ATT_WRITE_BATCH_MAX)
+		return false;
+
+	att->write_batch = max;
+
+	return true;
+}
+
 uint8_t bt_att_get_link_type(struct bt_att *att)
 {
 	struct bt_att_chan *chan;
@@ -1634,6 +1832,80 @@ done:
 	return op->id;
 }
 
+/*
+ * Send a notification gathered from iov. Unless the ring is full or the PDU
+ * does not fit, the PDU is built directly into a preallocated operation so
+ * that no memory is allocated.
+ */
+bool bt_att_send_nfy(struct bt_att *att, uint8_t opcode,
+					const struct iovec *iov, int iovcnt)
+{
+	struct att_nfy_ring *ring;
+	struct att_send_op *op = NULL;
+	uint8_t *pdu;
+	size_t len = 1;
+	int i;
+
+	if (!att || queue_isempty(att->chans))
+		return false;
+
+	if (get_op_type(opcode) != ATT_OP_TYPE_NFY)
+		return false;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	if (len > att->mtu)
+		return false;
+
+	ring = nfy_ring_get(att);
+
+	if (len <= ATT_NFY_PDU_LEN && ring->len < ATT_NFY_RING_LEN) {
+		op = &ring->ops[(ring->head + ring->len) % ATT_NFY_RING_LEN];
+
+		/* Still owned by a channel writing it out */
+		if (op->len)
+			op = NULL;
+	}
+
+	if (!op) {
+		op = new0(struct att_send_op, 1);
+		op->type = ATT_OP_TYPE_NFY;
+		op->pdu = malloc(len);
+		if (!op->pdu) {
+			free(op);
+			return false;
+		}
+	}
+
+	op->opcode = opcode;
+	op->len = len;
+
+	pdu = op->pdu;
+	pdu[0] = opcode;
+
+	for (i = 0, len = 1; i < iovcnt; i++) {
+		memcpy(pdu + len, iov[i].iov_base, iov[i].iov_len);
+		len += iov[i].iov_len;
+	}
+
+	if (att->next_send_id < 1)
+		att->next_send_id = 1;
+
+	op->id = att->next_send_id++;
+
+	if (op->pooled)
+		ring->len++;
+	else if (!queue_push_tail(att->write_queue, op)) {
+		destroy_att_send_op(op);
+		return false;
+	}
+
+	wakeup_writer(att);
+
+	return true;
+}
+
 int bt_att_resend(struct bt_att *att, unsigned int id, uint8_t opcode,
 				const void *pdu, uint16_t length,
 				bt_att_response_func_t callback,
@@ -1832,6 +2104,7 @@ bool bt_att_cancel_all(struct bt_att *att)
 	queue_remove_all(att->req_queue, NULL, NULL, destroy_att_send_op);
 	queue_remove_all(att->ind_queue, NULL, NULL, destroy_att_send_op);
 	queue_remove_all(att->write_queue, NULL, NULL, destroy_att_send_op);
+	nfy_ring_clear(att);
 
 	for (entry = queue_get_entries(att->chans); entry;
 						entry = entry->next) {
@@ -10,6 +10,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "src/shared/att-types.h"
 
@@ -53,6 +54,7 @@ bool bt_att_set_debug(struct bt_att *att, uint8_t level,
 uint16_t bt_att_get_mtu(struct bt_att *att);
 bool bt_att_set_mtu(struct bt_att *att, uint16_t mtu);
 uint8_t bt_att_get_link_type(struct bt_att *att);
+bool bt_att_set_write_batch(struct bt_att *att, uint8_t max);
 
 bool bt_att_set_timeout_cb(struct bt_att *att, bt_att_timeout_func_t callback,
 						void *user_data,
@@ -63,6 +65,8 @@ unsigned int bt_att_send(struct bt_att *att, uint8_t opcode,
 					bt_att_response_func_t callback,
 					void *user_data,
 					bt_att_destroy_func_t destroy);
+bool bt_att_send_nfy(struct bt_att *att, uint8_t opcode,
+					const struct iovec *iov, int iovcnt);
 int bt_att_resend(struct bt_att *att, unsigned int id, uint8_t opcode,
 					const void *pdu, uint16_t length,
 					bt_att_response_func_t callback,
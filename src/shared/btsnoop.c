@@ -14,14 +14,18 @@
 
 #define _GNU_SOURCE
 #include <endian.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <limits.h>
+#include <time.h>
 #include <arpa/inet.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #include "src/shared/btsnoop.h"
 
@@ -54,6 +58,28 @@ struct pklg_pkt {
 } __attribute__ ((packed));
 #define PKLG_PKT_SIZE (sizeof(struct pklg_pkt))
 
+/*
+ * With BTSNOOP_FLAG_BUFFERED, records are coalesced in user space and
+ * written out once the buffer fills up or once the oldest pending record
+ * is older than the flush interval. Readers use the same buffer size for
+ * read-ahead.
+ */
+#define BTSNOOP_BUF_SIZE		(64 * 1024)
+#define BTSNOOP_FLUSH_INTERVAL		1000	/* msec */
+
+/*
+ * With BTSNOOP_FLAG_MMAP, the file is mapped and an index of all records
+ * can be built on demand. It allows restricting btsnoop_read_hci() to a
+ * time range or a single connection handle without parsing the records
+ * outside of it.
+ */
+struct btsnoop_record {
+	uint64_t offset;
+	uint64_t ts;		/* Microseconds since the Unix epoch */
+	uint16_t opcode;
+	uint16_t handle;
+};
+
 struct btsnoop {
 	int ref_count;
 	int fd;
@@ -68,8 +94,137 @@ struct btsnoop {
 	size_t cur_size;
 	unsigned int max_count;
 	unsigned int cur_count;
+	uint8_t *wbuf;
+	size_t wbuf_len;
+	uint64_t wbuf_time;
+	uint8_t *rbuf;
+	size_t rbuf_len;
+	size_t rbuf_pos;
+	uint8_t *map;
+	size_t map_size;
+	size_t map_start;
+	size_t map_pos;
+	struct btsnoop_record *records;
+	size_t num_records;
+	bool records_sorted;
+	size_t rec_pos;
+	size_t rec_end;
+	uint64_t range_start;
+	uint64_t range_end;
+	uint16_t filter_handle;
 };
 
+static uint64_t get_time_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+static bool write_iov(int fd, struct iovec *iov, int iovcnt)
+{
+	while (iovcnt > 0) {
+		ssize_t written;
+
+		written = writev(fd, iov, iovcnt);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		while (iovcnt > 0 && (size_t) written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+
+		if (iovcnt > 0) {
+			iov->iov_base = (uint8_t *) iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+
+	return true;
+}
+
+static ssize_t read_data(struct btsnoop *btsnoop, void *data, size_t size)
+{
+	uint8_t *ptr = data;
+	size_t total = 0;
+
+	if (btsnoop->map) {
+		if (size > btsnoop->map_size - btsnoop->map_pos)
+			size = btsnoop->map_size - btsnoop->map_pos;
+
+		memcpy(data, btsnoop->map + btsnoop->map_pos, size);
+		btsnoop->map_pos += size;
+
+		return size;
+	}
+
+	if (!btsnoop->rbuf)
+		return read(btsnoop->fd, data, size);
+
+	while (total < size) {
+		size_t avail = btsnoop->rbuf_len - btsnoop->rbuf_pos;
+
+		if (!avail) {
+			ssize_t len;
+
+			len = read(btsnoop->fd, btsnoop->rbuf, BTSNOOP_BUF_SIZE);
+			if (len < 0) {
+				if (errno == EINTR)
+					continue;
+				return -1;
+			}
+
+			if (len == 0)
+				break;
+
+			btsnoop->rbuf_len = len;
+			btsnoop->rbuf_pos = 0;
+			continue;
+		}
+
+		if (avail > size - total)
+			avail = size - total;
+
+		memcpy(ptr + total, btsnoop->rbuf + btsnoop->rbuf_pos, avail);
+		btsnoop->rbuf_pos += avail;
+		total += avail;
+	}
+
+	return total;
+}
+
+static void map_file(struct btsnoop *btsnoop)
+{
+	struct stat st;
+	off_t pos;
+	void *map;
+
+	if (fstat(btsnoop->fd, &st) < 0 || !S_ISREG(st.st_mode))
+		return;
+
+	pos = lseek(btsnoop->fd, 0, SEEK_CUR);
+	if (pos < 0 || pos > st.st_size)
+		return;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, btsnoop->fd, 0);
+	if (map == MAP_FAILED)
+		return;
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	btsnoop->map = map;
+	btsnoop->map_size = st.st_size;
+	btsnoop->map_start = pos;
+	btsnoop->map_pos = pos;
+}
+
 struct btsnoop *btsnoop_open(const char *path, unsigned long flags)
 {
 	struct btsnoop *btsnoop;
@@ -117,6 +272,18 @@ struct btsnoop *btsnoop_open(const char *path, unsigned long flags)
 		lseek(btsnoop->fd, 0, SEEK_SET);
 	}
 
+	btsnoop->filter_handle = 0xffff;
+
+	/* Fall back to regular reads if the file cannot be mapped */
+	if (btsnoop->flags & BTSNOOP_FLAG_MMAP)
+		map_file(btsnoop);
+
+	if (!btsnoop->map && (btsnoop->flags & BTSNOOP_FLAG_BUFFERED)) {
+		btsnoop->rbuf = malloc(BTSNOOP_BUF_SIZE);
+		if (!btsnoop->rbuf)
+			goto failed;
+	}
+
 	return btsnoop_ref(btsnoop);
 
 failed:
@@ -127,7 +294,8 @@ failed:
 }
 
 struct btsnoop *btsnoop_create(const char *path, size_t max_size,
-					unsigned int max_count, uint32_t format)
+					unsigned int max_count, uint32_t format,
+					unsigned long flags)
 {
 	struct btsnoop *btsnoop;
 	struct btsnoop_hdr hdr;
@@ -157,12 +325,22 @@ struct btsnoop *btsnoop_create(const char *path, size_t max_size,
 		return NULL;
 	}
 
+	btsnoop->flags = flags;
 	btsnoop->format = format;
 	btsnoop->index = 0xffff;
 	btsnoop->path = path;
 	btsnoop->max_count = max_count;
 	btsnoop->max_size = max_size;
 
+	if (btsnoop->flags & BTSNOOP_FLAG_BUFFERED) {
+		btsnoop->wbuf = malloc(BTSNOOP_BUF_SIZE);
+		if (!btsnoop->wbuf) {
+			close(btsnoop->fd);
+			free(btsnoop);
+			return NULL;
+		}
+	}
+
 	memcpy(hdr.id, btsnoop_id, sizeof(btsnoop_id));
 	hdr.version = htobe32(btsnoop_version);
 	hdr.type = htobe32(btsnoop->format);
@@ -170,6 +348,7 @@ struct btsnoop *btsnoop_create(const char *path, size_t max_size,
 	written = write(btsnoop->fd, &hdr, BTSNOOP_HDR_SIZE);
 	if (written < 0) {
 		close(btsnoop->fd);
+		free(btsnoop->wbuf);
 		free(btsnoop);
 		return NULL;
 	}
@@ -197,9 +376,17 @@ void btsnoop_unref(struct btsnoop *btsnoop)
 	if (__sync_sub_and_fetch(&btsnoop->ref_count, 1))
 		return;
 
+	btsnoop_flush(btsnoop);
+
 	if (btsnoop->fd >= 0)
 		close(btsnoop->fd);
 
+	if (btsnoop->map)
+		munmap(btsnoop->map, btsnoop->map_size);
+
+	free(btsnoop->records);
+	free(btsnoop->wbuf);
+	free(btsnoop->rbuf);
 	free(btsnoop);
 }
 
@@ -211,12 +398,72 @@ uint32_t btsnoop_get_format(struct btsnoop *btsnoop)
 	return btsnoop->format;
 }
 
+bool btsnoop_flush(struct btsnoop *btsnoop)
+{
+	struct iovec iov;
+
+	if (!btsnoop)
+		return false;
+
+	if (!btsnoop->wbuf_len)
+		return true;
+
+	iov.iov_base = btsnoop->wbuf;
+	iov.iov_len = btsnoop->wbuf_len;
+
+	btsnoop->wbuf_len = 0;
+
+	return write_iov(btsnoop->fd, &iov, 1);
+}
+
+static bool write_buffered(struct btsnoop *btsnoop, struct btsnoop_pkt *pkt,
+					const void *data, uint16_t size)
+{
+	struct iovec iov[3];
+
+	/*
+	 * If the record does not fit, write out what is pending together
+	 * with the record itself instead of copying it first.
+	 */
+	if (btsnoop->wbuf_len + BTSNOOP_PKT_SIZE + size > BTSNOOP_BUF_SIZE) {
+		iov[0].iov_base = btsnoop->wbuf;
+		iov[0].iov_len = btsnoop->wbuf_len;
+		iov[1].iov_base = pkt;
+		iov[1].iov_len = BTSNOOP_PKT_SIZE;
+		iov[2].iov_base = (void *) data;
+		iov[2].iov_len = size;
+
+		btsnoop->wbuf_len = 0;
+
+		return write_iov(btsnoop->fd, iov, 3);
+	}
+
+	if (!btsnoop->wbuf_len)
+		btsnoop->wbuf_time = get_time_ms();
+
+	memcpy(btsnoop->wbuf + btsnoop->wbuf_len, pkt, BTSNOOP_PKT_SIZE);
+	btsnoop->wbuf_len += BTSNOOP_PKT_SIZE;
+
+	if (size) {
+		memcpy(btsnoop->wbuf + btsnoop->wbuf_len, data, size);
+		btsnoop->wbuf_len += size;
+	}
+
+	if (get_time_ms() - btsnoop->wbuf_time >= BTSNOOP_FLUSH_INTERVAL)
+		return btsnoop_flush(btsnoop);
+
+	return true;
+}
+
 static bool btsnoop_rotate(struct btsnoop *btsnoop)
 {
 	struct btsnoop_hdr hdr;
 	char path[PATH_MAX];
 	ssize_t written;
 
+	/* Pending records belong to the file being closed */
+	btsnoop_flush(btsnoop);
+
 	close(btsnoop->fd);
 
 	/* Check if max number of log files has been reached */
@@ -271,6 +518,15 @@ bool btsnoop_write(struct btsnoop *btsnoop, struct timeval *tv,
 	pkt.drops = htobe32(drops);
 	pkt.ts    = htobe64(ts + 0x00E03AB44A676000ll);
 
+	if (btsnoop->wbuf) {
+		if (!write_buffered(btsnoop, &pkt, data, data ? size : 0))
+			return false;
+
+		btsnoop->cur_size += BTSNOOP_PKT_SIZE + size;
+
+		return true;
+	}
+
 	written = write(btsnoop->fd, &pkt, BTSNOOP_PKT_SIZE);
 	if (written < 0)
 		return false;
@@ -378,7 +634,7 @@ static bool pklg_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 	uint64_t ts;
 	ssize_t len;
 
-	len = read(btsnoop->fd, &pkt, PKLG_PKT_SIZE);
+	len = read_data(btsnoop, &pkt, PKLG_PKT_SIZE);
 	if (len == 0)
 		return false;
 
@@ -453,7 +709,7 @@ static bool pklg_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 		break;
 	}
 
-	len = read(btsnoop->fd, data, toread);
+	len = read_data(btsnoop, data, toread);
 	if (len < 0) {
 		btsnoop->aborted = true;
 		return false;
@@ -504,7 +760,7 @@ static uint16_t get_opcode_from_flags(uint8_t type, uint32_t flags)
 	return 0xffff;
 }
 
-bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
+static bool read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 					uint16_t *index, uint16_t *opcode,
 					void *data, uint16_t *size)
 {
@@ -514,13 +770,10 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 	uint8_t pkt_type;
 	ssize_t len;
 
-	if (!btsnoop || btsnoop->aborted)
-		return false;
-
 	if (btsnoop->pklg_format)
 		return pklg_read_hci(btsnoop, tv, index, opcode, data, size);
 
-	len = read(btsnoop->fd, &pkt, BTSNOOP_PKT_SIZE);
+	len = read_data(btsnoop, &pkt, BTSNOOP_PKT_SIZE);
 	if (len == 0)
 		return false;
 
@@ -548,7 +801,7 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 		break;
 
 	case BTSNOOP_FORMAT_UART:
-		len = read(btsnoop->fd, &pkt_type, 1);
+		len = read_data(btsnoop, &pkt_type, 1);
 		if (len < 0) {
 			btsnoop->aborted = true;
 			return false;
@@ -569,7 +822,7 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 		return false;
 	}
 
-	len = read(btsnoop->fd, data, toread);
+	len = read_data(btsnoop, data, toread);
 	if (len < 0) {
 		btsnoop->aborted = true;
 		return false;
@@ -580,6 +833,479 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 	return true;
 }
 
+static bool is_hci_opcode(uint16_t opcode)
+{
+	switch (opcode) {
+	case BTSNOOP_OPCODE_COMMAND_PKT:
+	case BTSNOOP_OPCODE_EVENT_PKT:
+	case BTSNOOP_OPCODE_ACL_TX_PKT:
+	case BTSNOOP_OPCODE_ACL_RX_PKT:
+	case BTSNOOP_OPCODE_SCO_TX_PKT:
+	case BTSNOOP_OPCODE_SCO_RX_PKT:
+	case BTSNOOP_OPCODE_ISO_TX_PKT:
+	case BTSNOOP_OPCODE_ISO_RX_PKT:
+		return true;
+	}
+
+	return false;
+}
+
+/* Number of Completed Packets and CIS Request report more than one handle */
+#define HANDLE_MULTIPLE	0xfffe
+
+/* Commands whose parameters and return parameters start with a handle */
+static bool cmd_has_handle(uint16_t opcode)
+{
+	switch (opcode) {
+	case 0x0406:	/* Disconnect */
+	case 0x040f:	/* Change Connection Packet Type */
+	case 0x0411:	/* Authentication Requested */
+	case 0x0413:	/* Set Connection Encryption */
+	case 0x0415:	/* Change Connection Link Key */
+	case 0x041b:	/* Read Remote Supported Features */
+	case 0x041c:	/* Read Remote Extended Features */
+	case 0x041d:	/* Read Remote Version Information */
+	case 0x041f:	/* Read Clock Offset */
+	case 0x0420:	/* Read LMP Handle */
+	case 0x0801:	/* Hold Mode */
+	case 0x0803:	/* Sniff Mode */
+	case 0x0804:	/* Exit Sniff Mode */
+	case 0x0807:	/* QoS Setup */
+	case 0x0809:	/* Role Discovery */
+	case 0x080c:	/* Read Link Policy Settings */
+	case 0x080d:	/* Write Link Policy Settings */
+	case 0x0810:	/* Flow Specification */
+	case 0x0811:	/* Sniff Subrating */
+	case 0x0c08:	/* Flush */
+	case 0x0c2d:	/* Read Transmit Power Level */
+	case 0x0c36:	/* Read Link Supervision Timeout */
+	case 0x0c37:	/* Write Link Supervision Timeout */
+	case 0x0c7b:	/* Read Authenticated Payload Timeout */
+	case 0x0c7c:	/* Write Authenticated Payload Timeout */
+	case 0x1401:	/* Read Failed Contact Counter */
+	case 0x1402:	/* Reset Failed Contact Counter */
+	case 0x1403:	/* Read Link Quality */
+	case 0x1405:	/* Read RSSI */
+	case 0x1406:	/* Read AFH Channel Map */
+	case 0x1407:	/* Read Clock */
+	case 0x2013:	/* LE Connection Update */
+	case 0x2015:	/* LE Read Channel Map */
+	case 0x2016:	/* LE Read Remote Features */
+	case 0x2019:	/* LE Start Encryption */
+	case 0x201a:	/* LE Long Term Key Request Reply */
+	case 0x201b:	/* LE Long Term Key Request Negative Reply */
+	case 0x2020:	/* LE Remote Connection Parameter Request Reply */
+	case 0x2021:	/* LE Remote Connection Parameter Request Neg Reply */
+	case 0x2022:	/* LE Set Data Length */
+	case 0x2030:	/* LE Read PHY */
+	case 0x2032:	/* LE Set PHY */
+	case 0x2066:	/* LE Accept CIS Request */
+	case 0x2067:	/* LE Reject CIS Request */
+	case 0x206e:	/* LE Setup ISO Data Path */
+	case 0x206f:	/* LE Remove ISO Data Path */
+	case 0x2079:	/* LE Set Default Subrate */
+	case 0x207e:	/* LE Subrate Request */
+		return true;
+	}
+
+	return false;
+}
+
+static uint16_t get_le_event_handle(const uint8_t *data, uint16_t size)
+{
+	if (size < 5)
+		return 0xffff;
+
+	switch (data[2]) {
+	/* Subevents with the handle right after the status */
+	case 0x01:	/* LE Connection Complete */
+	case 0x03:	/* LE Connection Update Complete */
+	case 0x04:	/* LE Read Remote Features Complete */
+	case 0x0a:	/* LE Enhanced Connection Complete */
+	case 0x0c:	/* LE PHY Update Complete */
+	case 0x19:	/* LE CIS Established */
+	case 0x21:	/* LE Transmit Power Reporting */
+	case 0x23:	/* LE Subrate Change */
+	case 0x29:	/* LE Enhanced Connection Complete v2 */
+		if (size < 6)
+			break;
+		return (data[4] | data[5] << 8) & 0x0fff;
+
+	/* Subevents starting with the handle */
+	case 0x05:	/* LE Long Term Key Request */
+	case 0x06:	/* LE Remote Connection Parameter Request */
+	case 0x07:	/* LE Data Length Change */
+	case 0x14:	/* LE Channel Selection Algorithm */
+	case 0x20:	/* LE Path Loss Threshold */
+		return (data[3] | data[4] << 8) & 0x0fff;
+
+	case 0x1a:	/* LE CIS Request, ACL and CIS handles */
+		if (size < 7)
+			break;
+		return HANDLE_MULTIPLE;
+	}
+
+	return 0xffff;
+}
+
+static uint16_t get_event_handle(const uint8_t *data, uint16_t size)
+{
+	uint16_t opcode;
+
+	switch (data[0]) {
+	/* Events with the handle right after the status */
+	case 0x03:	/* Connection Complete */
+	case 0x05:	/* Disconnection Complete */
+	case 0x06:	/* Authentication Complete */
+	case 0x08:	/* Encryption Change */
+	case 0x09:	/* Change Connection Link Key Complete */
+	case 0x0b:	/* Read Remote Supported Features Complete */
+	case 0x0c:	/* Read Remote Version Information Complete */
+	case 0x0d:	/* QoS Setup Complete */
+	case 0x14:	/* Mode Change */
+	case 0x1c:	/* Read Clock Offset Complete */
+	case 0x1d:	/* Connection Packet Type Changed */
+	case 0x21:	/* Flow Specification Complete */
+	case 0x23:	/* Read Remote Extended Features Complete */
+	case 0x2c:	/* Synchronous Connection Complete */
+	case 0x2d:	/* Synchronous Connection Changed */
+	case 0x2e:	/* Sniff Subrating */
+	case 0x30:	/* Encryption Key Refresh Complete */
+	case 0x59:	/* Encryption Change v2 */
+		if (size < 5)
+			break;
+		return (data[3] | data[4] << 8) & 0x0fff;
+
+	/* Events starting with the handle */
+	case 0x10:	/* Flush Occurred */
+	case 0x1b:	/* Max Slots Change */
+	case 0x38:	/* Link Supervision Timeout Changed */
+	case 0x39:	/* Enhanced Flush Complete */
+	case 0x57:	/* Authenticated Payload Timeout Expired */
+		if (size < 4)
+			break;
+		return (data[2] | data[3] << 8) & 0x0fff;
+
+	case 0x0e:	/* Command Complete */
+		if (size < 8)
+			break;
+
+		opcode = data[3] | data[4] << 8;
+		if (!cmd_has_handle(opcode))
+			break;
+
+		return (data[6] | data[7] << 8) & 0x0fff;
+
+	case 0x13:	/* Number of Completed Packets */
+		if (size < 3 || !data[2] || size < 3 + data[2] * 4)
+			break;
+
+		if (data[2] > 1)
+			return HANDLE_MULTIPLE;
+
+		return (data[3] | data[4] << 8) & 0x0fff;
+
+	case 0x3e:	/* LE Meta Event */
+		return get_le_event_handle(data, size);
+	}
+
+	return 0xffff;
+}
+
+static uint16_t get_handle(uint16_t opcode, const uint8_t *data, uint16_t size)
+{
+	switch (opcode) {
+	case BTSNOOP_OPCODE_ACL_TX_PKT:
+	case BTSNOOP_OPCODE_ACL_RX_PKT:
+	case BTSNOOP_OPCODE_SCO_TX_PKT:
+	case BTSNOOP_OPCODE_SCO_RX_PKT:
+	case BTSNOOP_OPCODE_ISO_TX_PKT:
+	case BTSNOOP_OPCODE_ISO_RX_PKT:
+		if (size < 2)
+			break;
+		return (data[0] | data[1] << 8) & 0x0fff;
+
+	case BTSNOOP_OPCODE_COMMAND_PKT:
+		if (size < 5 || !cmd_has_handle(data[0] | data[1] << 8))
+			break;
+		return (data[3] | data[4] << 8) & 0x0fff;
+
+	case BTSNOOP_OPCODE_EVENT_PKT:
+		if (size < 2)
+			break;
+		return get_event_handle(data, size);
+	}
+
+	return 0xffff;
+}
+
+/* Check the packets reporting several handles against the filter */
+static bool match_multiple(const uint8_t *data, uint16_t size,
+							uint16_t handle)
+{
+	uint8_t i;
+
+	if (size < 3)
+		return false;
+
+	switch (data[0]) {
+	case 0x13:	/* Number of Completed Packets */
+		for (i = 0; i < data[2] && 3 + i * 4 + 1 < size; i++) {
+			const uint8_t *ptr = data + 3 + i * 4;
+
+			if (((ptr[0] | ptr[1] << 8) & 0x0fff) == handle)
+				return true;
+		}
+		break;
+
+	case 0x3e:	/* LE CIS Request */
+		if (size < 7)
+			break;
+
+		return ((data[3] | data[4] << 8) & 0x0fff) == handle ||
+				((data[5] | data[6] << 8) & 0x0fff) == handle;
+	}
+
+	return false;
+}
+
+static bool build_index(struct btsnoop *btsnoop)
+{
+	uint8_t data[BTSNOOP_MAX_PACKET_SIZE];
+	size_t alloc = 0, pos;
+	struct timeval tv;
+	uint16_t index, opcode, size;
+
+	if (btsnoop->records)
+		return true;
+
+	if (!btsnoop->map || btsnoop->aborted)
+		return false;
+
+	/* Simulator traces hold PHY frames which are not indexed */
+	if (btsnoop->format == BTSNOOP_FORMAT_SIMULATOR)
+		return false;
+
+	pos = btsnoop->map_pos;
+	btsnoop->map_pos = btsnoop->map_start;
+	btsnoop->records_sorted = true;
+
+	while (1) {
+		struct btsnoop_record *rec;
+		size_t offset = btsnoop->map_pos;
+
+		if (!read_hci(btsnoop, &tv, &index, &opcode, data, &size))
+			break;
+
+		if (btsnoop->num_records == alloc) {
+			alloc = alloc ? alloc * 2 : 1024;
+			rec = realloc(btsnoop->records, alloc * sizeof(*rec));
+			if (!rec) {
+				free(btsnoop->records);
+				btsnoop->records = NULL;
+				btsnoop->num_records = 0;
+				btsnoop->map_pos = pos;
+				return false;
+			}
+			btsnoop->records = rec;
+		}
+
+		rec = &btsnoop->records[btsnoop->num_records++];
+		rec->offset = offset;
+		rec->ts = tv.tv_sec * 1000000ull + tv.tv_usec;
+		rec->opcode = opcode;
+		rec->handle = get_handle(opcode, data, size);
+
+		if (btsnoop->num_records > 1 && rec->ts < rec[-1].ts)
+			btsnoop->records_sorted = false;
+	}
+
+	/* Only the records before a truncated or corrupted one are kept */
+	btsnoop->aborted = false;
+
+	if (!btsnoop->records) {
+		btsnoop->records = malloc(sizeof(*btsnoop->records));
+		if (!btsnoop->records) {
+			btsnoop->map_pos = pos;
+			return false;
+		}
+	}
+
+	btsnoop->range_start = 0;
+	btsnoop->range_end = UINT64_MAX;
+	btsnoop->rec_end = btsnoop->num_records;
+
+	/* Continue from where sequential reading was */
+	for (btsnoop->rec_pos = 0; btsnoop->rec_pos < btsnoop->num_records;
+							btsnoop->rec_pos++) {
+		if (btsnoop->records[btsnoop->rec_pos].offset >= pos)
+			break;
+	}
+
+	return true;
+}
+
+bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
+					uint16_t *index, uint16_t *opcode,
+					void *data, uint16_t *size)
+{
+	if (!btsnoop || btsnoop->aborted)
+		return false;
+
+	if (!btsnoop->records)
+		return read_hci(btsnoop, tv, index, opcode, data, size);
+
+	while (btsnoop->rec_pos < btsnoop->rec_end) {
+		const struct btsnoop_record *rec;
+
+		rec = &btsnoop->records[btsnoop->rec_pos++];
+
+		if (rec->ts < btsnoop->range_start ||
+					rec->ts > btsnoop->range_end)
+			continue;
+
+		/* Keep records not tied to any connection, like new index */
+		if (btsnoop->filter_handle != 0xffff &&
+				rec->handle != btsnoop->filter_handle &&
+				rec->handle != HANDLE_MULTIPLE &&
+				is_hci_opcode(rec->opcode))
+			continue;
+
+		btsnoop->map_pos = rec->offset;
+
+		if (!read_hci(btsnoop, tv, index, opcode, data, size))
+			return false;
+
+		if (btsnoop->filter_handle != 0xffff &&
+				rec->handle == HANDLE_MULTIPLE &&
+				!match_multiple(data, *size,
+						btsnoop->filter_handle))
+			continue;
+
+		return true;
+	}
+
+	return false;
+}
+
+static uint64_t timeval_to_usec(const struct timeval *tv)
+{
+	return tv->tv_sec * 1000000ull + tv->tv_usec;
+}
+
+bool btsnoop_is_mapped(struct btsnoop *btsnoop)
+{
+	if (!btsnoop)
+		return false;
+
+	return btsnoop->map != NULL;
+}
+
+bool btsnoop_get_first_time(struct btsnoop *btsnoop, struct timeval *tv)
+{
+	uint64_t ts = UINT64_MAX;
+	size_t i;
+
+	if (!btsnoop || !tv || !build_index(btsnoop))
+		return false;
+
+	if (!btsnoop->num_records)
+		return false;
+
+	if (btsnoop->records_sorted)
+		ts = btsnoop->records[0].ts;
+	else {
+		for (i = 0; i < btsnoop->num_records; i++) {
+			if (btsnoop->records[i].ts < ts)
+				ts = btsnoop->records[i].ts;
+		}
+	}
+
+	tv->tv_sec = ts / 1000000;
+	tv->tv_usec = ts % 1000000;
+
+	return true;
+}
+
+/* Index of the first record for which ts > limit, or ts >= limit */
+static size_t find_record(struct btsnoop *btsnoop, uint64_t limit,
+								bool after)
+{
+	size_t lo = 0, hi = btsnoop->num_records;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		uint64_t ts = btsnoop->records[mid].ts;
+
+		if (ts < limit || (after && ts == limit))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * Restrict btsnoop_read_hci() to records with a timestamp within start and
+ * end, NULL meaning no limit, and rewind to the first of them.
+ */
+bool btsnoop_set_time_range(struct btsnoop *btsnoop,
+				const struct timeval *start,
+				const struct timeval *end)
+{
+	size_t i;
+
+	if (!btsnoop || !build_index(btsnoop))
+		return false;
+
+	btsnoop->range_start = start ? timeval_to_usec(start) : 0;
+	btsnoop->range_end = end ? timeval_to_usec(end) : UINT64_MAX;
+
+	if (btsnoop->records_sorted) {
+		btsnoop->rec_pos = find_record(btsnoop, btsnoop->range_start,
+									false);
+		btsnoop->rec_end = find_record(btsnoop, btsnoop->range_end,
+									true);
+	} else {
+		/* Records are checked individually while reading */
+		btsnoop->rec_pos = btsnoop->num_records;
+		btsnoop->rec_end = 0;
+
+		for (i = 0; i < btsnoop->num_records; i++) {
+			uint64_t ts = btsnoop->records[i].ts;
+
+			if (ts < btsnoop->range_start ||
+						ts > btsnoop->range_end)
+				continue;
+
+			if (btsnoop->rec_pos > i)
+				btsnoop->rec_pos = i;
+
+			btsnoop->rec_end = i + 1;
+		}
+	}
+
+	if (btsnoop->rec_end < btsnoop->rec_pos)
+		btsnoop->rec_end = btsnoop->rec_pos;
+
+	return true;
+}
+
+/*
+ * Restrict btsnoop_read_hci() to HCI packets for the given connection
+ * handle, 0xffff removing the filter.
+ */
+bool btsnoop_set_handle_filter(struct btsnoop *btsnoop, uint16_t handle)
+{
+	if (!btsnoop || !build_index(btsnoop))
+		return false;
+
+	btsnoop->filter_handle = handle;
+
+	return true;
+}
+
 bool btsnoop_read_phy(struct btsnoop *btsnoop, struct timeval *tv,
 			uint16_t *frequency, void *data, uint16_t *size)
 {
@@ -21,6 +21,8 @@
 #define BTSNOOP_FORMAT_SIMULATOR	2002
 
 #define BTSNOOP_FLAG_PKLG_SUPPORT	(1 << 0)
+#define BTSNOOP_FLAG_BUFFERED		(1 << 1)
+#define BTSNOOP_FLAG_MMAP		(1 << 2)
 
 #define BTSNOOP_OPCODE_NEW_INDEX	0
 #define BTSNOOP_OPCODE_DEL_INDEX	1
@@ -89,13 +91,16 @@ struct btsnoop;
 
 struct btsnoop *btsnoop_open(const char *path, unsigned long flags);
 struct btsnoop *btsnoop_create(const char *path, size_t max_size,
-				unsigned int max_count, uint32_t format);
+				unsigned int max_count, uint32_t format,
+				unsigned long flags);
 
 struct btsnoop *btsnoop_ref(struct btsnoop *btsnoop);
 void btsnoop_unref(struct btsnoop *btsnoop);
 
 uint32_t btsnoop_get_format(struct btsnoop *btsnoop);
 
+bool btsnoop_flush(struct btsnoop *btsnoop);
+
 bool btsnoop_write(struct btsnoop *btsnoop, struct timeval *tv, uint32_t flags,
 			uint32_t drops, const void *data, uint16_t size);
 bool btsnoop_write_hci(struct btsnoop *btsnoop, struct timeval *tv,
@@ -109,3 +114,10 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 					void *data, uint16_t *size);
 bool btsnoop_read_phy(struct btsnoop *btsnoop, struct timeval *tv,
 			uint16_t *frequency, void *data, uint16_t *size);
+
+bool btsnoop_is_mapped(struct btsnoop *btsnoop);
+bool btsnoop_get_first_time(struct btsnoop *btsnoop, struct timeval *tv);
+bool btsnoop_set_time_range(struct btsnoop *btsnoop,
+				const struct timeval *start,
+				const struct timeval *end);
+bool btsnoop_set_handle_filter(struct btsnoop *btsnoop, uint16_t handle);
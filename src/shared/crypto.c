@@ -18,6 +18,7 @@
 #include <sys/socket.h>
 
 #include "src/shared/util.h"
+#include "src/shared/aes.h"
 #include "src/shared/crypto.h"
 
 #ifndef HAVE_LINUX_IF_ALG_H
@@ -62,10 +63,15 @@ struct af_alg_iv {
 /* Maximum message length that can be passed to aes_cmac */
 #define CMAC_MSG_MAX	80
 
+/* Size of the buffer used to coalesce streamed CMAC input */
+#define CMAC_STREAM_BUF	512
+
 #define ATT_SIGN_LEN	12
 
 struct bt_crypto {
 	int ref_count;
+	enum bt_crypto_backend backend;
+	bool hw;
 	int ecb_aes;
 	int urandom;
 	int cmac_aes;
@@ -127,41 +133,106 @@ static int cmac_aes_setup(void)
 }
 
 static struct bt_crypto *singleton;
+static struct bt_crypto *fast_singleton;
 
-struct bt_crypto *bt_crypto_new(void)
+static struct bt_crypto *crypto_new(enum bt_crypto_backend backend)
 {
-	if (singleton)
-		return bt_crypto_ref(singleton);
+	struct bt_crypto *crypto;
 
-	singleton = new0(struct bt_crypto, 1);
+	if (backend == BT_CRYPTO_BACKEND_AESNI && !bt_aes_hw_available())
+		return NULL;
 
-	singleton->ecb_aes = ecb_aes_setup();
-	if (singleton->ecb_aes < 0) {
-		free(singleton);
-		singleton = NULL;
+	crypto = new0(struct bt_crypto, 1);
+	crypto->backend = backend;
+	crypto->hw = backend == BT_CRYPTO_BACKEND_AESNI;
+	crypto->ecb_aes = -1;
+	crypto->cmac_aes = -1;
+
+	crypto->urandom = urandom_setup();
+	if (crypto->urandom < 0) {
+		free(crypto);
 		return NULL;
 	}
 
-	singleton->urandom = urandom_setup();
-	if (singleton->urandom < 0) {
-		close(singleton->ecb_aes);
-		free(singleton);
-		singleton = NULL;
+	if (backend != BT_CRYPTO_BACKEND_KERNEL)
+		return crypto;
+
+	crypto->ecb_aes = ecb_aes_setup();
+	if (crypto->ecb_aes < 0) {
+		close(crypto->urandom);
+		free(crypto);
 		return NULL;
 	}
 
-	singleton->cmac_aes = cmac_aes_setup();
-	if (singleton->cmac_aes < 0) {
-		close(singleton->urandom);
-		close(singleton->ecb_aes);
-		free(singleton);
-		singleton = NULL;
+	crypto->cmac_aes = cmac_aes_setup();
+	if (crypto->cmac_aes < 0) {
+		close(crypto->ecb_aes);
+		close(crypto->urandom);
+		free(crypto);
 		return NULL;
 	}
 
+	return crypto;
+}
+
+static struct bt_crypto *crypto_new_fast(void)
+{
+	return crypto_new(bt_aes_hw_available() ? BT_CRYPTO_BACKEND_AESNI :
+						BT_CRYPTO_BACKEND_SOFT);
+}
+
+static struct bt_crypto *crypto_new_auto(void)
+{
+	struct bt_crypto *crypto;
+
+	crypto = crypto_new(BT_CRYPTO_BACKEND_KERNEL);
+	if (crypto)
+		return crypto;
+
+	/* Kernels without AF_ALG support get the in-process engine */
+	return crypto_new_fast();
+}
+
+/*
+ * The default instance is shared and uses the kernel AF_ALG sockets, the
+ * in-process AES engine is only used when AF_ALG is not available.
+ */
+struct bt_crypto *bt_crypto_new(void)
+{
+	if (singleton)
+		return bt_crypto_ref(singleton);
+
+	singleton = crypto_new_auto();
+	if (!singleton)
+		return NULL;
+
 	return bt_crypto_ref(singleton);
 }
 
+/*
+ * BT_CRYPTO_BACKEND_FAST is a second shared instance for the users that run
+ * many block operations, such as RPA resolution and ATT signing, and would
+ * otherwise pay for a round trip to the kernel on each of them.
+ */
+struct bt_crypto *bt_crypto_new_backend(enum bt_crypto_backend backend)
+{
+	switch (backend) {
+	case BT_CRYPTO_BACKEND_AUTO:
+		return bt_crypto_new();
+	case BT_CRYPTO_BACKEND_FAST:
+		if (!fast_singleton)
+			fast_singleton = crypto_new_fast();
+
+		return bt_crypto_ref(fast_singleton);
+	case BT_CRYPTO_BACKEND_KERNEL:
+	case BT_CRYPTO_BACKEND_SOFT:
+	case BT_CRYPTO_BACKEND_AESNI:
+		break;
+	}
+
+	return bt_crypto_ref(crypto_new(backend));
+}
+
 struct bt_crypto *bt_crypto_ref(struct bt_crypto *crypto)
 {
 	if (!crypto)
@@ -181,11 +252,20 @@ void bt_crypto_unref(struct bt_crypto *crypto)
 		return;
 
 	close(crypto->urandom);
-	close(crypto->ecb_aes);
-	close(crypto->cmac_aes);
+
+	if (crypto->ecb_aes >= 0)
+		close(crypto->ecb_aes);
+
+	if (crypto->cmac_aes >= 0)
+		close(crypto->cmac_aes);
+
+	if (crypto == singleton)
+		singleton = NULL;
+
+	if (crypto == fast_singleton)
+		fast_singleton = NULL;
 
 	free(crypto);
-	singleton = NULL;
 }
 
 bool bt_crypto_random_bytes(struct bt_crypto *crypto,
@@ -251,6 +331,77 @@ static bool alg_encrypt(int fd, const void *inbuf, size_t inlen,
 	return true;
 }
 
+/*
+ * Single block encryption and CMAC with the key in the octet order used
+ * by AF_ALG. The in-process engine avoids the socket round trips, the
+ * kernel is only involved for the BT_CRYPTO_BACKEND_KERNEL backend.
+ */
+static bool aes_ecb(struct bt_crypto *crypto, const uint8_t key[16],
+				const uint8_t in[16], uint8_t out[16])
+{
+	struct bt_aes_key aes;
+	bool ret;
+	int fd;
+
+	if (crypto->backend != BT_CRYPTO_BACKEND_KERNEL) {
+		bt_aes_set_key(&aes, key, crypto->hw);
+		bt_aes_encrypt(&aes, in, out);
+		bt_aes_clear_key(&aes);
+		return true;
+	}
+
+	fd = alg_new(crypto->ecb_aes, key, 16);
+	if (fd < 0)
+		return false;
+
+	ret = alg_encrypt(fd, in, 16, out, 16);
+
+	close(fd);
+
+	return ret;
+}
+
+static bool aes_cmac_iov(struct bt_crypto *crypto, const uint8_t key[16],
+				const struct iovec *iov, size_t iov_len,
+				uint8_t res[16])
+{
+	struct bt_aes_cmac cmac;
+	ssize_t len;
+	size_t i;
+	int fd;
+
+	if (crypto->backend != BT_CRYPTO_BACKEND_KERNEL) {
+		bt_aes_cmac_init(&cmac, key, crypto->hw);
+
+		for (i = 0; i < iov_len; i++)
+			bt_aes_cmac_update(&cmac, iov[i].iov_base,
+							iov[i].iov_len);
+
+		bt_aes_cmac_final(&cmac, res);
+		return true;
+	}
+
+	fd = alg_new(crypto->cmac_aes, key, 16);
+	if (fd < 0)
+		return false;
+
+	len = writev(fd, iov, iov_len);
+	if (len < 0) {
+		close(fd);
+		return false;
+	}
+
+	len = read(fd, res, 16);
+	if (len < 0) {
+		close(fd);
+		return false;
+	}
+
+	close(fd);
+
+	return true;
+}
+
 static inline void swap_buf(const uint8_t *src, uint8_t *dst, uint16_t len)
 {
 	int i;
@@ -264,8 +415,7 @@ bool bt_crypto_sign_att(struct bt_crypto *crypto, const uint8_t key[16],
 				uint32_t sign_cnt,
 				uint8_t signature[ATT_SIGN_LEN])
 {
-	int fd;
-	int len;
+	struct iovec iov;
 	uint8_t tmp[16], out[16];
 	uint16_t msg_len = m_len + sizeof(uint32_t);
 	uint8_t msg[msg_len];
@@ -283,26 +433,14 @@ bool bt_crypto_sign_att(struct bt_crypto *crypto, const uint8_t key[16],
 	/* The most significant octet of key corresponds to key[0] */
 	swap_buf(key, tmp, 16);
 
-	fd = alg_new(crypto->cmac_aes, tmp, 16);
-	if (fd < 0)
-		return false;
-
 	/* Swap msg before signing */
 	swap_buf(msg, msg_s, msg_len);
 
-	len = send(fd, msg_s, msg_len, 0);
-	if (len < 0) {
-		close(fd);
-		return false;
-	}
+	iov.iov_base = msg_s;
+	iov.iov_len = msg_len;
 
-	len = read(fd, out, 16);
-	if (len < 0) {
-		close(fd);
+	if (!aes_cmac_iov(crypto, tmp, &iov, 1, out))
 		return false;
-	}
-
-	close(fd);
 
 	/*
 	 * As to BT spec. 4.1 Vol[3], Part C, chapter 10.4.1 sign counter should
@@ -358,7 +496,6 @@ bool bt_crypto_e(struct bt_crypto *crypto, const uint8_t key[16],
 			const uint8_t plaintext[16], uint8_t encrypted[16])
 {
 	uint8_t tmp[16], in[16], out[16];
-	int fd;
 
 	if (!crypto)
 		return false;
@@ -366,24 +503,15 @@ bool bt_crypto_e(struct bt_crypto *crypto, const uint8_t key[16],
 	/* The most significant octet of key corresponds to key[0] */
 	swap_buf(key, tmp, 16);
 
-	fd = alg_new(crypto->ecb_aes, tmp, 16);
-	if (fd < 0)
-		return false;
-
-
 	/* Most significant octet of plaintextData corresponds to in[0] */
 	swap_buf(plaintext, in, 16);
 
-	if (!alg_encrypt(fd, in, 16, out, 16)) {
-		close(fd);
+	if (!aes_ecb(crypto, tmp, in, out))
 		return false;
-	}
 
 	/* Most significant octet of encryptedData corresponds to out[0] */
 	swap_buf(out, encrypted, 16);
 
-	close(fd);
-
 	return true;
 }
 
@@ -589,31 +717,15 @@ bool bt_crypto_s1(struct bt_crypto *crypto, const uint8_t k[16],
 static bool aes_cmac_be(struct bt_crypto *crypto, const uint8_t key[16],
 			const uint8_t *msg, size_t msg_len, uint8_t res[16])
 {
-	ssize_t len;
-	int fd;
+	struct iovec iov;
 
 	if (msg_len > CMAC_MSG_MAX)
 		return false;
 
-	fd = alg_new(crypto->cmac_aes, key, 16);
-	if (fd < 0)
-		return false;
+	iov.iov_base = (void *) msg;
+	iov.iov_len = msg_len;
 
-	len = send(fd, msg, msg_len, 0);
-	if (len < 0) {
-		close(fd);
-		return false;
-	}
-
-	len = read(fd, res, 16);
-	if (len < 0) {
-		close(fd);
-		return false;
-	}
-
-	close(fd);
-
-	return true;
+	return aes_cmac_iov(crypto, key, &iov, 1, res);
 }
 
 static bool aes_cmac(struct bt_crypto *crypto, const uint8_t key[16],
@@ -725,33 +837,131 @@ bool bt_crypto_gatt_hash(struct bt_crypto *crypto, struct iovec *iov,
 				size_t iov_len, uint8_t res[16])
 {
 	const uint8_t key[16] = {};
-	ssize_t len;
-	int fd;
 
 	if (!crypto)
 		return false;
 
-	fd = alg_new(crypto->cmac_aes, key, 16);
+	return aes_cmac_iov(crypto, key, iov, iov_len, res);
+}
+
+struct bt_crypto_cmac {
+	int fd;
+	struct bt_aes_cmac aes;
+	size_t len;
+	uint8_t buf[CMAC_STREAM_BUF];
+};
+
+struct bt_crypto_cmac *bt_crypto_cmac_new(struct bt_crypto *crypto,
+						const uint8_t key[16])
+{
+	struct bt_crypto_cmac *cmac;
+	int fd = -1;
+
+	if (!crypto)
+		return NULL;
+
+	if (crypto->backend == BT_CRYPTO_BACKEND_KERNEL) {
+		fd = alg_new(crypto->cmac_aes, key, 16);
+		if (fd < 0)
+			return NULL;
+	}
+
+	cmac = new0(struct bt_crypto_cmac, 1);
+	cmac->fd = fd;
+
 	if (fd < 0)
+		bt_aes_cmac_init(&cmac->aes, key, crypto->hw);
+
+	return cmac;
+}
+
+static bool cmac_send(struct bt_crypto_cmac *cmac, const void *data,
+						size_t len, int flags)
+{
+	ssize_t written;
+
+	written = send(cmac->fd, data, len, flags);
+	if (written < 0 || (size_t) written != len)
 		return false;
 
-	len = writev(fd, iov, iov_len);
-	if (len < 0) {
-		close(fd);
+	return true;
+}
+
+/*
+ * Small inputs are collected into a contiguous buffer and handed to the
+ * kernel with MSG_MORE so the digest keeps accumulating across calls. The
+ * in-process engine consumes the data directly.
+ */
+bool bt_crypto_cmac_update(struct bt_crypto_cmac *cmac, const void *data,
+								size_t len)
+{
+	if (!cmac)
 		return false;
+
+	if (!len)
+		return true;
+
+	if (cmac->fd < 0) {
+		bt_aes_cmac_update(&cmac->aes, data, len);
+		return true;
 	}
 
-	len = read(fd, res, 16);
-	if (len < 0) {
-		close(fd);
+	if (cmac->len + len > sizeof(cmac->buf)) {
+		if (cmac->len && !cmac_send(cmac, cmac->buf, cmac->len,
+								MSG_MORE))
+			return false;
+
+		cmac->len = 0;
+	}
+
+	if (len >= sizeof(cmac->buf))
+		return cmac_send(cmac, data, len, MSG_MORE);
+
+	memcpy(cmac->buf + cmac->len, data, len);
+	cmac->len += len;
+
+	return true;
+}
+
+bool bt_crypto_cmac_final(struct bt_crypto_cmac *cmac, uint8_t res[16])
+{
+	ssize_t len;
+
+	if (!cmac)
 		return false;
+
+	if (cmac->fd < 0) {
+		bt_aes_cmac_final(&cmac->aes, res);
+		return true;
 	}
 
-	close(fd);
+	if (cmac->len) {
+		if (!cmac_send(cmac, cmac->buf, cmac->len, 0))
+			return false;
+
+		cmac->len = 0;
+	}
+
+	len = read(cmac->fd, res, 16);
+	if (len != 16)
+		return false;
 
 	return true;
 }
 
+void bt_crypto_cmac_free(struct bt_crypto_cmac *cmac)
+{
+	if (!cmac)
+		return;
+
+	if (cmac->fd >= 0)
+		close(cmac->fd);
+	else
+		bt_aes_clear_key(&cmac->aes.key);
+
+	free(cmac);
+}
+
 /*
  * Resolvable Set Identifier hash function sih
  *
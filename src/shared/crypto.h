@@ -14,7 +14,16 @@
 
 struct bt_crypto;
 
+enum bt_crypto_backend {
+	BT_CRYPTO_BACKEND_AUTO,
+	BT_CRYPTO_BACKEND_KERNEL,
+	BT_CRYPTO_BACKEND_SOFT,
+	BT_CRYPTO_BACKEND_AESNI,
+	BT_CRYPTO_BACKEND_FAST,
+};
+
 struct bt_crypto *bt_crypto_new(void);
+struct bt_crypto *bt_crypto_new_backend(enum bt_crypto_backend backend);
 
 struct bt_crypto *bt_crypto_ref(struct bt_crypto *crypto);
 void bt_crypto_unref(struct bt_crypto *crypto);
@@ -60,3 +69,12 @@ bool bt_crypto_sih(struct bt_crypto *crypto, const uint8_t k[16],
 bool bt_crypto_sirk(struct bt_crypto *crypto, const char *str, uint16_t vendor,
 			uint16_t product, uint16_t version, uint16_t source,
 			uint8_t sirk[16]);
+
+struct bt_crypto_cmac;
+
+struct bt_crypto_cmac *bt_crypto_cmac_new(struct bt_crypto *crypto,
+						const uint8_t key[16]);
+bool bt_crypto_cmac_update(struct bt_crypto_cmac *cmac, const void *data,
+								size_t len);
+bool bt_crypto_cmac_final(struct bt_crypto_cmac *cmac, uint8_t res[16]);
+void bt_crypto_cmac_free(struct bt_crypto_cmac *cmac);
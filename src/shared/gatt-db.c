@@ -58,9 +58,15 @@ struct gatt_db {
 	struct bt_crypto *crypto;
 	uint8_t hash[16];
 	unsigned int hash_id;
+	bool hash_stale;
 	uint16_t last_handle;
 	struct queue *services;
 
+	/* Services sorted by start handle, used for handle lookups */
+	struct gatt_db_service **index;
+	unsigned int index_len;
+	unsigned int index_size;
+
 	struct queue *notify_list;
 	unsigned int next_notify_id;
 
@@ -131,8 +137,21 @@ struct gatt_db_service {
 	bool claimed;
 	uint16_t num_handles;
 	struct gatt_db_attribute **attributes;
+
+	/* Cached Database Hash input covering this service */
+	bool hash_valid;
+	uint8_t *hash_data;
+	size_t hash_len;
 };
 
+static void service_hash_invalidate(struct gatt_db_service *service)
+{
+	service->hash_valid = false;
+
+	if (service->db)
+		service->db->hash_stale = true;
+}
+
 static void set_attribute_data(struct gatt_db_attribute *attribute,
 						gatt_db_read_t read_func,
 						gatt_db_write_t write_func,
@@ -230,6 +249,8 @@ static struct gatt_db_attribute *new_attribute(struct gatt_db_service *service,
 	attribute->pending_writes = queue_new();
 	attribute->notify_list = queue_new();
 
+	service_hash_invalidate(service);
+
 	return attribute;
 
 failed:
@@ -294,82 +315,117 @@ static void handle_notify(void *data, void *user_data)
 		notify->service_removed(notify_data->attr, notify->user_data);
 }
 
-struct hash_data {
-	struct iovec *iov;
-	uint16_t i;
-};
-
-static void gen_hash_m(struct gatt_db_attribute *attr, void *user_data)
+static size_t attribute_hash_len(const struct gatt_db_attribute *attr)
 {
-	struct hash_data *hash = user_data;
-	uint8_t *data;
-	size_t len;
-
-	if (bt_uuid_len(&attr->uuid) != 2)
-		return;
+	if (attr->uuid.type != BT_UUID16)
+		return 0;
 
 	switch (attr->uuid.value.u16) {
 	case GATT_PRIM_SVC_UUID:
 	case GATT_SND_SVC_UUID:
 	case GATT_INCLUDE_UUID:
 	case GATT_CHARAC_UUID:
-		/* Allocate space for handle + type + value */
-		len = 2 + 2 + attr->value_len;
-		data = malloc(2 + 2 + attr->value_len);
-		put_le16(attr->handle, data);
-		bt_uuid_to_le(&attr->uuid, data + 2);
-		memcpy(data + 4, attr->value, attr->value_len);
-		break;
+		/* handle + type + value */
+		return 2 + 2 + attr->value_len;
 	case GATT_CHARAC_USER_DESC_UUID:
 	case GATT_CLIENT_CHARAC_CFG_UUID:
 	case GATT_SERVER_CHARAC_CFG_UUID:
 	case GATT_CHARAC_FMT_UUID:
 	case GATT_CHARAC_AGREG_FMT_UUID:
-		/* Allocate space for handle + type  */
-		len = 2 + 2;
-		data = malloc(2 + 2 + attr->value_len);
-		put_le16(attr->handle, data);
-		bt_uuid_to_le(&attr->uuid, data + 2);
-		break;
+		/* handle + type */
+		return 2 + 2;
 	default:
-		return;
+		return 0;
+	}
+}
+
+/*
+ * Serialize the service attributes that are part of the Database Hash into
+ * a single buffer which is kept until the service changes.
+ */
+static bool service_hash_update(struct gatt_db_service *service)
+{
+	uint8_t *ptr;
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < service->num_handles; i++) {
+		if (service->attributes[i])
+			len += attribute_hash_len(service->attributes[i]);
 	}
 
-	hash->iov[hash->i].iov_base = data;
-	hash->iov[hash->i].iov_len = len;
+	if (len > service->hash_len || !service->hash_data) {
+		ptr = realloc(service->hash_data, len);
+		if (!ptr)
+			return false;
 
-	hash->i++;
+		service->hash_data = ptr;
+	}
 
-	return;
-}
+	ptr = service->hash_data;
 
-static void service_gen_hash_m(struct gatt_db_attribute *attr, void *user_data)
-{
-	gatt_db_service_foreach(attr, NULL, gen_hash_m, user_data);
+	for (i = 0; i < service->num_handles; i++) {
+		struct gatt_db_attribute *attr = service->attributes[i];
+		size_t attr_len;
+
+		if (!attr)
+			continue;
+
+		attr_len = attribute_hash_len(attr);
+		if (!attr_len)
+			continue;
+
+		put_le16(attr->handle, ptr);
+		put_le16(attr->uuid.value.u16, ptr + 2);
+
+		if (attr_len > 4)
+			memcpy(ptr + 4, attr->value, attr->value_len);
+
+		ptr += attr_len;
+	}
+
+	service->hash_len = len;
+	service->hash_valid = true;
+
+	return true;
 }
 
 static bool db_hash_update(void *user_data)
 {
+	static const uint8_t key[16] = {};
 	struct gatt_db *db = user_data;
-	struct hash_data hash;
-	uint16_t i;
+	struct bt_crypto_cmac *cmac;
+	unsigned int i;
 
 	db->hash_id = 0;
 
 	if (gatt_db_isempty(db))
 		return false;
 
-	hash.iov = new0(struct iovec, db->last_handle + 1);
-	hash.i = 0;
+	cmac = bt_crypto_cmac_new(db->crypto, key);
+	if (!cmac)
+		return false;
 
-	gatt_db_foreach_service(db, NULL, service_gen_hash_m, &hash);
-	bt_crypto_gatt_hash(db->crypto, hash.iov, db->last_handle + 1,
-				db->hash);
+	/* Services in the index are already sorted by handle */
+	for (i = 0; i < db->index_len; i++) {
+		struct gatt_db_service *service = db->index[i];
 
-	for (i = 0; i < hash.i; i++)
-		free(hash.iov[i].iov_base);
+		if (!service->active)
+			continue;
 
-	free(hash.iov);
+		if (!service->hash_valid && !service_hash_update(service))
+			goto done;
+
+		if (!bt_crypto_cmac_update(cmac, service->hash_data,
+							service->hash_len))
+			goto done;
+	}
+
+	if (bt_crypto_cmac_final(cmac, db->hash))
+		db->hash_stale = false;
+
+done:
+	bt_crypto_cmac_free(cmac);
 
 	return false;
 }
@@ -406,6 +462,8 @@ static void notify_service_changed(struct gatt_db *db,
 	if (!added)
 		notify_attribute_changed(service);
 
+	db->hash_stale = true;
+
 	if (queue_isempty(db->notify_list))
 		return;
 
@@ -424,11 +482,115 @@ static void notify_service_changed(struct gatt_db *db,
 	gatt_db_unref(db);
 }
 
+static void gatt_db_service_get_handles(const struct gatt_db_service *service,
+							uint16_t *start_handle,
+							uint16_t *end_handle)
+{
+	if (start_handle)
+		*start_handle = service->attributes[0]->handle;
+
+	if (end_handle)
+		*end_handle = service->attributes[0]->handle +
+						service->num_handles - 1;
+}
+
+/*
+ * Returns the position in the index of the first service which ends at or
+ * after the given handle, or index_len if there is none.
+ */
+static unsigned int index_lookup(struct gatt_db *db, uint16_t handle)
+{
+	unsigned int lo = 0, hi = db->index_len;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		uint16_t end;
+
+		gatt_db_service_get_handles(db->index[mid], NULL, &end);
+
+		if (end < handle)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static struct gatt_db_service *index_find(struct gatt_db *db, uint16_t handle)
+{
+	struct gatt_db_service *service;
+	unsigned int i;
+	uint16_t start;
+
+	i = index_lookup(db, handle);
+	if (i == db->index_len)
+		return NULL;
+
+	service = db->index[i];
+
+	gatt_db_service_get_handles(service, &start, NULL);
+	if (start > handle)
+		return NULL;
+
+	return service;
+}
+
+static bool index_insert(struct gatt_db *db, struct gatt_db_service *service)
+{
+	unsigned int i;
+	uint16_t start;
+
+	if (db->index_len == db->index_size) {
+		struct gatt_db_service **index;
+		unsigned int size;
+
+		size = db->index_size ? db->index_size * 2 : 16;
+
+		index = realloc(db->index, size * sizeof(*index));
+		if (!index)
+			return false;
+
+		db->index = index;
+		db->index_size = size;
+	}
+
+	gatt_db_service_get_handles(service, &start, NULL);
+
+	i = index_lookup(db, start);
+
+	memmove(&db->index[i + 1], &db->index[i],
+				(db->index_len - i) * sizeof(*db->index));
+	db->index[i] = service;
+	db->index_len++;
+
+	return true;
+}
+
+static void index_remove(struct gatt_db *db, struct gatt_db_service *service)
+{
+	unsigned int i;
+	uint16_t start;
+
+	gatt_db_service_get_handles(service, &start, NULL);
+
+	i = index_lookup(db, start);
+	if (i == db->index_len || db->index[i] != service)
+		return;
+
+	db->index_len--;
+	memmove(&db->index[i], &db->index[i + 1],
+				(db->index_len - i) * sizeof(*db->index));
+}
+
 static void gatt_db_service_destroy(void *data)
 {
 	struct gatt_db_service *service = data;
 	int i;
 
+	if (service->db)
+		index_remove(service->db, service);
+
 	if (service->active)
 		notify_service_changed(service->db, service, false);
 
@@ -436,6 +598,7 @@ static void gatt_db_service_destroy(void *data)
 		attribute_destroy(service->attributes[i]);
 
 	free(service->attributes);
+	free(service->hash_data);
 	free(service);
 }
 
@@ -456,7 +619,9 @@ static void gatt_db_destroy(struct gatt_db *db)
 	if (db->hash_id)
 		timeout_remove(db->hash_id);
 
+	db->index_len = 0;
 	queue_destroy(db->services, gatt_db_service_destroy);
+	free(db->index);
 	free(db->ccc);
 	free(db);
 }
@@ -575,18 +740,6 @@ bool gatt_db_clear(struct gatt_db *db)
 	return gatt_db_clear_range(db, 1, UINT16_MAX);
 }
 
-static void gatt_db_service_get_handles(const struct gatt_db_service *service,
-							uint16_t *start_handle,
-							uint16_t *end_handle)
-{
-	if (start_handle)
-		*start_handle = service->attributes[0]->handle;
-
-	if (end_handle)
-		*end_handle = service->attributes[0]->handle +
-						service->num_handles - 1;
-}
-
 struct clear_range {
 	uint16_t start, end;
 };
@@ -612,6 +765,7 @@ bool gatt_db_clear_range(struct gatt_db *db, uint16_t start_handle,
 
 	/* Check if it is a full clear */
 	if (start_handle == 1 && end_handle == UINT16_MAX) {
+		db->index_len = 0;
 		queue_remove_all(db->services, NULL, NULL,
 						gatt_db_service_destroy);
 		goto done;
@@ -637,8 +791,8 @@ uint8_t *gatt_db_get_hash(struct gatt_db *db)
 	if (!db || !db->crypto)
 		return NULL;
 
-	/* Generate hash if if has not been generated yet */
-	if (db->hash_id || !memcmp(db->hash, hash, 16)) {
+	/* Generate hash if if has not been generated yet or is outdated */
+	if (db->hash_id || db->hash_stale || !memcmp(db->hash, hash, 16)) {
 		timeout_remove(db->hash_id);
 		db_hash_update(db);
 	}
@@ -658,31 +812,24 @@ static struct gatt_db_service *find_insert_loc(struct gatt_db *db,
 						uint16_t start, uint16_t end,
 						struct gatt_db_service **after)
 {
-	const struct queue_entry *services_entry;
 	struct gatt_db_service *service;
-	uint16_t cur_start, cur_end;
+	uint16_t cur_start;
+	unsigned int i;
 
-	*after = NULL;
+	i = index_lookup(db, start);
 
-	services_entry = queue_get_entries(db->services);
+	*after = i ? db->index[i - 1] : NULL;
 
-	while (services_entry) {
-		service = services_entry->data;
-
-		gatt_db_service_get_handles(service, &cur_start, &cur_end);
+	if (i == db->index_len)
+		return NULL;
 
-		if (start >= cur_start && start <= cur_end)
-			return service;
+	service = db->index[i];
 
-		if (end >= cur_start && end <= cur_end)
-			return service;
+	gatt_db_service_get_handles(service, &cur_start, NULL);
 
-		if (end < cur_start)
-			return NULL;
-
-		*after = service;
-		services_entry = services_entry->next;
-	}
+	/* Any overlap with an existing service is a conflict */
+	if (end >= cur_start)
+		return service;
 
 	return NULL;
 }
@@ -748,6 +895,11 @@ struct gatt_db_attribute *gatt_db_insert_service(struct gatt_db *db,
 	service->attributes[0]->handle = handle;
 	service->num_handles = num_handles;
 
+	if (!index_insert(db, service)) {
+		queue_remove(db->services, service);
+		goto fail;
+	}
+
 	/* Fast-forward last_handle if the new service was added to the end */
 	db->last_handle = MAX(handle + num_handles - 1, db->last_handle);
 
@@ -1476,6 +1628,36 @@ static void foreach_in_range(void *data, void *user_data)
 	}
 }
 
+static void index_foreach_in_range(struct gatt_db *db,
+						struct foreach_data *data)
+{
+	uint32_t handle = data->start;
+
+	/*
+	 * Look up each service by handle instead of walking the index by
+	 * position so callbacks are free to add or remove services.
+	 */
+	while (handle <= data->end) {
+		struct gatt_db_service *service;
+		uint16_t start, end;
+		unsigned int i;
+
+		i = index_lookup(db, handle);
+		if (i == db->index_len)
+			return;
+
+		service = db->index[i];
+
+		gatt_db_service_get_handles(service, &start, &end);
+		if (start > data->end)
+			return;
+
+		foreach_in_range(service, data);
+
+		handle = (uint32_t) end + 1;
+	}
+}
+
 void gatt_db_foreach_service_in_range(struct gatt_db *db,
 						const bt_uuid_t *uuid,
 						gatt_db_attribute_cb_t func,
@@ -1495,7 +1677,7 @@ void gatt_db_foreach_service_in_range(struct gatt_db *db,
 	data.end = end_handle;
 	data.attr = false;
 
-	queue_foreach(db->services, foreach_in_range, &data);
+	index_foreach_in_range(db, &data);
 }
 
 void gatt_db_foreach_in_range(struct gatt_db *db, const bt_uuid_t *uuid,
@@ -1516,7 +1698,7 @@ void gatt_db_foreach_in_range(struct gatt_db *db, const bt_uuid_t *uuid,
 	data.end = end_handle;
 	data.attr = true;
 
-	queue_foreach(db->services, foreach_in_range, &data);
+	index_foreach_in_range(db, &data);
 }
 
 void gatt_db_service_foreach(struct gatt_db_attribute *attrib,
@@ -1638,17 +1820,6 @@ void gatt_db_service_foreach_incl(struct gatt_db_attribute *attrib,
 								user_data);
 }
 
-static bool find_service_for_handle(const void *data, const void *user_data)
-{
-	const struct gatt_db_service *service = data;
-	uint16_t handle = PTR_TO_UINT(user_data);
-	uint16_t start, end;
-
-	gatt_db_service_get_handles(service, &start, &end);
-
-	return (start <= handle) && (handle <= end);
-}
-
 struct gatt_db_attribute *gatt_db_get_service(struct gatt_db *db,
 							uint16_t handle)
 {
@@ -1657,8 +1828,7 @@ struct gatt_db_attribute *gatt_db_get_service(struct gatt_db *db,
 	if (!db || !handle)
 		return NULL;
 
-	service = queue_find(db->services, find_service_for_handle,
-						UINT_TO_PTR(handle));
+	service = index_find(db, handle);
 	if (!service)
 		return NULL;
 
@@ -1668,25 +1838,22 @@ struct gatt_db_attribute *gatt_db_get_service(struct gatt_db *db,
 struct gatt_db_attribute *gatt_db_get_attribute(struct gatt_db *db,
 							uint16_t handle)
 {
-	struct gatt_db_attribute *attrib;
 	struct gatt_db_service *service;
-	int i;
+	struct gatt_db_attribute *attrib;
 
-	attrib = gatt_db_get_service(db, handle);
-	if (!attrib)
+	if (!db || !handle)
 		return NULL;
 
-	service = attrib->service;
-
-	for (i = 0; i < service->num_handles; i++) {
-		if (!service->attributes[i])
-			continue;
+	service = index_find(db, handle);
+	if (!service)
+		return NULL;
 
-		if (service->attributes[i]->handle == handle)
-			return service->attributes[i];
-	}
+	/* Attributes are stored at their offset from the service handle */
+	attrib = service->attributes[handle - service->attributes[0]->handle];
+	if (!attrib || attrib->handle != handle)
+		return NULL;
 
-	return NULL;
+	return attrib;
 }
 
 static bool find_service_with_uuid(const void *data, const void *user_data)
@@ -2186,6 +2353,10 @@ bool gatt_db_attribute_write(struct gatt_db_attribute *attrib, uint16_t offset,
 
 	memcpy(&attrib->value[offset], value, len);
 
+	/* Declaration values are part of the Database Hash */
+	if (attribute_hash_len(attrib) > 4)
+		service_hash_invalidate(attrib->service);
+
 done:
 	if (func)
 		func(attrib, err, user_data);
@@ -2271,6 +2442,8 @@ bool gatt_db_attribute_reset(struct gatt_db_attribute *attrib)
 	attrib->value = NULL;
 	attrib->value_len = 0;
 
+	service_hash_invalidate(attrib->service);
+
 	return true;
 }
 
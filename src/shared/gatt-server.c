@@ -85,6 +85,7 @@ struct nfy_mult_data {
 	uint8_t *pdu;
 	uint16_t offset;
 	uint16_t len;
+	uint16_t size;
 };
 
 struct bt_gatt_server {
@@ -1722,13 +1723,20 @@ bool bt_gatt_server_set_debug(struct bt_gatt_server *server,
 	return true;
 }
 
-static void notify_multiple_timeout_remove(struct bt_gatt_server *server)
+static void notify_multiple_flush(struct bt_gatt_server *server)
 {
-	if (!server->nfy_mult->id)
+	struct iovec iov;
+
+	if (!server->nfy_mult->offset)
 		return;
 
-	timeout_remove(server->nfy_mult->id);
-	server->nfy_mult->id = 0;
+	iov.iov_base = server->nfy_mult->pdu;
+	iov.iov_len = server->nfy_mult->offset;
+
+	bt_att_send_nfy(server->att, BT_ATT_OP_HANDLE_NFY_MULT, &iov, 1);
+
+	/* Keep the buffer around for the next batch */
+	server->nfy_mult->offset = 0;
 }
 
 static bool notify_multiple(void *user_data)
@@ -1737,15 +1745,40 @@ static bool notify_multiple(void *user_data)
 
 	server->nfy_mult->id = 0;
 
-	bt_att_send(server->att, BT_ATT_OP_HANDLE_NFY_MULT,
-			server->nfy_mult->pdu, server->nfy_mult->offset, NULL,
-			NULL, NULL);
-
-	notify_multiple_free(server);
+	notify_multiple_flush(server);
 
 	return false;
 }
 
+static struct nfy_mult_data *notify_multiple_get(struct bt_gatt_server *server)
+{
+	struct nfy_mult_data *data = server->nfy_mult;
+	uint16_t len = bt_att_get_mtu(server->att) - 1;
+
+	if (!data) {
+		data = new0(struct nfy_mult_data, 1);
+		server->nfy_mult = data;
+	}
+
+	if (data->offset)
+		return data;
+
+	/* Start a new batch, the MTU may have changed since the last one */
+	if (len > data->size) {
+		uint8_t *pdu = realloc(data->pdu, len);
+
+		if (!pdu)
+			return NULL;
+
+		data->pdu = pdu;
+		data->size = len;
+	}
+
+	data->len = len;
+
+	return data;
+}
+
 static bool notify_append_le16(struct nfy_mult_data *data, uint16_t value)
 {
 	if (data->offset + sizeof(value) > data->len)
@@ -1761,40 +1794,46 @@ bool bt_gatt_server_send_notification(struct bt_gatt_server *server,
 					uint16_t handle, const uint8_t *value,
 					uint16_t length, bool multiple)
 {
-	struct nfy_mult_data *data = NULL;
-	bool result;
+	struct nfy_mult_data *data;
+	uint8_t hdr[2];
+	struct iovec iov[2];
 
 	if (!server || (length && !value))
 		return false;
 
-	if (multiple) {
-		data = server->nfy_mult;
+	if (!multiple) {
+		/* Encoded straight into the queued PDU, nothing is allocated */
+		put_le16(handle, hdr);
+		iov[0].iov_base = hdr;
+		iov[0].iov_len = sizeof(hdr);
+		iov[1].iov_base = (void *) value;
+		iov[1].iov_len = MIN(bt_att_get_mtu(server->att) - 3, length);
 
-		/* flush buffered data if this request hits buffer size limit */
-		if (data && data->offset > 0 &&
-				data->len - data->offset < 4 + length) {
-			notify_multiple_timeout_remove(server);
-			notify_multiple(server);
-			/* data has been freed by notify_multiple */
-			data = NULL;
-		}
+		return bt_att_send_nfy(server->att, BT_ATT_OP_HANDLE_NFY,
+								iov, 2);
 	}
 
-	if (!data) {
-		data = new0(struct nfy_mult_data, 1);
-		data->len = bt_att_get_mtu(server->att) - 1;
-		data->pdu = malloc(data->len);
-	}
+	data = server->nfy_mult;
+
+	/* flush buffered data if this request hits buffer size limit, the
+	 * timeout is left running so it does not need to be added again for
+	 * every PDU when notifying continuously.
+	 */
+	if (data && data->offset > 0 &&
+			data->len - data->offset < 4 + length)
+		notify_multiple_flush(server);
+
+	data = notify_multiple_get(server);
+	if (!data)
+		return false;
 
 	if (!notify_append_le16(data, handle))
-		goto error;
+		return false;
 
-	if (multiple) {
-		length = MIN(data->len - data->offset - 2, length);
-		if (!notify_append_le16(data, length))
-			goto error;
-	} else {
-		length = MIN(data->len - data->offset, length);
+	length = MIN(data->len - data->offset - 2, length);
+	if (!notify_append_le16(data, length)) {
+		data->offset -= 2;
+		return false;
 	}
 
 	if (value)
@@ -1802,30 +1841,11 @@ bool bt_gatt_server_send_notification(struct bt_gatt_server *server,
 
 	data->offset += length;
 
-	if (multiple) {
-		if (!server->nfy_mult)
-			server->nfy_mult = data;
-
-		if (!server->nfy_mult->id)
-			server->nfy_mult->id = timeout_add(NFY_MULT_TIMEOUT,
-						   notify_multiple, server,
-						   NULL);
-
-		return true;
-	}
-
-	result = !!bt_att_send(server->att, BT_ATT_OP_HANDLE_NFY,
-				data->pdu, data->offset, NULL, NULL, NULL);
-	free(data->pdu);
-	free(data);
-
-	return result;
-
-error:
-	if (data)
-		free(data);
+	if (!data->id)
+		data->id = timeout_add(NFY_MULT_TIMEOUT, notify_multiple,
+								server, NULL);
 
-	return false;
+	return true;
 }
 
 struct ind_data {
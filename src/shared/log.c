@@ -21,14 +21,22 @@
 #include <stdarg.h>
 #include <string.h>
 #include <signal.h>
+#include <syslog.h>
+#include <sys/param.h>
 #include <sys/socket.h>
 
 #include "lib/bluetooth.h"
 #include "lib/hci.h"
 
 #include "src/shared/util.h"
+#include "src/shared/timeout.h"
 #include "src/shared/log.h"
 
+#define LOG_RING_LEN		128
+#define LOG_SLOT_SIZE		512
+#define LOG_BATCH_MAX		32
+#define LOG_FLUSH_INTERVAL	10
+
 struct log_hdr {
 	uint16_t opcode;
 	uint16_t index;
@@ -44,8 +52,34 @@ struct log_l2cap_hdr {
 
 static int log_fd = -1;
 
-int bt_log_sendmsg(uint16_t index, const char *label, int level,
-					struct iovec *io, size_t io_len)
+/*
+ * In buffered mode messages are formatted straight into a ring of complete
+ * logging frames, which is flushed in batches from the main loop. If the
+ * ring is still full when a message comes in, the message is dropped and
+ * the number of dropped messages is reported once there is room again.
+ */
+struct log_slot {
+	uint16_t len;
+	uint8_t frame[LOG_SLOT_SIZE];
+};
+
+struct log_ring {
+	struct log_slot slots[LOG_RING_LEN];
+	unsigned int head;
+	unsigned int count;
+	unsigned int dropped;
+	bool blocked;
+	uint16_t drop_index;
+	char drop_label[32];
+	unsigned int flush_id;
+};
+
+static struct log_ring *log_ring;
+
+static int log_flush(int flags);
+
+static int log_send(uint16_t index, const char *label, int level,
+				struct iovec *io, size_t io_len, int flags)
 {
 	struct log_hdr hdr;
 	struct msghdr msg;
@@ -53,9 +87,6 @@ int bt_log_sendmsg(uint16_t index, const char *label, int level,
 	size_t i;
 	int err;
 
-	if (io_len > 3)
-		return -EMSGSIZE;
-
 	log_fd = bt_log_open();
 	if (log_fd < 0)
 		return log_fd;
@@ -82,9 +113,14 @@ int bt_log_sendmsg(uint16_t index, const char *label, int level,
 		msg.msg_iovlen++;
 	}
 
-	err = sendmsg(log_fd, &msg, 0);
+	err = sendmsg(log_fd, &msg, flags);
 	if (err < 0) {
 		err = -errno;
+
+		/* Only a full channel is worth trying again */
+		if (err == -EAGAIN)
+			return err;
+
 		close(log_fd);
 		log_fd = -1;
 	}
@@ -92,6 +128,203 @@ int bt_log_sendmsg(uint16_t index, const char *label, int level,
 	return err;
 }
 
+int bt_log_sendmsg(uint16_t index, const char *label, int level,
+					struct iovec *io, size_t io_len)
+{
+	if (io_len > 3)
+		return -EMSGSIZE;
+
+	/* Anything still queued goes out first to keep the order */
+	if (log_ring && log_ring->count)
+		log_flush(0);
+
+	return log_send(index, label, level, io, io_len, 0);
+}
+
+static int log_report_dropped(int flags)
+{
+	struct iovec iov;
+	char str[64];
+	int err;
+
+	snprintf(str, sizeof(str), "%u log messages dropped",
+							log_ring->dropped);
+
+	iov.iov_base = str;
+	iov.iov_len = strlen(str) + 1;
+
+	err = log_send(log_ring->drop_index, log_ring->drop_label, LOG_WARNING,
+							&iov, 1, flags);
+	if (err < 0) {
+		if (err == -EAGAIN)
+			log_ring->blocked = true;
+
+		return err;
+	}
+
+	log_ring->dropped = 0;
+
+	return 0;
+}
+
+static int log_flush(int flags)
+{
+	struct mmsghdr msgs[LOG_BATCH_MAX];
+	struct iovec iov[LOG_BATCH_MAX];
+	unsigned int i;
+	int fd, ret;
+
+	fd = bt_log_open();
+	if (fd < 0)
+		return fd;
+
+	while (log_ring->count) {
+		unsigned int count = MIN(log_ring->count, LOG_BATCH_MAX);
+
+		memset(msgs, 0, count * sizeof(*msgs));
+
+		for (i = 0; i < count; i++) {
+			struct log_slot *slot;
+
+			slot = &log_ring->slots[(log_ring->head + i) %
+								LOG_RING_LEN];
+
+			iov[i].iov_base = slot->frame;
+			iov[i].iov_len = slot->len;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		ret = sendmmsg(fd, msgs, count, flags);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EINTR) {
+				log_ring->blocked = true;
+				return -errno;
+			}
+
+			/* The channel is gone, so are the queued messages */
+			ret = -errno;
+			log_ring->count = 0;
+			close(log_fd);
+			log_fd = -1;
+			return ret;
+		}
+
+		log_ring->head = (log_ring->head + ret) % LOG_RING_LEN;
+		log_ring->count -= ret;
+	}
+
+	if (log_ring->dropped)
+		return log_report_dropped(flags);
+
+	return 0;
+}
+
+static bool flush_timeout(void *user_data)
+{
+	log_ring->blocked = false;
+
+	/* Try again later if the channel could not take everything */
+	if (log_flush(MSG_DONTWAIT) == -EAGAIN || log_ring->count)
+		return true;
+
+	log_ring->flush_id = 0;
+
+	return false;
+}
+
+static int log_queue(uint16_t index, const char *label, int level,
+					const char *format, va_list ap)
+{
+	struct log_slot *slot;
+	struct log_hdr *hdr;
+	size_t ident_len = strlen(label) + 1;
+	size_t room;
+	char *str;
+	va_list aq;
+	int len;
+
+	if (sizeof(*hdr) + ident_len >= LOG_SLOT_SIZE)
+		return -EMSGSIZE;
+
+	/* Until the channel takes messages again only the timer flushes */
+	if (log_ring->count == LOG_RING_LEN && !log_ring->blocked)
+		log_flush(MSG_DONTWAIT);
+
+	if (log_ring->count == LOG_RING_LEN) {
+		if (!log_ring->dropped++) {
+			log_ring->drop_index = index;
+			snprintf(log_ring->drop_label,
+					sizeof(log_ring->drop_label), "%s",
+					label);
+		}
+
+		return -ENOBUFS;
+	}
+
+	slot = &log_ring->slots[(log_ring->head + log_ring->count) %
+								LOG_RING_LEN];
+	str = (char *) slot->frame + sizeof(*hdr) + ident_len;
+	room = LOG_SLOT_SIZE - sizeof(*hdr) - ident_len;
+
+	va_copy(aq, ap);
+	len = vsnprintf(str, room, format, aq);
+	va_end(aq);
+
+	if (len < 0)
+		return -errno;
+
+	/* Messages that do not fit are sent on their own */
+	if ((size_t) len >= room)
+		return -EMSGSIZE;
+
+	/* Replace new line since btmon already adds it */
+	if (len > 1 && str[len - 1] == '\n') {
+		str[len - 1] = '\0';
+		len--;
+	}
+
+	hdr = (struct log_hdr *) slot->frame;
+	hdr->opcode = cpu_to_le16(0x0000);
+	hdr->index = cpu_to_le16(index);
+	hdr->ident_len = ident_len;
+	hdr->len = cpu_to_le16(2 + ident_len + len + 1);
+	hdr->priority = level;
+
+	memcpy(slot->frame + sizeof(*hdr), label, ident_len);
+
+	slot->len = sizeof(*hdr) + ident_len + len + 1;
+	log_ring->count++;
+
+	if (!log_ring->flush_id)
+		log_ring->flush_id = timeout_add(LOG_FLUSH_INTERVAL,
+						flush_timeout, NULL, NULL);
+
+	return len + 1;
+}
+
+bool bt_log_set_buffered(bool enable)
+{
+	if (!enable) {
+		if (!log_ring)
+			return true;
+
+		if (log_ring->count || log_ring->dropped)
+			log_flush(0);
+
+		timeout_remove(log_ring->flush_id);
+		free(log_ring);
+		log_ring = NULL;
+
+		return true;
+	}
+
+	if (!log_ring)
+		log_ring = new0(struct log_ring, 1);
+
+	return true;
+}
+
 int bt_log_open(void)
 {
 	struct sockaddr_hci addr;
@@ -134,6 +367,21 @@ int bt_log_vprintf(uint16_t index, const char *label, int level,
 	char *str;
 	int len;
 
+	/*
+	 * Skip formatting if there is no logging channel to send to. Whether
+	 * a monitor reads from it cannot be told, the kernel takes messages
+	 * on the channel either way.
+	 */
+	len = bt_log_open();
+	if (len < 0)
+		return len;
+
+	if (log_ring) {
+		len = log_queue(index, label, level, format, ap);
+		if (len != -EMSGSIZE)
+			return len;
+	}
+
 	len = vasprintf(&str, format, ap);
 	if (len < 0 || !str)
 		return errno;
@@ -171,6 +419,14 @@ int bt_log_printf(uint16_t index, const char *label, int level,
 
 void bt_log_close(void)
 {
+	if (log_ring) {
+		if (log_fd >= 0 && (log_ring->count || log_ring->dropped))
+			log_flush(0);
+
+		timeout_remove(log_ring->flush_id);
+		log_ring->flush_id = 0;
+	}
+
 	if (log_fd < 0)
 		return;
 
@@ -8,6 +8,8 @@
  *
  */
 
+#include <stdbool.h>
+
 int bt_log_open(void);
 int bt_log_sendmsg(uint16_t index, const char *label, int level,
 					struct iovec *io, size_t io_len);
@@ -16,3 +18,5 @@ int bt_log_vprintf(uint16_t index, const char *label, int level,
 int bt_log_printf(uint16_t index, const char *label, int level,
 					const char *format, ...);
 void bt_log_close(void);
+
+bool bt_log_set_buffered(bool enable);
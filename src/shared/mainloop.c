@@ -21,21 +21,32 @@
 #include <stddef.h>
 #include <string.h>
 #include <signal.h>
+#include <limits.h>
+#include <time.h>
 #include <sys/signalfd.h>
-#include <sys/timerfd.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 
 #include "mainloop.h"
 #include "mainloop-notify.h"
+#include "timer-wheel.h"
 
-#define MAX_EPOLL_EVENTS 10
+/* Events fetched per epoll_wait(), grown while batches keep coming full */
+#define MIN_EPOLL_EVENTS 16
+#define MAX_EPOLL_EVENTS 1024
+
+/* Initial size of the fd and timeout tables, doubled as needed */
+#define MIN_TABLE_SIZE 64
 
 static int epoll_fd;
 static int epoll_terminate;
 static int exit_status = EXIT_SUCCESS;
 
+static struct epoll_event *events;
+static int events_size;
+static int events_pending;
+
 struct mainloop_data {
 	int fd;
 	uint32_t events;
@@ -44,25 +55,82 @@ struct mainloop_data {
 	void *user_data;
 };
 
-#define MAX_MAINLOOP_ENTRIES 128
-
-static struct mainloop_data *mainloop_list[MAX_MAINLOOP_ENTRIES];
+static struct mainloop_data **mainloop_list;
+static unsigned int mainloop_list_size;
 
+/*
+ * Timeouts are kept in a timer wheel instead of using a timerfd each, the
+ * loop sleeps in epoll_wait() until the next one is due.
+ */
 struct timeout_data {
-	int fd;
+	int id;
+	struct timer_wheel_entry entry;
 	mainloop_timeout_func callback;
 	mainloop_destroy_func destroy;
 	void *user_data;
 };
 
-void mainloop_init(void)
+static struct timer_wheel *timer_wheel;
+static struct timeout_data **timeout_list;
+static unsigned int timeout_list_size;
+static int *timeout_free_ids;
+static unsigned int timeout_free_count;
+
+static void *table_grow(void *table, unsigned int *size, unsigned int min,
+							size_t elem_size)
 {
-	unsigned int i;
+	unsigned int new_size = *size ? *size : MIN_TABLE_SIZE;
+	void *ptr;
+
+	while (new_size <= min)
+		new_size *= 2;
+
+	if (new_size == *size)
+		return table;
+
+	ptr = realloc(table, new_size * elem_size);
+	if (!ptr)
+		return NULL;
+
+	memset((char *) ptr + *size * elem_size, 0,
+					(new_size - *size) * elem_size);
+	*size = new_size;
+
+	return ptr;
+}
 
+static uint64_t get_msec(bool round_up)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ULL +
+			(ts.tv_nsec + (round_up ? 999999 : 0)) / 1000000;
+}
+
+void mainloop_init(void)
+{
 	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
 
-	for (i = 0; i < MAX_MAINLOOP_ENTRIES; i++)
-		mainloop_list[i] = NULL;
+	free(events);
+	events_size = MIN_EPOLL_EVENTS;
+	events = calloc(events_size, sizeof(*events));
+
+	free(mainloop_list);
+	mainloop_list = NULL;
+	mainloop_list_size = 0;
+
+	timer_wheel_free(timer_wheel);
+	timer_wheel = timer_wheel_new(get_msec(false));
+
+	free(timeout_list);
+	timeout_list = NULL;
+	timeout_list_size = 0;
+
+	free(timeout_free_ids);
+	timeout_free_ids = NULL;
+	timeout_free_count = 0;
 
 	epoll_terminate = 0;
 
@@ -88,27 +156,83 @@ void mainloop_exit_failure(void)
 	epoll_terminate = 1;
 }
 
+/* Run the timeouts that are due and return how long to wait for the next */
+static int run_timeouts(void)
+{
+	struct timer_wheel_entry *entry;
+	uint64_t now, next;
+
+	now = get_msec(false);
+
+	while (!epoll_terminate &&
+			(entry = timer_wheel_expire(timer_wheel, now))) {
+		struct timeout_data *data = (void *) ((char *) entry -
+					offsetof(struct timeout_data, entry));
+
+		data->callback(data->id, data->user_data);
+	}
+
+	next = timer_wheel_next(timer_wheel);
+	if (next == UINT64_MAX)
+		return -1;
+
+	now = get_msec(false);
+	if (next <= now)
+		return 0;
+
+	return next - now > INT_MAX ? INT_MAX : (int) (next - now);
+}
+
+static void grow_events(void)
+{
+	struct epoll_event *ptr;
+
+	if (events_size >= MAX_EPOLL_EVENTS)
+		return;
+
+	ptr = realloc(events, events_size * 2 * sizeof(*events));
+	if (!ptr)
+		return;
+
+	events = ptr;
+	events_size *= 2;
+}
+
 int mainloop_run(void)
 {
 	unsigned int i;
 
 	while (!epoll_terminate) {
-		struct epoll_event events[MAX_EPOLL_EVENTS];
-		int n, nfds;
+		int n, nfds, timeout;
 
-		nfds = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+		timeout = run_timeouts();
+		if (epoll_terminate)
+			break;
+
+		nfds = epoll_wait(epoll_fd, events, events_size, timeout);
 		if (nfds < 0)
 			continue;
 
+		/* Callbacks removing an fd clear its pending events */
+		events_pending = nfds;
+
 		for (n = 0; n < nfds; n++) {
 			struct mainloop_data *data = events[n].data.ptr;
 
+			if (!data)
+				continue;
+
 			data->callback(data->fd, events[n].events,
 							data->user_data);
 		}
+
+		events_pending = 0;
+
+		if (nfds == events_size)
+			grow_events();
 	}
 
-	for (i = 0; i < MAX_MAINLOOP_ENTRIES; i++) {
+	for (i = 0; i < mainloop_list_size; i++) {
 		struct mainloop_data *data = mainloop_list[i];
 
 		mainloop_list[i] = NULL;
@@ -123,6 +247,30 @@ int mainloop_run(void)
 		}
 	}
 
+	for (i = 0; i < timeout_list_size; i++) {
+		if (timeout_list[i])
+			mainloop_remove_timeout(i);
+	}
+
+	free(mainloop_list);
+	mainloop_list = NULL;
+	mainloop_list_size = 0;
+
+	free(timeout_list);
+	timeout_list = NULL;
+	timeout_list_size = 0;
+
+	free(timeout_free_ids);
+	timeout_free_ids = NULL;
+	timeout_free_count = 0;
+
+	timer_wheel_free(timer_wheel);
+	timer_wheel = NULL;
+
+	free(events);
+	events = NULL;
+	events_size = 0;
+
 	close(epoll_fd);
 	epoll_fd = 0;
 
@@ -138,9 +286,20 @@ int mainloop_add_fd(int fd, uint32_t events, mainloop_event_func callback,
 	struct epoll_event ev;
 	int err;
 
-	if (fd < 0 || fd > MAX_MAINLOOP_ENTRIES - 1 || !callback)
+	if (fd < 0 || !callback)
 		return -EINVAL;
 
+	if ((unsigned int) fd >= mainloop_list_size) {
+		struct mainloop_data **list;
+
+		list = table_grow(mainloop_list, &mainloop_list_size, fd,
+							sizeof(*mainloop_list));
+		if (!list)
+			return -ENOMEM;
+
+		mainloop_list = list;
+	}
+
 	data = malloc(sizeof(*data));
 	if (!data)
 		return -ENOMEM;
@@ -167,16 +326,24 @@ int mainloop_add_fd(int fd, uint32_t events, mainloop_event_func callback,
 	return 0;
 }
 
+static struct mainloop_data *find_fd(int fd)
+{
+	if (fd < 0 || (unsigned int) fd >= mainloop_list_size)
+		return NULL;
+
+	return mainloop_list[fd];
+}
+
 int mainloop_modify_fd(int fd, uint32_t events)
 {
 	struct mainloop_data *data;
 	struct epoll_event ev;
 	int err;
 
-	if (fd < 0 || fd > MAX_MAINLOOP_ENTRIES - 1)
+	if (fd < 0)
 		return -EINVAL;
 
-	data = mainloop_list[fd];
+	data = find_fd(fd);
 	if (!data)
 		return -ENXIO;
 
@@ -196,12 +363,12 @@ int mainloop_modify_fd(int fd, uint32_t events)
 int mainloop_remove_fd(int fd)
 {
 	struct mainloop_data *data;
-	int err;
+	int err, n;
 
-	if (fd < 0 || fd > MAX_MAINLOOP_ENTRIES - 1)
+	if (fd < 0)
 		return -EINVAL;
 
-	data = mainloop_list[fd];
+	data = find_fd(fd);
 	if (!data)
 		return -ENXIO;
 
@@ -209,6 +376,11 @@ int mainloop_remove_fd(int fd)
 
 	err = epoll_ctl(epoll_fd, EPOLL_CTL_DEL, data->fd, NULL);
 
+	for (n = 0; n < events_pending; n++) {
+		if (events[n].data.ptr == data)
+			events[n].data.ptr = NULL;
+	}
+
 	if (data->destroy)
 		data->destroy(data->user_data);
 
@@ -217,105 +389,121 @@ int mainloop_remove_fd(int fd)
 	return err;
 }
 
-static void timeout_destroy(void *user_data)
+static int alloc_timeout_id(void)
 {
-	struct timeout_data *data = user_data;
+	unsigned int size = timeout_list_size;
+	unsigned int id;
+	struct timeout_data **list;
+	int *ids;
 
-	close(data->fd);
-	data->fd = -1;
+	if (timeout_free_count)
+		return timeout_free_ids[--timeout_free_count];
 
-	if (data->destroy)
-		data->destroy(data->user_data);
+	list = table_grow(timeout_list, &size, timeout_list_size,
+							sizeof(*timeout_list));
+	if (!list)
+		return -ENOMEM;
 
-	free(data);
-}
+	timeout_list = list;
 
-static void timeout_callback(int fd, uint32_t events, void *user_data)
-{
-	struct timeout_data *data = user_data;
-	uint64_t expired;
-	ssize_t result;
+	ids = realloc(timeout_free_ids, size * sizeof(*ids));
+	if (!ids)
+		return -ENOMEM;
 
-	if (events & (EPOLLERR | EPOLLHUP))
-		return;
+	timeout_free_ids = ids;
 
-	result = read(data->fd, &expired, sizeof(expired));
-	if (result != sizeof(expired))
-		return;
+	/* Hand out the lowest identifiers first, 0 is never used */
+	for (id = size - 1; id >= timeout_list_size && id > 0; id--)
+		timeout_free_ids[timeout_free_count++] = id;
+
+	timeout_list_size = size;
 
-	if (data->callback)
-		data->callback(data->fd, data->user_data);
+	return timeout_free_ids[--timeout_free_count];
 }
 
-static inline int timeout_set(int fd, unsigned int msec)
+static struct timeout_data *find_timeout(int id)
 {
-	struct itimerspec itimer;
-	unsigned int sec = msec / 1000;
+	if (id <= 0 || (unsigned int) id >= timeout_list_size)
+		return NULL;
 
-	memset(&itimer, 0, sizeof(itimer));
-	itimer.it_interval.tv_sec = 0;
-	itimer.it_interval.tv_nsec = 0;
-	itimer.it_value.tv_sec = sec;
-	itimer.it_value.tv_nsec = (msec - (sec * 1000)) * 1000 * 1000;
-
-	return timerfd_settime(fd, 0, &itimer, NULL);
+	return timeout_list[id];
 }
 
 int mainloop_add_timeout(unsigned int msec, mainloop_timeout_func callback,
 				void *user_data, mainloop_destroy_func destroy)
 {
 	struct timeout_data *data;
+	int id;
 
 	if (!callback)
 		return -EINVAL;
 
+	if (!timer_wheel) {
+		timer_wheel = timer_wheel_new(get_msec(false));
+		if (!timer_wheel)
+			return -ENOMEM;
+	}
+
 	data = malloc(sizeof(*data));
 	if (!data)
 		return -ENOMEM;
 
+	id = alloc_timeout_id();
+	if (id < 0) {
+		free(data);
+		return id;
+	}
+
 	memset(data, 0, sizeof(*data));
+	data->id = id;
 	data->callback = callback;
 	data->destroy = destroy;
 	data->user_data = user_data;
 
-	data->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
-	if (data->fd < 0) {
-		free(data);
-		return -EIO;
-	}
-
-	if (msec > 0) {
-		if (timeout_set(data->fd, msec) < 0) {
-			close(data->fd);
-			free(data);
-			return -EIO;
-		}
-	}
+	timeout_list[id] = data;
 
-	if (mainloop_add_fd(data->fd, EPOLLIN | EPOLLONESHOT,
-				timeout_callback, data, timeout_destroy) < 0) {
-		close(data->fd);
-		free(data);
-		return -EIO;
-	}
+	if (msec > 0)
+		timer_wheel_add(timer_wheel, &data->entry,
+						get_msec(true) + msec);
 
-	return data->fd;
+	return id;
 }
 
 int mainloop_modify_timeout(int id, unsigned int msec)
 {
-	if (msec > 0) {
-		if (timeout_set(id, msec) < 0)
-			return -EIO;
-	}
+	struct timeout_data *data;
 
-	if (mainloop_modify_fd(id, EPOLLIN | EPOLLONESHOT) < 0)
+	data = find_timeout(id);
+	if (!data)
 		return -EIO;
 
+	if (msec > 0)
+		timer_wheel_add(timer_wheel, &data->entry,
+						get_msec(true) + msec);
+
 	return 0;
 }
 
 int mainloop_remove_timeout(int id)
 {
-	return mainloop_remove_fd(id);
+	struct timeout_data *data;
+
+	if (id <= 0)
+		return -EINVAL;
+
+	data = find_timeout(id);
+	if (!data)
+		return -ENXIO;
+
+	timeout_list[id] = NULL;
+	timeout_free_ids[timeout_free_count++] = id;
+
+	timer_wheel_remove(timer_wheel, &data->entry);
+
+	if (data->destroy)
+		data->destroy(data->user_data);
+
+	free(data);
+
+	return 0;
 }
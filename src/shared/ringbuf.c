@@ -253,6 +253,41 @@ int ringbuf_vprintf(struct ringbuf *ringbuf, const char *format, va_list ap)
 	return len;
 }
 
+ssize_t ringbuf_append(struct ringbuf *ringbuf, const void *data, size_t len)
+{
+	size_t avail, offset, end;
+
+	if (!ringbuf || (!data && len))
+		return -1;
+
+	/* Data is either appended as a whole or not at all */
+	avail = ringbuf->size - ringbuf->in + ringbuf->out;
+	if (len > avail)
+		return -1;
+
+	/* Determine possible length of data before wrapping */
+	offset = ringbuf->in & (ringbuf->size - 1);
+	end = MIN(len, ringbuf->size - offset);
+	memcpy(ringbuf->buffer + offset, data, end);
+
+	if (ringbuf->in_tracing && end)
+		ringbuf->in_tracing(ringbuf->buffer + offset, end,
+							ringbuf->in_data);
+
+	if (len - end > 0) {
+		/* Put the remainder of data at the beginning */
+		memcpy(ringbuf->buffer, data + end, len - end);
+
+		if (ringbuf->in_tracing)
+			ringbuf->in_tracing(ringbuf->buffer, len - end,
+							ringbuf->in_data);
+	}
+
+	ringbuf->in += len;
+
+	return len;
+}
+
 ssize_t ringbuf_read(struct ringbuf *ringbuf, int fd)
 {
 	size_t avail, offset, end;
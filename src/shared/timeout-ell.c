@@ -8,38 +8,69 @@
  *
  */
 
+#include <stddef.h>
+#include <time.h>
+
 #include <ell/ell.h>
 
 #include "timeout.h"
+#include "timer-wheel.h"
 
-static struct l_queue *timeout_q;
-
+/*
+ * All timeouts are kept in a timer wheel driven by a single l_timeout, so
+ * there is only one timerfd no matter how many timeouts are pending. The
+ * timer is only re-armed when the earliest deadline moves closer.
+ */
 struct timeout_data {
+	struct timer_wheel_entry entry;
+	unsigned int id;
+	unsigned int timeout;
+	bool running;
+	bool removed;
 	timeout_func_t func;
 	timeout_destroy_func_t destroy;
 	void *user_data;
-	unsigned int timeout;
 };
 
-static bool match_id(const void *a, const void *b)
+static struct timer_wheel *wheel;
+static struct l_timeout *wheel_timeout;
+static struct l_hashmap *timeouts;
+static unsigned int next_id;
+static uint64_t armed = UINT64_MAX;
+
+static uint64_t get_msec(bool round_up)
 {
-	unsigned int to_id = L_PTR_TO_UINT(a);
-	unsigned int id = L_PTR_TO_UINT(b);
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	return (to_id == id);
+	return ts.tv_sec * 1000ULL +
+			(ts.tv_nsec + (round_up ? 999999 : 0)) / 1000000;
 }
 
-static void timeout_callback(struct l_timeout *timeout, void *user_data)
+static void wheel_arm(uint64_t next)
 {
-	struct timeout_data *data = user_data;
+	uint64_t now = get_msec(false);
+
+	armed = next;
+
+	if (next == UINT64_MAX)
+		return;
 
-	if (data->func)
-		data->func(data->user_data);
+	/* A zero timeout would leave the timer disarmed */
+	l_timeout_modify_ms(wheel_timeout, next > now ? next - now : 1);
+}
+
+static void wheel_update(void)
+{
+	uint64_t next = timer_wheel_next(wheel);
 
-	l_timeout_modify(timeout, data->timeout);
+	/* A later deadline is picked up when the timer fires anyway */
+	if (next < armed)
+		wheel_arm(next);
 }
 
-static void timeout_destroy(void *user_data)
+static void timeout_free(void *user_data)
 {
 	struct timeout_data *data = user_data;
 
@@ -49,16 +80,58 @@ static void timeout_destroy(void *user_data)
 	l_free(data);
 }
 
+static void wheel_callback(struct l_timeout *timeout, void *user_data)
+{
+	struct timer_wheel_entry *entry;
+	uint64_t now = get_msec(false);
+
+	while ((entry = timer_wheel_expire(wheel, now))) {
+		struct timeout_data *data = (void *) ((char *) entry -
+					offsetof(struct timeout_data, entry));
+		bool again;
+
+		data->running = true;
+		again = data->func(data->user_data);
+		data->running = false;
+
+		if (again && !data->removed) {
+			timer_wheel_add(wheel, &data->entry,
+					get_msec(true) + data->timeout);
+			continue;
+		}
+
+		if (!data->removed)
+			l_hashmap_remove(timeouts, L_UINT_TO_PTR(data->id));
+
+		timeout_free(data);
+	}
+
+	wheel_arm(timer_wheel_next(wheel));
+}
+
+static bool wheel_init(void)
+{
+	if (wheel_timeout)
+		return true;
+
+	/* Created disarmed, wheel_arm() sets the first deadline */
+	wheel_timeout = l_timeout_create_ms(0, wheel_callback, NULL, NULL);
+	if (!wheel_timeout)
+		return false;
+
+	wheel = timer_wheel_new(get_msec(false));
+	timeouts = l_hashmap_new();
+
+	return true;
+}
+
 unsigned int timeout_add(unsigned int timeout, timeout_func_t func,
 			void *user_data, timeout_destroy_func_t destroy)
 {
 	struct timeout_data *data;
-	unsigned int id = 0;
-	struct l_timeout *to;
-	int tries = 0;
 
-	if (!timeout_q)
-		timeout_q = l_queue_new();
+	if (!func || !wheel_init())
+		return 0;
 
 	data = l_new(struct timeout_data, 1);
 
@@ -67,39 +140,40 @@ unsigned int timeout_add(unsigned int timeout, timeout_func_t func,
 	data->user_data = user_data;
 	data->timeout = timeout;
 
-	while (id == 0 && tries < 3) {
-		to = l_timeout_create_ms(timeout, timeout_callback,
-							data, timeout_destroy);
-		if (!to)
-			break;
+	/* Identifiers are not reused until they wrap around */
+	do {
+		data->id = ++next_id;
+	} while (!data->id || l_hashmap_lookup(timeouts,
+						L_UINT_TO_PTR(data->id)));
 
-		tries++;
-		id = L_PTR_TO_UINT(to);
+	l_hashmap_insert(timeouts, L_UINT_TO_PTR(data->id), data);
 
-		if (id == 0 ||
-			l_queue_find(timeout_q, match_id, L_UINT_TO_PTR(id))) {
+	timer_wheel_add(wheel, &data->entry, get_msec(true) + timeout);
+	wheel_update();
 
-			l_timeout_remove(to);
-			continue;
-		}
-
-		l_queue_push_tail(timeout_q, to);
-	}
-
-	if (id == 0)
-		l_free(data);
-
-	return id;
+	return data->id;
 }
 
 void timeout_remove(unsigned int id)
 {
-	struct l_timeout *to;
+	struct timeout_data *data;
+
+	if (!id || !timeouts)
+		return;
+
+	data = l_hashmap_remove(timeouts, L_UINT_TO_PTR(id));
+	if (!data)
+		return;
 
-	to = l_queue_remove_if(timeout_q, match_id, L_UINT_TO_PTR(id));
+	timer_wheel_remove(wheel, &data->entry);
+
+	/* Freed once its callback returns */
+	if (data->running) {
+		data->removed = true;
+		return;
+	}
 
-	if (to)
-		l_timeout_remove(to);
+	timeout_free(data);
 }
 
 unsigned int timeout_add_seconds(unsigned int timeout, timeout_func_t func,
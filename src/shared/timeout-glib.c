@@ -8,93 +8,205 @@
  *
  */
 
+#include <stddef.h>
+
 #include "timeout.h"
+#include "timer-wheel.h"
 
 #include <glib.h>
 
+/*
+ * All timeouts are kept in a timer wheel driven by a single GSource, so the
+ * main context only ever has to look at the earliest deadline no matter how
+ * many timeouts are pending.
+ */
 struct timeout_data {
+	struct timer_wheel_entry entry;
+	unsigned int id;
+	unsigned int timeout;
+	bool seconds;
+	bool running;
+	bool removed;
 	timeout_func_t func;
 	timeout_destroy_func_t destroy;
 	void *user_data;
 };
 
-static gboolean timeout_callback(gpointer user_data)
-{
-	struct timeout_data *data  = user_data;
+static struct timer_wheel *wheel;
+static GSource *wheel_source;
+static GHashTable *timeouts;
+static unsigned int next_id;
 
-	if (data->func(data->user_data))
-		return TRUE;
+static uint64_t get_msec(bool round_up)
+{
+	gint64 now = g_get_monotonic_time();
 
-	return FALSE;
+	return (now + (round_up ? 999 : 0)) / 1000;
 }
 
-static void timeout_destroy(gpointer user_data)
+static void timeout_arm(struct timeout_data *data, uint64_t now)
 {
-	struct timeout_data *data = user_data;
+	uint64_t expires = now + data->timeout;
+
+	/* Let timeouts in seconds expire together on a second boundary */
+	if (data->seconds && data->timeout)
+		expires += 999 - (expires + 999) % 1000;
+
+	timer_wheel_add(wheel, &data->entry, expires);
+}
 
+static void timeout_free(struct timeout_data *data)
+{
 	if (data->destroy)
 		data->destroy(data->user_data);
 
 	g_free(data);
 }
 
-unsigned int timeout_add(unsigned int timeout, timeout_func_t func,
-			void *user_data, timeout_destroy_func_t destroy)
+static gboolean wheel_dispatch(GSource *source, GSourceFunc callback,
+							gpointer user_data)
+{
+	struct timer_wheel_entry *entry;
+	uint64_t now = get_msec(false);
+
+	while ((entry = timer_wheel_expire(wheel, now))) {
+		struct timeout_data *data = (void *) ((char *) entry -
+					offsetof(struct timeout_data, entry));
+		bool again;
+
+		data->running = true;
+		again = data->func(data->user_data);
+		data->running = false;
+
+		if (again && !data->removed) {
+			timeout_arm(data, get_msec(true));
+			continue;
+		}
+
+		if (!data->removed)
+			g_hash_table_remove(timeouts,
+						GUINT_TO_POINTER(data->id));
+
+		timeout_free(data);
+	}
+
+	return TRUE;
+}
+
+static gboolean wheel_prepare(GSource *source, gint *timeout)
+{
+	uint64_t next = timer_wheel_next(wheel);
+	uint64_t now;
+
+	if (next == UINT64_MAX) {
+		*timeout = -1;
+		return FALSE;
+	}
+
+	now = get_msec(false);
+	if (next <= now) {
+		*timeout = 0;
+		return TRUE;
+	}
+
+	*timeout = MIN(next - now, G_MAXINT);
+
+	return FALSE;
+}
+
+static gboolean wheel_check(GSource *source)
+{
+	return timer_wheel_next(wheel) <= get_msec(false);
+}
+
+static GSourceFuncs wheel_funcs = {
+	.prepare = wheel_prepare,
+	.check = wheel_check,
+	.dispatch = wheel_dispatch,
+};
+
+static bool wheel_init(void)
+{
+	if (wheel_source)
+		return true;
+
+	wheel = timer_wheel_new(get_msec(false));
+	if (!wheel)
+		return false;
+
+	timeouts = g_hash_table_new(NULL, NULL);
+
+	wheel_source = g_source_new(&wheel_funcs, sizeof(GSource));
+	g_source_set_priority(wheel_source, G_PRIORITY_DEFAULT);
+	g_source_attach(wheel_source, NULL);
+
+	return true;
+}
+
+static unsigned int timeout_add_full(unsigned int timeout, bool seconds,
+					timeout_func_t func, void *user_data,
+					timeout_destroy_func_t destroy)
 {
 	struct timeout_data *data;
-	guint id;
+
+	if (!func || !wheel_init())
+		return 0;
 
 	data = g_try_new0(struct timeout_data, 1);
 	if (!data)
 		return 0;
 
+	data->timeout = timeout;
+	data->seconds = seconds;
 	data->func = func;
 	data->destroy = destroy;
 	data->user_data = user_data;
 
-	id = g_timeout_add_full(G_PRIORITY_DEFAULT, timeout, timeout_callback,
-						data, timeout_destroy);
-	if (!id)
-		g_free(data);
+	/* Identifiers are not reused until they wrap around */
+	do {
+		data->id = ++next_id;
+	} while (!data->id || g_hash_table_contains(timeouts,
+						GUINT_TO_POINTER(data->id)));
+
+	g_hash_table_insert(timeouts, GUINT_TO_POINTER(data->id), data);
+
+	timeout_arm(data, get_msec(true));
+
+	return data->id;
+}
 
-	return id;
+unsigned int timeout_add(unsigned int timeout, timeout_func_t func,
+			void *user_data, timeout_destroy_func_t destroy)
+{
+	return timeout_add_full(timeout, false, func, user_data, destroy);
 }
 
 void timeout_remove(unsigned int id)
 {
-	GSource *source;
+	struct timeout_data *data;
 
-	if (!id)
+	if (!id || !timeouts)
 		return;
 
-	source = g_main_context_find_source_by_id(NULL, id);
-	if (source)
-		g_source_destroy(source);
+	data = g_hash_table_lookup(timeouts, GUINT_TO_POINTER(id));
+	if (!data)
+		return;
+
+	g_hash_table_remove(timeouts, GUINT_TO_POINTER(id));
+	timer_wheel_remove(wheel, &data->entry);
+
+	/* Freed once its callback returns */
+	if (data->running) {
+		data->removed = true;
+		return;
+	}
+
+	timeout_free(data);
 }
 
 unsigned int timeout_add_seconds(unsigned int timeout, timeout_func_t func,
 			void *user_data, timeout_destroy_func_t destroy)
 {
-	struct timeout_data *data;
-	guint id;
-
-	data = g_try_new0(struct timeout_data, 1);
-	if (!data)
-		return 0;
-
-	data->func = func;
-	data->destroy = destroy;
-	data->user_data = user_data;
-
-	if (!timeout)
-		id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, timeout_callback,
-							data, timeout_destroy);
-	else
-		id = g_timeout_add_seconds_full(G_PRIORITY_DEFAULT, timeout,
-							timeout_callback, data,
-							timeout_destroy);
-	if (!id)
-		g_free(data);
-
-	return id;
+	return timeout_add_full(timeout * 1000, true, func, user_data,
+								destroy);
 }
@@ -0,0 +1,288 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include "src/shared/util.h"
+#include "src/shared/timer-wheel.h"
+
+/*
+ * Hierarchical timer wheel with a resolution of one tick, usually a
+ * millisecond. Level n has 64 slots of 64^n ticks each, timers far away
+ * sit in a higher level and are cascaded down as the wheel gets closer
+ * to their expiry, so they still fire on the exact tick they were set
+ * for. Adding and removing a timer is O(1) and a bitmap of the occupied
+ * slots of each level gives the next tick that needs processing without
+ * scanning the slots.
+ */
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	6
+
+#define LEVEL_SHIFT(level)	((level) * WHEEL_BITS)
+#define LEVEL_RANGE(level)	((uint64_t) 1 << LEVEL_SHIFT(level))
+
+struct timer_wheel {
+	uint64_t now;			/* Next tick to process */
+	unsigned int count;
+	uint64_t pending[WHEEL_LEVELS];
+	struct timer_wheel_entry *slots[WHEEL_LEVELS][WHEEL_SIZE];
+	struct timer_wheel_entry *expired;
+};
+
+static void entry_link(struct timer_wheel_entry **head,
+					struct timer_wheel_entry *entry)
+{
+	entry->next = *head;
+	entry->pprev = head;
+
+	if (*head)
+		(*head)->pprev = &entry->next;
+
+	*head = entry;
+}
+
+static void entry_unlink(struct timer_wheel_entry *entry)
+{
+	*entry->pprev = entry->next;
+
+	if (entry->next)
+		entry->next->pprev = entry->pprev;
+
+	entry->next = NULL;
+	entry->pprev = NULL;
+}
+
+static void wheel_insert(struct timer_wheel *wheel,
+					struct timer_wheel_entry *entry)
+{
+	uint64_t delta = entry->expires - wheel->now;
+	unsigned int level, slot;
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < LEVEL_RANGE(level + 1))
+			break;
+	}
+
+	/* Beyond the range of the wheel wait in the farthest slot */
+	if (delta >= LEVEL_RANGE(WHEEL_LEVELS))
+		slot = ((wheel->now >> LEVEL_SHIFT(level)) - 1) & WHEEL_MASK;
+	else
+		slot = (entry->expires >> LEVEL_SHIFT(level)) & WHEEL_MASK;
+
+	entry_link(&wheel->slots[level][slot], entry);
+	wheel->pending[level] |= (uint64_t) 1 << slot;
+}
+
+static void slot_update(struct timer_wheel *wheel,
+					struct timer_wheel_entry **head)
+{
+	unsigned int level, slot;
+
+	if (*head)
+		return;
+
+	/* Find out which slot the list head belongs to */
+	level = (head - &wheel->slots[0][0]) / WHEEL_SIZE;
+	slot = (head - &wheel->slots[0][0]) % WHEEL_SIZE;
+
+	if (level < WHEEL_LEVELS)
+		wheel->pending[level] &= ~((uint64_t) 1 << slot);
+}
+
+struct timer_wheel *timer_wheel_new(uint64_t now)
+{
+	struct timer_wheel *wheel;
+
+	wheel = new0(struct timer_wheel, 1);
+	wheel->now = now;
+
+	return wheel;
+}
+
+void timer_wheel_free(struct timer_wheel *wheel)
+{
+	free(wheel);
+}
+
+void timer_wheel_add(struct timer_wheel *wheel,
+				struct timer_wheel_entry *entry, uint64_t expires)
+{
+	if (!wheel || !entry)
+		return;
+
+	if (entry->pprev)
+		timer_wheel_remove(wheel, entry);
+
+	/* Anything already due fires on the next tick processed */
+	entry->expires = expires < wheel->now ? wheel->now : expires;
+
+	wheel_insert(wheel, entry);
+	wheel->count++;
+}
+
+void timer_wheel_remove(struct timer_wheel *wheel,
+				struct timer_wheel_entry *entry)
+{
+	struct timer_wheel_entry **head;
+
+	if (!wheel || !entry || !entry->pprev)
+		return;
+
+	/* Only the first entry of a list points back into its head */
+	head = entry->pprev;
+
+	entry_unlink(entry);
+
+	if (head >= &wheel->slots[0][0] &&
+			head < &wheel->slots[0][0] + WHEEL_LEVELS * WHEEL_SIZE)
+		slot_update(wheel, head);
+
+	wheel->count--;
+}
+
+bool timer_wheel_entry_pending(const struct timer_wheel_entry *entry)
+{
+	return entry && entry->pprev;
+}
+
+unsigned int timer_wheel_count(struct timer_wheel *wheel)
+{
+	return wheel ? wheel->count : 0;
+}
+
+/* Number of slots from the current one to the next occupied one */
+static unsigned int next_slot(uint64_t pending, unsigned int index)
+{
+	uint64_t rotated;
+
+	rotated = (pending >> index) | (index ? pending << (64 - index) : 0);
+
+	return __builtin_ctzll(rotated);
+}
+
+/*
+ * Return the next tick at which a timer expires or has to be cascaded to
+ * a lower level, UINT64_MAX if there are no timers.
+ */
+uint64_t timer_wheel_next(struct timer_wheel *wheel)
+{
+	uint64_t next = UINT64_MAX;
+	unsigned int level;
+
+	if (!wheel || !wheel->count)
+		return UINT64_MAX;
+
+	if (wheel->expired)
+		return wheel->now;
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		uint64_t range = LEVEL_RANGE(level);
+		uint64_t start, tick;
+
+		if (!wheel->pending[level])
+			continue;
+
+		/* First tick at which this level is looked at again */
+		start = (wheel->now + range - 1) & ~(range - 1);
+
+		tick = start + next_slot(wheel->pending[level],
+				(start >> LEVEL_SHIFT(level)) & WHEEL_MASK) *
+									range;
+		if (tick < next)
+			next = tick;
+	}
+
+	return next;
+}
+
+static void cascade(struct timer_wheel *wheel, unsigned int level)
+{
+	unsigned int slot = (wheel->now >> LEVEL_SHIFT(level)) & WHEEL_MASK;
+	struct timer_wheel_entry *entry, *list = NULL;
+
+	/* Reinsert oldest first so timers due on the same tick keep the
+	 * order they were added in.
+	 */
+	while ((entry = wheel->slots[level][slot])) {
+		entry_unlink(entry);
+		entry->next = list;
+		list = entry;
+	}
+
+	wheel->pending[level] &= ~((uint64_t) 1 << slot);
+
+	while (list) {
+		entry = list;
+		list = entry->next;
+		wheel_insert(wheel, entry);
+	}
+}
+
+static void process_tick(struct timer_wheel *wheel)
+{
+	unsigned int slot = wheel->now & WHEEL_MASK;
+	unsigned int level;
+	struct timer_wheel_entry *entry;
+
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		if (wheel->now & (LEVEL_RANGE(level) - 1))
+			break;
+
+		cascade(wheel, level);
+	}
+
+	/* Everything left in the slot expires on this tick, moving the
+	 * newest first puts them back in the order they were added in.
+	 */
+	while ((entry = wheel->slots[0][slot])) {
+		entry_unlink(entry);
+		entry_link(&wheel->expired, entry);
+	}
+
+	wheel->pending[0] &= ~((uint64_t) 1 << slot);
+	wheel->now++;
+}
+
+/*
+ * Remove and return a timer that expired at or before now, NULL once
+ * there are none left. Timers may be added and removed in between calls.
+ */
+struct timer_wheel_entry *timer_wheel_expire(struct timer_wheel *wheel,
+								uint64_t now)
+{
+	struct timer_wheel_entry *entry;
+
+	if (!wheel)
+		return NULL;
+
+	while (!wheel->expired) {
+		uint64_t next = timer_wheel_next(wheel);
+
+		if (next > now) {
+			if (wheel->now <= now)
+				wheel->now = now + 1;
+
+			return NULL;
+		}
+
+		wheel->now = next;
+		process_tick(wheel);
+	}
+
+	entry = wheel->expired;
+	entry_unlink(entry);
+	wheel->count--;
+
+	return entry;
+}
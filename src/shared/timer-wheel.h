@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Embedded in the timer owned by the user of the wheel */
+struct timer_wheel_entry {
+	struct timer_wheel_entry *next;
+	struct timer_wheel_entry **pprev;
+	uint64_t expires;
+};
+
+struct timer_wheel;
+
+struct timer_wheel *timer_wheel_new(uint64_t now);
+void timer_wheel_free(struct timer_wheel *wheel);
+
+void timer_wheel_add(struct timer_wheel *wheel,
+				struct timer_wheel_entry *entry, uint64_t expires);
+void timer_wheel_remove(struct timer_wheel *wheel,
+				struct timer_wheel_entry *entry);
+bool timer_wheel_entry_pending(const struct timer_wheel_entry *entry);
+
+unsigned int timer_wheel_count(struct timer_wheel *wheel);
+uint64_t timer_wheel_next(struct timer_wheel *wheel);
+struct timer_wheel_entry *timer_wheel_expire(struct timer_wheel *wheel,
+								uint64_t now);
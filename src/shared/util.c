@@ -1658,18 +1658,106 @@ static const struct {
 	{ }
 };
 
+/*
+ * The tables above follow the order of the assigned numbers documents, so
+ * lookups go through indexes sorted by UUID which are built on first use.
+ * Entries sharing a UUID keep their table order, the first one still wins.
+ */
+static uint16_t uuid16_index[ARRAY_SIZE(uuid16_table) - 1];
+static uint16_t uuid128_index[ARRAY_SIZE(uuid128_table) - 1];
+static bool uuid_index_ready;
+
+static int uuid16_index_cmp(const void *a, const void *b)
+{
+	uint16_t i = *(const uint16_t *) a;
+	uint16_t j = *(const uint16_t *) b;
+
+	if (uuid16_table[i].uuid != uuid16_table[j].uuid)
+		return uuid16_table[i].uuid < uuid16_table[j].uuid ? -1 : 1;
+
+	return i - j;
+}
+
+static int uuid128_index_cmp(const void *a, const void *b)
+{
+	uint16_t i = *(const uint16_t *) a;
+	uint16_t j = *(const uint16_t *) b;
+	int cmp;
+
+	cmp = strcasecmp(uuid128_table[i].uuid, uuid128_table[j].uuid);
+	if (cmp)
+		return cmp;
+
+	return i - j;
+}
+
+static void uuid_index_init(void)
+{
+	size_t i;
+
+	if (uuid_index_ready)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(uuid16_index); i++)
+		uuid16_index[i] = i;
+
+	qsort(uuid16_index, ARRAY_SIZE(uuid16_index), sizeof(uint16_t),
+							uuid16_index_cmp);
+
+	for (i = 0; i < ARRAY_SIZE(uuid128_index); i++)
+		uuid128_index[i] = i;
+
+	qsort(uuid128_index, ARRAY_SIZE(uuid128_index), sizeof(uint16_t),
+							uuid128_index_cmp);
+
+	uuid_index_ready = true;
+}
+
 const char *bt_uuid16_to_str(uint16_t uuid)
 {
-	int i;
+	size_t lo = 0, hi = ARRAY_SIZE(uuid16_index);
+
+	uuid_index_init();
 
-	for (i = 0; uuid16_table[i].str; i++) {
-		if (uuid16_table[i].uuid == uuid)
-			return uuid16_table[i].str;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (uuid16_table[uuid16_index[mid]].uuid < uuid)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
+	if (lo < ARRAY_SIZE(uuid16_index) &&
+				uuid16_table[uuid16_index[lo]].uuid == uuid)
+		return uuid16_table[uuid16_index[lo]].str;
+
 	return "Unknown";
 }
 
+static const char *uuid128_lookup(const char *uuid)
+{
+	size_t lo = 0, hi = ARRAY_SIZE(uuid128_index);
+
+	uuid_index_init();
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (strcasecmp(uuid128_table[uuid128_index[mid]].uuid,
+								uuid) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < ARRAY_SIZE(uuid128_index) &&
+		!strcasecmp(uuid128_table[uuid128_index[lo]].uuid, uuid))
+		return uuid128_table[uuid128_index[lo]].str;
+
+	return NULL;
+}
+
 const char *bt_uuid32_to_str(uint32_t uuid)
 {
 	if ((uuid & 0xffff0000) == 0x0000)
@@ -1692,9 +1780,9 @@ const char *bt_uuid128_to_str(const uint8_t uuid[16])
 
 const char *bt_uuidstr_to_str(const char *uuid)
 {
+	const char *str;
 	uint32_t val;
 	size_t len;
-	int i;
 
 	if (!uuid)
 		return NULL;
@@ -1717,10 +1805,9 @@ const char *bt_uuidstr_to_str(const char *uuid)
 	if (len != 36)
 		return NULL;
 
-	for (i = 0; uuid128_table[i].str; i++) {
-		if (strcasecmp(uuid128_table[i].uuid, uuid) == 0)
-			return uuid128_table[i].str;
-	}
+	str = uuid128_lookup(uuid);
+	if (str)
+		return str;
 
 	if (strncasecmp(uuid + 8, "-0000-1000-8000-00805f9b34fb", 28))
 		return "Vendor specific";
@@ -1795,26 +1882,29 @@ static const struct {
 
 const char *bt_appear_to_str(uint16_t appearance)
 {
-	const char *str = NULL;
-	int i, type = 0;
-
-	for (i = 0; appearance_table[i].str; i++) {
-		if (appearance_table[i].generic) {
-			if (appearance < appearance_table[i].val)
-				break;
-			type = i;
-		}
+	size_t lo = 0, hi = ARRAY_SIZE(appearance_table) - 1;
 
-		if (appearance_table[i].val == appearance) {
-			str = appearance_table[i].str;
-			break;
-		}
+	/* The table is sorted, find the last entry not above appearance */
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (appearance_table[mid].val <= appearance)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	if (!str)
-		str = appearance_table[type].str;
+	/* The first entry is 0 so there always is one */
+	lo--;
 
-	return str;
+	if (appearance_table[lo].val == appearance)
+		return appearance_table[lo].str;
+
+	/* Otherwise use the category the sub-category would belong to */
+	while (!appearance_table[lo].generic)
+		lo--;
+
+	return appearance_table[lo].str;
 }
 
 char *strdelimit(char *str, char *del, char c)
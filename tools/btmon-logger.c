@@ -38,6 +38,8 @@
 
 #define MONITOR_INDEX_NONE 0xffff
 
+#define FLUSH_INTERVAL 1000
+
 struct monitor_hdr {
 	uint16_t opcode;
 	uint16_t index;
@@ -143,6 +145,15 @@ static bool open_monitor_channel(void)
 	return true;
 }
 
+static void flush_callback(int id, void *user_data)
+{
+	/* Do not leave records behind in the buffer when traffic stops */
+	btsnoop_flush(btsnoop_file);
+
+	if (mainloop_modify_timeout(id, FLUSH_INTERVAL) < 0)
+		mainloop_quit();
+}
+
 static void signal_callback(int signum, void *user_data)
 {
 	switch (signum) {
@@ -346,10 +357,16 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 
 	btsnoop_file = btsnoop_create(path, size_limit, max_count,
-							BTSNOOP_FORMAT_MONITOR);
+				BTSNOOP_FORMAT_MONITOR, BTSNOOP_FLAG_BUFFERED);
 	if (!btsnoop_file)
 		return EXIT_FAILURE;
 
+	if (mainloop_add_timeout(FLUSH_INTERVAL, flush_callback, NULL,
+								NULL) < 0) {
+		btsnoop_unref(btsnoop_file);
+		return EXIT_FAILURE;
+	}
+
 	drop_capabilities();
 
 	printf("Bluetooth monitor logger ver %s\n", VERSION);
@@ -322,6 +322,8 @@ static int setopts(int sk, struct l2cap_options *opts)
 							sizeof(opts->imtu));
 }
 
+bool display_quiet = false;
+
 bool use_color(void)
 {
 	return false;
@@ -14,6 +14,7 @@
 #define _GNU_SOURCE
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -85,16 +86,23 @@ static void cmd_connect(int argc, char **argv)
 
 struct transfer_data {
 	int fd;
+	off_t size;
+	off_t offset;
+	gint64 start;
 };
 
 static void transfer_complete(GObex *obex, GError *err, gpointer user_data)
 {
 	struct transfer_data *data = user_data;
+	gint64 usec = g_get_monotonic_time() - data->start;
 
 	if (err != NULL)
 		g_printerr("failed: %s\n", err->message);
 	else
-		g_print("transfer succeeded\n");
+		g_print("transfer succeeded: %lld bytes in %.3f s (%.1f KiB/s)\n",
+				(long long) data->offset, usec / 1000000.0,
+				usec ? data->offset * 1000000.0 / usec / 1024 :
+									0);
 
 	close(data->fd);
 	g_free(data);
@@ -103,14 +111,34 @@ static void transfer_complete(GObex *obex, GError *err, gpointer user_data)
 static gssize put_data_cb(void *buf, gsize len, gpointer user_data)
 {
 	struct transfer_data *data = user_data;
+	gssize ret;
 
-	return read(data->fd, buf, len);
+	ret = read(data->fd, buf, len);
+	if (ret > 0)
+		data->offset += ret;
+
+	return ret;
+}
+
+/* Regular files are sent with sendfile() instead of being copied */
+static gssize put_fd_cb(int *fd, gsize len, gpointer user_data)
+{
+	struct transfer_data *data = user_data;
+	gssize ret;
+
+	*fd = data->fd;
+
+	ret = MIN((off_t) len, data->size - data->offset);
+	data->offset += ret;
+
+	return ret;
 }
 
 static void cmd_put(int argc, char **argv)
 {
 	struct transfer_data *data;
 	GError *err = NULL;
+	struct stat st;
 	int fd;
 
 	if (argc < 2) {
@@ -126,9 +154,16 @@ static void cmd_put(int argc, char **argv)
 
 	data = g_new0(struct transfer_data, 1);
 	data->fd = fd;
+	data->start = g_get_monotonic_time();
 
-	g_obex_put_req(obex, put_data_cb, transfer_complete, data, &err,
-						G_OBEX_HDR_NAME, argv[1],
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		data->size = st.st_size;
+		g_obex_put_req_fd(obex, put_fd_cb, transfer_complete, data,
+						&err, G_OBEX_HDR_NAME, argv[1],
+						G_OBEX_HDR_INVALID);
+	} else
+		g_obex_put_req(obex, put_data_cb, transfer_complete, data,
+						&err, G_OBEX_HDR_NAME, argv[1],
 						G_OBEX_HDR_INVALID);
 	if (err != NULL) {
 		g_printerr("put failed: %s\n", err->message);
@@ -147,6 +182,8 @@ static gboolean get_data_cb(const void *buf, gsize len, gpointer user_data)
 		return FALSE;
 	}
 
+	data->offset += len;
+
 	return TRUE;
 }
 
@@ -169,6 +206,7 @@ static void cmd_get(int argc, char **argv)
 
 	data = g_new0(struct transfer_data, 1);
 	data->fd = fd;
+	data->start = g_get_monotonic_time();
 
 	g_obex_get_req(obex, get_data_cb, transfer_complete, data, &err,
 						G_OBEX_HDR_NAME, argv[1],
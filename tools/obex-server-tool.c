@@ -14,6 +14,7 @@
 #define _GNU_SOURCE
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -71,6 +72,8 @@ static void disconn_func(GObex *obex, GError *err, gpointer user_data)
 
 struct transfer_data {
 	int fd;
+	off_t size;
+	off_t offset;
 };
 
 static void transfer_complete(GObex *obex, GError *err, gpointer user_data)
@@ -159,6 +162,22 @@ static gssize send_data(void *buf, gsize len, gpointer user_data)
 	return ret;
 }
 
+/* Regular files are sent with sendfile() instead of being copied */
+static gssize send_fd(int *fd, gsize len, gpointer user_data)
+{
+	struct transfer_data *data = user_data;
+	gssize ret;
+
+	*fd = data->fd;
+
+	ret = MIN((off_t) len, data->size - data->offset);
+	data->offset += ret;
+
+	g_print("sending %zd bytes of data\n", ret);
+
+	return ret;
+}
+
 static void handle_get(GObex *obex, GObexPacket *req, gpointer user_data)
 {
 	GError *err = NULL;
@@ -166,6 +185,7 @@ static void handle_get(GObex *obex, GObexPacket *req, gpointer user_data)
 	const char *type, *name;
 	GObexHeader *hdr;
 	gsize type_len;
+	struct stat st;
 
 	hdr = g_obex_packet_get_header(req, G_OBEX_HDR_TYPE);
 	if (hdr != NULL) {
@@ -198,7 +218,12 @@ static void handle_get(GObex *obex, GObexPacket *req, gpointer user_data)
 		return;
 	}
 
-	g_obex_get_rsp(obex, send_data, transfer_complete, data, &err,
+	if (fstat(data->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		data->size = st.st_size;
+		g_obex_get_rsp_fd(obex, send_fd, transfer_complete, data, &err,
+							G_OBEX_HDR_INVALID);
+	} else
+		g_obex_get_rsp(obex, send_data, transfer_complete, data, &err,
 							G_OBEX_HDR_INVALID);
 	if (err != NULL) {
 		g_printerr("Unable to send response: %s\n", err->message);
@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Assertion for the tests which do not run under the GLib based tester */
+#define CHECK(cond) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__,	\
+								#cond);	\
+		exit(EXIT_FAILURE);					\
+	}								\
+} while (0)
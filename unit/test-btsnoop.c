@@ -0,0 +1,613 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <glib.h>
+
+#include "src/shared/btsnoop.h"
+#include "src/shared/tester.h"
+
+#define NUM_RECORDS	20000
+#define MAX_SIZE	(256 * 1024)
+#define MAX_COUNT	3
+#define NUM_HANDLES	4
+
+struct test_data {
+	char dir[32];
+};
+
+static void make_record(unsigned int i, struct timeval *tv, uint16_t *index,
+				uint16_t *opcode, uint8_t *data, uint16_t *size)
+{
+	static const uint16_t opcodes[] = {
+		BTSNOOP_OPCODE_COMMAND_PKT, BTSNOOP_OPCODE_EVENT_PKT,
+		BTSNOOP_OPCODE_ACL_TX_PKT, BTSNOOP_OPCODE_ACL_RX_PKT,
+		BTSNOOP_OPCODE_ISO_TX_PKT, BTSNOOP_OPCODE_ISO_RX_PKT,
+	};
+	uint16_t j;
+
+	tv->tv_sec = 1700000000 + i / 1000;
+	tv->tv_usec = (i % 1000) * 1000;
+	*index = i % 3;
+	*opcode = opcodes[i % G_N_ELEMENTS(opcodes)];
+
+	/* Mix of empty, small and maximum sized records */
+	*size = (i * 37) % (BTSNOOP_MAX_PACKET_SIZE + 1);
+	if (i % 101 == 0)
+		*size = 0;
+
+	for (j = 0; j < *size; j++)
+		data[j] = i + j;
+
+	if (*size < 2)
+		return;
+
+	switch (*opcode) {
+	case BTSNOOP_OPCODE_EVENT_PKT:
+		/* Command Complete, not tied to a connection */
+		data[0] = 0x0e;
+		break;
+	case BTSNOOP_OPCODE_ACL_TX_PKT:
+	case BTSNOOP_OPCODE_ACL_RX_PKT:
+	case BTSNOOP_OPCODE_ISO_TX_PKT:
+	case BTSNOOP_OPCODE_ISO_RX_PKT:
+		data[0] = i % NUM_HANDLES;
+		data[1] = 0x20;
+		break;
+	}
+}
+
+static bool has_handle(unsigned int i, uint16_t handle)
+{
+	uint8_t data[BTSNOOP_MAX_PACKET_SIZE];
+	struct timeval tv;
+	uint16_t index, opcode, size;
+
+	make_record(i, &tv, &index, &opcode, data, &size);
+
+	if (opcode == BTSNOOP_OPCODE_COMMAND_PKT ||
+					opcode == BTSNOOP_OPCODE_EVENT_PKT)
+		return false;
+
+	return size >= 2 && data[0] == handle;
+}
+
+static void write_records(const char *path, size_t max_size,
+					unsigned int max_count, unsigned long flags)
+{
+	uint8_t data[BTSNOOP_MAX_PACKET_SIZE];
+	struct btsnoop *btsnoop;
+	struct timeval tv;
+	uint16_t index, opcode, size;
+	unsigned int i;
+
+	btsnoop = btsnoop_create(path, max_size, max_count,
+					BTSNOOP_FORMAT_MONITOR, flags);
+	g_assert(btsnoop);
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		make_record(i, &tv, &index, &opcode, data, &size);
+		g_assert(btsnoop_write_hci(btsnoop, &tv, index, opcode, 0,
+								data, size));
+	}
+
+	btsnoop_unref(btsnoop);
+}
+
+static void check_record(struct btsnoop *btsnoop, unsigned int i)
+{
+	uint8_t data[BTSNOOP_MAX_PACKET_SIZE];
+	uint8_t expect[BTSNOOP_MAX_PACKET_SIZE];
+	struct timeval tv, expect_tv;
+	uint16_t index, opcode, size;
+	uint16_t expect_index, expect_opcode, expect_size;
+
+	make_record(i, &expect_tv, &expect_index, &expect_opcode, expect,
+								&expect_size);
+
+	g_assert(btsnoop_read_hci(btsnoop, &tv, &index, &opcode, data, &size));
+	g_assert(tv.tv_sec == expect_tv.tv_sec);
+	g_assert(tv.tv_usec == expect_tv.tv_usec);
+	g_assert(index == expect_index);
+	g_assert(opcode == expect_opcode);
+	g_assert(size == expect_size);
+	g_assert(!memcmp(data, expect, size));
+}
+
+static void check_end(struct btsnoop *btsnoop)
+{
+	uint8_t data[BTSNOOP_MAX_PACKET_SIZE];
+	struct timeval tv;
+	uint16_t index, opcode, size;
+
+	g_assert(!btsnoop_read_hci(btsnoop, &tv, &index, &opcode, data,
+								&size));
+}
+
+static void read_records(const char *path, unsigned long flags,
+					unsigned int first, unsigned int last)
+{
+	struct btsnoop *btsnoop;
+	unsigned int i;
+
+	btsnoop = btsnoop_open(path, flags);
+	g_assert(btsnoop);
+	g_assert(btsnoop_get_format(btsnoop) == BTSNOOP_FORMAT_MONITOR);
+
+	for (i = first; i < last; i++)
+		check_record(btsnoop, i);
+
+	check_end(btsnoop);
+
+	btsnoop_unref(btsnoop);
+}
+
+static bool file_equal(const char *path1, const char *path2)
+{
+	char *buf1, *buf2;
+	gsize len1, len2;
+	bool result;
+
+	if (!g_file_get_contents(path1, &buf1, &len1, NULL))
+		return false;
+
+	if (!g_file_get_contents(path2, &buf2, &len2, NULL)) {
+		g_free(buf1);
+		return false;
+	}
+
+	result = len1 == len2 && !memcmp(buf1, buf2, len1);
+
+	g_free(buf1);
+	g_free(buf2);
+
+	return result;
+}
+
+static void test_setup(const void *data)
+{
+	struct test_data *test = tester_get_data();
+
+	snprintf(test->dir, sizeof(test->dir), "/tmp/test-btsnoop.XXXXXX");
+	g_assert(mkdtemp(test->dir));
+
+	tester_setup_complete();
+}
+
+static void test_teardown(const void *data)
+{
+	struct test_data *test = tester_get_data();
+	const char *name;
+	GDir *dir;
+
+	dir = g_dir_open(test->dir, 0, NULL);
+	if (dir) {
+		while ((name = g_dir_read_name(dir))) {
+			char *path = g_build_filename(test->dir, name, NULL);
+
+			unlink(path);
+			g_free(path);
+		}
+
+		g_dir_close(dir);
+	}
+
+	rmdir(test->dir);
+
+	tester_teardown_complete();
+}
+
+static void test_buffered(const void *data)
+{
+	struct test_data *test = tester_get_data();
+	char path1[PATH_MAX], path2[PATH_MAX];
+
+	snprintf(path1, sizeof(path1), "%s/direct", test->dir);
+	snprintf(path2, sizeof(path2), "%s/buffered", test->dir);
+
+	write_records(path1, 0, 0, 0);
+	write_records(path2, 0, 0, BTSNOOP_FLAG_BUFFERED);
+
+	g_assert(file_equal(path1, path2));
+
+	read_records(path1, 0, 0, NUM_RECORDS);
+	read_records(path2, BTSNOOP_FLAG_BUFFERED, 0, NUM_RECORDS);
+
+	tester_test_passed();
+}
+
+/*
+ * Rotated files must contain exactly the same records no matter whether
+ * the buffered writer is used, pending records belong to the file being
+ * rotated out.
+ */
+static void test_rotate(const void *data)
+{
+	struct test_data *test = tester_get_data();
+	char path1[PATH_MAX], path2[PATH_MAX];
+	char file1[PATH_MAX + 16], file2[PATH_MAX + 16];
+	unsigned int i, count = 0;
+	struct stat st;
+
+	snprintf(path1, sizeof(path1), "%s/direct", test->dir);
+	snprintf(path2, sizeof(path2), "%s/buffered", test->dir);
+
+	write_records(path1, MAX_SIZE, MAX_COUNT, 0);
+	write_records(path2, MAX_SIZE, MAX_COUNT, BTSNOOP_FLAG_BUFFERED);
+
+	for (i = 0; ; i++) {
+		snprintf(file1, sizeof(file1), "%s.%u", path1, i);
+		snprintf(file2, sizeof(file2), "%s.%u", path2, i);
+
+		if (stat(file1, &st) < 0) {
+			g_assert(stat(file2, &st) < 0);
+
+			/* Keep going past the files removed by rotation */
+			if (count)
+				break;
+
+			continue;
+		}
+
+		g_assert(st.st_size <= MAX_SIZE);
+		g_assert(file_equal(file1, file2));
+		count++;
+	}
+
+	tester_debug("%u files kept", count);
+
+	g_assert(count == MAX_COUNT);
+
+	tester_test_passed();
+}
+
+static void test_mmap(const void *data)
+{
+	struct test_data *test = tester_get_data();
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/mmap", test->dir);
+
+	write_records(path, 0, 0, BTSNOOP_FLAG_BUFFERED);
+
+	read_records(path, BTSNOOP_FLAG_MMAP, 0, NUM_RECORDS);
+
+	tester_test_passed();
+}
+
+static void test_time_range(const void *data)
+{
+	struct test_data *test = tester_get_data();
+	struct btsnoop *btsnoop;
+	struct timeval first, start, end;
+	char path[PATH_MAX];
+	unsigned int i;
+
+	snprintf(path, sizeof(path), "%s/time-range", test->dir);
+
+	write_records(path, 0, 0, BTSNOOP_FLAG_BUFFERED);
+
+	btsnoop = btsnoop_open(path, BTSNOOP_FLAG_MMAP);
+	g_assert(btsnoop);
+
+	/* Records are 1 ms apart, the range limits are inclusive */
+	g_assert(btsnoop_get_first_time(btsnoop, &first));
+	g_assert(first.tv_sec == 1700000000 && first.tv_usec == 0);
+
+	start.tv_sec = first.tv_sec + 5;
+	start.tv_usec = 0;
+	end.tv_sec = first.tv_sec + 7;
+	end.tv_usec = 500000;
+
+	g_assert(btsnoop_set_time_range(btsnoop, &start, &end));
+
+	for (i = 5000; i <= 7500; i++)
+		check_record(btsnoop, i);
+
+	check_end(btsnoop);
+
+	/* Seeking backwards works as well */
+	g_assert(btsnoop_set_time_range(btsnoop, NULL, &start));
+
+	for (i = 0; i <= 5000; i++)
+		check_record(btsnoop, i);
+
+	check_end(btsnoop);
+
+	g_assert(btsnoop_set_time_range(btsnoop, &end, NULL));
+
+	for (i = 7500; i < NUM_RECORDS; i++)
+		check_record(btsnoop, i);
+
+	check_end(btsnoop);
+
+	btsnoop_unref(btsnoop);
+
+	tester_test_passed();
+}
+
+static void test_handle(const void *data)
+{
+	struct test_data *test = tester_get_data();
+	struct btsnoop *btsnoop;
+	struct timeval start;
+	char path[PATH_MAX];
+	unsigned int i, count = 0;
+
+	snprintf(path, sizeof(path), "%s/handle", test->dir);
+
+	write_records(path, 0, 0, BTSNOOP_FLAG_BUFFERED);
+
+	btsnoop = btsnoop_open(path, BTSNOOP_FLAG_MMAP);
+	g_assert(btsnoop);
+
+	g_assert(btsnoop_set_handle_filter(btsnoop, 2));
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		if (!has_handle(i, 2))
+			continue;
+
+		check_record(btsnoop, i);
+		count++;
+	}
+
+	check_end(btsnoop);
+
+	tester_debug("%u records for handle 2", count);
+	g_assert(count > 0);
+
+	/* Both filters combined */
+	start.tv_sec = 1700000000 + 10;
+	start.tv_usec = 0;
+
+	g_assert(btsnoop_set_time_range(btsnoop, &start, NULL));
+
+	for (i = 10000; i < NUM_RECORDS; i++) {
+		if (has_handle(i, 2))
+			check_record(btsnoop, i);
+	}
+
+	check_end(btsnoop);
+
+	btsnoop_unref(btsnoop);
+
+	tester_test_passed();
+}
+
+struct hci_packet {
+	uint16_t opcode;
+	bool match;
+	uint8_t len;
+	uint8_t data[16];
+};
+
+/* Commands and events referring, or not, to connection handle 0x0042 */
+static const struct hci_packet hci_packets[] = {
+	/* Disconnect */
+	{ BTSNOOP_OPCODE_COMMAND_PKT, true, 6,
+		{ 0x06, 0x04, 0x03, 0x42, 0x00, 0x13 } },
+	{ BTSNOOP_OPCODE_COMMAND_PKT, false, 6,
+		{ 0x06, 0x04, 0x03, 0x43, 0x00, 0x13 } },
+	/* LE Connection Update */
+	{ BTSNOOP_OPCODE_COMMAND_PKT, true, 5,
+		{ 0x13, 0x20, 0x0e, 0x42, 0x00 } },
+	/* Reset */
+	{ BTSNOOP_OPCODE_COMMAND_PKT, false, 3, { 0x03, 0x0c, 0x00 } },
+	/* Encryption Change */
+	{ BTSNOOP_OPCODE_EVENT_PKT, true, 6,
+		{ 0x08, 0x04, 0x00, 0x42, 0x00, 0x01 } },
+	/* Read Remote Supported Features Complete */
+	{ BTSNOOP_OPCODE_EVENT_PKT, true, 5, { 0x0b, 0x0b, 0x00, 0x42, 0x00 } },
+	/* Read Remote Version Information Complete */
+	{ BTSNOOP_OPCODE_EVENT_PKT, true, 5, { 0x0c, 0x08, 0x00, 0x42, 0x00 } },
+	{ BTSNOOP_OPCODE_EVENT_PKT, false, 5, { 0x0c, 0x08, 0x00, 0x01, 0x00 } },
+	/* Number of Completed Packets, single and multiple handles */
+	{ BTSNOOP_OPCODE_EVENT_PKT, true, 7,
+		{ 0x13, 0x05, 0x01, 0x42, 0x00, 0x01, 0x00 } },
+	{ BTSNOOP_OPCODE_EVENT_PKT, true, 11,
+		{ 0x13, 0x09, 0x02, 0x01, 0x00, 0x01, 0x00,
+					0x42, 0x00, 0x02, 0x00 } },
+	{ BTSNOOP_OPCODE_EVENT_PKT, false, 11,
+		{ 0x13, 0x09, 0x02, 0x01, 0x00, 0x01, 0x00,
+					0x02, 0x00, 0x02, 0x00 } },
+	/* Command Complete for Read RSSI */
+	{ BTSNOOP_OPCODE_EVENT_PKT, true, 9,
+		{ 0x0e, 0x07, 0x01, 0x05, 0x14, 0x00, 0x42, 0x00, 0xc4 } },
+	/* Command Complete for Reset */
+	{ BTSNOOP_OPCODE_EVENT_PKT, false, 6,
+		{ 0x0e, 0x04, 0x01, 0x03, 0x0c, 0x00 } },
+	/* LE CIS Established */
+	{ BTSNOOP_OPCODE_EVENT_PKT, true, 6,
+		{ 0x3e, 0x1d, 0x19, 0x00, 0x42, 0x00 } },
+	/* LE CIS Request, on the ACL and for the CIS handle */
+	{ BTSNOOP_OPCODE_EVENT_PKT, true, 9,
+		{ 0x3e, 0x07, 0x1a, 0x42, 0x00, 0x60, 0x00, 0x00, 0x00 } },
+	{ BTSNOOP_OPCODE_EVENT_PKT, true, 9,
+		{ 0x3e, 0x07, 0x1a, 0x01, 0x00, 0x42, 0x00, 0x00, 0x00 } },
+	/* LE Enhanced Connection Complete v2 */
+	{ BTSNOOP_OPCODE_EVENT_PKT, true, 6,
+		{ 0x3e, 0x22, 0x29, 0x00, 0x42, 0x00 } },
+	/* LE Advertising Report */
+	{ BTSNOOP_OPCODE_EVENT_PKT, false, 6,
+		{ 0x3e, 0x0c, 0x02, 0x01, 0x42, 0x00 } },
+	{ BTSNOOP_OPCODE_ACL_RX_PKT, true, 4, { 0x42, 0x20, 0x00, 0x00 } },
+	{ BTSNOOP_OPCODE_ACL_RX_PKT, false, 4, { 0x43, 0x20, 0x00, 0x00 } },
+};
+
+static void test_handle_hci(const void *data)
+{
+	struct test_data *test = tester_get_data();
+	uint8_t buf[BTSNOOP_MAX_PACKET_SIZE];
+	struct btsnoop *btsnoop;
+	struct timeval tv;
+	uint16_t index, opcode, size;
+	char path[PATH_MAX];
+	unsigned int i;
+
+	snprintf(path, sizeof(path), "%s/handle_hci", test->dir);
+
+	btsnoop = btsnoop_create(path, 0, 0, BTSNOOP_FORMAT_MONITOR, 0);
+	g_assert(btsnoop);
+
+	for (i = 0; i < G_N_ELEMENTS(hci_packets); i++) {
+		const struct hci_packet *pkt = &hci_packets[i];
+
+		tv.tv_sec = 1700000000;
+		tv.tv_usec = i;
+		g_assert(btsnoop_write_hci(btsnoop, &tv, 0, pkt->opcode, 0,
+							pkt->data, pkt->len));
+	}
+
+	btsnoop_unref(btsnoop);
+
+	btsnoop = btsnoop_open(path, BTSNOOP_FLAG_MMAP);
+	g_assert(btsnoop);
+
+	g_assert(btsnoop_set_handle_filter(btsnoop, 0x0042));
+
+	for (i = 0; i < G_N_ELEMENTS(hci_packets); i++) {
+		const struct hci_packet *pkt = &hci_packets[i];
+
+		if (!pkt->match)
+			continue;
+
+		g_assert(btsnoop_read_hci(btsnoop, &tv, &index, &opcode, buf,
+								&size));
+		g_assert(tv.tv_usec == (long) i);
+		g_assert(opcode == pkt->opcode);
+		g_assert(size == pkt->len);
+		g_assert(!memcmp(buf, pkt->data, size));
+	}
+
+	check_end(btsnoop);
+
+	btsnoop_unref(btsnoop);
+
+	tester_test_passed();
+}
+
+static void test_simulator(const void *data)
+{
+	struct test_data *test = tester_get_data();
+	static const uint8_t frame[] = { 0xd6, 0xbe, 0x89, 0x8e, 0x00 };
+	struct btsnoop *btsnoop;
+	struct timeval tv;
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/simulator", test->dir);
+
+	btsnoop = btsnoop_create(path, 0, 0, BTSNOOP_FORMAT_SIMULATOR, 0);
+	g_assert(btsnoop);
+
+	gettimeofday(&tv, NULL);
+	g_assert(btsnoop_write_phy(btsnoop, &tv, 2402, frame, sizeof(frame)));
+
+	btsnoop_unref(btsnoop);
+
+	btsnoop = btsnoop_open(path, BTSNOOP_FLAG_MMAP);
+	g_assert(btsnoop);
+
+	/* PHY frames are not indexed, filtering them is refused */
+	g_assert(!btsnoop_set_handle_filter(btsnoop, 0x0042));
+	g_assert(!btsnoop_set_time_range(btsnoop, &tv, NULL));
+
+	btsnoop_unref(btsnoop);
+
+	tester_test_passed();
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) +
+			(now.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static void bench(const char *path, unsigned long flags)
+{
+	struct timespec start;
+	double write_secs, read_secs;
+	struct btsnoop *btsnoop;
+	uint8_t data[BTSNOOP_MAX_PACKET_SIZE];
+	struct timeval tv;
+	uint16_t index, opcode, size;
+	unsigned int count = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	write_records(path, 0, 0, flags);
+	write_secs = elapsed(&start);
+
+	btsnoop = btsnoop_open(path, flags);
+	g_assert(btsnoop);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (btsnoop_read_hci(btsnoop, &tv, &index, &opcode, data, &size))
+		count++;
+	read_secs = elapsed(&start);
+
+	btsnoop_unref(btsnoop);
+
+	g_assert(count == NUM_RECORDS);
+
+	tester_print("%s: write %.0f records/sec, read %.0f records/sec",
+			flags & BTSNOOP_FLAG_BUFFERED ? "buffered" : "direct",
+			NUM_RECORDS / (write_secs > 0 ? write_secs : 1),
+			NUM_RECORDS / (read_secs > 0 ? read_secs : 1));
+}
+
+static void test_bench(const void *data)
+{
+	struct test_data *test = tester_get_data();
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/bench", test->dir);
+
+	bench(path, 0);
+	bench(path, BTSNOOP_FLAG_BUFFERED);
+
+	tester_test_passed();
+}
+
+#define test_btsnoop(name, func) \
+	do { \
+		struct test_data *test = g_new0(struct test_data, 1); \
+		tester_add_full(name, test, NULL, test_setup, func, \
+					test_teardown, NULL, 2, test, g_free); \
+	} while (0)
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	test_btsnoop("/btsnoop/buffered", test_buffered);
+	test_btsnoop("/btsnoop/rotate", test_rotate);
+	test_btsnoop("/btsnoop/mmap", test_mmap);
+	test_btsnoop("/btsnoop/time_range", test_time_range);
+	test_btsnoop("/btsnoop/handle", test_handle);
+	test_btsnoop("/btsnoop/handle_hci", test_handle_hci);
+	test_btsnoop("/btsnoop/simulator", test_simulator);
+	test_btsnoop("/btsnoop/bench", test_bench);
+
+	return tester_run();
+}
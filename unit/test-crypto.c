@@ -16,9 +16,13 @@
 #include "src/shared/util.h"
 #include "src/shared/tester.h"
 
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <glib.h>
 
+#define BENCH_ROUNDS	20000
+
 static struct bt_crypto *crypto;
 
 static void print_debug(const char *str, void *user_data)
@@ -383,34 +387,262 @@ static void test_sih(const void *data)
 	tester_test_passed();
 }
 
+static const enum bt_crypto_backend backends[] = {
+	BT_CRYPTO_BACKEND_KERNEL,
+	BT_CRYPTO_BACKEND_SOFT,
+	BT_CRYPTO_BACKEND_AESNI,
+	BT_CRYPTO_BACKEND_FAST,
+};
+
+static const char *backend_str(enum bt_crypto_backend backend)
+{
+	switch (backend) {
+	case BT_CRYPTO_BACKEND_KERNEL:
+		return "kernel";
+	case BT_CRYPTO_BACKEND_SOFT:
+		return "soft";
+	case BT_CRYPTO_BACKEND_AESNI:
+		return "aesni";
+	case BT_CRYPTO_BACKEND_FAST:
+		return "fast";
+	case BT_CRYPTO_BACKEND_AUTO:
+		break;
+	}
+
+	return "auto";
+}
+
+static void fill(uint8_t *buf, size_t len, unsigned int seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (seed * 131 + i * 29 + (i >> 3)) & 0xff;
+}
+
+/* All backends must agree with the portable in-process engine */
+static void test_backends(const void *data)
+{
+	const uint8_t zero[16] = {};
+	struct bt_crypto *ref;
+	unsigned int i, j;
+
+	ref = bt_crypto_new_backend(BT_CRYPTO_BACKEND_SOFT);
+	g_assert(ref);
+
+	for (i = 0; i < G_N_ELEMENTS(backends); i++) {
+		struct bt_crypto *c;
+
+		c = bt_crypto_new_backend(backends[i]);
+		if (!c) {
+			tester_debug("%s: not available",
+						backend_str(backends[i]));
+			continue;
+		}
+
+		for (j = 0; j < 64; j++) {
+			uint8_t k[16], r[16], u[32], v[32], m[80];
+			uint8_t exp[16], res[16], ltk[16], ltk_exp[16];
+			struct bt_crypto_cmac *cmac;
+			struct iovec iov;
+			size_t off;
+
+			fill(k, sizeof(k), j);
+			fill(r, sizeof(r), j + 1);
+			fill(u, sizeof(u), j + 2);
+			fill(v, sizeof(v), j + 3);
+			fill(m, sizeof(m), j + 4);
+
+			g_assert(bt_crypto_e(ref, k, r, exp));
+			g_assert(bt_crypto_e(c, k, r, res));
+			g_assert(!memcmp(exp, res, 16));
+
+			g_assert(bt_crypto_ah(ref, k, r, exp));
+			g_assert(bt_crypto_ah(c, k, r, res));
+			g_assert(!memcmp(exp, res, 3));
+
+			g_assert(bt_crypto_f4(ref, u, v, k, j, exp));
+			g_assert(bt_crypto_f4(c, u, v, k, j, res));
+			g_assert(!memcmp(exp, res, 16));
+
+			g_assert(bt_crypto_f5(ref, u, k, r, m, m + 7, exp,
+								ltk_exp));
+			g_assert(bt_crypto_f5(c, u, k, r, m, m + 7, res, ltk));
+			g_assert(!memcmp(exp, res, 16));
+			g_assert(!memcmp(ltk_exp, ltk, 16));
+
+			g_assert(bt_crypto_sign_att(ref, k, m, j, j, exp));
+			g_assert(bt_crypto_sign_att(c, k, m, j, j, res));
+			g_assert(!memcmp(exp, res, 12));
+
+			/* Streamed CMAC fed in uneven chunks */
+			iov.iov_base = m;
+			iov.iov_len = j;
+			g_assert(bt_crypto_gatt_hash(ref, &iov, 1, exp));
+
+			cmac = bt_crypto_cmac_new(c, zero);
+			g_assert(cmac);
+
+			for (off = 0; off < j; off += 7)
+				g_assert(bt_crypto_cmac_update(cmac, m + off,
+						j - off < 7 ? j - off : 7));
+
+			g_assert(bt_crypto_cmac_final(cmac, res));
+			g_assert(!memcmp(exp, res, 16));
+			bt_crypto_cmac_free(cmac);
+		}
+
+		bt_crypto_unref(c);
+	}
+
+	bt_crypto_unref(ref);
+	tester_test_passed();
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) +
+			(now.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static void test_bench(const void *data)
+{
+	const uint8_t r[3] = { 0x63, 0xf5, 0x69 };
+	unsigned int i, j;
+
+	for (i = 0; i < G_N_ELEMENTS(backends); i++) {
+		struct timespec start;
+		struct bt_crypto *c;
+		uint8_t irk[16], hash[3];
+		double ah, sign;
+
+		c = bt_crypto_new_backend(backends[i]);
+		if (!c)
+			continue;
+
+		/* Resolving against a list of IRKs, one key per call */
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		for (j = 0; j < BENCH_ROUNDS; j++) {
+			fill(irk, sizeof(irk), j);
+			g_assert(bt_crypto_ah(c, irk, r, hash));
+		}
+
+		ah = BENCH_ROUNDS / elapsed(&start);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		for (j = 0; j < BENCH_ROUNDS; j++)
+			g_assert(bt_crypto_verify_att_sign(c, key_5,
+						msg_to_verify_pass,
+						sizeof(msg_to_verify_pass)));
+
+		sign = BENCH_ROUNDS / elapsed(&start);
+
+		tester_print("%s: %.0f ah/sec, %.0f signature checks/sec",
+					backend_str(backends[i]), ah, sign);
+
+		bt_crypto_unref(c);
+	}
+
+	tester_test_passed();
+}
+
+static const struct {
+	const char *name;
+	const void *data;
+	tester_data_func_t func;
+} kat_tests[] = {
+	{ "h6", NULL, test_h6 },
+	{ "sign_att_1", &test_data_1, test_sign },
+	{ "sign_att_2", &test_data_2, test_sign },
+	{ "sign_att_3", &test_data_3, test_sign },
+	{ "sign_att_4", &test_data_4, test_sign },
+	{ "sign_att_5", &test_data_5, test_sign },
+	{ "gatt_hash", NULL, test_gatt_hash },
+	{ "verify_sign_pass", &verify_sign_pass_data, test_verify_sign },
+	{ "verify_sign_bad_sign", &verify_sign_bad_sign_data,
+							test_verify_sign },
+	{ "verify_sign_too_short", &verify_sign_too_short_data,
+							test_verify_sign },
+	{ "sef", NULL, test_sef },
+	{ "sih", NULL, test_sih },
+};
+
+static struct bt_crypto *default_crypto;
+
+/* Known answer tests run against each backend through the global */
+static void setup_backend(const void *data)
+{
+	crypto = tester_get_data();
+
+	tester_setup_complete();
+}
+
+static void teardown_backend(const void *data)
+{
+	crypto = default_crypto;
+
+	tester_teardown_complete();
+}
+
+static void backend_unref(void *user_data)
+{
+	bt_crypto_unref(user_data);
+}
+
+static void add_backend_tests(enum bt_crypto_backend backend)
+{
+	struct bt_crypto *c;
+	char name[64];
+	unsigned int i;
+
+	c = bt_crypto_new_backend(backend);
+	if (!c)
+		return;
+
+	for (i = 0; i < G_N_ELEMENTS(kat_tests); i++) {
+		snprintf(name, sizeof(name), "/crypto/%s/%s",
+				backend_str(backend), kat_tests[i].name);
+
+		tester_add_full(name, kat_tests[i].data, NULL, setup_backend,
+					kat_tests[i].func, teardown_backend,
+					NULL, 0, bt_crypto_ref(c),
+					backend_unref);
+	}
+
+	bt_crypto_unref(c);
+}
+
 int main(int argc, char *argv[])
 {
+	char name[64];
 	int exit_status;
+	unsigned int i;
 
 	crypto = bt_crypto_new();
 	if (!crypto)
 		return 0;
 
-	tester_init(&argc, &argv);
+	default_crypto = crypto;
 
-	tester_add("/crypto/h6", NULL, NULL, test_h6, NULL);
+	tester_init(&argc, &argv);
 
-	tester_add("/crypto/sign_att_1", &test_data_1, NULL, test_sign, NULL);
-	tester_add("/crypto/sign_att_2", &test_data_2, NULL, test_sign, NULL);
-	tester_add("/crypto/sign_att_3", &test_data_3, NULL, test_sign, NULL);
-	tester_add("/crypto/sign_att_4", &test_data_4, NULL, test_sign, NULL);
-	tester_add("/crypto/sign_att_5", &test_data_5, NULL, test_sign, NULL);
+	for (i = 0; i < G_N_ELEMENTS(kat_tests); i++) {
+		snprintf(name, sizeof(name), "/crypto/%s", kat_tests[i].name);
+		tester_add(name, kat_tests[i].data, NULL, kat_tests[i].func,
+									NULL);
+	}
 
-	tester_add("/crypto/gatt_hash", NULL, NULL, test_gatt_hash, NULL);
+	for (i = 0; i < G_N_ELEMENTS(backends); i++)
+		add_backend_tests(backends[i]);
 
-	tester_add("/crypto/verify_sign_pass", &verify_sign_pass_data,
-						NULL, test_verify_sign, NULL);
-	tester_add("/crypto/verify_sign_bad_sign", &verify_sign_bad_sign_data,
-						NULL, test_verify_sign, NULL);
-	tester_add("/crypto/verify_sign_too_short", &verify_sign_too_short_data,
-						NULL, test_verify_sign, NULL);
-	tester_add("/crypto/sef", NULL, NULL, test_sef, NULL);
-	tester_add("/crypto/sih", NULL, NULL, test_sih, NULL);
+	tester_add("/crypto/backends", NULL, NULL, test_backends, NULL);
+	tester_add("/crypto/bench", NULL, NULL, test_bench, NULL);
 
 	exit_status = tester_run();
 
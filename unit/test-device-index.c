@@ -0,0 +1,310 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "lib/bluetooth.h"
+#include "src/shared/tester.h"
+#include "src/device-index.h"
+
+#define NUM_TAGS	10000
+#define NUM_EVENTS	100000
+
+struct test_device {
+	bdaddr_t bdaddr;
+	uint8_t bdaddr_type;
+	bdaddr_t conn_bdaddr;
+	uint8_t conn_bdaddr_type;
+	char path[64];
+};
+
+struct test_addr {
+	bdaddr_t bdaddr;
+	uint8_t bdaddr_type;
+};
+
+/* Same matching rules as device_addr_type_cmp() for LE devices */
+static int test_addr_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct test_device *dev = a;
+	const struct test_addr *addr = b;
+
+	if (addr->bdaddr_type != dev->bdaddr_type) {
+		if (addr->bdaddr_type == dev->conn_bdaddr_type)
+			return bacmp(&dev->conn_bdaddr, &addr->bdaddr);
+		return -1;
+	}
+
+	return bacmp(&dev->bdaddr, &addr->bdaddr);
+}
+
+static void make_addr(bdaddr_t *bdaddr, unsigned int id)
+{
+	bdaddr->b[0] = id & 0xff;
+	bdaddr->b[1] = (id >> 8) & 0xff;
+	bdaddr->b[2] = (id >> 16) & 0xff;
+	bdaddr->b[3] = 0x5a;
+	bdaddr->b[4] = 0x1e;
+	bdaddr->b[5] = 0xc0;
+}
+
+static struct test_device *new_device(unsigned int id, uint8_t type)
+{
+	struct test_device *dev;
+	char str[18];
+
+	dev = g_new0(struct test_device, 1);
+	make_addr(&dev->bdaddr, id);
+	dev->bdaddr_type = type;
+
+	ba2str(&dev->bdaddr, str);
+	snprintf(dev->path, sizeof(dev->path), "/org/bluez/hci0/dev_%s", str);
+	g_strdelimit(dev->path, ":", '_');
+
+	return dev;
+}
+
+static void add_device(struct device_index *index, struct test_device *dev)
+{
+	g_assert(device_index_add(index, dev, dev->path, &dev->bdaddr));
+}
+
+static struct test_device *find(struct device_index *index, unsigned int id,
+								uint8_t type)
+{
+	struct test_addr addr;
+
+	make_addr(&addr.bdaddr, id);
+	addr.bdaddr_type = type;
+
+	return device_index_find(index, &addr.bdaddr, test_addr_cmp, &addr);
+}
+
+static void test_order(const void *data)
+{
+	struct device_index *index;
+	struct test_device *devs[16];
+	unsigned int i;
+	GList *l;
+
+	index = device_index_new();
+
+	for (i = 0; i < G_N_ELEMENTS(devs); i++) {
+		devs[i] = new_device(i, BDADDR_LE_PUBLIC);
+		add_device(index, devs[i]);
+	}
+
+	g_assert(!device_index_add(index, devs[0], devs[0]->path,
+							&devs[0]->bdaddr));
+
+	/* Removal must not change the order of the remaining devices */
+	for (i = 0; i < G_N_ELEMENTS(devs); i += 3)
+		g_assert(device_index_remove(index, devs[i]));
+
+	g_assert(!device_index_remove(index, devs[0]));
+
+	l = device_index_get_list(index);
+
+	for (i = 0; i < G_N_ELEMENTS(devs); i++) {
+		if (i % 3 == 0)
+			continue;
+
+		g_assert(l && l->data == devs[i]);
+		l = l->next;
+	}
+
+	g_assert(!l);
+	g_assert(device_index_size(index) == G_N_ELEMENTS(devs) - 6);
+
+	device_index_free(index);
+
+	for (i = 0; i < G_N_ELEMENTS(devs); i++)
+		g_free(devs[i]);
+
+	tester_test_passed();
+}
+
+static void test_path(const void *data)
+{
+	struct device_index *index;
+	struct test_device *dev;
+	char *path;
+
+	index = device_index_new();
+	dev = new_device(0x1234, BDADDR_LE_RANDOM);
+	add_device(index, dev);
+
+	g_assert(device_index_find_path(index, dev->path) == dev);
+
+	/* Object paths have always been compared case-insensitively */
+	path = g_ascii_strdown(dev->path, -1);
+	g_assert(device_index_find_path(index, path) == dev);
+	g_free(path);
+
+	g_assert(!device_index_find_path(index, "/org/bluez/hci0/dev_x"));
+
+	g_assert(device_index_remove(index, dev));
+	g_assert(!device_index_find_path(index, dev->path));
+
+	device_index_free(index);
+	g_free(dev);
+
+	tester_test_passed();
+}
+
+static void test_conn_address(const void *data)
+{
+	struct device_index *index;
+	struct test_device *dev;
+
+	index = device_index_new();
+
+	/* Connected over an RPA which later resolves to an identity */
+	dev = new_device(1, BDADDR_LE_RANDOM);
+	add_device(index, dev);
+
+	bacpy(&dev->conn_bdaddr, &dev->bdaddr);
+	dev->conn_bdaddr_type = dev->bdaddr_type;
+	make_addr(&dev->bdaddr, 2);
+	dev->bdaddr_type = BDADDR_LE_PUBLIC;
+
+	device_index_set_address(index, dev, &dev->bdaddr, &dev->conn_bdaddr);
+
+	g_assert(find(index, 2, BDADDR_LE_PUBLIC) == dev);
+	g_assert(find(index, 1, BDADDR_LE_RANDOM) == dev);
+	g_assert(!find(index, 1, BDADDR_LE_PUBLIC));
+
+	/* Reconnecting with the identity drops the old address */
+	bacpy(&dev->conn_bdaddr, &dev->bdaddr);
+	dev->conn_bdaddr_type = dev->bdaddr_type;
+
+	device_index_set_address(index, dev, &dev->bdaddr, &dev->conn_bdaddr);
+
+	g_assert(find(index, 2, BDADDR_LE_PUBLIC) == dev);
+	g_assert(!find(index, 1, BDADDR_LE_RANDOM));
+
+	device_index_free(index);
+	g_free(dev);
+
+	tester_test_passed();
+}
+
+static void test_duplicate(const void *data)
+{
+	struct device_index *index;
+	struct test_device *a, *b, *c;
+
+	index = device_index_new();
+
+	a = new_device(7, BDADDR_LE_RANDOM);
+	b = new_device(7, BDADDR_LE_RANDOM);
+	c = new_device(7, BDADDR_LE_RANDOM);
+	add_device(index, a);
+	add_device(index, b);
+	add_device(index, c);
+
+	/* The first device in list order wins, as with a list search */
+	g_assert(find(index, 7, BDADDR_LE_RANDOM) == a);
+
+	g_assert(device_index_remove(index, a));
+	g_assert(find(index, 7, BDADDR_LE_RANDOM) == b);
+
+	add_device(index, a);
+	g_assert(find(index, 7, BDADDR_LE_RANDOM) == b);
+
+	device_index_free(index);
+	g_free(a);
+	g_free(b);
+	g_free(c);
+
+	tester_test_passed();
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) +
+			(now.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+/*
+ * Replay a stream of advertising reports from a large population of tags
+ * the way btd_adapter_device_found() handles them: look the device up by
+ * address and type and create it when it is not known yet.
+ */
+static void test_device_found(const void *data)
+{
+	struct device_index *index;
+	struct timespec start;
+	unsigned int i, created = 0;
+	double secs;
+	GList *l;
+
+	index = device_index_new();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < NUM_EVENTS; i++) {
+		unsigned int id = (i * 7919) % NUM_TAGS;
+		struct test_device *dev;
+		bdaddr_t bdaddr;
+
+		dev = find(index, id, BDADDR_LE_RANDOM);
+		if (!dev) {
+			dev = new_device(id, BDADDR_LE_RANDOM);
+			add_device(index, dev);
+			created++;
+		}
+
+		make_addr(&bdaddr, id);
+		g_assert(!bacmp(&dev->bdaddr, &bdaddr));
+	}
+
+	secs = elapsed(&start);
+
+	tester_print("%u devices: %.0f events/sec", NUM_TAGS,
+					NUM_EVENTS / (secs > 0 ? secs : 1));
+
+	g_assert(created == NUM_TAGS);
+	g_assert(device_index_size(index) == NUM_TAGS);
+
+	for (l = device_index_get_list(index); l; l = l->next)
+		g_free(l->data);
+
+	device_index_free(index);
+
+	tester_test_passed();
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/device-index/order", NULL, NULL, test_order, NULL);
+	tester_add("/device-index/path", NULL, NULL, test_path, NULL);
+	tester_add("/device-index/conn_address", NULL, NULL,
+						test_conn_address, NULL);
+	tester_add("/device-index/duplicate", NULL, NULL, test_duplicate,
+									NULL);
+	tester_add("/device-index/device_found", NULL, NULL,
+						test_device_found, NULL);
+
+	return tester_run();
+}
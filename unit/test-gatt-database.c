@@ -0,0 +1,553 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "src/gatt-database.c"
+
+#include "src/shared/tester.h"
+
+#define UUID_TEST		0xfff0
+#define UUID_TEST_VALUE		0xfff1
+
+#define NUM_PEERS		8
+
+struct context;
+
+struct peer {
+	struct context *context;
+	bdaddr_t addr;
+	struct bt_att *att;
+	struct bt_gatt_server *server;
+	struct io *io;
+	unsigned int received;
+};
+
+struct context {
+	struct btd_gatt_database *database;
+	struct gatt_db_attribute *value;
+	struct gatt_db_attribute *ccc;
+	struct peer peers[NUM_PEERS];
+	unsigned int disconnected;
+};
+
+/* The peers stand in for the bonded devices of the adapter */
+static struct context *test_context;
+static unsigned int find_device_calls;
+
+static struct peer *find_peer_by_fd(int fd)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_PEERS; i++) {
+		struct peer *peer = &test_context->peers[i];
+
+		if (peer->att && bt_att_get_fd(peer->att) == fd)
+			return peer;
+	}
+
+	return NULL;
+}
+
+struct btd_opts btd_opts;
+
+gboolean bt_io_get(GIOChannel *io, GError **err, BtIOOption opt1, ...)
+{
+	struct peer *peer = find_peer_by_fd(g_io_channel_unix_get_fd(io));
+	BtIOOption opt = opt1;
+	va_list args;
+
+	if (!peer)
+		return FALSE;
+
+	va_start(args, opt1);
+
+	while (opt != BT_IO_OPT_INVALID) {
+		switch (opt) {
+		case BT_IO_OPT_DEST_BDADDR:
+			bacpy(va_arg(args, bdaddr_t *), &peer->addr);
+			break;
+		case BT_IO_OPT_DEST_TYPE:
+			*va_arg(args, uint8_t *) = BDADDR_LE_PUBLIC;
+			break;
+		default:
+			va_end(args);
+			return FALSE;
+		}
+
+		opt = va_arg(args, int);
+	}
+
+	va_end(args);
+
+	return TRUE;
+}
+
+GIOChannel *bt_io_listen(BtIOConnect connect, BtIOConfirm confirm,
+				gpointer user_data, GDestroyNotify destroy,
+				GError **err, BtIOOption opt1, ...)
+{
+	return NULL;
+}
+
+gboolean bt_io_accept(GIOChannel *io, BtIOConnect connect, gpointer user_data,
+					GDestroyNotify destroy, GError **err)
+{
+	return FALSE;
+}
+
+struct btd_device *btd_adapter_find_device(struct btd_adapter *adapter,
+							const bdaddr_t *dst,
+							uint8_t dst_type)
+{
+	unsigned int i;
+
+	find_device_calls++;
+
+	if (dst_type != BDADDR_LE_PUBLIC)
+		return NULL;
+
+	for (i = 0; i < NUM_PEERS; i++) {
+		struct peer *peer = &test_context->peers[i];
+
+		if (!bacmp(dst, &peer->addr))
+			return (struct btd_device *) peer;
+	}
+
+	return NULL;
+}
+
+struct btd_device *btd_adapter_get_device(struct btd_adapter *adapter,
+					const bdaddr_t *addr,
+					uint8_t addr_type)
+{
+	return btd_adapter_find_device(adapter, addr, addr_type);
+}
+
+bool device_is_bonded(struct btd_device *device, uint8_t bdaddr_type)
+{
+	return true;
+}
+
+struct bt_gatt_server *btd_device_get_gatt_server(struct btd_device *device)
+{
+	struct peer *peer = (struct peer *) device;
+
+	return peer->server;
+}
+
+const bdaddr_t *device_get_address(struct btd_device *device)
+{
+	struct peer *peer = (struct peer *) device;
+
+	return &peer->addr;
+}
+
+uint8_t btd_device_get_bdaddr_type(struct btd_device *dev)
+{
+	return BDADDR_LE_PUBLIC;
+}
+
+uint8_t device_get_le_address_type(struct btd_device *device)
+{
+	return BDADDR_LE_PUBLIC;
+}
+
+const char *device_get_path(const struct btd_device *device)
+{
+	return "/org/bluez/hci0/dev_06_05_04_03_02_01";
+}
+
+bool device_attach_att(struct btd_device *dev, GIOChannel *io)
+{
+	return false;
+}
+
+bool btd_device_is_initiator(struct btd_device *device)
+{
+	return false;
+}
+
+bool btd_device_is_trusted(struct btd_device *device)
+{
+	return true;
+}
+
+void device_store_svc_chng_ccc(struct btd_device *device, uint8_t bdaddr_type,
+								uint16_t value)
+{
+}
+
+void device_load_svc_chng_ccc(struct btd_device *device, uint16_t *ccc_le,
+							uint16_t *ccc_bredr)
+{
+}
+
+struct btd_adapter *btd_adapter_ref(struct btd_adapter *adapter)
+{
+	return adapter;
+}
+
+void btd_adapter_unref(struct btd_adapter *adapter)
+{
+}
+
+struct btd_adapter *adapter_find(const bdaddr_t *sba)
+{
+	return NULL;
+}
+
+void adapter_foreach(adapter_cb func, gpointer user_data)
+{
+}
+
+void btd_adapter_for_each_device(struct btd_adapter *adapter,
+			void (*cb)(struct btd_device *device, void *data),
+			void *data)
+{
+}
+
+const char *adapter_get_path(struct btd_adapter *adapter)
+{
+	return "/org/bluez/hci0";
+}
+
+const bdaddr_t *btd_adapter_get_address(struct btd_adapter *adapter)
+{
+	return BDADDR_ANY;
+}
+
+uint8_t btd_adapter_get_address_type(struct btd_adapter *adapter)
+{
+	return BDADDR_LE_PUBLIC;
+}
+
+uint32_t btd_adapter_get_class(struct btd_adapter *adapter)
+{
+	return 0;
+}
+
+const char *btd_adapter_get_name(struct btd_adapter *adapter)
+{
+	return "test";
+}
+
+const char *btd_adapter_get_storage_dir(struct btd_adapter *adapter)
+{
+	return "00:00:00:00:00:00";
+}
+
+void adapter_add_profile(struct btd_adapter *adapter, gpointer p)
+{
+}
+
+void adapter_remove_profile(struct btd_adapter *adapter, gpointer p)
+{
+}
+
+int adapter_service_add(struct btd_adapter *adapter, sdp_record_t *rec)
+{
+	return -ENOTSUP;
+}
+
+void adapter_service_remove(struct btd_adapter *adapter, uint32_t handle)
+{
+}
+
+int btd_profile_register(struct btd_profile *profile)
+{
+	return 0;
+}
+
+void btd_profile_unregister(struct btd_profile *profile)
+{
+}
+
+struct btd_profile *btd_service_get_profile(const struct btd_service *service)
+{
+	return NULL;
+}
+
+void btd_settings_gatt_db_store(struct gatt_db *db, const char *filename)
+{
+}
+
+/*
+ * A database with a single characteristic to notify, without the core
+ * services nor the D-Bus and socket setup of btd_gatt_database_new().
+ */
+static struct btd_gatt_database *create_database(struct context *context)
+{
+	struct btd_gatt_database *database;
+	struct gatt_db_attribute *service;
+	bt_uuid_t uuid;
+
+	database = new0(struct btd_gatt_database, 1);
+	database->db = gatt_db_new();
+	database->records = queue_new();
+	database->device_states = queue_new();
+	database->ccc_subscribers = queue_new();
+	database->apps = queue_new();
+	database->profiles = queue_new();
+	database->ccc_callbacks = queue_new();
+
+	gatt_db_ccc_register(database->db, gatt_ccc_read_cb, gatt_ccc_write_cb,
+						gatt_notify_cb, database);
+
+	bt_uuid16_create(&uuid, UUID_TEST);
+	service = gatt_db_add_service(database->db, &uuid, true, 4);
+	g_assert(service);
+
+	bt_uuid16_create(&uuid, UUID_TEST_VALUE);
+	context->value = gatt_db_service_add_characteristic(service, &uuid,
+						BT_ATT_PERM_READ,
+						BT_GATT_CHRC_PROP_NOTIFY,
+						NULL, NULL, NULL);
+	g_assert(context->value);
+
+	context->ccc = service_add_ccc(service, database, NULL, NULL,
+				BT_ATT_PERM_READ | BT_ATT_PERM_WRITE, NULL);
+	g_assert(context->ccc);
+
+	gatt_db_service_set_active(service, true);
+
+	return database;
+}
+
+static bool can_read_data(struct io *io, void *user_data);
+static void peer_disconnect_cb(int err, void *user_data);
+
+static void connect_peer(struct peer *peer)
+{
+	struct context *context = peer->context;
+	int sv[2];
+
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv));
+
+	peer->att = bt_att_new(sv[0], false);
+	g_assert(peer->att);
+	bt_att_set_close_on_unref(peer->att, true);
+
+	peer->server = bt_gatt_server_new(context->database->db, peer->att,
+									0, 0);
+	g_assert(peer->server);
+
+	peer->io = io_new(sv[1]);
+	g_assert(peer->io);
+	io_set_close_on_destroy(peer->io, true);
+	io_set_read_handler(peer->io, can_read_data, peer, NULL);
+
+	btd_gatt_database_server_connected(context->database, peer->server);
+
+	bt_att_register_disconnect(peer->att, peer_disconnect_cb, peer, NULL);
+}
+
+static void release_peer(struct peer *peer)
+{
+	io_destroy(peer->io);
+	peer->io = NULL;
+	bt_gatt_server_unref(peer->server);
+	peer->server = NULL;
+	bt_att_unref(peer->att);
+	peer->att = NULL;
+}
+
+static void write_ccc_cb(struct gatt_db_attribute *attrib, int err,
+								void *user_data)
+{
+	g_assert(!err);
+}
+
+static void subscribe(struct peer *peer)
+{
+	struct context *context = peer->context;
+	uint8_t value[2];
+
+	put_le16(0x0001, value);
+
+	g_assert(gatt_db_attribute_write(context->ccc, 0, value, sizeof(value),
+						BT_ATT_OP_WRITE_REQ, peer->att,
+						write_ccc_cb, NULL));
+}
+
+static struct ccc_state *peer_ccc(struct peer *peer)
+{
+	struct context *context = peer->context;
+	struct device_state *state;
+
+	state = find_device_state(context->database, &peer->addr,
+							BDADDR_LE_PUBLIC);
+	g_assert(state);
+
+	return find_ccc_state(state,
+			gatt_db_attribute_get_handle(context->ccc));
+}
+
+static unsigned int num_subscribers(struct context *context)
+{
+	struct ccc_subscribers *subs;
+
+	subs = find_subscribers(context->database,
+				gatt_db_attribute_get_handle(context->ccc));
+	if (!subs)
+		return 0;
+
+	return queue_length(subs->ccc_states);
+}
+
+static void destroy_context(struct context *context)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_PEERS; i++)
+		release_peer(&context->peers[i]);
+
+	gatt_database_free(context->database);
+	g_free(context);
+	test_context = NULL;
+}
+
+static void notify(struct context *context, uint8_t value)
+{
+	g_assert(gatt_db_attribute_notify(context->value, &value,
+							sizeof(value), NULL));
+}
+
+static gboolean notify_offline(gpointer user_data)
+{
+	struct context *context = user_data;
+	struct peer *peer;
+	unsigned int i;
+
+	/* Only the first peer is still connected */
+	for (i = 1; i < NUM_PEERS; i++) {
+		peer = &context->peers[i];
+
+		release_peer(peer);
+
+		/* The bonded devices keep their CCC values stored */
+		g_assert(peer_ccc(peer)->value == 0x0001);
+	}
+
+	g_assert(num_subscribers(context) == 1);
+
+	/* The bonded devices that are away are not visited */
+	find_device_calls = 0;
+	notify(context, 0x01);
+	g_assert(find_device_calls == 1);
+
+	/* Reconnecting restores the subscription from the stored value */
+	connect_peer(&context->peers[1]);
+	g_assert(num_subscribers(context) == 2);
+
+	find_device_calls = 0;
+	notify(context, 0x02);
+	g_assert(find_device_calls == 2);
+
+	return FALSE;
+}
+
+static void peer_disconnect_cb(int err, void *user_data)
+{
+	struct peer *peer = user_data;
+	struct context *context = peer->context;
+
+	/* The database is told about the disconnection after this */
+	if (++context->disconnected == NUM_PEERS - 1)
+		g_idle_add(notify_offline, context);
+}
+
+static bool can_read_data(struct io *io, void *user_data)
+{
+	struct peer *peer = user_data;
+	struct context *context = peer->context;
+	uint8_t pdu[23];
+	ssize_t len;
+
+	len = recv(io_get_fd(io), pdu, sizeof(pdu), MSG_DONTWAIT);
+	if (len < 0 && errno == EAGAIN)
+		return true;
+
+	g_assert(len == 4);
+	g_assert(pdu[0] == BT_ATT_OP_HANDLE_NFY);
+	g_assert(get_le16(pdu + 1) ==
+				gatt_db_attribute_get_handle(context->value));
+
+	peer->received++;
+
+	if (peer == &context->peers[0])
+		g_assert(pdu[3] == peer->received);
+	else if (peer == &context->peers[1])
+		g_assert(pdu[3] == 0x02);
+	else
+		g_assert_not_reached();
+
+	if (context->peers[0].received == 2 &&
+					context->peers[1].received == 1) {
+		destroy_context(context);
+		tester_test_passed();
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Bonded devices subscribe and all but one disconnect. Notifying only goes
+ * over the connected subscriber, and a device that reconnects is notified
+ * again without writing its CCC.
+ */
+static void test_bonded_offline(const void *user_data)
+{
+	struct context *context;
+	unsigned int i;
+
+	context = g_new0(struct context, 1);
+	test_context = context;
+	context->database = create_database(context);
+
+	for (i = 0; i < NUM_PEERS; i++) {
+		struct peer *peer = &context->peers[i];
+		bdaddr_t addr = { { i + 1, 0x02, 0x03, 0x04, 0x05, 0x06 } };
+
+		peer->context = context;
+		bacpy(&peer->addr, &addr);
+
+		connect_peer(peer);
+		subscribe(peer);
+	}
+
+	g_assert(num_subscribers(context) == NUM_PEERS);
+
+	for (i = 1; i < NUM_PEERS; i++) {
+		io_destroy(context->peers[i].io);
+		context->peers[i].io = NULL;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/gatt-database/notify/bonded-offline", NULL, NULL,
+						test_bonded_offline, NULL);
+
+	return tester_run();
+}
@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "lib/bluetooth.h"
+#include "lib/uuid.h"
+#include "src/shared/util.h"
+#include "src/shared/att.h"
+#include "src/shared/queue.h"
+#include "src/shared/gatt-db.h"
+#include "src/shared/tester.h"
+
+#define NUM_SERVICES		1024
+#define SERVICE_HANDLES		16
+#define CHRC_PER_SERVICE	7
+#define BENCH_ROUNDS		100
+
+static struct gatt_db *make_large_db(uint16_t num_services)
+{
+	struct gatt_db *db;
+	bt_uuid_t uuid;
+	uint16_t i, j;
+
+	db = gatt_db_new();
+	g_assert(db);
+
+	for (i = 0; i < num_services; i++) {
+		struct gatt_db_attribute *svc;
+
+		bt_uuid16_create(&uuid, 0x1800 + (i % 64));
+
+		svc = gatt_db_insert_service(db, 1 + i * SERVICE_HANDLES,
+						&uuid, true, SERVICE_HANDLES);
+		g_assert(svc);
+
+		for (j = 0; j < CHRC_PER_SERVICE; j++) {
+			bt_uuid16_create(&uuid, 0x2a00 + j);
+
+			g_assert(gatt_db_service_add_characteristic(svc, &uuid,
+						BT_ATT_PERM_READ,
+						BT_GATT_CHRC_PROP_READ,
+						NULL, NULL, NULL));
+		}
+
+		gatt_db_service_set_active(svc, true);
+	}
+
+	return db;
+}
+
+static void test_lookup(const void *data)
+{
+	struct gatt_db *db;
+	unsigned int handle;
+
+	db = make_large_db(NUM_SERVICES);
+
+	for (handle = 1; handle <= NUM_SERVICES * SERVICE_HANDLES; handle++) {
+		struct gatt_db_attribute *attr, *svc;
+		uint16_t offset = (handle - 1) % SERVICE_HANDLES;
+
+		svc = gatt_db_get_service(db, handle);
+		g_assert(svc);
+		g_assert(gatt_db_attribute_get_handle(svc) == handle - offset);
+
+		attr = gatt_db_get_attribute(db, handle);
+
+		/* Last handle of every service is left unused */
+		if (offset > CHRC_PER_SERVICE * 2) {
+			g_assert(!attr);
+			continue;
+		}
+
+		g_assert(attr);
+		g_assert(gatt_db_attribute_get_handle(attr) == handle);
+	}
+
+	g_assert(!gatt_db_get_service(db, handle));
+	g_assert(!gatt_db_get_attribute(db, handle));
+
+	gatt_db_unref(db);
+	tester_test_passed();
+}
+
+static void count_attr(struct gatt_db_attribute *attrib, void *user_data)
+{
+	unsigned int *count = user_data;
+
+	(*count)++;
+}
+
+static void test_foreach_range(const void *data)
+{
+	struct gatt_db *db;
+	unsigned int count;
+
+	db = make_large_db(NUM_SERVICES);
+
+	count = 0;
+	gatt_db_foreach_service(db, NULL, count_attr, &count);
+	g_assert(count == NUM_SERVICES);
+
+	/* Range starting and ending in the middle of a service */
+	count = 0;
+	gatt_db_foreach_in_range(db, NULL, count_attr, &count,
+					SERVICE_HANDLES - 1,
+					3 * SERVICE_HANDLES + 2);
+	g_assert(count == 1 + (CHRC_PER_SERVICE * 2 + 1) * 2 + 2);
+
+	/* Services only start inside the range are reported */
+	count = 0;
+	gatt_db_foreach_service_in_range(db, NULL, count_attr, &count,
+					SERVICE_HANDLES - 1,
+					3 * SERVICE_HANDLES + 2);
+	g_assert(count == 3);
+
+	gatt_db_unref(db);
+	tester_test_passed();
+}
+
+static void test_clear_range(const void *data)
+{
+	struct gatt_db *db;
+	unsigned int count;
+	bt_uuid_t uuid;
+
+	db = make_large_db(NUM_SERVICES);
+
+	g_assert(gatt_db_clear_range(db, 10 * SERVICE_HANDLES + 1,
+						20 * SERVICE_HANDLES));
+
+	g_assert(gatt_db_get_service(db, 10 * SERVICE_HANDLES));
+	g_assert(!gatt_db_get_service(db, 10 * SERVICE_HANDLES + 1));
+	g_assert(!gatt_db_get_attribute(db, 15 * SERVICE_HANDLES + 2));
+	g_assert(gatt_db_get_service(db, 20 * SERVICE_HANDLES + 1));
+
+	count = 0;
+	gatt_db_foreach_service(db, NULL, count_attr, &count);
+	g_assert(count == NUM_SERVICES - 10);
+
+	/* Overlapping an existing service must fail */
+	bt_uuid16_create(&uuid, 0x180f);
+	g_assert(!gatt_db_insert_service(db, 10 * SERVICE_HANDLES - 2,
+					&uuid, true, SERVICE_HANDLES));
+
+	/* Filling the hole must succeed and be found */
+	g_assert(gatt_db_insert_service(db, 10 * SERVICE_HANDLES + 1,
+					&uuid, true, 10 * SERVICE_HANDLES));
+	g_assert(gatt_db_get_service(db, 15 * SERVICE_HANDLES));
+
+	g_assert(gatt_db_remove_service(db, gatt_db_get_service(db, 1)));
+	g_assert(!gatt_db_get_service(db, 1));
+
+	g_assert(gatt_db_clear(db));
+	g_assert(gatt_db_isempty(db));
+	g_assert(!gatt_db_get_service(db, SERVICE_HANDLES + 1));
+
+	gatt_db_unref(db);
+	tester_test_passed();
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) +
+			(now.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static void test_bench_lookup(const void *data)
+{
+	struct gatt_db *db;
+	struct timespec start;
+	unsigned int handle, round, count = 0;
+	double secs;
+
+	db = make_large_db(NUM_SERVICES);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		for (handle = 1; handle <= NUM_SERVICES * SERVICE_HANDLES;
+								handle++) {
+			if (gatt_db_get_attribute(db, handle))
+				count++;
+		}
+	}
+
+	secs = elapsed(&start);
+
+	tester_print("%u handles: %.0f lookups/sec",
+				NUM_SERVICES * SERVICE_HANDLES,
+				BENCH_ROUNDS * NUM_SERVICES * SERVICE_HANDLES /
+				(secs > 0 ? secs : 1));
+
+	g_assert(count == BENCH_ROUNDS * NUM_SERVICES *
+					(CHRC_PER_SERVICE * 2 + 1));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		count = 0;
+		gatt_db_foreach_in_range(db, NULL, count_attr, &count,
+					NUM_SERVICES * SERVICE_HANDLES - 32,
+					NUM_SERVICES * SERVICE_HANDLES);
+	}
+
+	secs = elapsed(&start);
+
+	tester_print("%u handles: %.0f range iterations/sec",
+				NUM_SERVICES * SERVICE_HANDLES,
+				BENCH_ROUNDS / (secs > 0 ? secs : 1));
+
+	gatt_db_unref(db);
+	tester_test_passed();
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/gatt-db/lookup", NULL, NULL, test_lookup, NULL);
+	tester_add("/gatt-db/foreach_range", NULL, NULL, test_foreach_range,
+									NULL);
+	tester_add("/gatt-db/clear_range", NULL, NULL, test_clear_range, NULL);
+	tester_add("/gatt-db/bench_lookup", NULL, NULL, test_bench_lookup,
+									NULL);
+
+	return tester_run();
+}
@@ -0,0 +1,295 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "lib/bluetooth.h"
+#include "lib/uuid.h"
+#include "src/shared/util.h"
+#include "src/shared/io.h"
+#include "src/shared/att.h"
+#include "src/shared/queue.h"
+#include "src/shared/gatt-db.h"
+#include "src/shared/gatt-server.h"
+#include "src/shared/tester.h"
+
+#define NUM_NOTIFICATIONS	200000
+#define BURST_LEN		16
+#define TEST_MTU		64
+#define VALUE_LEN		10
+
+struct test_data {
+	bool multiple;
+	uint8_t write_batch;
+};
+
+struct context {
+	const struct test_data *data;
+	struct gatt_db *db;
+	struct bt_att *att;
+	struct bt_gatt_server *server;
+	struct io *io;
+	unsigned int sent;
+	unsigned int received;
+	unsigned int pdus;
+	unsigned int allocs;
+	struct timespec start;
+};
+
+/*
+ * The test is linked with --wrap for the allocation functions so that the
+ * allocations made by the code under test can be counted.
+ */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+static unsigned int allocs;
+
+void *__wrap_malloc(size_t size)
+{
+	allocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	allocs++;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	allocs++;
+	return __real_realloc(ptr, size);
+}
+
+static uint16_t value_handle(unsigned int i)
+{
+	return 0x0001 + i % 0x0100;
+}
+
+static void fill_value(uint8_t *value, unsigned int i)
+{
+	unsigned int j;
+
+	for (j = 0; j < VALUE_LEN; j++)
+		value[j] = i + j;
+}
+
+static void check_value(uint16_t handle, const uint8_t *value, uint16_t len,
+								unsigned int i)
+{
+	uint8_t expected[VALUE_LEN];
+
+	fill_value(expected, i);
+
+	g_assert(handle == value_handle(i));
+	g_assert(len == VALUE_LEN);
+	g_assert(!memcmp(value, expected, VALUE_LEN));
+}
+
+static void send_burst(struct context *context)
+{
+	unsigned int i;
+
+	for (i = 0; i < BURST_LEN && context->sent < NUM_NOTIFICATIONS; i++) {
+		uint8_t value[VALUE_LEN];
+
+		fill_value(value, context->sent);
+
+		g_assert(bt_gatt_server_send_notification(context->server,
+					value_handle(context->sent), value,
+					sizeof(value), context->data->multiple));
+		context->sent++;
+	}
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) +
+			(now.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static void destroy_context(struct context *context)
+{
+	io_destroy(context->io);
+	bt_gatt_server_unref(context->server);
+	bt_att_unref(context->att);
+	gatt_db_unref(context->db);
+	g_free(context);
+}
+
+static void test_complete(struct context *context)
+{
+	unsigned int count = allocs - context->allocs;
+	double secs = elapsed(&context->start);
+
+	tester_print("%u notifications in %u PDUs: %.0f notifications/sec",
+					context->received, context->pdus,
+					context->received / (secs > 0 ? secs : 1));
+	tester_print("%.3f allocations/notification",
+				(double) count / context->received);
+
+	/*
+	 * Buffers are only allocated once, and coalescing re-arms its timer
+	 * at most once per period.
+	 */
+	g_assert(count * 100 < context->received);
+
+	destroy_context(context);
+
+	tester_test_passed();
+}
+
+static void parse_pdu(struct context *context, const uint8_t *pdu,
+								ssize_t len)
+{
+	context->pdus++;
+
+	if (pdu[0] == BT_ATT_OP_HANDLE_NFY) {
+		g_assert(!context->data->multiple);
+		check_value(get_le16(pdu + 1), pdu + 3, len - 3,
+							context->received++);
+		return;
+	}
+
+	g_assert(pdu[0] == BT_ATT_OP_HANDLE_NFY_MULT);
+	g_assert(context->data->multiple);
+
+	for (pdu++, len--; len > 0; ) {
+		uint16_t value_len;
+
+		g_assert(len >= 4);
+		value_len = get_le16(pdu + 2);
+		g_assert(len >= 4 + value_len);
+
+		check_value(get_le16(pdu), pdu + 4, value_len,
+							context->received++);
+
+		pdu += 4 + value_len;
+		len -= 4 + value_len;
+	}
+}
+
+static bool can_read_data(struct io *io, void *user_data)
+{
+	struct context *context = user_data;
+	uint8_t pdu[TEST_MTU];
+	ssize_t len;
+
+	while ((len = recv(io_get_fd(io), pdu, sizeof(pdu),
+						MSG_DONTWAIT)) > 0)
+		parse_pdu(context, pdu, len);
+
+	g_assert(len < 0 && errno == EAGAIN);
+	g_assert(context->received <= context->sent);
+
+	if (context->received == NUM_NOTIFICATIONS) {
+		test_complete(context);
+		return false;
+	}
+
+	/* Keep at most two bursts in flight */
+	if (context->sent - context->received < BURST_LEN)
+		send_burst(context);
+
+	return true;
+}
+
+/*
+ * Drive notifications from a GATT server through a socket pair in bursts,
+ * sending the next one as the previous is being received.
+ */
+static void test_notify(const void *user_data)
+{
+	struct context *context;
+	int sv[2];
+
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv));
+
+	context = g_new0(struct context, 1);
+	context->data = user_data;
+
+	context->att = bt_att_new(sv[0], false);
+	g_assert(context->att);
+	bt_att_set_close_on_unref(context->att, true);
+	g_assert(bt_att_set_mtu(context->att, TEST_MTU));
+
+	if (context->data->write_batch)
+		g_assert(bt_att_set_write_batch(context->att,
+						context->data->write_batch));
+
+	context->db = gatt_db_new();
+	context->server = bt_gatt_server_new(context->db, context->att,
+							TEST_MTU, 0);
+	g_assert(context->server);
+
+	context->io = io_new(sv[1]);
+	g_assert(context->io);
+	io_set_close_on_destroy(context->io, true);
+	io_set_read_handler(context->io, can_read_data, context, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &context->start);
+	context->allocs = allocs;
+
+	send_burst(context);
+}
+
+static const struct test_data single_data = {
+	.multiple = false,
+};
+
+static const struct test_data multiple_data = {
+	.multiple = true,
+};
+
+static const struct test_data single_batch_data = {
+	.multiple = false,
+	.write_batch = BURST_LEN,
+};
+
+static const struct test_data multiple_batch_data = {
+	.multiple = true,
+	.write_batch = BURST_LEN,
+};
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/gatt-notify/single", &single_data, NULL, test_notify,
+									NULL);
+	tester_add("/gatt-notify/multiple", &multiple_data, NULL, test_notify,
+									NULL);
+	tester_add("/gatt-notify/single/batch", &single_batch_data, NULL,
+							test_notify, NULL);
+	tester_add("/gatt-notify/multiple/batch", &multiple_batch_data, NULL,
+							test_notify, NULL);
+
+	return tester_run();
+}
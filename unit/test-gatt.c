@@ -31,6 +31,7 @@
 #include "src/shared/gatt-db.h"
 #include "src/shared/gatt-server.h"
 #include "src/shared/gatt-client.h"
+#include "src/shared/crypto.h"
 #include "src/shared/tester.h"
 
 struct test_pdu {
@@ -2412,6 +2413,139 @@ static void test_hash_db(gconstpointer data)
 	context_quit(context);
 }
 
+struct hash_ref {
+	struct iovec iov[512];
+	size_t count;
+};
+
+static void hash_ref_read_cb(struct gatt_db_attribute *attrib, int err,
+					const uint8_t *value, size_t length,
+					void *user_data)
+{
+	struct iovec *iov = user_data;
+
+	g_assert(!err);
+
+	iov->iov_base = realloc(iov->iov_base, iov->iov_len + length);
+	memcpy(iov->iov_base + iov->iov_len, value, length);
+	iov->iov_len += length;
+}
+
+/*
+ * Generate the Database Hash input one attribute at a time, the way it is
+ * described in Core Specification Vol 3, Part G, 7.3.1.
+ */
+static void hash_ref_attr(struct gatt_db_attribute *attr, void *user_data)
+{
+	struct hash_ref *ref = user_data;
+	const bt_uuid_t *type = gatt_db_attribute_get_type(attr);
+	struct iovec *iov;
+	bool value;
+
+	if (type->type != BT_UUID16)
+		return;
+
+	switch (type->value.u16) {
+	case GATT_PRIM_SVC_UUID:
+	case GATT_SND_SVC_UUID:
+	case GATT_INCLUDE_UUID:
+	case GATT_CHARAC_UUID:
+		value = true;
+		break;
+	case GATT_CHARAC_USER_DESC_UUID:
+	case GATT_CLIENT_CHARAC_CFG_UUID:
+	case GATT_SERVER_CHARAC_CFG_UUID:
+	case GATT_CHARAC_FMT_UUID:
+	case GATT_CHARAC_AGREG_FMT_UUID:
+		value = false;
+		break;
+	default:
+		return;
+	}
+
+	g_assert(ref->count < G_N_ELEMENTS(ref->iov));
+
+	iov = &ref->iov[ref->count++];
+	iov->iov_base = malloc(4);
+	iov->iov_len = 4;
+	put_le16(gatt_db_attribute_get_handle(attr), iov->iov_base);
+	put_le16(type->value.u16, iov->iov_base + 2);
+
+	if (value)
+		gatt_db_attribute_read(attr, 0, 0, NULL, hash_ref_read_cb, iov);
+}
+
+static void hash_ref_service(struct gatt_db_attribute *attr, void *user_data)
+{
+	gatt_db_service_foreach(attr, NULL, hash_ref_attr, user_data);
+}
+
+static void check_db_hash(struct gatt_db *db)
+{
+	struct bt_crypto *crypto;
+	struct hash_ref ref;
+	uint8_t hash[16];
+	size_t i;
+
+	memset(&ref, 0, sizeof(ref));
+
+	gatt_db_foreach_service(db, NULL, hash_ref_service, &ref);
+
+	crypto = bt_crypto_new();
+	g_assert(crypto);
+	g_assert(bt_crypto_gatt_hash(crypto, ref.iov, ref.count, hash));
+	bt_crypto_unref(crypto);
+
+	for (i = 0; i < ref.count; i++)
+		free(ref.iov[i].iov_base);
+
+	g_assert(!memcmp(gatt_db_get_hash(db), hash, sizeof(hash)));
+}
+
+static void test_hash_db_incremental(gconstpointer data)
+{
+	struct gatt_db *db;
+	struct gatt_db_attribute *svc;
+	bt_uuid_t uuid;
+
+	db = make_test_spec_large_db_1();
+
+	check_db_hash(db);
+
+	/* Add a service at the end of the database */
+	bt_string_to_uuid(&uuid, HEART_RATE_UUID);
+	svc = gatt_db_add_service(db, &uuid, true, 4);
+	g_assert(svc);
+
+	bt_uuid16_create(&uuid, 0x2a37);
+	g_assert(gatt_db_service_add_characteristic(svc, &uuid,
+						BT_ATT_PERM_NONE,
+						BT_GATT_CHRC_PROP_NOTIFY,
+						NULL, NULL, NULL));
+	bt_uuid16_create(&uuid, GATT_CLIENT_CHARAC_CFG_UUID);
+	g_assert(gatt_db_service_add_descriptor(svc, &uuid,
+						BT_ATT_PERM_READ |
+						BT_ATT_PERM_WRITE,
+						NULL, NULL, NULL));
+	gatt_db_service_set_active(svc, true);
+
+	check_db_hash(db);
+
+	/* Inactive services are not part of the hash */
+	gatt_db_service_set_active(svc, false);
+
+	check_db_hash(db);
+
+	/* Remove a service in the middle of the database */
+	g_assert(gatt_db_remove_service(db, gatt_db_get_service(db, 0x0020)));
+
+	check_db_hash(db);
+
+	gatt_db_unref(db);
+
+	tester_test_passed();
+}
+
 int main(int argc, char *argv[])
 {
 	struct gatt_db *service_db_1, *service_db_2, *service_db_3;
@@ -4559,5 +4693,9 @@ int main(int argc, char *argv[])
 			test_hash_db, ts_tail_db, NULL,
 			{});
 
+	define_test_server("/robustness/hash-db-incremental",
+			test_hash_db_incremental, NULL, NULL,
+			{});
+
 	return tester_run();
 }
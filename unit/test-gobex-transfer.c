@@ -2394,6 +2394,361 @@ static void test_conn_put_req_seq_srm(void)
 	g_assert_no_error(d.err);
 }
 
+static guint8 fd_body[4096];
+static int fd_body_fd = -1;
+static gsize fd_body_sent;
+
+static gssize provide_fd(int *fd, gsize len, gpointer user_data)
+{
+	gssize ret = MIN(len, sizeof(fd_body) - fd_body_sent);
+
+	*fd = fd_body_fd;
+	fd_body_sent += ret;
+
+	return ret;
+}
+
+static gboolean receive_fd_body(const void *buf, gsize len,
+							gpointer user_data)
+{
+	struct test_data *d = user_data;
+
+	if (d->total + len > sizeof(fd_body) ||
+				memcmp(&fd_body[d->total], buf, len) != 0) {
+		g_set_error(&d->err, TEST_ERROR, TEST_ERROR_UNEXPECTED,
+				"Unexpected body data at offset %zu", d->total);
+		return FALSE;
+	}
+
+	d->total += len;
+
+	return TRUE;
+}
+
+static void fd_transfer_complete(GObex *obex, GError *err,
+							gpointer user_data)
+{
+	struct test_data *d = user_data;
+
+	if (err != NULL && d->err == NULL)
+		d->err = g_error_copy(err);
+}
+
+static void handle_get_fd(GObex *obex, GObexPacket *req, gpointer user_data)
+{
+	struct test_data *d = user_data;
+
+	if (g_obex_get_rsp_fd(obex, provide_fd, fd_transfer_complete, d,
+					&d->err, G_OBEX_HDR_INVALID) == 0)
+		g_main_loop_quit(d->mainloop);
+}
+
+static void handle_put_fd(GObex *obex, GObexPacket *req, gpointer user_data)
+{
+	struct test_data *d = user_data;
+
+	if (g_obex_put_rsp(obex, req, receive_fd_body, fd_transfer_complete,
+				d, &d->err, G_OBEX_HDR_INVALID) == 0)
+		g_main_loop_quit(d->mainloop);
+}
+
+/*
+ * Transfers a body sent straight from a file descriptor between two GObex
+ * instances, stream transports use sendfile() and packet ones copy it.
+ */
+static void test_fd_transfer(int sock_type, guint8 op)
+{
+	GObexTransportType transport_type;
+	GObex *server, *client;
+	char *path;
+	int sv[2];
+	gsize i;
+	struct test_data d = { 0, NULL, { { NULL, 0 } }, { { NULL, 0 } } };
+
+	for (i = 0; i < sizeof(fd_body); i++)
+		fd_body[i] = i * 7;
+
+	fd_body_fd = g_file_open_tmp(NULL, &path, &d.err);
+	g_assert_no_error(d.err);
+	unlink(path);
+	g_free(path);
+
+	g_assert(write(fd_body_fd, fd_body, sizeof(fd_body)) ==
+							sizeof(fd_body));
+	g_assert(lseek(fd_body_fd, 0, SEEK_SET) == 0);
+	fd_body_sent = 0;
+
+	g_assert(socketpair(AF_UNIX, sock_type | SOCK_NONBLOCK, 0, sv) == 0);
+
+	if (sock_type == SOCK_STREAM)
+		transport_type = G_OBEX_TRANSPORT_STREAM;
+	else
+		transport_type = G_OBEX_TRANSPORT_PACKET;
+
+	server = create_gobex(sv[0], transport_type, TRUE);
+	client = create_gobex(sv[1], transport_type, TRUE);
+
+	d.mainloop = g_main_loop_new(NULL, FALSE);
+
+	d.timer_id = g_timeout_add_seconds(1, test_timeout, &d);
+
+	if (op == G_OBEX_OP_GET) {
+		g_obex_add_request_function(server, op, handle_get_fd, &d);
+		g_obex_get_req(client, receive_fd_body, transfer_complete, &d,
+					&d.err, G_OBEX_HDR_NAME, "file.txt",
+					G_OBEX_HDR_INVALID);
+	} else {
+		g_obex_add_request_function(server, op, handle_put_fd, &d);
+		g_obex_put_req_fd(client, provide_fd, transfer_complete, &d,
+					&d.err, G_OBEX_HDR_NAME, "file.txt",
+					G_OBEX_HDR_INVALID);
+	}
+	g_assert_no_error(d.err);
+
+	g_main_loop_run(d.mainloop);
+
+	g_assert_no_error(d.err);
+	g_assert_cmpuint(d.total, ==, sizeof(fd_body));
+
+	g_main_loop_unref(d.mainloop);
+
+	if (d.timer_id > 0)
+		g_source_remove(d.timer_id);
+
+	g_obex_unref(client);
+	g_obex_unref(server);
+
+	close(fd_body_fd);
+	fd_body_fd = -1;
+}
+
+static guint8 connect_req_max_mtu[] = { G_OBEX_OP_CONNECT | FINAL_BIT,
+					0x00, 0x07, 0x10, 0x00, 0xff, 0xff };
+
+static guint8 abort_fd_body[32768];
+static int abort_fd_junk = -1;
+static GIOChannel *abort_fd_io;
+static GByteArray *abort_fd_rx;
+
+static gssize provide_abort_fd(int *fd, gsize len, gpointer user_data)
+{
+	struct test_data *d = user_data;
+	gssize ret = MIN(len, sizeof(abort_fd_body) - fd_body_sent);
+
+	*fd = fd_body_fd;
+	fd_body_sent += ret;
+
+	/* The peer gives up before reading anything */
+	if (ret > 0 && write(g_io_channel_unix_get_fd(abort_fd_io), abort_req,
+				sizeof(abort_req)) != sizeof(abort_req))
+		g_set_error(&d->err, TEST_ERROR, TEST_ERROR_UNEXPECTED,
+					"Unable to send abort: %s",
+					strerror(errno));
+
+	return ret;
+}
+
+/* Returns the length of the packet at offset if it was fully received */
+static gsize abort_fd_packet(gsize offset)
+{
+	guint16 len;
+
+	if (abort_fd_rx->len < offset + 3)
+		return 0;
+
+	len = abort_fd_rx->data[offset + 1] << 8 |
+					abort_fd_rx->data[offset + 2];
+	if (abort_fd_rx->len < offset + len)
+		return 0;
+
+	return len;
+}
+
+static gboolean abort_fd_read(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	struct test_data *d = user_data;
+	guint8 buf[4096];
+	gsize connect_len, get_len, body_len;
+	const guint8 *pkt;
+	ssize_t ret;
+
+	ret = read(g_io_channel_unix_get_fd(io), buf, sizeof(buf));
+	if (ret <= 0) {
+		if (ret < 0 && errno == EAGAIN)
+			return TRUE;
+
+		g_set_error(&d->err, TEST_ERROR, TEST_ERROR_UNEXPECTED,
+						"Unexpected end of stream");
+		goto done;
+	}
+
+	g_byte_array_append(abort_fd_rx, buf, ret);
+
+	/* CONNECT response, then the GET response cut short by the abort */
+	connect_len = abort_fd_packet(0);
+	if (!connect_len)
+		return TRUE;
+
+	get_len = abort_fd_packet(connect_len);
+	if (!get_len)
+		return TRUE;
+
+	pkt = abort_fd_rx->data + connect_len;
+	body_len = get_len - 6;
+
+	if (abort_fd_rx->len != connect_len + get_len ||
+				pkt[0] != (G_OBEX_RSP_CONTINUE | FINAL_BIT) ||
+				pkt[3] != G_OBEX_HDR_BODY ||
+				(pkt[4] << 8 | pkt[5]) != body_len + 3 ||
+				memcmp(pkt + 6, abort_fd_body, body_len))
+		g_set_error(&d->err, TEST_ERROR, TEST_ERROR_UNEXPECTED,
+					"Corrupted GET response");
+
+done:
+	d->io_id = 0;
+	g_main_loop_quit(d->mainloop);
+	return FALSE;
+}
+
+static void abort_fd_complete(GObex *obex, GError *err, gpointer user_data)
+{
+	struct test_data *d = user_data;
+	GIOCondition cond = G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL;
+
+	if (!g_error_matches(err, G_OBEX_ERROR, G_OBEX_ERROR_CANCELLED)) {
+		g_set_error(&d->err, TEST_ERROR, TEST_ERROR_UNEXPECTED,
+						"Transfer was not aborted");
+		g_main_loop_quit(d->mainloop);
+		return;
+	}
+
+	/* Like obexd, close the file and reuse its descriptor number */
+	g_assert(dup2(abort_fd_junk, fd_body_fd) == fd_body_fd);
+
+	d->io_id = g_io_add_watch(abort_fd_io, cond, abort_fd_read, d);
+}
+
+static void handle_get_abort_fd(GObex *obex, GObexPacket *req,
+							gpointer user_data)
+{
+	struct test_data *d = user_data;
+
+	if (g_obex_get_rsp_fd(obex, provide_abort_fd, abort_fd_complete, d,
+					&d->err, G_OBEX_HDR_INVALID) == 0)
+		g_main_loop_quit(d->mainloop);
+}
+
+static int create_tmp_file(const void *data, gsize len)
+{
+	GError *err = NULL;
+	char *path;
+	int fd;
+
+	fd = g_file_open_tmp(NULL, &path, &err);
+	g_assert_no_error(err);
+	unlink(path);
+	g_free(path);
+
+	g_assert(write(fd, data, len) == (ssize_t) len);
+	g_assert(lseek(fd, 0, SEEK_SET) == 0);
+
+	return fd;
+}
+
+/*
+ * The peer aborts a GET while the body of the response is still being
+ * sent from the file, and the server reuses the descriptor of the file
+ * right away. The response in flight must still go out whole.
+ */
+static void test_stream_get_rsp_fd_abort(void)
+{
+	guint8 junk[sizeof(abort_fd_body)];
+	GObex *obex;
+	int sv[2], sndbuf = 4096;
+	gsize i;
+	struct test_data d = { 0, NULL, { { NULL, 0 } }, { { NULL, 0 } } };
+
+	for (i = 0; i < sizeof(abort_fd_body); i++)
+		abort_fd_body[i] = i * 7;
+
+	memset(junk, 0x55, sizeof(junk));
+
+	fd_body_fd = create_tmp_file(abort_fd_body, sizeof(abort_fd_body));
+	abort_fd_junk = create_tmp_file(junk, sizeof(junk));
+	fd_body_sent = 0;
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == 0);
+
+	/* Make sure the body does not fit in the socket at once */
+	g_assert(setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf,
+							sizeof(sndbuf)) == 0);
+
+	obex = create_gobex(sv[0], G_OBEX_TRANSPORT_STREAM, TRUE);
+
+	abort_fd_io = g_io_channel_unix_new(sv[1]);
+	g_io_channel_set_encoding(abort_fd_io, NULL, NULL);
+	g_io_channel_set_buffered(abort_fd_io, FALSE);
+	g_io_channel_set_close_on_unref(abort_fd_io, TRUE);
+
+	abort_fd_rx = g_byte_array_new();
+
+	d.mainloop = g_main_loop_new(NULL, FALSE);
+
+	d.timer_id = g_timeout_add_seconds(1, test_timeout, &d);
+
+	g_obex_add_request_function(obex, G_OBEX_OP_GET, handle_get_abort_fd,
+									&d);
+
+	g_io_channel_write_chars(abort_fd_io, (char *) connect_req_max_mtu,
+				sizeof(connect_req_max_mtu), NULL, &d.err);
+	g_assert_no_error(d.err);
+
+	g_io_channel_write_chars(abort_fd_io, (char *) get_req_last,
+				sizeof(get_req_last), NULL, &d.err);
+	g_assert_no_error(d.err);
+
+	g_main_loop_run(d.mainloop);
+
+	g_assert_no_error(d.err);
+
+	g_main_loop_unref(d.mainloop);
+
+	if (d.timer_id > 0)
+		g_source_remove(d.timer_id);
+	if (d.io_id > 0)
+		g_source_remove(d.io_id);
+
+	g_byte_array_unref(abort_fd_rx);
+	g_io_channel_unref(abort_fd_io);
+	g_obex_unref(obex);
+
+	close(abort_fd_junk);
+	abort_fd_junk = -1;
+	close(fd_body_fd);
+	fd_body_fd = -1;
+}
+
+static void test_stream_get_rsp_fd(void)
+{
+	test_fd_transfer(SOCK_STREAM, G_OBEX_OP_GET);
+}
+
+static void test_packet_get_rsp_fd(void)
+{
+	test_fd_transfer(SOCK_SEQPACKET, G_OBEX_OP_GET);
+}
+
+static void test_stream_put_req_fd(void)
+{
+	test_fd_transfer(SOCK_STREAM, G_OBEX_OP_PUT);
+}
+
+static void test_packet_put_req_fd(void)
+{
+	test_fd_transfer(SOCK_SEQPACKET, G_OBEX_OP_PUT);
+}
+
 int main(int argc, char *argv[])
 {
 	g_test_init(&argc, &argv, NULL);
@@ -2467,5 +2822,16 @@ int main(int argc, char *argv[])
 	g_test_add_func("/gobex/test_conn_put_req_seq_srm",
 						test_conn_put_req_seq_srm);
 
+	g_test_add_func("/gobex/test_stream_get_rsp_fd",
+						test_stream_get_rsp_fd);
+	g_test_add_func("/gobex/test_packet_get_rsp_fd",
+						test_packet_get_rsp_fd);
+	g_test_add_func("/gobex/test_stream_put_req_fd",
+						test_stream_put_req_fd);
+	g_test_add_func("/gobex/test_packet_put_req_fd",
+						test_packet_put_req_fd);
+	g_test_add_func("/gobex/test_stream_get_rsp_fd_abort",
+					test_stream_get_rsp_fd_abort);
+
 	return g_test_run();
 }
@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "src/shared/mainloop.h"
+
+#include "src/shared/log.c"
+
+#include "unit/check.h"
+
+#define NUM_DROPS		5
+#define GUARD_TIMEOUT		10000
+
+/* The logging channel is a socket pair, the peer stands in for btmon */
+static int peer_fd = -1;
+
+static unsigned int received;
+static unsigned int fillers;
+
+static void open_channel(void)
+{
+	int sv[2];
+
+	CHECK(!socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, sv));
+
+	log_fd = sv[0];
+	peer_fd = sv[1];
+
+	CHECK(bt_log_set_buffered(true));
+	CHECK(log_ring);
+}
+
+static void close_channel(void)
+{
+	CHECK(bt_log_set_buffered(false));
+	CHECK(!log_ring);
+
+	bt_log_close();
+	CHECK(log_fd < 0);
+
+	close(peer_fd);
+	peer_fd = -1;
+}
+
+static void check_frame(const uint8_t *frame, ssize_t len, uint16_t index,
+					int priority, const char *label,
+					const char *text)
+{
+	const struct log_hdr *hdr = (const void *) frame;
+	size_t ident_len = strlen(label) + 1;
+
+	CHECK(len == (ssize_t) (sizeof(*hdr) + ident_len + strlen(text) + 1));
+	CHECK(le16_to_cpu(hdr->opcode) == 0x0000);
+	CHECK(le16_to_cpu(hdr->index) == index);
+	CHECK(le16_to_cpu(hdr->len) == len - 6);
+	CHECK(hdr->priority == priority);
+	CHECK(hdr->ident_len == ident_len);
+	CHECK(!strcmp((const char *) frame + sizeof(*hdr), label));
+	CHECK(!strcmp((const char *) frame + sizeof(*hdr) + ident_len, text));
+}
+
+static ssize_t recv_frame(uint8_t *frame, size_t size)
+{
+	return recv(peer_fd, frame, size, MSG_DONTWAIT);
+}
+
+static bool guard_callback(void *user_data)
+{
+	CHECK(false);
+
+	return false;
+}
+
+static void ring_callback(int fd, uint32_t events, void *user_data)
+{
+	uint8_t frame[LOG_SLOT_SIZE];
+	char text[32];
+	ssize_t len;
+
+	while ((len = recv_frame(frame, sizeof(frame))) > 0) {
+		snprintf(text, sizeof(text), "message %u", 3 + received);
+		check_frame(frame, len, 0x0001, LOG_INFO, "test", text);
+		received++;
+	}
+
+	if (received == 2)
+		mainloop_quit();
+}
+
+/*
+ * Messages are queued until the flush timeout sends them. A message too
+ * long for the ring is sent right away, after what was already queued.
+ */
+static void check_ring(void)
+{
+	char long_text[LOG_SLOT_SIZE];
+	uint8_t frame[2 * LOG_SLOT_SIZE];
+	char text[32];
+	unsigned int i;
+	ssize_t len;
+
+	mainloop_init();
+	open_channel();
+
+	for (i = 0; i < 3; i++)
+		CHECK(bt_log_printf(0x0001, "test", LOG_INFO, "message %u\n",
+								i) == 10);
+
+	CHECK(log_ring->count == 3);
+	CHECK(log_ring->flush_id);
+	CHECK(recv_frame(frame, sizeof(frame)) < 0 && errno == EAGAIN);
+
+	memset(long_text, 'x', sizeof(long_text) - 1);
+	long_text[sizeof(long_text) - 1] = '\0';
+
+	CHECK(bt_log_printf(0x0001, "test", LOG_INFO, "%s", long_text) > 0);
+	CHECK(!log_ring->count);
+
+	for (i = 0; i < 3; i++) {
+		len = recv_frame(frame, sizeof(frame));
+		snprintf(text, sizeof(text), "message %u", i);
+		check_frame(frame, len, 0x0001, LOG_INFO, "test", text);
+	}
+
+	len = recv_frame(frame, sizeof(frame));
+	check_frame(frame, len, 0x0001, LOG_INFO, "test", long_text);
+
+	/* The next ones go out from the main loop */
+	for (i = 3; i < 5; i++)
+		CHECK(bt_log_printf(0x0001, "test", LOG_INFO, "message %u",
+								i) == 10);
+
+	received = 0;
+
+	CHECK(!mainloop_add_fd(peer_fd, EPOLLIN, ring_callback, NULL, NULL));
+	CHECK(timeout_add(GUARD_TIMEOUT, guard_callback, NULL, NULL));
+
+	CHECK(mainloop_run() == EXIT_SUCCESS);
+
+	CHECK(!log_ring->count);
+	CHECK(!log_ring->flush_id);
+
+	close_channel();
+
+	printf("Ring: %u messages flushed from the main loop\n", received);
+}
+
+static void drop_callback(int fd, uint32_t events, void *user_data)
+{
+	uint8_t frame[LOG_SLOT_SIZE];
+	char text[32];
+	ssize_t len;
+
+	while ((len = recv_frame(frame, sizeof(frame))) > 0) {
+		/* What filled up the channel before the test started */
+		if (len == 1) {
+			fillers--;
+			continue;
+		}
+
+		CHECK(!fillers);
+
+		if (received < LOG_RING_LEN) {
+			snprintf(text, sizeof(text), "message %u", received);
+			check_frame(frame, len, 0x0002, LOG_DEBUG, "test",
+									text);
+			received++;
+			continue;
+		}
+
+		/* Reported with the index and label of the first drop */
+		snprintf(text, sizeof(text), "%u log messages dropped",
+								NUM_DROPS);
+		check_frame(frame, len, 0x0003, LOG_WARNING, "dropped", text);
+		mainloop_quit();
+	}
+}
+
+/*
+ * With the channel full the ring fills up, then messages are dropped and
+ * counted. The count is reported once the ring is flushed.
+ */
+static void check_drop(void)
+{
+	unsigned int i;
+
+	mainloop_init();
+	open_channel();
+
+	for (fillers = 0; send(log_fd, "", 1, MSG_DONTWAIT) == 1; fillers++)
+		;
+
+	CHECK(errno == EAGAIN);
+
+	for (i = 0; i < LOG_RING_LEN; i++)
+		CHECK(bt_log_printf(0x0002, "test", LOG_DEBUG, "message %u",
+								i) > 0);
+
+	CHECK(log_ring->count == LOG_RING_LEN);
+	CHECK(!log_ring->dropped);
+
+	for (i = 0; i < NUM_DROPS; i++)
+		CHECK(bt_log_printf(0x0003 + i, "dropped", LOG_DEBUG,
+					"message %u", i) == -ENOBUFS);
+
+	/* Only the first drop tried to flush, then the timer takes over */
+	CHECK(log_ring->blocked);
+	CHECK(log_ring->dropped == NUM_DROPS);
+	CHECK(log_ring->count == LOG_RING_LEN);
+	CHECK(log_ring->flush_id);
+
+	received = 0;
+
+	CHECK(!mainloop_add_fd(peer_fd, EPOLLIN, drop_callback, NULL, NULL));
+	CHECK(timeout_add(GUARD_TIMEOUT, guard_callback, NULL, NULL));
+
+	CHECK(mainloop_run() == EXIT_SUCCESS);
+
+	CHECK(received == LOG_RING_LEN);
+	CHECK(!log_ring->count);
+	CHECK(!log_ring->dropped);
+
+	close_channel();
+
+	printf("Drop: %u messages queued, %u dropped and reported\n",
+						received, NUM_DROPS);
+}
+
+int main(int argc, char *argv[])
+{
+	check_ring();
+	check_drop();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,298 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include "src/shared/mainloop.h"
+
+#include "unit/check.h"
+
+#define NUM_FDS			4000
+#define NUM_TIMERS		20000
+#define MAX_TIMEOUT		200
+#define GUARD_TIMEOUT		10000
+
+struct fd_data {
+	int fd;
+	unsigned int called;
+	bool destroyed;
+};
+
+struct timer_data {
+	int id;
+	unsigned int msec;
+	uint64_t armed;
+	unsigned int rearm;
+	unsigned int called;
+	bool cancel;
+	bool destroyed;
+};
+
+static struct fd_data fds[NUM_FDS];
+static struct timer_data timers[NUM_TIMERS];
+static unsigned int num_fds;
+static unsigned int pending;
+static unsigned int late;
+
+static uint32_t rand_state = 0x12345678;
+
+static uint32_t next_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+
+	return rand_state;
+}
+
+static uint64_t now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void raise_fd_limit(void)
+{
+	struct rlimit rlim;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim) < 0)
+		return;
+
+	rlim.rlim_cur = rlim.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rlim);
+
+	/* Leave some room for the descriptors the loop itself needs */
+	num_fds = NUM_FDS;
+	if (rlim.rlim_cur != RLIM_INFINITY && rlim.rlim_cur < NUM_FDS + 64)
+		num_fds = rlim.rlim_cur - 64;
+}
+
+static void fd_destroy(void *user_data)
+{
+	struct fd_data *data = user_data;
+
+	CHECK(!data->destroyed);
+	data->destroyed = true;
+
+	close(data->fd);
+
+	if (!--pending)
+		mainloop_quit();
+}
+
+static void fd_callback(int fd, uint32_t events, void *user_data)
+{
+	struct fd_data *data = user_data;
+	unsigned int i = data - fds;
+	uint64_t value;
+
+	CHECK(fd == data->fd);
+	CHECK(events & EPOLLIN);
+	CHECK(!data->destroyed);
+	CHECK(read(fd, &value, sizeof(value)) == sizeof(value));
+
+	data->called++;
+
+	/*
+	 * Also remove the neighbour, its event may be waiting in the same
+	 * batch and must not be dispatched anymore.
+	 */
+	if (!(i & 1) && i + 1 < num_fds && !fds[i + 1].destroyed)
+		CHECK(!mainloop_remove_fd(fds[i + 1].fd));
+
+	CHECK(!mainloop_remove_fd(fd));
+}
+
+/* Register thousands of descriptors at once and have all of them ready */
+static void check_fds(void)
+{
+	uint64_t start, value = 1;
+	unsigned int i;
+
+	mainloop_init();
+
+	for (i = 0; i < num_fds; i++) {
+		fds[i].fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		CHECK(fds[i].fd >= 0);
+
+		CHECK(!mainloop_add_fd(fds[i].fd, EPOLLIN, fd_callback,
+						&fds[i], fd_destroy));
+	}
+
+	CHECK(mainloop_modify_fd(-1, EPOLLIN) == -EINVAL);
+	CHECK(mainloop_remove_fd(fds[num_fds - 1].fd + 1) == -ENXIO);
+
+	for (i = 0; i < num_fds; i++)
+		CHECK(write(fds[i].fd, &value, sizeof(value)) ==
+							sizeof(value));
+
+	pending = num_fds;
+	start = now_usec();
+
+	CHECK(mainloop_run() == EXIT_SUCCESS);
+
+	for (i = 0; i < num_fds; i++) {
+		CHECK(fds[i].destroyed);
+		CHECK(fds[i].called <= 1);
+		CHECK(fds[i].called || (i & 1));
+	}
+
+	printf("%u descriptors dispatched in %.1f ms\n", num_fds,
+					(now_usec() - start) / 1000.0);
+}
+
+static void timer_destroy(void *user_data)
+{
+	struct timer_data *data = user_data;
+
+	CHECK(!data->destroyed);
+	data->destroyed = true;
+}
+
+static void timer_arm(struct timer_data *data, unsigned int msec)
+{
+	data->msec = msec;
+	data->armed = now_usec();
+}
+
+static void timer_callback(int id, void *user_data)
+{
+	struct timer_data *data = user_data;
+	uint64_t elapsed = now_usec() - data->armed;
+
+	CHECK(id == data->id);
+	CHECK(!data->cancel);
+	CHECK(!data->destroyed);
+
+	/* Never early, and not much later than asked for either */
+	CHECK(elapsed >= data->msec * 1000ULL);
+	if (elapsed > (data->msec + 50) * 1000ULL)
+		late++;
+
+	data->called++;
+
+	if (data->called <= data->rearm) {
+		timer_arm(data, 1 + next_rand() % MAX_TIMEOUT);
+		CHECK(!mainloop_modify_timeout(id, data->msec));
+		return;
+	}
+
+	CHECK(!mainloop_remove_timeout(id));
+
+	if (!--pending)
+		mainloop_quit();
+}
+
+static void guard_callback(int id, void *user_data)
+{
+	CHECK(false);
+}
+
+static void never_callback(int id, void *user_data)
+{
+	CHECK(false);
+}
+
+/*
+ * Arm thousands of timeouts at random deadlines, cancel some of them and
+ * re-arm others from their callback.
+ */
+static void check_timers(void)
+{
+	struct timer_data never = { 0 };
+	uint64_t start;
+	unsigned int i, fired = 0;
+	int guard;
+
+	mainloop_init();
+
+	guard = mainloop_add_timeout(GUARD_TIMEOUT, guard_callback, NULL,
+									NULL);
+	CHECK(guard > 0);
+
+	/* A zero timeout is registered but never fires */
+	never.id = mainloop_add_timeout(0, never_callback, &never,
+								timer_destroy);
+	CHECK(never.id > 0);
+
+	pending = 0;
+
+	for (i = 0; i < NUM_TIMERS; i++) {
+		struct timer_data *data = &timers[i];
+
+		timer_arm(data, 1 + next_rand() % MAX_TIMEOUT);
+		data->id = mainloop_add_timeout(data->msec, timer_callback,
+							data, timer_destroy);
+		CHECK(data->id > 0);
+
+		switch (next_rand() % 8) {
+		case 0:
+			data->cancel = true;
+			break;
+		case 1:
+			data->rearm = 1 + next_rand() % 3;
+			break;
+		}
+
+		if (!data->cancel)
+			pending++;
+	}
+
+	for (i = 0; i < NUM_TIMERS; i++) {
+		if (timers[i].cancel) {
+			CHECK(!mainloop_remove_timeout(timers[i].id));
+			CHECK(timers[i].destroyed);
+		}
+	}
+
+	CHECK(mainloop_modify_timeout(0, 10) < 0);
+
+	start = now_usec();
+
+	CHECK(mainloop_run() == EXIT_SUCCESS);
+
+	for (i = 0; i < NUM_TIMERS; i++) {
+		CHECK(timers[i].destroyed);
+		CHECK(timers[i].called == (timers[i].cancel ? 0 :
+							1 + timers[i].rearm));
+		fired += timers[i].called;
+	}
+
+	/* Leftover timeouts are cleaned up when the loop exits */
+	CHECK(never.destroyed);
+	CHECK(!never.called);
+
+	printf("%u timeouts fired in %.1f ms, %u late\n", fired,
+					(now_usec() - start) / 1000.0, late);
+}
+
+int main(int argc, char *argv[])
+{
+	raise_fd_limit();
+
+	check_fds();
+	check_timers();
+
+	return EXIT_SUCCESS;
+}
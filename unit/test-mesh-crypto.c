@@ -14,11 +14,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "client/display.h"
 
 #include "mesh/crypto.c"
 
+#define THROUGHPUT_ITERATIONS	2000
+
 struct mesh_crypto_test {
 	const char *name;
 
@@ -2133,6 +2136,68 @@ static void check_k4(const struct mesh_crypto_test *keys)
 	l_info("");
 }
 
+static double decode_rate(const uint8_t *pkt, size_t pkt_len,
+				uint32_t iv_index, const uint8_t enc_key[16],
+				const uint8_t priv_key[16], bool cached)
+{
+	struct timespec start, end;
+	uint8_t out[29];
+	double secs;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < THROUGHPUT_ITERATIONS; i++) {
+		/* Without the cache every call sets up fresh AF_ALG sockets */
+		if (!cached)
+			mesh_crypto_cache_cleanup();
+
+		if (!mesh_crypto_packet_decode(pkt, pkt_len, false, out,
+						iv_index, enc_key, priv_key))
+			exit(1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) +
+				(end.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+	return THROUGHPUT_ITERATIONS / (secs > 0 ? secs : 1);
+}
+
+static void check_throughput(const struct mesh_crypto_test *keys)
+{
+	uint8_t *net_key;
+	uint8_t *packet;
+	size_t packet_len;
+	uint8_t enc_key[16];
+	uint8_t priv_key[16];
+	uint8_t nid;
+	uint8_t p[] = { 0 };
+	double uncached, cached;
+
+	l_info(COLOR_BLUE "[Throughput %s]" COLOR_OFF, keys->name);
+
+	net_key = l_util_from_hexstring(keys->net_key, NULL);
+	packet = l_util_from_hexstring(keys->packet[0], &packet_len);
+
+	mesh_crypto_k2(net_key, p, sizeof(p), &nid, enc_key, priv_key);
+
+	uncached = decode_rate(packet, packet_len, keys->iv_index, enc_key,
+							priv_key, false);
+	cached = decode_rate(packet, packet_len, keys->iv_index, enc_key,
+							priv_key, true);
+
+	l_info("%-20s = %.0f PDU/s", "Uncached decode", uncached);
+	l_info("%-20s = %.0f PDU/s", "Cached decode", cached);
+	l_info("");
+
+	mesh_crypto_cache_cleanup();
+
+	l_free(packet);
+	l_free(net_key);
+}
+
 int main(int argc, char *argv[])
 {
 	l_log_set_stderr();
@@ -2187,5 +2252,8 @@ int main(int argc, char *argv[])
 	/* Section 8.6 Mesh Proxy Service sample data */
 	check_id_beacon(&s8_6_2);
 
+	/* Network PDU decode throughput with and without cipher reuse */
+	check_throughput(&s8_3_1);
+
 	return 0;
 }
@@ -0,0 +1,269 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <ell/ell.h>
+
+#include "client/display.h"
+
+#include "mesh/node.h"
+#include "mesh/net.h"
+#include "mesh/rpl.h"
+#include "mesh/net-cache.h"
+
+#include "unit/check.h"
+
+#define NUM_NODES		500
+#define NUM_RELAYS		3
+#define FLOOD_PDUS		1000000
+#define DEFAULT_CRPL		0x7fff
+
+struct ref_msg {
+	uint16_t src;
+	uint32_t seq;
+	uint32_t mic;
+};
+
+static uint32_t rand_state = 0x12345678;
+
+static uint32_t next_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+
+	return rand_state;
+}
+
+static bool match_ref(const void *a, const void *b)
+{
+	const struct ref_msg *msg = a;
+	const struct ref_msg *tst = b;
+
+	return msg->src == tst->src && msg->seq == tst->seq &&
+							msg->mic == tst->mic;
+}
+
+/* The list based message cache previously used by mesh/net.c */
+static bool ref_in_cache(struct l_queue *cache, uint16_t src, uint32_t seq,
+								uint32_t mic)
+{
+	struct ref_msg tst = { .src = src, .seq = seq, .mic = mic };
+	struct ref_msg *msg;
+
+	if (l_queue_find(cache, match_ref, &tst))
+		return true;
+
+	msg = l_memdup(&tst, sizeof(tst));
+	l_queue_push_head(cache, msg);
+
+	if (l_queue_length(cache) > MSG_CACHE_SIZE) {
+		msg = l_queue_pop_tail(cache);
+		l_free(msg);
+	}
+
+	return false;
+}
+
+static void check_msg_cache(void)
+{
+	struct mesh_msg_cache *cache;
+	struct l_queue *ref;
+	unsigned int i;
+
+	l_info(COLOR_BLUE "[Message cache]" COLOR_OFF);
+
+	cache = msg_cache_new(MSG_CACHE_SIZE);
+	CHECK(cache);
+
+	CHECK(!msg_cache_seen(cache, 0x0001, 1, 0xdeadbeef));
+	CHECK(msg_cache_seen(cache, 0x0001, 1, 0xdeadbeef));
+	CHECK(!msg_cache_seen(cache, 0x0001, 1, 0xdeadbeee));
+	CHECK(!msg_cache_seen(cache, 0x0002, 1, 0xdeadbeef));
+
+	/* Oldest message is evicted first, lookups do not refresh it */
+	for (i = 0; i < MSG_CACHE_SIZE - 3; i++)
+		CHECK(!msg_cache_seen(cache, 0x0100, i, i));
+
+	CHECK(msg_cache_seen(cache, 0x0001, 1, 0xdeadbeef));
+	CHECK(!msg_cache_seen(cache, 0x0200, 0, 0));
+	CHECK(!msg_cache_seen(cache, 0x0001, 1, 0xdeadbeef));
+
+	msg_cache_clear(cache);
+	CHECK(!msg_cache_seen(cache, 0x0200, 0, 0));
+
+	/* Same decisions as the list on a stream with many collisions */
+	msg_cache_clear(cache);
+	ref = l_queue_new();
+
+	for (i = 0; i < 200000; i++) {
+		uint32_t r = next_rand();
+		uint16_t src = 1 + (r & 0x3f);
+		uint32_t seq = (r >> 6) & 0x7f;
+
+		CHECK(msg_cache_seen(cache, src, seq, seq ^ src) ==
+				ref_in_cache(ref, src, seq, seq ^ src));
+	}
+
+	l_queue_destroy(ref, l_free);
+	msg_cache_free(cache);
+
+	l_info("%-20s = %s", "Message cache", COLOR_GREEN "PASS" COLOR_OFF);
+}
+
+static void check_replay_cache(void)
+{
+	struct mesh_replay_cache *cache;
+	struct mesh_rpl *rpe;
+	unsigned int i;
+
+	l_info(COLOR_BLUE "[Replay cache]" COLOR_OFF);
+
+	cache = replay_cache_new();
+	CHECK(cache);
+
+	CHECK(!replay_cache_find(cache, 0x0001));
+	CHECK(!replay_cache_add(cache, 0x0000));
+
+	/* Grow well past the initial table size */
+	for (i = 1; i <= 1000; i++) {
+		rpe = replay_cache_add(cache, i);
+		CHECK(rpe && rpe->src == i && !rpe->seq);
+		rpe->iv_index = i % 3;
+		rpe->seq = i;
+	}
+
+	CHECK(replay_cache_length(cache) == 1000);
+	CHECK(replay_cache_add(cache, 10)->seq == 10);
+	CHECK(replay_cache_length(cache) == 1000);
+
+	for (i = 1; i <= 1000; i++) {
+		rpe = replay_cache_find(cache, i);
+		CHECK(rpe && rpe->seq == i && rpe->iv_index == i % 3);
+	}
+
+	CHECK(!replay_cache_find(cache, 1001));
+
+	/* Only entries older than the previous IV Index are removed */
+	CHECK(!replay_cache_clean(cache, 1));
+	CHECK(replay_cache_clean(cache, 2) == 333);
+	CHECK(!replay_cache_clean(cache, 2));
+	CHECK(replay_cache_length(cache) == 667);
+
+	for (i = 1; i <= 1000; i++)
+		CHECK(!replay_cache_find(cache, i) == (i % 3 == 0));
+
+	replay_cache_free(cache);
+
+	l_info("%-20s = %s", "Replay cache", COLOR_GREEN "PASS" COLOR_OFF);
+}
+
+/*
+ * Same checks as msg_in_cache(), msg_check_replay_cache() and
+ * msg_add_replay_cache() on the packet_received() path.
+ */
+static bool receive(struct mesh_msg_cache *msgs,
+			struct mesh_replay_cache *replay, uint16_t src,
+			uint32_t seq, uint32_t mic, uint32_t iv_index)
+{
+	struct mesh_rpl *rpe;
+
+	if (msg_cache_seen(msgs, src, seq, mic))
+		return false;
+
+	rpe = replay_cache_find(replay, src);
+	if (rpe) {
+		if (iv_index < rpe->iv_index ||
+				(iv_index == rpe->iv_index && seq <= rpe->seq))
+			return false;
+	} else if (replay_cache_length(replay) >= DEFAULT_CRPL &&
+				!replay_cache_clean(replay, iv_index))
+		return false;
+
+	rpe = replay_cache_add(replay, src);
+	rpe->seq = seq;
+	rpe->iv_index = iv_index;
+
+	return true;
+}
+
+/*
+ * Flood the caches with the traffic of a busy network: every PDU is heard
+ * once from its source and then again from each relay, and some sources
+ * replay old sequence numbers.
+ */
+static void check_flood(void)
+{
+	struct mesh_msg_cache *msgs;
+	struct mesh_replay_cache *replay;
+	struct timespec start, end;
+	uint32_t seqs[NUM_NODES] = { 0 };
+	unsigned int i, accepted = 0, pdus = 0;
+	double secs;
+
+	l_info(COLOR_BLUE "[Flood]" COLOR_OFF);
+
+	msgs = msg_cache_new(MSG_CACHE_SIZE);
+	replay = replay_cache_new();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; pdus < FLOOD_PDUS; i++) {
+		unsigned int node = next_rand() % NUM_NODES;
+		uint16_t src = 0x0100 + node;
+		uint32_t seq = ++seqs[node];
+		uint32_t mic = next_rand();
+		unsigned int j;
+
+		/* Replay of an older PDU with a fresh MIC */
+		if (!(i % 16) && seq > 4) {
+			seq -= 4;
+			seqs[node]--;
+		}
+
+		for (j = 0; j <= NUM_RELAYS; j++, pdus++) {
+			if (receive(msgs, replay, src, seq, mic, 0))
+				accepted++;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) +
+				(end.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+	CHECK(accepted && accepted < pdus / (NUM_RELAYS + 1));
+	CHECK(replay_cache_length(replay) == NUM_NODES);
+
+	l_info("%-20s = %u of %u", "Accepted", accepted, pdus);
+	l_info("%-20s = %.0f PDU/s", "Network cache", pdus /
+							(secs > 0 ? secs : 1));
+
+	replay_cache_free(replay);
+	msg_cache_free(msgs);
+}
+
+int main(int argc, char *argv[])
+{
+	l_log_set_stderr();
+
+	check_msg_cache();
+	check_replay_cache();
+
+	/* Duplicate and replay filtering throughput */
+	check_flood();
+
+	return 0;
+}
@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ell/ell.h>
+
+#include "client/display.h"
+
+#include "mesh/net-keys.c"
+
+#include "unit/check.h"
+
+#define NUM_KEYS	3
+#define IV_INDEX	0x12345678
+
+/* Beacons are never sent, the tests do not enable them */
+bool mesh_io_send(struct mesh_io *io, struct mesh_io_send_info *info,
+					const uint8_t *data, uint16_t len)
+{
+	return false;
+}
+
+void net_local_beacon(uint32_t key_id, uint32_t ivi, bool ivu, bool kr)
+{
+}
+
+static uint8_t key_nid(uint32_t id)
+{
+	struct net_key *key = l_queue_find(keys, match_id, L_UINT_TO_PTR(id));
+
+	CHECK(key);
+
+	return key->nid;
+}
+
+/* Add network keys until NUM_KEYS of them share the NID of the first one */
+static void add_keys(uint32_t ids[NUM_KEYS])
+{
+	uint8_t flooding[16];
+	unsigned int count = 0;
+	uint32_t i, id;
+
+	memset(flooding, 0x5a, sizeof(flooding));
+
+	for (i = 0; count < NUM_KEYS; i++) {
+		CHECK(i < 100000);
+
+		l_put_be32(i, flooding);
+
+		id = net_key_add(flooding);
+		CHECK(id);
+
+		if (count && key_nid(id) != key_nid(ids[0])) {
+			net_key_unref(id);
+			continue;
+		}
+
+		ids[count++] = id;
+	}
+
+	l_info("%-20s = %02x after %u keys", "Shared NID", key_nid(ids[0]), i);
+}
+
+static size_t build_packet(uint32_t id, uint16_t src, uint32_t seq,
+							uint8_t pkt[29])
+{
+	uint8_t payload[8];
+	uint8_t len;
+
+	memset(payload, src, sizeof(payload));
+
+	CHECK(mesh_crypto_packet_build(false, 5, seq, src, 0xc000, 0, false,
+					0, false, false, 0, 0, 0, payload,
+					sizeof(payload), pkt, &len));
+	CHECK(net_key_encrypt(id, IV_INDEX, pkt, len));
+
+	return len;
+}
+
+static void check_decrypt(uint32_t id, uint16_t src, const uint8_t *pkt,
+								size_t len)
+{
+	uint8_t *plain;
+	size_t plain_len;
+	unsigned int i;
+
+	CHECK(net_key_decrypt(IV_INDEX, pkt, len, &plain, &plain_len) == id);
+	CHECK(plain_len == len - 4);
+	CHECK(l_get_be16(plain + 5) == src);
+
+	for (i = 10; i < plain_len; i++)
+		CHECK(plain[i] == (uint8_t) src);
+}
+
+static void check_shared_nid(void)
+{
+	uint8_t pkts[DECODE_CACHE_MAX][29];
+	size_t lens[DECODE_CACHE_MAX];
+	uint8_t bad[29];
+	uint32_t ids[NUM_KEYS];
+	uint8_t *plain;
+	size_t plain_len;
+	unsigned int i, next;
+
+	l_info(COLOR_BLUE "[Shared NID]" COLOR_OFF);
+
+	add_keys(ids);
+
+	/* Each packet is only decrypted by the key it was encrypted with */
+	for (i = 0; i < DECODE_CACHE_MAX; i++) {
+		lens[i] = build_packet(ids[i % NUM_KEYS], 0x0100 + i, i,
+								pkts[i]);
+		check_decrypt(ids[i % NUM_KEYS], 0x0100 + i, pkts[i], lens[i]);
+	}
+
+	for (i = 0; i < DECODE_CACHE_MAX; i++)
+		CHECK(decode_cache[i].id);
+
+	/* A packet no key authenticates leaves the cache untouched */
+	memcpy(bad, pkts[0], lens[0]);
+	bad[lens[0] - 1] ^= 0x01;
+	next = decode_next;
+
+	CHECK(!net_key_decrypt(IV_INDEX, bad, lens[0], &plain, &plain_len));
+	CHECK(decode_next == next);
+
+	for (i = 0; i < DECODE_CACHE_MAX; i++) {
+		CHECK(decode_cache[i].id);
+		CHECK(decode_cache[i].len != lens[0] ||
+				memcmp(decode_cache[i].pkt, bad, lens[0]));
+	}
+
+	/* Cached packets are decrypted again under the same key */
+	for (i = 0; i < DECODE_CACHE_MAX; i++)
+		check_decrypt(ids[i % NUM_KEYS], 0x0100 + i, pkts[i], lens[i]);
+
+	/* Once released, a key decrypts nothing, cached or not */
+	net_key_unref(ids[1]);
+
+	for (i = 0; i < DECODE_CACHE_MAX; i++) {
+		if (i % NUM_KEYS == 1)
+			CHECK(!net_key_decrypt(IV_INDEX, pkts[i], lens[i],
+							&plain, &plain_len));
+		else
+			check_decrypt(ids[i % NUM_KEYS], 0x0100 + i, pkts[i],
+								lens[i]);
+	}
+
+	net_key_cleanup();
+
+	l_info("%-20s = %s", "Shared NID", COLOR_GREEN "PASS" COLOR_OFF);
+}
+
+int main(int argc, char *argv[])
+{
+	l_log_set_stderr();
+
+	check_shared_nid();
+
+	mesh_crypto_cache_cleanup();
+
+	return 0;
+}
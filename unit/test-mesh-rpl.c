@@ -0,0 +1,312 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ell/ell.h>
+
+#include "client/display.h"
+
+#include "mesh/rpl.c"
+
+#include "unit/check.h"
+
+static char node_dir[] = "/tmp/mesh-rpl-XXXXXX";
+static struct mesh_node *node = (struct mesh_node *) node_dir;
+static uint32_t net_iv_index;
+
+const char *node_get_storage_dir(struct mesh_node *node)
+{
+	return node_dir;
+}
+
+struct mesh_net *node_get_net(struct mesh_node *node)
+{
+	return NULL;
+}
+
+uint32_t mesh_net_get_iv_index(struct mesh_net *net)
+{
+	return net_iv_index;
+}
+
+static void reset_node(void)
+{
+	char path[PATH_MAX];
+
+	rpl_release(node);
+
+	snprintf(path, sizeof(path), "%s%s", node_dir, rpl_dir);
+	del_path(path);
+
+	CHECK(rpl_init(node_dir));
+}
+
+static struct l_queue *load_list(void)
+{
+	struct l_queue *rpl_list = l_queue_new();
+
+	/* Read back what a restarted daemon would see */
+	rpl_release(node);
+	CHECK(rpl_get_list(node, rpl_list));
+
+	return rpl_list;
+}
+
+static bool has_entry(struct l_queue *rpl_list, uint16_t src,
+						uint32_t iv_index, uint32_t seq)
+{
+	struct mesh_rpl *rpl;
+
+	rpl = l_queue_find(rpl_list, match_src, L_UINT_TO_PTR(src));
+
+	return rpl && rpl->iv_index == iv_index && rpl->seq == seq;
+}
+
+static size_t journal_size(uint32_t iv_index)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	CHECK(journal_path(path, node_dir, iv_index));
+
+	if (stat(path, &st) < 0)
+		return 0;
+
+	return st.st_size;
+}
+
+static void check_load(void)
+{
+	struct l_queue *rpl_list;
+
+	l_info(COLOR_BLUE "[Journal load]" COLOR_OFF);
+
+	reset_node();
+
+	CHECK(rpl_put_entry(node, 0x0001, 5, 0x000010));
+	CHECK(rpl_put_entry(node, 0x0001, 5, 0x000020));
+	CHECK(rpl_put_entry(node, 0x0002, 5, 0x000030));
+	CHECK(rpl_put_entry(node, 0x0002, 6, 0x000001));
+	CHECK(rpl_put_entry(node, 0x0003, 6, 0xffffff));
+	CHECK(rpl_put_entry(node, 0x0004, 6, 0x000040));
+
+	/* Group addresses never make it into the list */
+	CHECK(!rpl_put_entry(node, 0xc000, 6, 0x000050));
+
+	net_iv_index = 6;
+	rpl_del_entry(node, 0x0004);
+
+	rpl_list = load_list();
+
+	CHECK(l_queue_length(rpl_list) == 3);
+	CHECK(has_entry(rpl_list, 0x0001, 5, 0x000020));
+	CHECK(has_entry(rpl_list, 0x0002, 6, 0x000001));
+	CHECK(has_entry(rpl_list, 0x0003, 6, 0xffffff));
+
+	l_queue_destroy(rpl_list, l_free);
+
+	/* Only the journals of the current and previous IV Index remain */
+	rpl_update(node, 7);
+
+	CHECK(!journal_size(5));
+	CHECK(journal_size(6));
+
+	rpl_list = load_list();
+
+	CHECK(l_queue_length(rpl_list) == 2);
+	CHECK(has_entry(rpl_list, 0x0002, 6, 0x000001));
+
+	l_queue_destroy(rpl_list, l_free);
+
+	l_info("%-20s = %s", "Journal load", COLOR_GREEN "PASS" COLOR_OFF);
+}
+
+static void check_torn(void)
+{
+	uint8_t rec[RPL_REC_SIZE];
+	struct l_queue *rpl_list;
+	char path[PATH_MAX];
+	int fd;
+
+	l_info(COLOR_BLUE "[Torn record]" COLOR_OFF);
+
+	reset_node();
+
+	CHECK(rpl_put_entry(node, 0x0001, 5, 0x000010));
+	CHECK(rpl_put_entry(node, 0x0002, 5, 0x000020));
+
+	rpl_release(node);
+
+	/* A record for 0x0001 cut short by a crash, without its check byte */
+	rec_pack(rec, 0x0001, 0x000030, 0);
+	rec[7] = 0;
+
+	CHECK(journal_path(path, node_dir, 5));
+
+	fd = open(path, O_WRONLY);
+	CHECK(fd >= 0);
+	CHECK(pwrite(fd, rec, sizeof(rec), RPL_HDR_SIZE + 2 * RPL_REC_SIZE) ==
+								sizeof(rec));
+	close(fd);
+
+	rpl_list = load_list();
+
+	CHECK(l_queue_length(rpl_list) == 2);
+	CHECK(has_entry(rpl_list, 0x0001, 5, 0x000010));
+	CHECK(has_entry(rpl_list, 0x0002, 5, 0x000020));
+
+	l_queue_destroy(rpl_list, l_free);
+
+	/* New records go after the torn one and are read back */
+	CHECK(rpl_put_entry(node, 0x0001, 5, 0x000040));
+
+	rpl_list = load_list();
+
+	CHECK(l_queue_length(rpl_list) == 2);
+	CHECK(has_entry(rpl_list, 0x0001, 5, 0x000040));
+
+	l_queue_destroy(rpl_list, l_free);
+
+	l_info("%-20s = %s", "Torn record", COLOR_GREEN "PASS" COLOR_OFF);
+}
+
+static void check_compaction(void)
+{
+	struct l_queue *rpl_list;
+	unsigned int i;
+	uint16_t src;
+
+	l_info(COLOR_BLUE "[Compaction]" COLOR_OFF);
+
+	reset_node();
+
+	/* Many times what a minimum sized journal holds */
+	for (i = 0; i < 20 * RPL_JOURNAL_MIN / RPL_REC_SIZE; i++)
+		CHECK(rpl_put_entry(node, 1 + i % 100, 5, i));
+
+	/* Deleted entries are dropped by the next compaction */
+	net_iv_index = 5;
+	for (src = 51; src <= 100; src++)
+		rpl_del_entry(node, src);
+
+	for (; i < 40 * RPL_JOURNAL_MIN / RPL_REC_SIZE; i++)
+		CHECK(rpl_put_entry(node, 1 + i % 50, 5, i));
+
+	CHECK(journal_size(5) == RPL_JOURNAL_MIN);
+
+	/* The compaction table is left clean for the next journal */
+	CHECK(compact_last);
+
+	for (src = 0; src < RPL_MAX_SRC; src++)
+		CHECK(!compact_last[src]);
+
+	rpl_list = load_list();
+
+	CHECK(l_queue_length(rpl_list) == 50);
+
+	/* Each source keeps the sequence of its last record */
+	for (src = 1; src <= 50; src++) {
+		uint32_t seq = i - 1 - (i - src) % 50;
+
+		CHECK(has_entry(rpl_list, src, 5, seq));
+	}
+
+	l_queue_destroy(rpl_list, l_free);
+
+	l_info("%-20s = %s", "Compaction", COLOR_GREEN "PASS" COLOR_OFF);
+}
+
+static void put_legacy(uint32_t iv_index, uint16_t src, uint32_t seq)
+{
+	char path[PATH_MAX];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s%s/%8.8x", node_dir, rpl_dir,
+								iv_index);
+	mkdir(path, 0755);
+
+	snprintf(path, sizeof(path), "%s%s/%8.8x/%4.4x", node_dir, rpl_dir,
+								iv_index, src);
+	fp = fopen(path, "w");
+	CHECK(fp);
+	fprintf(fp, "%6.6x", seq);
+	fclose(fp);
+}
+
+static void check_migrate(void)
+{
+	struct l_queue *rpl_list;
+	char path[PATH_MAX];
+	struct stat st;
+
+	l_info(COLOR_BLUE "[Migration]" COLOR_OFF);
+
+	reset_node();
+	rpl_release(node);
+
+	put_legacy(4, 0x0011, 0x000999);
+	put_legacy(4, 0x0012, 0x000300);
+	put_legacy(5, 0x0010, 0x000100);
+	put_legacy(5, 0x0011, 0x000200);
+
+	/* Not a unicast address, dropped */
+	put_legacy(5, 0xc000, 0x000001);
+
+	CHECK(rpl_init(node_dir));
+
+	snprintf(path, sizeof(path), "%s%s/%8.8x", node_dir, rpl_dir, 4);
+	CHECK(stat(path, &st) < 0);
+
+	snprintf(path, sizeof(path), "%s%s/%8.8x", node_dir, rpl_dir, 5);
+	CHECK(stat(path, &st) < 0);
+
+	CHECK(journal_size(4));
+	CHECK(journal_size(5));
+
+	rpl_list = load_list();
+
+	CHECK(l_queue_length(rpl_list) == 3);
+	CHECK(has_entry(rpl_list, 0x0010, 5, 0x000100));
+	CHECK(has_entry(rpl_list, 0x0011, 5, 0x000200));
+	CHECK(has_entry(rpl_list, 0x0012, 4, 0x000300));
+
+	l_queue_destroy(rpl_list, l_free);
+
+	/* Migrating again is a no-op */
+	CHECK(rpl_init(node_dir));
+
+	rpl_list = load_list();
+	CHECK(l_queue_length(rpl_list) == 3);
+	l_queue_destroy(rpl_list, l_free);
+
+	l_info("%-20s = %s", "Migration", COLOR_GREEN "PASS" COLOR_OFF);
+}
+
+int main(int argc, char *argv[])
+{
+	l_log_set_stderr();
+
+	CHECK(mkdtemp(node_dir));
+
+	check_load();
+	check_torn();
+	check_compaction();
+	check_migrate();
+
+	rpl_release(node);
+	del_path(node_dir);
+
+	return 0;
+}
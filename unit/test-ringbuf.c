@@ -133,6 +133,60 @@ static void test_printf(const void *data)
 	tester_test_passed();
 }
 
+static void test_append(const void *data)
+{
+	static size_t rb_size = 500;
+	static size_t rb_capa = 512;
+	unsigned char in[512], out[512];
+	unsigned int next = 0, expect = 0;
+	struct ringbuf *rb;
+	int i;
+
+	rb = ringbuf_new(rb_size);
+	g_assert(rb != NULL);
+
+	/* Data larger than the available space is not appended */
+	g_assert(ringbuf_append(rb, in, rb_capa + 1) < 0);
+	g_assert(ringbuf_len(rb) == 0);
+
+	for (i = 0; i < 10000; i++) {
+		size_t len, nowrap, count = i % 97 + 1;
+		unsigned char *ptr;
+		size_t j;
+
+		tester_debug("Iteration %i\n", i);
+
+		for (j = 0; j < count; j++)
+			in[j] = next++;
+
+		if (ringbuf_avail(rb) < count) {
+			g_assert(ringbuf_append(rb, in, count) < 0);
+			next -= count;
+		} else {
+			g_assert(ringbuf_append(rb, in, count) ==
+							(ssize_t) count);
+		}
+
+		/* Drain part of the data, leaving some to wrap around */
+		len = MIN(ringbuf_len(rb), (size_t) (i % 131));
+
+		ptr = ringbuf_peek(rb, 0, &nowrap);
+		memcpy(out, ptr, MIN(len, nowrap));
+		if (len > nowrap)
+			memcpy(out + nowrap, ringbuf_peek(rb, nowrap, NULL),
+								len - nowrap);
+
+		for (j = 0; j < len; j++)
+			g_assert(out[j] == (unsigned char) expect++);
+
+		g_assert(ringbuf_drain(rb, len) == len);
+		g_assert(ringbuf_len(rb) + ringbuf_avail(rb) == rb_capa);
+	}
+
+	ringbuf_free(rb);
+	tester_test_passed();
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -140,6 +194,7 @@ int main(int argc, char *argv[])
 	tester_add("/ringbuf/power2", NULL, NULL, test_power2, NULL);
 	tester_add("/ringbuf/alloc", NULL, NULL, test_alloc, NULL);
 	tester_add("/ringbuf/printf", NULL, NULL, test_printf, NULL);
+	tester_add("/ringbuf/append", NULL, NULL, test_append, NULL);
 
 	return tester_run();
 }
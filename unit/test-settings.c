@@ -0,0 +1,419 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "src/settings.c"
+
+#include "src/shared/tester.h"
+
+#define MAX_HANDLE		0x0030
+
+struct test_data {
+	char dir[32];
+	char *filename;
+	char *path;
+};
+
+static const uint8_t db_hash[16] = {
+	0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+	0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+};
+
+static void write_value(struct gatt_db_attribute *attr, const uint8_t *value,
+								size_t len)
+{
+	g_assert(gatt_db_attribute_write(attr, 0, value, len, 0, NULL,
+						load_desc_value, NULL));
+}
+
+/*
+ * A remote database as discovered: a primary service with the Database
+ * Hash, a secondary service and a 128-bit primary service that includes
+ * the secondary one and has a characteristic with extended properties.
+ */
+static struct gatt_db *create_db(const uint8_t hash[16])
+{
+	struct gatt_db *db = gatt_db_new();
+	struct gatt_db_attribute *service, *secondary, *attr;
+	uint128_t u128;
+	bt_uuid_t uuid;
+	uint8_t value[2];
+
+	bt_uuid16_create(&uuid, 0x1801);
+	service = gatt_db_insert_service(db, 0x0001, &uuid, true, 6);
+	g_assert(service);
+
+	bt_uuid16_create(&uuid, GATT_CHARAC_DB_HASH);
+	attr = gatt_db_service_insert_characteristic(service, 0x0002, 0x0003,
+						&uuid, 0, BT_GATT_CHRC_PROP_READ,
+						NULL, NULL, NULL);
+	g_assert(attr);
+	write_value(attr, hash, 16);
+
+	bt_uuid16_create(&uuid, GATT_CHARAC_SERVICE_CHANGED);
+	attr = gatt_db_service_insert_characteristic(service, 0x0004, 0x0005,
+					&uuid, 0, BT_GATT_CHRC_PROP_INDICATE,
+					NULL, NULL, NULL);
+	g_assert(attr);
+
+	bt_uuid16_create(&uuid, GATT_CLIENT_CHARAC_CFG_UUID);
+	g_assert(gatt_db_service_insert_descriptor(service, 0x0006, &uuid, 0,
+							NULL, NULL, NULL));
+
+	gatt_db_service_set_active(service, true);
+
+	bt_uuid32_create(&uuid, 0x12345678);
+	secondary = gatt_db_insert_service(db, 0x0010, &uuid, false, 3);
+	g_assert(secondary);
+
+	bt_uuid16_create(&uuid, 0x2a19);
+	g_assert(gatt_db_service_insert_characteristic(secondary, 0x0011,
+						0x0012, &uuid, 0,
+						BT_GATT_CHRC_PROP_READ,
+						NULL, NULL, NULL));
+
+	gatt_db_service_set_active(secondary, true);
+
+	memset(&u128, 0xa5, sizeof(u128));
+	bt_uuid128_create(&uuid, u128);
+	service = gatt_db_insert_service(db, 0x0020, &uuid, true, 6);
+	g_assert(service);
+
+	g_assert(gatt_db_service_insert_included(service, 0x0021, secondary));
+
+	bt_uuid16_create(&uuid, 0x2a00);
+	g_assert(gatt_db_service_insert_characteristic(service, 0x0022,
+					0x0023, &uuid, 0,
+					BT_GATT_CHRC_PROP_READ |
+					BT_GATT_CHRC_PROP_EXT_PROP,
+					NULL, NULL, NULL));
+
+	bt_uuid16_create(&uuid, GATT_CHARAC_EXT_PROPER_UUID);
+	attr = gatt_db_service_insert_descriptor(service, 0x0024, &uuid, 0,
+							NULL, NULL, NULL);
+	g_assert(attr);
+	put_le16(0x0001, value);
+	write_value(attr, value, sizeof(value));
+
+	bt_uuid16_create(&uuid, GATT_CHARAC_USER_DESC_UUID);
+	g_assert(gatt_db_service_insert_descriptor(service, 0x0025, &uuid, 0,
+							NULL, NULL, NULL));
+
+	gatt_db_service_set_active(service, true);
+
+	return db;
+}
+
+struct attr_value {
+	const uint8_t *value;
+	size_t len;
+};
+
+static void read_value_cb(struct gatt_db_attribute *attrib, int err,
+					const uint8_t *value, size_t length,
+					void *user_data)
+{
+	struct attr_value *val = user_data;
+
+	g_assert(!err);
+
+	val->value = value;
+	val->len = length;
+}
+
+static void read_value(struct gatt_db_attribute *attr, struct attr_value *val)
+{
+	memset(val, 0, sizeof(*val));
+
+	g_assert(gatt_db_attribute_read(attr, 0, BT_ATT_OP_READ_REQ, NULL,
+							read_value_cb, val));
+}
+
+/* Both databases have the same attributes, types and stored values */
+static void compare_db(struct gatt_db *a, struct gatt_db *b)
+{
+	uint16_t handle;
+
+	for (handle = 0x0001; handle <= MAX_HANDLE; handle++) {
+		struct gatt_db_attribute *attr_a, *attr_b;
+		struct attr_value val_a, val_b;
+
+		attr_a = gatt_db_get_attribute(a, handle);
+		attr_b = gatt_db_get_attribute(b, handle);
+
+		g_assert(!attr_a == !attr_b);
+		if (!attr_a)
+			continue;
+
+		g_assert(!bt_uuid_cmp(gatt_db_attribute_get_type(attr_a),
+					gatt_db_attribute_get_type(attr_b)));
+
+		read_value(attr_a, &val_a);
+		read_value(attr_b, &val_b);
+
+		g_assert(val_a.len == val_b.len);
+		g_assert(!val_a.len || !memcmp(val_a.value, val_b.value,
+								val_a.len));
+	}
+}
+
+static void test_setup(const void *data)
+{
+	struct test_data *test = tester_get_data();
+
+	strcpy(test->dir, "/tmp/bluez-settings-XXXXXX");
+	g_assert(mkdtemp(test->dir));
+
+	test->filename = g_strconcat(test->dir, "/cache", NULL);
+	test->path = gatt_cache_path(test->filename);
+
+	tester_setup_complete();
+}
+
+static void test_teardown(const void *data)
+{
+	struct test_data *test = tester_get_data();
+
+	unlink(test->path);
+	unlink(test->filename);
+	rmdir(test->dir);
+
+	tester_teardown_complete();
+}
+
+static void test_data_free(void *user_data)
+{
+	struct test_data *test = user_data;
+
+	g_free(test->filename);
+	g_free(test->path);
+	g_free(test);
+}
+
+static void store_cache(struct test_data *test, struct gatt_db *db)
+{
+	g_assert(!btd_settings_gatt_cache_store(db, test->filename));
+}
+
+static ino_t cache_inode(struct test_data *test)
+{
+	struct stat st;
+
+	g_assert(!stat(test->path, &st));
+
+	return st.st_ino;
+}
+
+static void write_cache(struct test_data *test, off_t offset,
+					const void *data, size_t len)
+{
+	int fd;
+
+	fd = open(test->path, O_WRONLY);
+	g_assert(fd >= 0);
+	g_assert(pwrite(fd, data, len, offset) == (ssize_t) len);
+	close(fd);
+}
+
+static void test_round_trip(const void *data)
+{
+	struct test_data *test = tester_get_data();
+	struct gatt_db *db, *loaded;
+
+	db = create_db(db_hash);
+	store_cache(test, db);
+
+	loaded = gatt_db_new();
+	g_assert(!btd_settings_gatt_cache_load(loaded, test->filename));
+
+	compare_db(db, loaded);
+
+	gatt_db_unref(loaded);
+	gatt_db_unref(db);
+
+	tester_test_passed();
+}
+
+/* Stores a valid cache, lets the test break it and checks it is refused */
+static void check_invalid(struct test_data *test,
+				void (*corrupt)(struct test_data *test))
+{
+	struct gatt_db *db;
+
+	db = create_db(db_hash);
+	store_cache(test, db);
+	gatt_db_unref(db);
+
+	corrupt(test);
+
+	db = gatt_db_new();
+	g_assert(btd_settings_gatt_cache_load(db, test->filename) == -ENOENT);
+	g_assert(gatt_db_isempty(db));
+	gatt_db_unref(db);
+
+	tester_test_passed();
+}
+
+static void corrupt_magic(struct test_data *test)
+{
+	write_cache(test, offsetof(struct gatt_cache_hdr, magic), "BZGX", 4);
+}
+
+static void corrupt_version(struct test_data *test)
+{
+	uint8_t version = GATT_CACHE_VERSION + 1;
+
+	write_cache(test, offsetof(struct gatt_cache_hdr, version), &version,
+								sizeof(version));
+}
+
+static void corrupt_size(struct test_data *test)
+{
+	struct stat st;
+
+	g_assert(!stat(test->path, &st));
+	g_assert(!truncate(test->path, st.st_size - 1));
+}
+
+/* Changes the UUID of the first service, which would still load */
+static void corrupt_record(struct test_data *test)
+{
+	uint8_t uuid = 0x02;
+
+	write_cache(test, sizeof(struct gatt_cache_hdr) +
+				offsetof(struct gatt_cache_attr, uuid),
+				&uuid, sizeof(uuid));
+}
+
+static void test_bad_magic(const void *data)
+{
+	check_invalid(tester_get_data(), corrupt_magic);
+}
+
+static void test_bad_version(const void *data)
+{
+	check_invalid(tester_get_data(), corrupt_version);
+}
+
+static void test_bad_size(const void *data)
+{
+	check_invalid(tester_get_data(), corrupt_size);
+}
+
+static void test_bad_crc(const void *data)
+{
+	check_invalid(tester_get_data(), corrupt_record);
+}
+
+static void test_unchanged(const void *data)
+{
+	struct test_data *test = tester_get_data();
+	struct gatt_db *db, *loaded;
+	uint8_t hash[16];
+	ino_t ino;
+
+	db = create_db(db_hash);
+	store_cache(test, db);
+	ino = cache_inode(test);
+
+	/* Same Database Hash, the file is left alone */
+	store_cache(test, db);
+	g_assert(cache_inode(test) == ino);
+
+	/* A cache that does not load is rewritten even with the same hash */
+	corrupt_record(test);
+	store_cache(test, db);
+	g_assert(cache_inode(test) != ino);
+
+	loaded = gatt_db_new();
+	g_assert(!btd_settings_gatt_cache_load(loaded, test->filename));
+	compare_db(db, loaded);
+	gatt_db_unref(loaded);
+	gatt_db_unref(db);
+
+	/* A different Database Hash is written out */
+	ino = cache_inode(test);
+	memcpy(hash, db_hash, sizeof(hash));
+	hash[0] ^= 0xff;
+
+	db = create_db(hash);
+	store_cache(test, db);
+	g_assert(cache_inode(test) != ino);
+
+	loaded = gatt_db_new();
+	g_assert(!btd_settings_gatt_cache_load(loaded, test->filename));
+	compare_db(db, loaded);
+	gatt_db_unref(loaded);
+	gatt_db_unref(db);
+
+	tester_test_passed();
+}
+
+/*
+ * A device stored before the binary cache only has the text "Attributes"
+ * group, it is loaded from there and the cache is used once written.
+ */
+static void test_migrate(const void *data)
+{
+	struct test_data *test = tester_get_data();
+	struct gatt_db *db, *loaded;
+
+	db = create_db(db_hash);
+	btd_settings_gatt_db_store(db, test->filename);
+	g_assert(access(test->path, F_OK) < 0);
+
+	loaded = gatt_db_new();
+	g_assert(!btd_settings_gatt_db_load(loaded, test->filename));
+	compare_db(db, loaded);
+
+	store_cache(test, loaded);
+	gatt_db_unref(loaded);
+
+	/* The text copy is dropped once the cache is written */
+	g_assert(g_file_set_contents(test->filename, "", 0, NULL));
+
+	loaded = gatt_db_new();
+	g_assert(!btd_settings_gatt_db_load(loaded, test->filename));
+	compare_db(db, loaded);
+	gatt_db_unref(loaded);
+	gatt_db_unref(db);
+
+	tester_test_passed();
+}
+
+#define define_test(name, function)					\
+	tester_add_full(name, NULL, NULL, test_setup, function,		\
+				test_teardown, NULL, 0,			\
+				g_new0(struct test_data, 1),		\
+				test_data_free)
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	define_test("/settings/gatt-cache/round-trip", test_round_trip);
+	define_test("/settings/gatt-cache/bad-magic", test_bad_magic);
+	define_test("/settings/gatt-cache/bad-version", test_bad_version);
+	define_test("/settings/gatt-cache/bad-size", test_bad_size);
+	define_test("/settings/gatt-cache/bad-crc", test_bad_crc);
+	define_test("/settings/gatt-cache/unchanged", test_unchanged);
+	define_test("/settings/gatt-cache/migrate", test_migrate);
+
+	return tester_run();
+}
@@ -0,0 +1,278 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "src/shared/mainloop.h"
+#include "src/shared/timeout.h"
+
+#include "unit/check.h"
+
+#define NUM_LINKS		1000
+#define NUM_ROUNDS		100
+#define ATT_TIMEOUT		30000
+#define MAX_TIMEOUT		100
+#define GUARD_TIMEOUT		10000
+
+/*
+ * The test is linked with --wrap for the timer and epoll system calls so
+ * that the ones made by the code under test can be counted.
+ */
+int __real_timerfd_create(int clockid, int flags);
+int __real_timerfd_settime(int fd, int flags, const struct itimerspec *new,
+						struct itimerspec *old);
+int __real_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int __real_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+								int timeout);
+int __real_close(int fd);
+int __wrap_timerfd_create(int clockid, int flags);
+int __wrap_timerfd_settime(int fd, int flags, const struct itimerspec *new,
+						struct itimerspec *old);
+int __wrap_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int __wrap_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+								int timeout);
+int __wrap_close(int fd);
+
+static unsigned int syscalls;
+static unsigned int wakeups;
+
+int __wrap_timerfd_create(int clockid, int flags)
+{
+	syscalls++;
+	return __real_timerfd_create(clockid, flags);
+}
+
+int __wrap_timerfd_settime(int fd, int flags, const struct itimerspec *new,
+						struct itimerspec *old)
+{
+	syscalls++;
+	return __real_timerfd_settime(fd, flags, new, old);
+}
+
+int __wrap_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+	syscalls++;
+	return __real_epoll_ctl(epfd, op, fd, event);
+}
+
+int __wrap_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+								int timeout)
+{
+	syscalls++;
+	wakeups++;
+	return __real_epoll_wait(epfd, events, maxevents, timeout);
+}
+
+int __wrap_close(int fd)
+{
+	syscalls++;
+	return __real_close(fd);
+}
+
+/* One timerfd per timeout, as timeouts were previously implemented */
+static void ref_timeout_callback(int fd, uint32_t events, void *user_data)
+{
+}
+
+static void ref_timeout_destroy(void *user_data)
+{
+	int fd = (intptr_t) user_data;
+
+	close(fd);
+}
+
+static int ref_timeout_add(unsigned int msec)
+{
+	struct itimerspec itimer;
+	int fd;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	CHECK(fd >= 0);
+
+	memset(&itimer, 0, sizeof(itimer));
+	itimer.it_value.tv_sec = msec / 1000;
+	itimer.it_value.tv_nsec = (msec % 1000) * 1000 * 1000;
+	CHECK(!timerfd_settime(fd, 0, &itimer, NULL));
+
+	CHECK(!mainloop_add_fd(fd, EPOLLIN | EPOLLONESHOT,
+				ref_timeout_callback, (void *) (intptr_t) fd,
+				ref_timeout_destroy));
+
+	return fd;
+}
+
+static void ref_timeout_remove(int fd)
+{
+	CHECK(!mainloop_remove_fd(fd));
+}
+
+static bool churn_callback(void *user_data)
+{
+	CHECK(false);
+
+	return false;
+}
+
+/*
+ * Every link has a request outstanding, each response cancels the ATT
+ * timeout of its request and the next request arms a new one.
+ */
+static void check_churn(void)
+{
+	unsigned int ids[NUM_LINKS] = { 0 };
+	int fds[NUM_LINKS];
+	unsigned int i, j, ops = NUM_LINKS * NUM_ROUNDS;
+	unsigned int ref_syscalls;
+
+	syscalls = 0;
+
+	for (i = 0; i < NUM_LINKS; i++)
+		fds[i] = ref_timeout_add(ATT_TIMEOUT);
+
+	for (j = 1; j < NUM_ROUNDS; j++) {
+		for (i = 0; i < NUM_LINKS; i++) {
+			ref_timeout_remove(fds[i]);
+			fds[i] = ref_timeout_add(ATT_TIMEOUT);
+		}
+	}
+
+	for (i = 0; i < NUM_LINKS; i++)
+		ref_timeout_remove(fds[i]);
+
+	ref_syscalls = syscalls;
+	syscalls = 0;
+
+	for (j = 0; j < NUM_ROUNDS; j++) {
+		for (i = 0; i < NUM_LINKS; i++) {
+			timeout_remove(ids[i]);
+			ids[i] = timeout_add(ATT_TIMEOUT, churn_callback, NULL,
+									NULL);
+			CHECK(ids[i]);
+		}
+	}
+
+	for (i = 0; i < NUM_LINKS; i++)
+		timeout_remove(ids[i]);
+
+	printf("%u timeouts added and removed: %u syscalls, %u with a "
+				"timerfd each\n", ops, syscalls, ref_syscalls);
+
+	CHECK(syscalls * 100 < ref_syscalls);
+}
+
+struct expiry_data {
+	unsigned int id;
+	unsigned int timeout;
+	uint64_t armed;
+	unsigned int called;
+	bool again;
+	bool destroyed;
+};
+
+static struct expiry_data expiries[NUM_LINKS];
+static unsigned int pending;
+
+static uint64_t now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static bool expiry_callback(void *user_data)
+{
+	struct expiry_data *data = user_data;
+
+	CHECK(!data->destroyed);
+	CHECK(now_usec() - data->armed >= data->timeout * 1000ULL);
+
+	data->armed = now_usec();
+
+	/* Returning true keeps the timeout going with the same period */
+	return ++data->called == 1 && data->again;
+}
+
+static void expiry_destroy(void *user_data)
+{
+	struct expiry_data *data = user_data;
+
+	CHECK(!data->destroyed);
+	data->destroyed = true;
+
+	if (!--pending)
+		mainloop_quit();
+}
+
+static bool guard_callback(void *user_data)
+{
+	CHECK(false);
+
+	return false;
+}
+
+/* Short timeouts that actually expire, some of them repeating once */
+static void check_expiry(void)
+{
+	unsigned int i, fired = 0, guard;
+
+	guard = timeout_add(GUARD_TIMEOUT, guard_callback, NULL, NULL);
+	CHECK(guard);
+
+	pending = NUM_LINKS;
+
+	for (i = 0; i < NUM_LINKS; i++) {
+		struct expiry_data *data = &expiries[i];
+
+		data->timeout = 1 + rand() % MAX_TIMEOUT;
+		data->again = !(i % 4);
+		data->armed = now_usec();
+		data->id = timeout_add(data->timeout, expiry_callback, data,
+							expiry_destroy);
+		CHECK(data->id);
+	}
+
+	syscalls = 0;
+	wakeups = 0;
+
+	CHECK(mainloop_run() == EXIT_SUCCESS);
+
+	for (i = 0; i < NUM_LINKS; i++) {
+		CHECK(expiries[i].destroyed);
+		CHECK(expiries[i].called == (expiries[i].again ? 2 : 1));
+		fired += expiries[i].called;
+	}
+
+	printf("%u timeouts expired: %u syscalls, %u wakeups\n", fired,
+							syscalls, wakeups);
+
+	CHECK(wakeups <= fired);
+}
+
+int main(int argc, char *argv[])
+{
+	mainloop_init();
+
+	check_churn();
+	check_expiry();
+
+	return EXIT_SUCCESS;
+}
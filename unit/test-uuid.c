@@ -12,12 +12,18 @@
 #include <config.h>
 #endif
 
+#include <inttypes.h>
+#include <time.h>
+
 #include <glib.h>
 
 #include "lib/bluetooth.h"
 #include "lib/uuid.h"
+#include "src/shared/util.h"
 #include "src/shared/tester.h"
 
+#define NUM_LOOKUPS	(1 << 22)
+
 struct uuid_test_data {
 	const char *str;
 	uint16_t val16;
@@ -217,6 +223,109 @@ static void test_malformed(gconstpointer data)
 	tester_test_passed();
 }
 
+struct name_test_data {
+	const char *str;
+	const char *name;
+};
+
+static const struct name_test_data names[] = {
+	{ "0x0001", "SDP" },
+	{ "0x1800", "Generic Access Profile" },
+	{ "0x180f", "Battery Service" },
+	{ "0x2c03", "BGS Features" },
+	{ "0xfffd", "Fast IDentity Online Alliance (FIDO)" },
+	{ "0x0002", "Unknown" },
+	{ "0x12345678", "Unknown" },
+	{ "0000180F-0000-1000-8000-00805F9B34FB", "Battery Service" },
+	{ "a3c87500-8ed3-4bdf-8a39-a01bebede295",
+				"Eddystone Configuration Service" },
+	{ "6E400001-B5A3-F393-E0A9-E50E24DCCA9E", "Nordic UART Service" },
+	{ "69518c4c-b69f-4679-8bc1-c021b47b5733",
+				"BlueZ Experimental Poll Errqueue" },
+	{ "69518c4c-b69f-4679-8bc1-c021b47b5734", "Vendor specific" },
+	{ }
+};
+
+struct appear_test_data {
+	uint16_t val;
+	const char *name;
+};
+
+static const struct appear_test_data appearances[] = {
+	{ 0, "Unknown" },
+	{ 63, "Unknown" },
+	{ 192, "Watch" },
+	{ 193, "Sports Watch" },
+	{ 194, "Watch" },
+	{ 961, "Keyboard" },
+	{ 1023, "Human Interface Device" },
+	{ 2000, "Undefined" },
+	{ 3138, "Pulse Oximeter: Wrist Worn" },
+	{ 5188, "Location and Navigation Pod" },
+	{ 65535, "Undefined" },
+	{ }
+};
+
+static void test_names(gconstpointer data)
+{
+	int i;
+
+	for (i = 0; names[i].str; i++)
+		g_assert_cmpstr(bt_uuidstr_to_str(names[i].str), ==,
+							names[i].name);
+
+	for (i = 0; appearances[i].name; i++)
+		g_assert_cmpstr(bt_appear_to_str(appearances[i].val), ==,
+							appearances[i].name);
+
+	tester_test_passed();
+}
+
+static uint64_t now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* Resolve UUIDs the way btmon does for every decoded attribute */
+static void test_names_benchmark(gconstpointer data)
+{
+	const char *str = NULL;
+	uint64_t start;
+	unsigned int i;
+
+	start = now_usec();
+
+	for (i = 0; i < NUM_LOOKUPS; i++)
+		str = bt_uuid16_to_str(i);
+
+	tester_print("%u 16-bit UUIDs resolved in %" PRIu64 " ms", i,
+						(now_usec() - start) / 1000);
+
+	start = now_usec();
+
+	for (i = 0; i < NUM_LOOKUPS / 8; i++)
+		str = bt_uuidstr_to_str(names[i % 4 + 8].str);
+
+	tester_print("%u 128-bit UUIDs resolved in %" PRIu64 " ms", i,
+						(now_usec() - start) / 1000);
+
+	start = now_usec();
+
+	for (i = 0; i < NUM_LOOKUPS; i++)
+		str = bt_appear_to_str(i);
+
+	tester_print("%u appearances resolved in %" PRIu64 " ms", i,
+						(now_usec() - start) / 1000);
+
+	g_assert(str);
+
+	tester_test_passed();
+}
+
 int main(int argc, char *argv[])
 {
 	size_t i;
@@ -264,5 +373,9 @@ int main(int argc, char *argv[])
 		g_free(testpath);
 	}
 
+	tester_add("/uuid/names", NULL, NULL, test_names, NULL);
+	tester_add("/uuid/names/benchmark", NULL, NULL, test_names_benchmark,
+									NULL);
+
 	return tester_run();
 }